@@ -0,0 +1,712 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "examples.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+typedef HANDLE      benchThread;
+#else
+#include <pthread.h>
+typedef pthread_t   benchThread;
+#endif
+
+static const char *usage = "" \
+"-np            number of publishers (or requestors) (default is 1)\n" \
+"-ns            number of subscribers (or responders) (default is 1)\n" \
+"-nc            number of connections shared by all clients (default is 1)\n" \
+"-size          payload size(s), a comma separated list for a sweep\n" \
+"               (default is 128)\n" \
+"-req           request/reply mode (default is publish/subscribe)\n" \
+"-sync          receive with NextMsg (default is asynchronous)\n" \
+"-count         number of messages (or requests) per run\n" \
+"-csv           report results as CSV\n" \
+"-json          report results as JSON\n";
+
+#define FORMAT_TEXT     (0)
+#define FORMAT_CSV      (1)
+#define FORMAT_JSON     (2)
+
+#define MAX_SIZES       (32)
+
+// Maximum number of latency samples kept per client.
+#define MAX_SAMPLES     (100000)
+
+// A run is aborted if no message is received for that long (in ms).
+#define IDLE_TIMEOUT    (10000)
+
+typedef struct __benchClient
+{
+    natsConnection      *conn;
+    natsSubscription    *sub;
+    benchThread         thread;
+    bool                started;
+
+    // Messages to send, or expected to be received.
+    int64_t             expected;
+    volatile int64_t    received;
+    volatile int64_t    last;
+    natsStatus          status;
+
+    int64_t             *samples;
+    int                 sampleCount;
+    int64_t             stride;
+
+} benchClient;
+
+typedef struct __benchResult
+{
+    int                 size;
+    int64_t             sent;
+    int64_t             received;
+    int64_t             dropped;
+    double              pubRate;
+    double              subRate;
+    double              mbRate;
+    int64_t             latency[6];
+
+} benchResult;
+
+static int          numPubs  = 1;
+static int          numSubs  = 1;
+static int          numConns = 1;
+static bool         reqMode  = false;
+static int          format   = FORMAT_TEXT;
+static int          sizes[MAX_SIZES];
+static int          numSizes = 0;
+static int          curSize  = 0;
+
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+
+#ifdef _WIN32
+static unsigned __stdcall
+_threadStart(void *arg);
+
+static bool
+_startThread(benchThread *t, void *arg)
+{
+    *t = (HANDLE) _beginthreadex(NULL, 0, _threadStart, arg, 0, NULL);
+    return (*t != 0);
+}
+
+static void
+_joinThread(benchThread t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+#else
+static void*
+_threadStart(void *arg);
+
+static bool
+_startThread(benchThread *t, void *arg)
+{
+    return (pthread_create(t, NULL, _threadStart, arg) == 0);
+}
+
+static void
+_joinThread(benchThread t)
+{
+    pthread_join(t, NULL);
+}
+#endif
+
+static void
+_record(benchClient *c, int64_t latency)
+{
+    if ((c->sampleCount < MAX_SAMPLES) && ((c->received % c->stride) == 0))
+        c->samples[c->sampleCount++] = latency;
+}
+
+// Publishers put their send time in the first bytes of the payload, which
+// gives the one-way latency when publishers and subscribers run on the
+// same host.
+static void
+_recordFromPayload(benchClient *c, natsMsg *msg)
+{
+    int64_t sentAt;
+
+    if (natsMsg_GetDataLength(msg) < (int) sizeof(sentAt))
+        return;
+
+    memcpy(&sentAt, natsMsg_GetData(msg), sizeof(sentAt));
+    _record(c, nats_NowInNanoSeconds() - sentAt);
+}
+
+static void
+_onMsg(natsConnection *nc, natsSubscription *sub, natsMsg *msg, void *closure)
+{
+    benchClient *c = (benchClient*) closure;
+
+    if (reqMode)
+    {
+        natsConnection_Publish(nc, natsMsg_GetReply(msg),
+                               natsMsg_GetData(msg),
+                               natsMsg_GetDataLength(msg));
+    }
+    else
+    {
+        _recordFromPayload(c, msg);
+    }
+
+    c->received++;
+    c->last = nats_Now();
+
+    natsMsg_Destroy(msg);
+}
+
+static void
+_sendLoop(benchClient *c, bool request)
+{
+    natsStatus  s       = NATS_OK;
+    natsMsg     *reply  = NULL;
+    char        *data   = NULL;
+    int64_t     now;
+    int64_t     i;
+
+    data = (char*) calloc(1, (curSize > 0 ? curSize : 1));
+    if (data == NULL)
+        s = NATS_NO_MEMORY;
+
+    for (i = 0; (s == NATS_OK) && (i < c->expected); i++)
+    {
+        now = nats_NowInNanoSeconds();
+
+        if (curSize >= (int) sizeof(now))
+            memcpy(data, &now, sizeof(now));
+
+        if (request)
+        {
+            s = natsConnection_Request(&reply, c->conn, subj, data, curSize,
+                                       IDLE_TIMEOUT);
+            if (s == NATS_OK)
+            {
+                _record(c, nats_NowInNanoSeconds() - now);
+                c->received++;
+                natsMsg_Destroy(reply);
+            }
+        }
+        else
+        {
+            s = natsConnection_Publish(c->conn, subj, data, curSize);
+        }
+    }
+
+    c->status = s;
+
+    free(data);
+}
+
+static void
+_recvLoop(benchClient *c)
+{
+    natsStatus  s   = NATS_OK;
+    natsMsg     *msg = NULL;
+
+    while ((s == NATS_OK) && (c->received < c->expected))
+    {
+        s = natsSubscription_NextMsg(&msg, c->sub, IDLE_TIMEOUT);
+        if (s != NATS_OK)
+            break;
+
+        if (reqMode)
+        {
+            s = natsConnection_Publish(c->conn, natsMsg_GetReply(msg),
+                                       natsMsg_GetData(msg),
+                                       natsMsg_GetDataLength(msg));
+        }
+        else
+        {
+            _recordFromPayload(c, msg);
+        }
+
+        c->received++;
+        c->last = nats_Now();
+
+        natsMsg_Destroy(msg);
+    }
+
+    c->status = s;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall
+#else
+static void*
+#endif
+_threadStart(void *arg)
+{
+    benchClient *c = (benchClient*) arg;
+
+    if (c->sub != NULL)
+        _recvLoop(c);
+    else
+        _sendLoop(c, reqMode);
+
+    return 0;
+}
+
+static int
+_cmpInt64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t*) a;
+    int64_t vb = *(const int64_t*) b;
+
+    return (va < vb ? -1 : (va > vb ? 1 : 0));
+}
+
+// Merges the samples of all clients and computes the percentiles (and max)
+// in microseconds.
+static void
+_computeLatency(benchResult *res, benchClient *clients, int count)
+{
+    int64_t *all       = NULL;
+    int     numSamples = 0;
+    int     n          = 0;
+    int     i;
+
+    memset(res->latency, 0, sizeof(res->latency));
+
+    for (i = 0; i < count; i++)
+        numSamples += clients[i].sampleCount;
+
+    if (numSamples == 0)
+        return;
+
+    all = (int64_t*) malloc(numSamples * sizeof(int64_t));
+    if (all == NULL)
+        return;
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(all + n, clients[i].samples,
+               clients[i].sampleCount * sizeof(int64_t));
+        n += clients[i].sampleCount;
+    }
+
+    qsort(all, numSamples, sizeof(int64_t), _cmpInt64);
+
+    for (i = 0; i < 5; i++)
+    {
+        int idx = (int) ((percentiles[i] / 100.0) * (numSamples - 1) + 0.5);
+
+        res->latency[i] = all[idx] / 1000;
+    }
+    res->latency[5] = all[numSamples - 1] / 1000;
+
+    free(all);
+}
+
+static void
+_printHeader(void)
+{
+    if (format == FORMAT_CSV)
+    {
+        printf("mode,consumer,publishers,subscribers,connections,size,"
+               "sent,received,dropped,pub_msgs_sec,sub_msgs_sec,mb_sec,"
+               "p50_us,p90_us,p99_us,p99_9_us,p99_99_us,max_us\n");
+    }
+    else if (format == FORMAT_JSON)
+    {
+        printf("[\n");
+    }
+}
+
+static void
+_printResult(benchResult *res, bool first)
+{
+    const char  *mode     = (reqMode ? "reqreply" : "pubsub");
+    const char  *consumer = (async ? "async" : "sync");
+
+    if (format == FORMAT_CSV)
+    {
+        printf("%s,%s,%d,%d,%d,%d,"
+               "%" PRId64 ",%" PRId64 ",%" PRId64 ",%.0f,%.0f,%.2f,"
+               "%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ","
+               "%" PRId64 ",%" PRId64 "\n",
+               mode, consumer, numPubs, numSubs, numConns, res->size,
+               res->sent, res->received, res->dropped,
+               res->pubRate, res->subRate, res->mbRate,
+               res->latency[0], res->latency[1], res->latency[2],
+               res->latency[3], res->latency[4], res->latency[5]);
+    }
+    else if (format == FORMAT_JSON)
+    {
+        printf("%s  {\"mode\": \"%s\", \"consumer\": \"%s\", "
+               "\"publishers\": %d, \"subscribers\": %d, "
+               "\"connections\": %d, \"size\": %d, "
+               "\"sent\": %" PRId64 ", \"received\": %" PRId64 ", "
+               "\"dropped\": %" PRId64 ", "
+               "\"pub_msgs_sec\": %.0f, \"sub_msgs_sec\": %.0f, "
+               "\"mb_sec\": %.2f, "
+               "\"latency_us\": {\"p50\": %" PRId64 ", \"p90\": %" PRId64 ", "
+               "\"p99\": %" PRId64 ", \"p99_9\": %" PRId64 ", "
+               "\"p99_99\": %" PRId64 ", \"max\": %" PRId64 "}}",
+               (first ? "" : ",\n"), mode, consumer,
+               numPubs, numSubs, numConns, res->size,
+               res->sent, res->received, res->dropped,
+               res->pubRate, res->subRate, res->mbRate,
+               res->latency[0], res->latency[1], res->latency[2],
+               res->latency[3], res->latency[4], res->latency[5]);
+    }
+    else
+    {
+        printf("%s (%s) %d bytes: sent %" PRId64 " - received %" PRId64
+               " - dropped %" PRId64 "\n",
+               mode, consumer, res->size, res->sent, res->received,
+               res->dropped);
+        printf("  publishers: %.0f msgs/sec - subscribers: %.0f msgs/sec"
+               " (%.2f MB/sec)\n",
+               res->pubRate, res->subRate, res->mbRate);
+        printf("  latency (us): p50=%" PRId64 " p90=%" PRId64 " p99=%" PRId64
+               " p99.9=%" PRId64 " p99.99=%" PRId64 " max=%" PRId64 "\n",
+               res->latency[0], res->latency[1], res->latency[2],
+               res->latency[3], res->latency[4], res->latency[5]);
+    }
+}
+
+static void
+_printFooter(void)
+{
+    if (format == FORMAT_JSON)
+        printf("\n]\n");
+}
+
+static double
+_rate(int64_t count, int64_t elapsedNs)
+{
+    if (elapsedNs <= 0)
+        return 0.0;
+
+    return ((double) count * 1000000000.0) / (double) elapsedNs;
+}
+
+static natsStatus
+_run(natsConnection **conns, benchResult *res)
+{
+    natsStatus  s       = NATS_OK;
+    benchClient *pubs   = NULL;
+    benchClient *subs   = NULL;
+    int64_t     perPub  = total / numPubs;
+    int64_t     runStart;
+    int64_t     pubEnd;
+    int64_t     subEnd;
+    int         i;
+
+    memset(res, 0, sizeof(benchResult));
+    res->size = curSize;
+
+    pubs = (benchClient*) calloc(numPubs, sizeof(benchClient));
+    subs = (benchClient*) calloc(numSubs, sizeof(benchClient));
+    if ((pubs == NULL) || (subs == NULL))
+        s = NATS_NO_MEMORY;
+
+    // Clients are spread over the connections in a round-robin fashion.
+    for (i = 0; (s == NATS_OK) && (i < numPubs); i++)
+    {
+        benchClient *c = &(pubs[i]);
+
+        c->conn     = conns[i % numConns];
+        c->expected = perPub + (i < (total % numPubs) ? 1 : 0);
+        c->stride   = (c->expected / MAX_SAMPLES) + 1;
+        c->samples  = (int64_t*) malloc(MAX_SAMPLES * sizeof(int64_t));
+        if (c->samples == NULL)
+            s = NATS_NO_MEMORY;
+    }
+    for (i = 0; (s == NATS_OK) && (i < numSubs); i++)
+    {
+        benchClient *c = &(subs[i]);
+
+        c->conn     = conns[(numPubs + i) % numConns];
+        c->last     = nats_Now();
+        c->samples  = (int64_t*) malloc(MAX_SAMPLES * sizeof(int64_t));
+        if (c->samples == NULL)
+            s = NATS_NO_MEMORY;
+
+        // Responders are in a queue group and share the requests, while
+        // each subscriber gets all messages.
+        c->expected = (reqMode ? 0 : total);
+        c->stride   = (total / MAX_SAMPLES) + 1;
+
+        if (s == NATS_OK)
+        {
+            if (async && reqMode)
+                s = natsConnection_QueueSubscribe(&(c->sub), c->conn, subj,
+                                                  "bench", _onMsg, (void*) c);
+            else if (async)
+                s = natsConnection_Subscribe(&(c->sub), c->conn, subj,
+                                             _onMsg, (void*) c);
+            else if (reqMode)
+                s = natsConnection_QueueSubscribeSync(&(c->sub), c->conn,
+                                                      subj, "bench");
+            else
+                s = natsConnection_SubscribeSync(&(c->sub), c->conn, subj);
+        }
+        if (s == NATS_OK)
+            s = natsSubscription_SetPendingLimits(c->sub, (int) total + 1,
+                                                  (total + 1) * (curSize + 1));
+    }
+
+    // Make sure that the server knows about all subscriptions.
+    for (i = 0; (s == NATS_OK) && (i < numConns); i++)
+        s = natsConnection_FlushTimeout(conns[i], IDLE_TIMEOUT);
+
+    // In request mode, responders reply until they are unsubscribed.
+    for (i = 0; (s == NATS_OK) && !async && !reqMode && (i < numSubs); i++)
+    {
+        if (_startThread(&(subs[i].thread), (void*) &(subs[i])))
+            subs[i].started = true;
+        else
+            s = NATS_SYS_ERROR;
+    }
+    for (i = 0; (s == NATS_OK) && !async && reqMode && (i < numSubs); i++)
+    {
+        subs[i].expected = total;
+        if (_startThread(&(subs[i].thread), (void*) &(subs[i])))
+            subs[i].started = true;
+        else
+            s = NATS_SYS_ERROR;
+    }
+
+    runStart = nats_NowInNanoSeconds();
+
+    for (i = 0; (s == NATS_OK) && (i < numPubs); i++)
+    {
+        if (_startThread(&(pubs[i].thread), (void*) &(pubs[i])))
+            pubs[i].started = true;
+        else
+            s = NATS_SYS_ERROR;
+    }
+    for (i = 0; i < numPubs; i++)
+    {
+        if (!pubs[i].started)
+            continue;
+
+        _joinThread(pubs[i].thread);
+        if (s == NATS_OK)
+            s = pubs[i].status;
+
+        res->sent += (reqMode ? pubs[i].received : pubs[i].expected);
+    }
+
+    for (i = 0; (s == NATS_OK) && (i < numConns); i++)
+        s = natsConnection_FlushTimeout(conns[i], IDLE_TIMEOUT);
+
+    pubEnd = nats_NowInNanoSeconds();
+
+    // Wait for all subscribers to get their messages, unless they stop
+    // making progress.
+    while ((s == NATS_OK) && !reqMode && async)
+    {
+        bool done = true;
+
+        for (i = 0; i < numSubs; i++)
+        {
+            int64_t dropped = 0;
+
+            natsSubscription_GetStats(subs[i].sub, NULL, NULL, NULL, NULL,
+                                      NULL, &dropped, NULL);
+
+            // Messages dropped as a slow consumer will never be delivered.
+            if (subs[i].received + dropped >= subs[i].expected)
+                continue;
+
+            if (nats_Now() - subs[i].last > IDLE_TIMEOUT)
+                s = NATS_TIMEOUT;
+
+            done = false;
+        }
+        if (done)
+            break;
+
+        nats_Sleep(1);
+    }
+
+    // Synchronous responders are unblocked by the unsubscribe.
+    for (i = 0; i < numSubs; i++)
+    {
+        if (reqMode && (subs[i].sub != NULL))
+            natsSubscription_Unsubscribe(subs[i].sub);
+
+        if (subs[i].started)
+            _joinThread(subs[i].thread);
+
+        if ((s == NATS_OK) && !reqMode && (subs[i].status != NATS_OK))
+            s = subs[i].status;
+    }
+
+    subEnd = nats_NowInNanoSeconds();
+
+    for (i = 0; i < numSubs; i++)
+    {
+        int64_t dropped = 0;
+
+        if (subs[i].sub == NULL)
+            continue;
+
+        if (natsSubscription_GetStats(subs[i].sub, NULL, NULL, NULL, NULL,
+                                      NULL, &dropped, NULL) == NATS_OK)
+        {
+            res->dropped += dropped;
+        }
+        if (!reqMode)
+            res->received += subs[i].received;
+    }
+
+    if (reqMode)
+    {
+        res->received = res->sent;
+        res->pubRate  = _rate(res->sent, pubEnd - runStart);
+        res->subRate  = res->pubRate;
+        _computeLatency(res, pubs, numPubs);
+    }
+    else
+    {
+        res->pubRate = _rate(res->sent, pubEnd - runStart);
+        res->subRate = _rate(res->received, subEnd - runStart);
+        _computeLatency(res, subs, numSubs);
+    }
+    res->mbRate = (res->subRate * curSize) / (1024.0 * 1024.0);
+
+    for (i = 0; (pubs != NULL) && (i < numPubs); i++)
+        free(pubs[i].samples);
+
+    for (i = 0; (subs != NULL) && (i < numSubs); i++)
+    {
+        natsSubscription_Destroy(subs[i].sub);
+        free(subs[i].samples);
+    }
+
+    free(pubs);
+    free(subs);
+
+    return s;
+}
+
+static void
+_parseSizes(const char *progName, const char *list)
+{
+    const char *ptr = list;
+
+    numSizes = 0;
+
+    while ((ptr != NULL) && (*ptr != '\0'))
+    {
+        if (numSizes == MAX_SIZES)
+            printUsageAndExit(progName, usage);
+
+        sizes[numSizes] = atoi(ptr);
+        if (sizes[numSizes] < 0)
+            printUsageAndExit(progName, usage);
+
+        numSizes++;
+
+        ptr = strchr(ptr, ',');
+        if (ptr != NULL)
+            ptr++;
+    }
+}
+
+static int
+_positive(const char *progName, const char *value)
+{
+    int v = atoi(value);
+
+    if (v <= 0)
+        printUsageAndExit(progName, usage);
+
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    natsConnection  **conns = NULL;
+    natsStatus      s       = NATS_OK;
+    char            **args  = NULL;
+    int             nargs   = 1;
+    benchResult     res;
+    int             i;
+
+    // Pick the benchmark specific options and leave the common ones
+    // to parseArgs().
+    args = (char**) calloc(argc + 1, sizeof(char*));
+    if (args == NULL)
+        return 1;
+
+    args[0] = argv[0];
+
+    for (i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+
+        if ((strcasecmp(argv[i], "-np") == 0) && hasValue)
+            numPubs = _positive(argv[0], argv[++i]);
+        else if ((strcasecmp(argv[i], "-ns") == 0) && hasValue)
+            numSubs = _positive(argv[0], argv[++i]);
+        else if ((strcasecmp(argv[i], "-nc") == 0) && hasValue)
+            numConns = _positive(argv[0], argv[++i]);
+        else if ((strcasecmp(argv[i], "-size") == 0) && hasValue)
+            _parseSizes(argv[0], argv[++i]);
+        else if (strcasecmp(argv[i], "-req") == 0)
+            reqMode = true;
+        else if (strcasecmp(argv[i], "-csv") == 0)
+            format = FORMAT_CSV;
+        else if (strcasecmp(argv[i], "-json") == 0)
+            format = FORMAT_JSON;
+        else
+            args[nargs++] = argv[i];
+    }
+
+    opts = parseArgs(nargs, args, usage);
+
+    if (total <= 0)
+        printUsageAndExit(argv[0], usage);
+
+    if (numSizes == 0)
+        sizes[numSizes++] = 128;
+
+    conns = (natsConnection**) calloc(numConns, sizeof(natsConnection*));
+    if (conns == NULL)
+        s = NATS_NO_MEMORY;
+
+    for (i = 0; (s == NATS_OK) && (i < numConns); i++)
+        s = natsConnection_Connect(&(conns[i]), opts);
+
+    if (s == NATS_OK)
+        _printHeader();
+
+    for (i = 0; (s == NATS_OK) && (i < numSizes); i++)
+    {
+        curSize = sizes[i];
+
+        s = _run(conns, &res);
+        if (s == NATS_OK)
+            _printResult(&res, (i == 0));
+    }
+
+    if (s == NATS_OK)
+    {
+        _printFooter();
+    }
+    else
+    {
+        printf("Error: %d - %s\n", s, natsStatus_GetText(s));
+        nats_PrintLastErrorStack(stderr);
+    }
+
+    // Destroy all our objects to avoid report of memory leak
+    for (i = 0; (conns != NULL) && (i < numConns); i++)
+        natsConnection_Destroy(conns[i]);
+
+    free(conns);
+    free(args);
+    natsOptions_Destroy(opts);
+
+    // To silence reports of memory still in used with valgrind
+    nats_Close();
+
+    return (s == NATS_OK ? 0 : 1);
+}
@@ -0,0 +1,236 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef LIBEVENT_H_
+#define LIBEVENT_H_
+
+/** \file libevent.h
+ *  \brief Runs a NATS connection from a libevent event base.
+ *
+ * This header only adapter creates a connection that drives its own I/O
+ * (see #natsOptions_SetCallerDrivenIO()) and registers its socket with a
+ * libevent `event_base`. The connection has no thread of its own: messages
+ * and connection callbacks are invoked from the thread running the event
+ * base, which must also be the only thread using the connection.
+ *
+ * \code
+ * natsLibeventConn *conn = NULL;
+ *
+ * s = natsLibevent_Connect(&conn, base, opts);
+ * if (s == NATS_OK)
+ *     s = natsConnection_Subscribe(&sub, natsLibevent_GetConnection(conn),
+ *                                  "foo", onMsg, NULL);
+ * event_base_dispatch(base);
+ * ...
+ * natsSubscription_Destroy(sub);
+ * natsLibevent_Destroy(conn);
+ * \endcode
+ */
+
+#include <stdlib.h>
+#include <event2/event.h>
+
+#include "../nats.h"
+
+/** \brief Interval, in milliseconds, at which natsConnection_ProcessTimers()
+ *         is invoked.
+ */
+#define NATS_LIBEVENT_TIMER_INTERVAL    (1000)
+
+/** \brief A NATS connection registered with a libevent event base.
+ */
+typedef struct __natsLibeventConn
+{
+    natsConnection      *nc;
+    struct event        *read;
+    struct event        *write;
+    struct event        *timer;
+    bool                writing;
+
+} natsLibeventConn;
+
+// Invoked with the connection's write lock held, so only arm the event.
+static inline void
+natsLibevent_writeInterest(natsConnection *nc, void *closure)
+{
+    natsLibeventConn *conn = (natsLibeventConn*) closure;
+
+    (void) nc;
+
+    if (!(conn->writing) && (conn->write != NULL))
+    {
+        conn->writing = true;
+        event_add(conn->write, NULL);
+    }
+}
+
+static inline void
+natsLibevent_update(natsLibeventConn *conn, natsStatus s)
+{
+    if (s == NATS_CONNECTION_CLOSED)
+    {
+        event_del(conn->read);
+        event_del(conn->write);
+        event_del(conn->timer);
+        conn->writing = false;
+        return;
+    }
+
+    if (natsConnection_Buffered(conn->nc) > 0)
+    {
+        if (!(conn->writing))
+        {
+            conn->writing = true;
+            event_add(conn->write, NULL);
+        }
+    }
+    else if (conn->writing)
+    {
+        conn->writing = false;
+        event_del(conn->write);
+    }
+}
+
+static inline void
+natsLibevent_onEvent(evutil_socket_t fd, short what, void *arg)
+{
+    natsLibeventConn    *conn   = (natsLibeventConn*) arg;
+    int                 events  = 0;
+    natsStatus          s;
+
+    (void) fd;
+
+    if ((what & EV_READ) != 0)
+        events |= NATS_IO_READ;
+    if ((what & EV_WRITE) != 0)
+        events |= NATS_IO_WRITE;
+
+    s = natsConnection_ProcessIO(conn->nc, events);
+
+    natsLibevent_update(conn, s);
+}
+
+static inline void
+natsLibevent_onTimer(evutil_socket_t fd, short what, void *arg)
+{
+    natsLibeventConn    *conn = (natsLibeventConn*) arg;
+    natsStatus          s;
+
+    (void) fd;
+    (void) what;
+
+    s = natsConnection_ProcessTimers(conn->nc, nats_Now());
+
+    natsLibevent_update(conn, s);
+}
+
+/** \brief Destroys the connection and its events.
+ *
+ * The connection is closed (invoking its closed callback, if any) and
+ * destroyed, and its events are removed from the event base.
+ *
+ * @param conn the pointer to the #natsLibeventConn object, can be `NULL`.
+ */
+static inline void
+natsLibevent_Destroy(natsLibeventConn *conn)
+{
+    if (conn == NULL)
+        return;
+
+    if (conn->read != NULL)
+        event_free(conn->read);
+    if (conn->write != NULL)
+        event_free(conn->write);
+    if (conn->timer != NULL)
+        event_free(conn->timer);
+
+    conn->read  = NULL;
+    conn->write = NULL;
+    conn->timer = NULL;
+
+    natsConnection_Destroy(conn->nc);
+
+    free(conn);
+}
+
+/** \brief Connects to a `NATS Server` and registers the connection with
+ *         `base`.
+ *
+ * The options are modified to enable #natsOptions_SetCallerDrivenIO() and
+ * to set the callback of #natsOptions_SetWriteInterestCB(), which is what
+ * the adapter uses to register interest for the socket being writable only
+ * when there is data to send.
+ *
+ * @param newConn the location where to store the pointer to the
+ * #natsLibeventConn object.
+ * @param base the libevent event base.
+ * @param opts the options to use for this connection.
+ */
+static inline natsStatus
+natsLibevent_Connect(natsLibeventConn **newConn, struct event_base *base,
+                     natsOptions *opts)
+{
+    natsStatus          s       = NATS_OK;
+    natsLibeventConn    *conn   = NULL;
+    natsSock            fd      = 0;
+    struct timeval      tv;
+
+    if ((newConn == NULL) || (base == NULL) || (opts == NULL))
+        return NATS_INVALID_ARG;
+
+    conn = (natsLibeventConn*) calloc(1, sizeof(natsLibeventConn));
+    if (conn == NULL)
+        return NATS_NO_MEMORY;
+
+    s = natsOptions_SetCallerDrivenIO(opts, true);
+    if (s == NATS_OK)
+        s = natsOptions_SetWriteInterestCB(opts, natsLibevent_writeInterest,
+                                           (void*) conn);
+    if (s == NATS_OK)
+        s = natsConnection_Connect(&(conn->nc), opts);
+    if (s == NATS_OK)
+        s = natsConnection_GetFd(conn->nc, &fd);
+    if (s == NATS_OK)
+    {
+        conn->read  = event_new(base, fd, EV_READ | EV_PERSIST,
+                                natsLibevent_onEvent, (void*) conn);
+        conn->write = event_new(base, fd, EV_WRITE | EV_PERSIST,
+                                natsLibevent_onEvent, (void*) conn);
+        conn->timer = event_new(base, -1, EV_PERSIST,
+                                natsLibevent_onTimer, (void*) conn);
+
+        if ((conn->read == NULL) || (conn->write == NULL) || (conn->timer == NULL))
+            s = NATS_NO_MEMORY;
+    }
+    if (s == NATS_OK)
+    {
+        tv.tv_sec  = NATS_LIBEVENT_TIMER_INTERVAL / 1000;
+        tv.tv_usec = (NATS_LIBEVENT_TIMER_INTERVAL % 1000) * 1000;
+
+        if ((event_add(conn->read, NULL) != 0)
+            || (event_add(conn->timer, &tv) != 0))
+        {
+            s = NATS_ERR;
+        }
+    }
+    if (s == NATS_OK)
+        natsLibevent_update(conn, NATS_OK);
+
+    if (s == NATS_OK)
+        *newConn = conn;
+    else
+        natsLibevent_Destroy(conn);
+
+    return s;
+}
+
+/** \brief Returns the NATS connection.
+ *
+ * @param conn the pointer to the #natsLibeventConn object.
+ */
+static inline natsConnection*
+natsLibevent_GetConnection(natsLibeventConn *conn)
+{
+    return conn->nc;
+}
+
+#endif /* LIBEVENT_H_ */
@@ -0,0 +1,247 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef LIBUV_H_
+#define LIBUV_H_
+
+/** \file libuv.h
+ *  \brief Runs a NATS connection from a libuv loop.
+ *
+ * This header only adapter creates a connection that drives its own I/O
+ * (see #natsOptions_SetCallerDrivenIO()) and registers its socket with a
+ * libuv `uv_loop_t`. The connection has no thread of its own: messages and
+ * connection callbacks are invoked from the thread running the loop, which
+ * must also be the only thread using the connection.
+ *
+ * \code
+ * natsLibuvConn *conn = NULL;
+ *
+ * s = natsLibuv_Connect(&conn, uv_default_loop(), opts);
+ * if (s == NATS_OK)
+ *     s = natsConnection_Subscribe(&sub, natsLibuv_GetConnection(conn),
+ *                                  "foo", onMsg, NULL);
+ * uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+ * ...
+ * natsSubscription_Destroy(sub);
+ * natsLibuv_Destroy(conn);
+ * \endcode
+ */
+
+#include <stdlib.h>
+#include <uv.h>
+
+#include "../nats.h"
+
+/** \brief Interval, in milliseconds, at which natsConnection_ProcessTimers()
+ *         is invoked.
+ */
+#define NATS_LIBUV_TIMER_INTERVAL   (1000)
+
+/** \brief A NATS connection registered with a libuv loop.
+ */
+typedef struct __natsLibuvConn
+{
+    natsConnection      *nc;
+    uv_poll_t           poll;
+    uv_timer_t          timer;
+    bool                polling;
+    bool                writing;
+    int                 handles;
+
+} natsLibuvConn;
+
+static inline void natsLibuv_onPoll(uv_poll_t *handle, int status, int events);
+
+static inline void
+natsLibuv_watch(natsLibuvConn *conn, bool write)
+{
+    int events = UV_READABLE;
+
+    if (write)
+        events |= UV_WRITABLE;
+
+    conn->writing = write;
+    uv_poll_start(&(conn->poll), events, natsLibuv_onPoll);
+}
+
+// Invoked with the connection's write lock held, so only arm the event.
+static inline void
+natsLibuv_writeInterest(natsConnection *nc, void *closure)
+{
+    natsLibuvConn *conn = (natsLibuvConn*) closure;
+
+    (void) nc;
+
+    if (conn->polling && !(conn->writing))
+        natsLibuv_watch(conn, true);
+}
+
+static inline void
+natsLibuv_update(natsLibuvConn *conn, natsStatus s)
+{
+    bool write;
+
+    if (!(conn->polling))
+        return;
+
+    if (s == NATS_CONNECTION_CLOSED)
+    {
+        uv_poll_stop(&(conn->poll));
+        uv_timer_stop(&(conn->timer));
+        conn->polling = false;
+        conn->writing = false;
+        return;
+    }
+
+    write = (natsConnection_Buffered(conn->nc) > 0);
+    if (write != conn->writing)
+        natsLibuv_watch(conn, write);
+}
+
+static inline void
+natsLibuv_onPoll(uv_poll_t *handle, int status, int events)
+{
+    natsLibuvConn   *conn   = (natsLibuvConn*) handle->data;
+    int             ioEvents = 0;
+    natsStatus      s;
+
+    // On error, let the read fail so that the connection gets closed.
+    if ((status < 0) || ((events & UV_READABLE) != 0))
+        ioEvents |= NATS_IO_READ;
+    if ((status == 0) && ((events & UV_WRITABLE) != 0))
+        ioEvents |= NATS_IO_WRITE;
+
+    s = natsConnection_ProcessIO(conn->nc, ioEvents);
+
+    natsLibuv_update(conn, s);
+}
+
+static inline void
+natsLibuv_onTimer(uv_timer_t *handle)
+{
+    natsLibuvConn   *conn = (natsLibuvConn*) handle->data;
+    natsStatus      s;
+
+    s = natsConnection_ProcessTimers(conn->nc, nats_Now());
+
+    natsLibuv_update(conn, s);
+}
+
+static inline void
+natsLibuv_onClose(uv_handle_t *handle)
+{
+    natsLibuvConn *conn = (natsLibuvConn*) handle->data;
+
+    if (--(conn->handles) == 0)
+        free(conn);
+}
+
+/** \brief Destroys the connection and closes its handles.
+ *
+ * The connection is closed (invoking its closed callback, if any) and
+ * destroyed. The memory of the #natsLibuvConn object is released once
+ * the loop has closed the handles.
+ *
+ * @param conn the pointer to the #natsLibuvConn object, can be `NULL`.
+ */
+static inline void
+natsLibuv_Destroy(natsLibuvConn *conn)
+{
+    if (conn == NULL)
+        return;
+
+    conn->polling = false;
+
+    natsConnection_Destroy(conn->nc);
+    conn->nc = NULL;
+
+    if (conn->handles == 0)
+    {
+        free(conn);
+        return;
+    }
+
+    uv_close((uv_handle_t*) &(conn->timer), natsLibuv_onClose);
+    if (conn->handles == 2)
+        uv_close((uv_handle_t*) &(conn->poll), natsLibuv_onClose);
+}
+
+/** \brief Connects to a `NATS Server` and registers the connection with
+ *         `loop`.
+ *
+ * The options are modified to enable #natsOptions_SetCallerDrivenIO() and
+ * to set the callback of #natsOptions_SetWriteInterestCB(), which is what
+ * the adapter uses to watch the socket for writability only when there is
+ * data to send.
+ *
+ * @param newConn the location where to store the pointer to the
+ * #natsLibuvConn object.
+ * @param loop the libuv loop.
+ * @param opts the options to use for this connection.
+ */
+static inline natsStatus
+natsLibuv_Connect(natsLibuvConn **newConn, uv_loop_t *loop, natsOptions *opts)
+{
+    natsStatus      s       = NATS_OK;
+    natsLibuvConn   *conn   = NULL;
+    natsSock        fd      = 0;
+
+    if ((newConn == NULL) || (loop == NULL) || (opts == NULL))
+        return NATS_INVALID_ARG;
+
+    conn = (natsLibuvConn*) calloc(1, sizeof(natsLibuvConn));
+    if (conn == NULL)
+        return NATS_NO_MEMORY;
+
+    conn->poll.data  = (void*) conn;
+    conn->timer.data = (void*) conn;
+
+    s = natsOptions_SetCallerDrivenIO(opts, true);
+    if (s == NATS_OK)
+        s = natsOptions_SetWriteInterestCB(opts, natsLibuv_writeInterest,
+                                           (void*) conn);
+    if (s == NATS_OK)
+        s = natsConnection_Connect(&(conn->nc), opts);
+    if (s == NATS_OK)
+        s = natsConnection_GetFd(conn->nc, &fd);
+    if ((s == NATS_OK) && (uv_timer_init(loop, &(conn->timer)) != 0))
+        s = NATS_ERR;
+    if (s == NATS_OK)
+    {
+        conn->handles++;
+        if (uv_poll_init_socket(loop, &(conn->poll), (uv_os_sock_t) fd) != 0)
+            s = NATS_ERR;
+    }
+    if (s == NATS_OK)
+    {
+        conn->handles++;
+        conn->polling = true;
+
+        natsLibuv_watch(conn, (natsConnection_Buffered(conn->nc) > 0));
+
+        if (uv_timer_start(&(conn->timer), natsLibuv_onTimer,
+                           NATS_LIBUV_TIMER_INTERVAL,
+                           NATS_LIBUV_TIMER_INTERVAL) != 0)
+        {
+            s = NATS_ERR;
+        }
+    }
+
+    if (s == NATS_OK)
+        *newConn = conn;
+    else
+        natsLibuv_Destroy(conn);
+
+    return s;
+}
+
+/** \brief Returns the NATS connection.
+ *
+ * @param conn the pointer to the #natsLibuvConn object.
+ */
+static inline natsConnection*
+natsLibuv_GetConnection(natsLibuvConn *conn)
+{
+    return conn->nc;
+}
+
+#endif /* LIBUV_H_ */
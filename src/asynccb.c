@@ -10,6 +10,32 @@ _freeAsyncCbInfo(natsAsyncCbInfo *info)
     NATS_FREE(info);
 }
 
+static void
+_freeFlushReqs(natsFlushReq *reqs)
+{
+    natsFlushReq *req;
+
+    while ((req = reqs) != NULL)
+    {
+        reqs = req->next;
+        NATS_FREE(req);
+    }
+}
+
+// Connections with caller driven I/O invoke their callbacks from the
+// application's thread instead of the library's one.
+static natsStatus
+_postCb(natsAsyncCbInfo *cb)
+{
+    if (cb->nc->opts->callerDrivenIO)
+    {
+        natsConn_postInlineCb(cb->nc, cb);
+        return NATS_OK;
+    }
+
+    return nats_postAsyncCbInfo(cb);
+}
+
 static void
 _createAndPostCb(natsAsyncCbType type, natsConnection *nc, natsSubscription *sub, natsStatus err)
 {
@@ -31,7 +57,7 @@ _createAndPostCb(natsAsyncCbType type, natsConnection *nc, natsSubscription *sub
 
     natsConn_retain(nc);
 
-    s = nats_postAsyncCbInfo(cb);
+    s = _postCb(cb);
     if (s != NATS_OK)
     {
         _freeAsyncCbInfo(cb);
@@ -48,9 +74,124 @@ natsAsyncCb_PostConnHandler(natsConnection *nc, natsAsyncCbType type)
 void
 natsAsyncCb_PostErrHandler(natsConnection *nc, natsSubscription *sub, natsStatus err)
 {
+    // A subscription that keeps going in and out of the slow consumer state
+    // would otherwise queue an event (and allocate it) each time.
+    if ((err == NATS_SLOW_CONSUMER)
+        && !(nc->opts->callerDrivenIO)
+        && nats_coalesceAsyncErr(nc, sub, err))
+    {
+        return;
+    }
+
     _createAndPostCb(ASYNC_ERROR, nc, sub, err);
 }
 
+void
+natsAsyncCb_PostFlushHandler(natsConnection *nc, natsFlushReq *reqs,
+                             natsStatus err)
+{
+    natsStatus          s  = NATS_OK;
+    natsAsyncCbInfo     *cb;
+
+    cb = NATS_CALLOC(1, sizeof(natsAsyncCbInfo));
+    if (cb == NULL)
+    {
+        _freeFlushReqs(reqs);
+        return;
+    }
+
+    cb->type      = ASYNC_FLUSH;
+    cb->nc        = nc;
+    cb->err       = err;
+    cb->flushReqs = reqs;
+
+    natsConn_retain(nc);
+
+    s = _postCb(cb);
+    if (s != NATS_OK)
+        natsAsyncCb_Destroy(cb);
+}
+
+void
+natsAsyncCb_PostWatermarkHandler(natsConnection *nc, bool high)
+{
+    natsAsyncCbInfo     *cb;
+
+    cb = NATS_CALLOC(1, sizeof(natsAsyncCbInfo));
+    if (cb == NULL)
+        return;
+
+    cb->type = ASYNC_WATERMARK;
+    cb->nc   = nc;
+    cb->high = high;
+
+    natsConn_retain(nc);
+
+    if (_postCb(cb) != NATS_OK)
+    {
+        _freeAsyncCbInfo(cb);
+        natsConn_release(nc);
+    }
+}
+
+void
+natsAsyncCb_PostReplyHandler(natsConnection *nc, natsRespInfo *resp,
+                             natsStatus err)
+{
+    natsAsyncCbInfo     *cb;
+
+    cb = NATS_CALLOC(1, sizeof(natsAsyncCbInfo));
+    if (cb == NULL)
+    {
+        NATS_FREE(resp);
+        return;
+    }
+
+    cb->type = ASYNC_REPLY;
+    cb->nc   = nc;
+    cb->err  = err;
+    cb->resp = resp;
+
+    natsConn_retain(nc);
+
+    if (_postCb(cb) != NATS_OK)
+        natsAsyncCb_Destroy(cb);
+}
+
+void
+natsAsyncCb_Dispatch(natsAsyncCbInfo *cb)
+{
+    natsConnection *nc = cb->nc;
+
+    switch (cb->type)
+    {
+        case ASYNC_CLOSED:
+            (*(nc->opts->closedCb))(nc, nc->opts->closedCbClosure);
+            break;
+        case ASYNC_DISCONNECTED:
+            (*(nc->opts->disconnectedCb))(nc, nc->opts->disconnectedCbClosure);
+            break;
+        case ASYNC_RECONNECTED:
+            (*(nc->opts->reconnectedCb))(nc, nc->opts->reconnectedCbClosure);
+            break;
+        case ASYNC_ERROR:
+            (*(nc->opts->asyncErrCb))(nc, cb->sub, cb->err, nc->opts->asyncErrCbClosure);
+            break;
+        case ASYNC_FLUSH:
+            natsConn_completeFlushRequests(nc, cb->flushReqs, cb->err);
+            cb->flushReqs = NULL;
+            break;
+        case ASYNC_WATERMARK:
+            (*(nc->opts->watermarkCb))(nc, cb->high, nc->opts->watermarkCbClosure);
+            break;
+        case ASYNC_REPLY:
+            (*(cb->resp->cb))(nc, NULL, cb->err, cb->resp->closure);
+            break;
+        default:
+            break;
+    }
+}
+
 void
 natsAsyncCb_Destroy(natsAsyncCbInfo *info)
 {
@@ -61,6 +202,10 @@ natsAsyncCb_Destroy(natsAsyncCbInfo *info)
 
     nc = info->nc;
 
+    // Flush requests that were not completed (the library is shutting down).
+    _freeFlushReqs(info->flushReqs);
+    NATS_FREE(info->resp);
+
     _freeAsyncCbInfo(info);
     natsConn_release(nc);
 }
@@ -10,13 +10,18 @@ typedef enum
     ASYNC_CLOSED          = 0,
     ASYNC_DISCONNECTED,
     ASYNC_RECONNECTED,
-    ASYNC_ERROR
+    ASYNC_ERROR,
+    ASYNC_FLUSH,
+    ASYNC_WATERMARK,
+    ASYNC_REPLY
 
 } natsAsyncCbType;
 
 struct __natsConnection;
 struct __natsSubscription;
 struct __natsAsyncCbInfo;
+struct __natsFlushReq;
+struct __natsRespInfo;
 
 typedef struct __natsAsyncCbInfo
 {
@@ -24,6 +29,13 @@ typedef struct __natsAsyncCbInfo
     struct __natsConnection     *nc;
     struct __natsSubscription   *sub;
     natsStatus                  err;
+    struct __natsFlushReq       *flushReqs;
+
+    // For ASYNC_WATERMARK, whether the high watermark was reached.
+    bool                        high;
+
+    // For ASYNC_REPLY, the asynchronous request that failed.
+    struct __natsRespInfo       *resp;
 
     struct __natsAsyncCbInfo    *next;
 
@@ -36,6 +48,24 @@ void
 natsAsyncCb_PostErrHandler(struct __natsConnection *nc,
                            struct __natsSubscription *sub, natsStatus err);
 
+void
+natsAsyncCb_PostFlushHandler(struct __natsConnection *nc,
+                             struct __natsFlushReq *reqs, natsStatus err);
+
+// Must not be invoked with the connection's write lock held, since the
+// connection is retained.
+void
+natsAsyncCb_PostWatermarkHandler(struct __natsConnection *nc, bool high);
+
+// Reports the failure of an asynchronous request (caller driven I/O only).
+void
+natsAsyncCb_PostReplyHandler(struct __natsConnection *nc,
+                             struct __natsRespInfo *resp, natsStatus err);
+
+// Invokes the callback described by 'info'.
+void
+natsAsyncCb_Dispatch(natsAsyncCbInfo *info);
+
 void
 natsAsyncCb_Destroy(natsAsyncCbInfo *info);
 
@@ -110,6 +110,21 @@ natsBuf_RewindTo(natsBuffer *buf, int newPosition)
     buf->pos = buf->data + newPosition;
 }
 
+void
+natsBuf_Consume(natsBuffer *buf, int n)
+{
+    int remaining;
+
+    assert(n <= buf->len);
+
+    remaining = buf->len - n;
+
+    if ((n > 0) && (remaining > 0))
+        memmove(buf->data, buf->data + n, remaining);
+
+    buf->len = remaining;
+    buf->pos = buf->data + remaining;
+}
 
 natsStatus
 natsBuf_Expand(natsBuffer *buf, int newSize)
@@ -69,6 +69,11 @@ natsBuf_Reset(natsBuffer *buf);
 void
 natsBuf_RewindTo(natsBuffer *buf, int newPosition);
 
+// Removes the first 'n' bytes from the buffer, moving the remaining data
+// to the beginning of the buffer.
+void
+natsBuf_Consume(natsBuffer *buf, int n);
+
 // Expands 'buf' underlying buffer to the given new size 'newSize'.
 //
 // If 'buf' did not own the underlying buffer, a new buffer is
@@ -0,0 +1,199 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include "mem.h"
+#include "capture.h"
+
+// The capture is written through the stdio buffer, so that a small read
+// does not cost a write to the file.
+#define _CAPTURE_FILE_BUF_SIZE  (64 * 1024)
+
+static void
+_putUInt(char *b, uint64_t v, int len)
+{
+    for (int i = len - 1; i >= 0; i--)
+    {
+        b[i] = (char) (v & 0xFF);
+        v >>= 8;
+    }
+}
+
+static uint64_t
+_getUInt(const char *b, int len)
+{
+    uint64_t v = 0;
+
+    for (int i = 0; i < len; i++)
+        v = (v << 8) | (uint8_t) b[i];
+
+    return v;
+}
+
+natsStatus
+natsCapture_Create(natsCapture **newCapture, const char *path)
+{
+    natsCapture *capture = NULL;
+
+    capture = (natsCapture*) NATS_CALLOC(1, sizeof(natsCapture));
+    if (capture == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    capture->f = fopen(path, "wb");
+    if (capture->f == NULL)
+    {
+        NATS_FREE(capture);
+        return nats_setError(NATS_SYS_ERROR, "unable to open capture file '%s': %d",
+                             path, errno);
+    }
+
+    (void) setvbuf(capture->f, NULL, _IOFBF, _CAPTURE_FILE_BUF_SIZE);
+
+    if (fwrite(NATS_CAPTURE_MAGIC, 1, NATS_CAPTURE_MAGIC_LEN, capture->f)
+        != NATS_CAPTURE_MAGIC_LEN)
+    {
+        natsCapture_Destroy(capture);
+        return nats_setError(NATS_SYS_ERROR, "unable to write capture file '%s': %d",
+                             path, errno);
+    }
+
+    *newCapture = capture;
+
+    return NATS_OK;
+}
+
+void
+natsCapture_Write(natsCapture *capture, const char *data, int len)
+{
+    char hdr[NATS_CAPTURE_HDR_LEN];
+
+    if (capture->failed || (len <= 0))
+        return;
+
+    _putUInt(hdr, (uint64_t) nats_NowInNanoSeconds(), 8);
+    _putUInt(hdr + 8, (uint64_t) len, 4);
+
+    if ((fwrite(hdr, 1, sizeof(hdr), capture->f) != sizeof(hdr))
+        || (fwrite(data, 1, (size_t) len, capture->f) != (size_t) len))
+    {
+        capture->failed = true;
+    }
+}
+
+void
+natsCapture_Destroy(natsCapture *capture)
+{
+    if (capture == NULL)
+        return;
+
+    if (capture->f != NULL)
+        fclose(capture->f);
+
+    NATS_FREE(capture);
+}
+
+natsStatus
+natsCaptureReader_Create(natsCaptureReader **newReader, const char *path)
+{
+    natsStatus          s       = NATS_OK;
+    natsCaptureReader   *reader = NULL;
+    FILE                *f      = NULL;
+    long                size    = 0;
+
+    f = fopen(path, "rb");
+    if (f == NULL)
+        return nats_setError(NATS_SYS_ERROR, "unable to open capture file '%s': %d",
+                             path, errno);
+
+    if ((fseek(f, 0, SEEK_END) != 0)
+        || ((size = ftell(f)) < 0)
+        || (fseek(f, 0, SEEK_SET) != 0))
+    {
+        s = nats_setError(NATS_SYS_ERROR, "unable to read capture file '%s': %d",
+                          path, errno);
+    }
+    if ((s == NATS_OK)
+        && ((size < NATS_CAPTURE_MAGIC_LEN) || (size > INT32_MAX)))
+    {
+        s = nats_setError(NATS_ERR, "invalid capture file '%s'", path);
+    }
+    if (s == NATS_OK)
+    {
+        reader = (natsCaptureReader*) NATS_CALLOC(1, sizeof(natsCaptureReader));
+        if (reader != NULL)
+            reader->data = (char*) NATS_MALLOC((size_t) size);
+        if ((reader == NULL) || (reader->data == NULL))
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if ((s == NATS_OK)
+        && (fread(reader->data, 1, (size_t) size, f) != (size_t) size))
+    {
+        s = nats_setError(NATS_SYS_ERROR, "unable to read capture file '%s': %d",
+                          path, errno);
+    }
+    if ((s == NATS_OK)
+        && (memcmp(reader->data, NATS_CAPTURE_MAGIC, NATS_CAPTURE_MAGIC_LEN) != 0))
+    {
+        s = nats_setError(NATS_ERR, "invalid capture file '%s'", path);
+    }
+
+    fclose(f);
+
+    if (s == NATS_OK)
+    {
+        reader->size = (int64_t) size;
+        reader->pos  = NATS_CAPTURE_MAGIC_LEN;
+
+        *newReader = reader;
+    }
+    else
+    {
+        natsCaptureReader_Destroy(reader);
+    }
+
+    return s;
+}
+
+natsStatus
+natsCaptureReader_Next(natsCaptureReader *reader, int64_t *ts,
+                       const char **data, int *len)
+{
+    int64_t recLen;
+
+    if (reader->pos == reader->size)
+        return NATS_NOT_FOUND;
+
+    if (reader->size - reader->pos < NATS_CAPTURE_HDR_LEN)
+        return nats_setError(NATS_ERR, "%s", "truncated capture file");
+
+    recLen = (int64_t) _getUInt(reader->data + reader->pos + 8, 4);
+    if (reader->size - reader->pos - NATS_CAPTURE_HDR_LEN < recLen)
+        return nats_setError(NATS_ERR, "%s", "truncated capture file");
+
+    *ts   = (int64_t) _getUInt(reader->data + reader->pos, 8);
+    *data = reader->data + reader->pos + NATS_CAPTURE_HDR_LEN;
+    *len  = (int) recLen;
+
+    reader->pos += NATS_CAPTURE_HDR_LEN + recLen;
+
+    return NATS_OK;
+}
+
+void
+natsCaptureReader_Rewind(natsCaptureReader *reader)
+{
+    reader->pos = NATS_CAPTURE_MAGIC_LEN;
+}
+
+void
+natsCaptureReader_Destroy(natsCaptureReader *reader)
+{
+    if (reader == NULL)
+        return;
+
+    NATS_FREE(reader->data);
+    NATS_FREE(reader);
+}
@@ -0,0 +1,65 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "nats.h"
+
+// A capture file starts with this marker, followed by a record for each
+// read from the socket: the time of the read, in nanoseconds (8 bytes), and
+// the number of bytes read (4 bytes), both big endian, then the bytes.
+#define NATS_CAPTURE_MAGIC      "NATSCAP1"
+#define NATS_CAPTURE_MAGIC_LEN  (8)
+#define NATS_CAPTURE_HDR_LEN    (8 + 4)
+
+typedef struct __natsCapture
+{
+    FILE                *f;
+
+    // Set when a write fails, after which the reads are no longer recorded.
+    bool                failed;
+
+} natsCapture;
+
+// A capture file loaded in memory, to go through its records.
+typedef struct __natsCaptureReader
+{
+    char                *data;
+    int64_t             size;
+    int64_t             pos;
+
+} natsCaptureReader;
+
+natsStatus
+natsCapture_Create(natsCapture **newCapture, const char *path);
+
+// Records the 'len' bytes read from the socket. Invoked only by the thread
+// reading from the socket. Errors are not reported to the connection, but
+// stop the capture.
+void
+natsCapture_Write(natsCapture *capture, const char *data, int len);
+
+void
+natsCapture_Destroy(natsCapture *capture);
+
+natsStatus
+natsCaptureReader_Create(natsCaptureReader **newReader, const char *path);
+
+// Sets 'ts', 'data' and 'len' to the next record, whose data is valid until
+// the reader is destroyed. Returns NATS_NOT_FOUND after the last one.
+natsStatus
+natsCaptureReader_Next(natsCaptureReader *reader, int64_t *ts,
+                       const char **data, int *len);
+
+// Goes back to the first record.
+void
+natsCaptureReader_Rewind(natsCaptureReader *reader);
+
+void
+natsCaptureReader_Destroy(natsCaptureReader *reader);
+
+#endif /* CAPTURE_H_ */
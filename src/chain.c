@@ -0,0 +1,276 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include <string.h>
+
+#include "err.h"
+#include "mem.h"
+#include "chain.h"
+
+#define _CHUNK_SIZE(c)  ((int) (sizeof(natsChainChunk) - 1) + (c)->chunkSize)
+
+natsStatus
+natsChain_Create(natsChain **newChain, int chunkSize, int maxFree)
+{
+    natsChain *chain = NULL;
+
+    if (chunkSize <= 0)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    chain = (natsChain*) NATS_CALLOC(1, sizeof(natsChain));
+    if (chain == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    chain->chunkSize = chunkSize;
+    chain->maxFree   = maxFree;
+
+    *newChain = chain;
+
+    return NATS_OK;
+}
+
+static void
+_releaseChunk(natsChain *chain, natsChainChunk *chunk)
+{
+    if (chain->freeCount >= chain->maxFree)
+    {
+        NATS_FREE(chunk);
+        return;
+    }
+
+    chunk->next = chain->free;
+    chain->free = chunk;
+    chain->freeCount++;
+}
+
+static natsStatus
+_addChunk(natsChain *chain)
+{
+    natsChainChunk *chunk = chain->free;
+
+    if (chunk != NULL)
+    {
+        chain->free = chunk->next;
+        chain->freeCount--;
+    }
+    else
+    {
+        chunk = (natsChainChunk*) NATS_MALLOC(_CHUNK_SIZE(chain));
+        if (chunk == NULL)
+            return nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    chunk->next = NULL;
+    chunk->len  = 0;
+
+    if (chain->tail == NULL)
+        chain->head = chunk;
+    else
+        chain->tail->next = chunk;
+
+    chain->tail = chunk;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsChain_Append(natsChain *chain, const char *data, int len)
+{
+    natsStatus  s = NATS_OK;
+    int         n = 0;
+
+    if (len < 0)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    if (len > 0x7FFFFFFF - chain->len)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    while ((s == NATS_OK) && (len > 0))
+    {
+        if ((chain->tail == NULL) || (chain->tail->len == chain->chunkSize))
+            s = _addChunk(chain);
+
+        if (s == NATS_OK)
+        {
+            n = chain->chunkSize - chain->tail->len;
+            if (n > len)
+                n = len;
+
+            memcpy(chain->tail->data + chain->tail->len, data, n);
+            chain->tail->len += n;
+            chain->len       += n;
+            data             += n;
+            len              -= n;
+        }
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+int
+natsChain_GetIOVec(natsChain *chain, natsSockIOVec *iov, int maxIov,
+                   int maxBytes, int *bytes)
+{
+    natsChainChunk  *chunk = chain->head;
+    int             pos    = chain->headPos;
+    int             count  = 0;
+    int             total  = 0;
+    int             n      = 0;
+
+    while ((chunk != NULL) && (count < maxIov) && (total < maxBytes))
+    {
+        n = chunk->len - pos;
+        if (n > maxBytes - total)
+            n = maxBytes - total;
+
+        if (n > 0)
+        {
+            NATS_IOVEC_SET(iov[count], chunk->data + pos, n);
+            count++;
+            total += n;
+        }
+
+        chunk = chunk->next;
+        pos   = 0;
+    }
+
+    *bytes = total;
+
+    return count;
+}
+
+void
+natsChain_Consume(natsChain *chain, int n)
+{
+    natsChainChunk  *chunk = NULL;
+    int             avail  = 0;
+
+    if (n >= chain->len)
+    {
+        natsChain_Reset(chain);
+        return;
+    }
+
+    chain->len -= n;
+
+    while (n > 0)
+    {
+        chunk = chain->head;
+        avail = chunk->len - chain->headPos;
+
+        if (n < avail)
+        {
+            chain->headPos += n;
+            break;
+        }
+
+        n -= avail;
+
+        chain->head    = chunk->next;
+        chain->headPos = 0;
+
+        _releaseChunk(chain, chunk);
+    }
+
+    if (chain->head == NULL)
+        chain->tail = NULL;
+}
+
+// Returns the chunk holding the byte at 'offset' from the front of the
+// chain and sets 'pos' to the position of that byte in the chunk.
+static natsChainChunk*
+_findChunk(natsChain *chain, int offset, int *pos)
+{
+    natsChainChunk  *chunk = chain->head;
+    int             p      = chain->headPos + offset;
+
+    while ((chunk != NULL) && (p >= chunk->len))
+    {
+        p     -= chunk->len;
+        chunk  = chunk->next;
+    }
+
+    *pos = p;
+
+    return chunk;
+}
+
+int
+natsChain_IndexOf(natsChain *chain, int offset, char ch)
+{
+    natsChainChunk  *chunk = NULL;
+    const char      *found = NULL;
+    int             pos    = 0;
+
+    if ((offset < 0) || (offset >= chain->len))
+        return -1;
+
+    chunk = _findChunk(chain, offset, &pos);
+
+    while (chunk != NULL)
+    {
+        found = (const char*) memchr(chunk->data + pos, ch, chunk->len - pos);
+        if (found != NULL)
+            return offset + (int) (found - (chunk->data + pos));
+
+        offset += chunk->len - pos;
+        chunk   = chunk->next;
+        pos     = 0;
+    }
+
+    return -1;
+}
+
+void
+natsChain_Copy(natsChain *chain, int offset, char *dst, int len)
+{
+    natsChainChunk  *chunk = _findChunk(chain, offset, &offset);
+    int             n      = 0;
+
+    while ((chunk != NULL) && (len > 0))
+    {
+        n = chunk->len - offset;
+        if (n > len)
+            n = len;
+
+        memcpy(dst, chunk->data + offset, n);
+        dst   += n;
+        len   -= n;
+        chunk  = chunk->next;
+        offset = 0;
+    }
+}
+
+void
+natsChain_Reset(natsChain *chain)
+{
+    natsChainChunk *chunk = NULL;
+
+    while ((chunk = chain->head) != NULL)
+    {
+        chain->head = chunk->next;
+        _releaseChunk(chain, chunk);
+    }
+
+    chain->tail    = NULL;
+    chain->headPos = 0;
+    chain->len     = 0;
+}
+
+void
+natsChain_Destroy(natsChain *chain)
+{
+    natsChainChunk *chunk = NULL;
+
+    if (chain == NULL)
+        return;
+
+    natsChain_Reset(chain);
+
+    while ((chunk = chain->free) != NULL)
+    {
+        chain->free = chunk->next;
+        NATS_FREE(chunk);
+    }
+
+    NATS_FREE(chain);
+}
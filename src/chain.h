@@ -0,0 +1,79 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef CHAIN_H_
+#define CHAIN_H_
+
+#if defined(_WIN32)
+# include "include/n-win.h"
+#else
+# include "include/n-unix.h"
+#endif
+
+#include "status.h"
+
+// A natsChain is a byte buffer made of a list of fixed size chunks. Unlike
+// a natsBuffer, appending never moves the data already stored, and
+// consuming from the front does not shift what remains: chunks that have
+// been fully consumed are kept (up to a limit) for later appends.
+typedef struct __natsChainChunk
+{
+    struct __natsChainChunk *next;
+    int                     len;
+    char                    data[1];
+
+} natsChainChunk;
+
+typedef struct __natsChain
+{
+    natsChainChunk  *head;
+    natsChainChunk  *tail;
+    int             headPos;
+    int             len;
+    int             chunkSize;
+
+    natsChainChunk  *free;
+    int             freeCount;
+    int             maxFree;
+
+} natsChain;
+
+#define natsChain_Len(c)        ((c)->len)
+
+// Creates a chain made of chunks of 'chunkSize' bytes. At most 'maxFree'
+// consumed chunks are kept for reuse.
+natsStatus
+natsChain_Create(natsChain **newChain, int chunkSize, int maxFree);
+
+// Appends 'len' bytes from 'data' to the end of the chain.
+natsStatus
+natsChain_Append(natsChain *chain, const char *data, int len);
+
+// Fills at most 'maxIov' elements of 'iov' with the data at the front of
+// the chain, up to 'maxBytes' bytes. Returns the number of elements set
+// and the number of bytes they reference in 'bytes'.
+int
+natsChain_GetIOVec(natsChain *chain, natsSockIOVec *iov, int maxIov,
+                   int maxBytes, int *bytes);
+
+// Removes 'n' bytes from the front of the chain.
+void
+natsChain_Consume(natsChain *chain, int n);
+
+// Returns the offset, from the front of the chain, of the first occurrence
+// of 'ch' at or after 'offset', or -1 if not found.
+int
+natsChain_IndexOf(natsChain *chain, int offset, char ch);
+
+// Copies 'len' bytes starting at 'offset' into 'dst'. The caller must make
+// sure that the chain holds that many bytes.
+void
+natsChain_Copy(natsChain *chain, int offset, char *dst, int len);
+
+// Removes all data. Chunks are recycled.
+void
+natsChain_Reset(natsChain *chain);
+
+void
+natsChain_Destroy(natsChain *chain);
+
+#endif /* CHAIN_H_ */
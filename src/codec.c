@@ -0,0 +1,512 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include <string.h>
+
+#include "err.h"
+#include "mem.h"
+#include "codec.h"
+
+#define _LZ4_MIN_MATCH      (4)
+#define _LZ4_MF_LIMIT       (12)
+#define _LZ4_LAST_LITERALS  (5)
+#define _LZ4_MAX_OFFSET     (65535)
+#define _LZ4_SKIP_TRIGGER   (6)
+
+#define _LZ4_TABLE_SIZE     (1 << NATS_LZ4_HASH_LOG)
+
+static uint32_t
+_read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static uint32_t
+_hash32(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - NATS_LZ4_HASH_LOG);
+}
+
+// Writes the remainder of a length whose first 4 bits are in the token.
+static uint8_t*
+_writeLen(uint8_t *op, int len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+
+    *op++ = (uint8_t) len;
+
+    return op;
+}
+
+// Writes a sequence made of the literals from 'anchor' to 'ip', followed by
+// a match of 'matchLen' bytes (not counting the minimum match) at 'offset',
+// if 'offset' is not 0. Returns NULL if it does not fit before 'oend'.
+static uint8_t*
+_writeSequence(uint8_t *op, uint8_t *oend, const uint8_t *anchor,
+               const uint8_t *ip, int offset, int matchLen)
+{
+    int     litLen  = (int) (ip - anchor);
+    uint8_t *token  = op;
+
+    // Worst case for the token, lengths and offset.
+    if ((oend - op) < (1 + litLen + (litLen / 255) + 1
+                       + (offset != 0 ? 2 + (matchLen / 255) + 1 : 0)))
+    {
+        return NULL;
+    }
+
+    op++;
+
+    if (litLen >= 15)
+    {
+        *token = (15 << 4);
+        op = _writeLen(op, litLen - 15);
+    }
+    else
+    {
+        *token = (uint8_t) (litLen << 4);
+    }
+
+    memcpy(op, anchor, litLen);
+    op += litLen;
+
+    if (offset == 0)
+        return op;
+
+    *op++ = (uint8_t) (offset & 0xFF);
+    *op++ = (uint8_t) (offset >> 8);
+
+    if (matchLen >= 15)
+    {
+        *token |= 15;
+        op = _writeLen(op, matchLen - 15);
+    }
+    else
+    {
+        *token |= (uint8_t) matchLen;
+    }
+
+    return op;
+}
+
+int
+natsLZ4_Compress(uint32_t *table, const char *src, int srcLen,
+                 char *dst, int dstCap)
+{
+    const uint8_t   *base       = (const uint8_t*) src;
+    const uint8_t   *ip         = base;
+    const uint8_t   *anchor     = base;
+    const uint8_t   *iend       = base + srcLen;
+    const uint8_t   *mflimit    = iend - _LZ4_MF_LIMIT;
+    const uint8_t   *matchLimit = iend - _LZ4_LAST_LITERALS;
+    uint8_t         *op         = (uint8_t*) dst;
+    uint8_t         *oend       = op + dstCap;
+    int             attempts    = 0;
+
+    // Blocks too small for a match are made of literals only. The table is
+    // not cleared between blocks: a position left by a previous block is
+    // still a position in this one, and a candidate is always verified.
+    if (srcLen > _LZ4_MF_LIMIT)
+    {
+        ip++;
+
+        while (ip <= mflimit)
+        {
+            uint32_t        pos     = (uint32_t) (ip - base);
+            uint32_t        h       = _hash32(_read32(ip));
+            uint32_t        refPos  = table[h];
+            const uint8_t   *ref;
+            const uint8_t   *mp;
+
+            table[h] = pos;
+
+            if ((refPos >= pos)
+                || ((pos - refPos) > _LZ4_MAX_OFFSET)
+                || (_read32(base + refPos) != _read32(ip)))
+            {
+                // The less we find matches, the more bytes we skip, so that
+                // data that does not compress does not cost much.
+                ip += 1 + (attempts++ >> _LZ4_SKIP_TRIGGER);
+                continue;
+            }
+
+            attempts = 0;
+            ref      = base + refPos;
+
+            while ((ip > anchor) && (ref > base) && (ip[-1] == ref[-1]))
+            {
+                ip--;
+                ref--;
+            }
+
+            for (mp = ip + _LZ4_MIN_MATCH;
+                 (mp < matchLimit) && (*mp == ref[mp - ip]);
+                 mp++)
+            {
+            }
+
+            op = _writeSequence(op, oend, anchor, ip, (int) (ip - ref),
+                                (int) (mp - ip) - _LZ4_MIN_MATCH);
+            if (op == NULL)
+                return 0;
+
+            ip     = mp;
+            anchor = ip;
+
+            if (ip <= mflimit)
+                table[_hash32(_read32(ip - 2))] = (uint32_t) (ip - 2 - base);
+        }
+    }
+
+    // The block ends with the last literals.
+    op = _writeSequence(op, oend, anchor, iend, 0, 0);
+    if (op == NULL)
+        return 0;
+
+    return (int) (op - (uint8_t*) dst);
+}
+
+// Reads the remainder of a length whose first 4 bits were in the token.
+// Returns false if it goes past 'iend' or over 'max'.
+static bool
+_readLen(const uint8_t **ip, const uint8_t *iend, int *len, int max)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*ip >= iend)
+            return false;
+
+        b = *(*ip)++;
+        *len += b;
+
+        if (*len > max)
+            return false;
+    }
+    while (b == 255);
+
+    return true;
+}
+
+bool
+natsLZ4_Decompress(const char *src, int srcLen, char *dst, int dstLen)
+{
+    const uint8_t   *ip     = (const uint8_t*) src;
+    const uint8_t   *iend   = ip + srcLen;
+    uint8_t         *op     = (uint8_t*) dst;
+    uint8_t         *oend   = op + dstLen;
+
+    while (ip < iend)
+    {
+        uint8_t token   = *ip++;
+        int     litLen  = (token >> 4);
+        int     matchLen = (token & 15);
+        int     offset;
+
+        if ((litLen == 15) && !_readLen(&ip, iend, &litLen, dstLen))
+            return false;
+
+        if ((litLen > (iend - ip)) || (litLen > (oend - op)))
+            return false;
+
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        // The last sequence has no match.
+        if (ip == iend)
+            break;
+
+        if ((iend - ip) < 2)
+            return false;
+
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if ((offset == 0) || (offset > (op - (uint8_t*) dst)))
+            return false;
+
+        if ((matchLen == 15) && !_readLen(&ip, iend, &matchLen, dstLen))
+            return false;
+
+        matchLen += _LZ4_MIN_MATCH;
+
+        if (matchLen > (oend - op))
+            return false;
+
+        if (offset >= matchLen)
+        {
+            memcpy(op, op - offset, matchLen);
+            op += matchLen;
+        }
+        else
+        {
+            // Overlapping copy, which repeats the last 'offset' bytes.
+            const uint8_t *ref = op - offset;
+
+            while (matchLen-- > 0)
+                *op++ = *ref++;
+        }
+    }
+
+    return (op == oend);
+}
+
+natsStatus
+natsCodec_Create(natsCodec **newCodec, int id, natsPayloadEncoder encoder,
+                 natsPayloadDecoder decoder, void *closure, int minSize)
+{
+    natsStatus  s      = NATS_OK;
+    natsCodec   *codec = NULL;
+
+    codec = (natsCodec*) NATS_CALLOC(1, sizeof(natsCodec));
+    if (codec == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    codec->id      = id;
+    codec->encoder = encoder;
+    codec->decoder = decoder;
+    codec->closure = closure;
+    codec->minSize = minSize;
+
+    s = natsBuf_Create(&(codec->encBuf), 1024);
+    if (s == NATS_OK)
+        s = natsBuf_Create(&(codec->decBuf), 1024);
+    if ((s == NATS_OK) && (id == NATS_CODEC_LZ4))
+    {
+        codec->lz4Table = (uint32_t*) NATS_CALLOC(_LZ4_TABLE_SIZE, sizeof(uint32_t));
+        if (codec->lz4Table == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    if (s == NATS_OK)
+        *newCodec = codec;
+    else
+        natsCodec_Destroy(codec);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Makes sure that the buffer can hold 'size' bytes, without preserving
+// its content.
+static natsStatus
+_reserve(natsBuffer *buf, int size)
+{
+    natsStatus s = NATS_OK;
+
+    natsBuf_Reset(buf);
+
+    if (natsBuf_Capacity(buf) < size)
+        s = natsBuf_Expand(buf, size);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static void
+_writeHeader(char *hdr, int id, int dataLen)
+{
+    memcpy(hdr, NATS_CODEC_MARKER, NATS_CODEC_MARKER_LEN);
+    hdr[3] = (char) id;
+    hdr[4] = (char) ((dataLen >> 24) & 0xFF);
+    hdr[5] = (char) ((dataLen >> 16) & 0xFF);
+    hdr[6] = (char) ((dataLen >> 8) & 0xFF);
+    hdr[7] = (char) (dataLen & 0xFF);
+}
+
+// Returns true if the payload made of the 'iovcnt' fragments of 'iov' starts
+// with the marker of encoded payloads.
+static bool
+_startsWithMarker(const natsIOVec *iov, int iovcnt)
+{
+    char    start[NATS_CODEC_MARKER_LEN];
+    int     n = 0;
+
+    for (int i=0; (i<iovcnt) && (n < NATS_CODEC_MARKER_LEN); i++)
+    {
+        int len = iov[i].len;
+
+        if (len > NATS_CODEC_MARKER_LEN - n)
+            len = NATS_CODEC_MARKER_LEN - n;
+
+        memcpy(start + n, iov[i].data, len);
+        n += len;
+    }
+
+    return ((n == NATS_CODEC_MARKER_LEN)
+            && (memcmp(start, NATS_CODEC_MARKER, NATS_CODEC_MARKER_LEN) == 0));
+}
+
+natsStatus
+natsCodec_Encode(natsCodec *codec, const natsIOVec *iov, int iovcnt,
+                 int dataLen, const char **out, int *outLen)
+{
+    natsStatus  s       = NATS_OK;
+    const char  *src    = NULL;
+    char        *dst    = NULL;
+    int         srcOff  = 0;
+    int         encLen  = 0;
+    bool        encode;
+
+    // Encoding is worth it only if it saves more than the header.
+    int         dstCap  = dataLen - NATS_CODEC_HDR_LEN - 1;
+
+    *out = NULL;
+
+    // A payload shorter than the header can't be mistaken for an encoded
+    // one, and would not gain anything.
+    if (dataLen < NATS_CODEC_HDR_LEN)
+        return NATS_OK;
+
+    encode = ((dataLen >= codec->minSize) && (dstCap > 0));
+    if (!encode && !_startsWithMarker(iov, iovcnt))
+        return NATS_OK;
+
+    // The fragments of the payload are first gathered at the start of the
+    // buffer, and encoded after them.
+    if (iovcnt > 1)
+        srcOff = dataLen;
+
+    s = _reserve(codec->encBuf, srcOff + NATS_CODEC_HDR_LEN + dataLen);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (iovcnt > 1)
+    {
+        char *ptr = natsBuf_Data(codec->encBuf);
+
+        for (int i=0; i<iovcnt; i++)
+        {
+            memcpy(ptr, iov[i].data, iov[i].len);
+            ptr += iov[i].len;
+        }
+        src = natsBuf_Data(codec->encBuf);
+    }
+    else
+    {
+        src = (const char*) iov[0].data;
+    }
+
+    dst = natsBuf_Data(codec->encBuf) + srcOff;
+
+    if (encode && (codec->lz4Table != NULL))
+    {
+        encLen = natsLZ4_Compress(codec->lz4Table, src, dataLen,
+                                  dst + NATS_CODEC_HDR_LEN, dstCap);
+    }
+    else if (encode)
+    {
+        // The encoder fails if the result does not fit.
+        encLen = dstCap;
+        if (((*(codec->encoder))(dst + NATS_CODEC_HDR_LEN, &encLen,
+                                 src, dataLen, codec->closure) != NATS_OK)
+            || (encLen <= 0) || (encLen > dstCap))
+        {
+            encLen = 0;
+        }
+    }
+
+    if (encLen > 0)
+    {
+        _writeHeader(dst, codec->id, dataLen);
+    }
+    else if (_startsWithMarker(iov, iovcnt))
+    {
+        // Not encoded, but needs to be told apart from an encoded payload.
+        _writeHeader(dst, NATS_CODEC_STORED, dataLen);
+        memmove(dst + NATS_CODEC_HDR_LEN, src, dataLen);
+        encLen = dataLen;
+    }
+    else
+    {
+        return NATS_OK;
+    }
+
+    *out    = dst;
+    *outLen = NATS_CODEC_HDR_LEN + encLen;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsCodec_Decode(natsCodec *codec, const char *data, int dataLen,
+                 int64_t maxLen, const char **out, int *outLen)
+{
+    natsStatus      s       = NATS_OK;
+    const uint8_t   *hdr    = (const uint8_t*) data;
+    const char      *src    = data + NATS_CODEC_HDR_LEN;
+    int             srcLen  = dataLen - NATS_CODEC_HDR_LEN;
+    int             id;
+    int             origLen;
+    bool            ok      = false;
+
+    *out = NULL;
+
+    if ((dataLen < NATS_CODEC_HDR_LEN)
+        || (memcmp(data, NATS_CODEC_MARKER, NATS_CODEC_MARKER_LEN) != 0))
+    {
+        return NATS_OK;
+    }
+
+    id      = hdr[3];
+    origLen = (int) (((uint32_t) hdr[4] << 24) | ((uint32_t) hdr[5] << 16)
+                     | ((uint32_t) hdr[6] << 8) | (uint32_t) hdr[7]);
+
+    if (id == NATS_CODEC_STORED)
+    {
+        if (origLen == srcLen)
+        {
+            *out    = src;
+            *outLen = srcLen;
+        }
+        return NATS_OK;
+    }
+
+    // Payloads encoded with a codec we don't know are delivered as is, and
+    // so are those whose size, taken from the wire, is over the limit.
+    if ((origLen < 0)
+        || ((int64_t) origLen > maxLen)
+        || ((id != NATS_CODEC_LZ4) && ((id != codec->id) || (codec->decoder == NULL))))
+    {
+        return NATS_OK;
+    }
+
+    // An LZ4 block can't expand more than 255 times, which prevents a
+    // corrupted size from causing a large allocation.
+    if ((id == NATS_CODEC_LZ4) && ((int64_t) origLen > (int64_t) srcLen * 255))
+        return NATS_OK;
+
+    s = _reserve(codec->decBuf, origLen);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (id == NATS_CODEC_LZ4)
+        ok = natsLZ4_Decompress(src, srcLen, natsBuf_Data(codec->decBuf), origLen);
+    else
+        ok = ((*(codec->decoder))(natsBuf_Data(codec->decBuf), origLen,
+                                  src, srcLen, codec->closure) == NATS_OK);
+
+    if (ok)
+    {
+        *out    = natsBuf_Data(codec->decBuf);
+        *outLen = origLen;
+    }
+
+    return NATS_OK;
+}
+
+void
+natsCodec_Destroy(natsCodec *codec)
+{
+    if (codec == NULL)
+        return;
+
+    natsBuf_Destroy(codec->encBuf);
+    natsBuf_Destroy(codec->decBuf);
+    NATS_FREE(codec->lz4Table);
+    NATS_FREE(codec);
+}
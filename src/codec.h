@@ -0,0 +1,78 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <stdint.h>
+
+#include "status.h"
+#include "nats.h"
+#include "buf.h"
+
+// An encoded payload starts with this header: the 3 bytes of the marker,
+// the id of the codec, and the size of the original payload (4 bytes, big
+// endian). A payload that starts with the marker but was not encoded is
+// sent with the id NATS_CODEC_STORED, so that it is not mistaken for an
+// encoded one.
+#define NATS_CODEC_MARKER       "\0NZ"
+#define NATS_CODEC_MARKER_LEN   (3)
+#define NATS_CODEC_HDR_LEN      (NATS_CODEC_MARKER_LEN + 1 + 4)
+
+#define NATS_CODEC_STORED       (0)
+
+// The LZ4 compressor hashes 4 bytes sequences in a table of that many
+// entries (as a power of 2).
+#define NATS_LZ4_HASH_LOG       (12)
+
+typedef struct __natsCodec
+{
+    int                 id;
+    natsPayloadEncoder  encoder;
+    natsPayloadDecoder  decoder;
+    void                *closure;
+    int                 minSize;
+
+    // Reused for every message: the encoding buffer is protected by the
+    // connection's write lock, the decoding one is used only by the thread
+    // reading from the socket.
+    natsBuffer          *encBuf;
+    natsBuffer          *decBuf;
+    uint32_t            *lz4Table;
+
+} natsCodec;
+
+natsStatus
+natsCodec_Create(natsCodec **newCodec, int id, natsPayloadEncoder encoder,
+                 natsPayloadDecoder decoder, void *closure, int minSize);
+
+// If the payload made of the 'iovcnt' fragments of 'iov' needs to be
+// encoded, sets 'out' and 'outLen' to the encoded payload, which is in the
+// codec's buffer until the next call. Otherwise, sets 'out' to NULL.
+natsStatus
+natsCodec_Encode(natsCodec *codec, const natsIOVec *iov, int iovcnt,
+                 int dataLen, const char **out, int *outLen);
+
+// If the payload is encoded with a codec known to 'codec', sets 'out' and
+// 'outLen' to the decoded payload, which is in the codec's buffer until the
+// next call. Otherwise, or if it would decode to more than 'maxLen' bytes,
+// sets 'out' to NULL.
+natsStatus
+natsCodec_Decode(natsCodec *codec, const char *data, int dataLen,
+                 int64_t maxLen, const char **out, int *outLen);
+
+void
+natsCodec_Destroy(natsCodec *codec);
+
+// Compresses 'src' to 'dst' in the LZ4 block format. Returns the compressed
+// size, or 0 if it would not fit in 'dstCap' bytes. 'table' must have
+// (1 << NATS_LZ4_HASH_LOG) entries.
+int
+natsLZ4_Compress(uint32_t *table, const char *src, int srcLen,
+                 char *dst, int dstCap);
+
+// Decompresses the LZ4 block 'src', which must produce exactly 'dstLen'
+// bytes. Returns false if the block is corrupted.
+bool
+natsLZ4_Decompress(const char *src, int srcLen, char *dst, int dstLen);
+
+#endif /* CODEC_H_ */
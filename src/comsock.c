@@ -59,157 +59,355 @@ natsSock_SetCommonTcpOptions(natsSock fd)
 }
 
 natsStatus
-natsSock_CreateFDSet(fd_set **newFDSet)
+natsSock_WaitReady(bool forWrite, natsSockCtx *ctx)
 {
-    fd_set  *fdSet = NULL;
-
-#ifdef _WIN32
-#else
-    assert(FD_SETSIZE == 32768);
-#endif
+    natsSockPollFd  pfd;
+    int             res;
 
-    fdSet = (fd_set*) NATS_MALLOC(sizeof(fd_set));
+    pfd.fd      = ctx->fd;
+    pfd.events  = (forWrite ? NATS_POLL_OUT : NATS_POLL_IN);
+    pfd.revents = 0;
 
-    if (fdSet == NULL)
-        return nats_setDefaultError(NATS_NO_MEMORY);
+    res = natsSock_Poll(&pfd, 1, natsDeadline_GetTimeout(&(ctx->deadline)));
 
-    FD_ZERO(fdSet);
+    if (res == NATS_SOCK_ERROR)
+        return nats_setError(NATS_IO_ERROR, "poll error: %d",
+                             NATS_SOCK_GET_ERROR);
 
-    *newFDSet = fdSet;
+    // If the socket is in error, the next read or write reports it.
+    if (res == 0)
+        return nats_setDefaultError(NATS_TIMEOUT);
 
     return NATS_OK;
 }
 
-void
-natsSock_DestroyFDSet(fd_set *fdSet)
+typedef struct __natsConnAttempt
 {
-    if (fdSet == NULL)
-        return;
+    struct addrinfo *addr;
+    int             host;
+    natsSock        fd;
 
-    NATS_FREE(fdSet);
+} natsConnAttempt;
+
+// Adds the addresses of a host to 'attempts', alternating between address
+// families, starting with the family of the first address returned by the
+// resolver (RFC 8305). Returns the number of addresses added.
+static int
+_orderHostAddrs(natsConnAttempt *attempts, struct addrinfo *list, int host)
+{
+    struct addrinfo *first  = list;
+    struct addrinfo *other  = list;
+    int             count   = 0;
+
+    while ((first != NULL) || (other != NULL))
+    {
+        while ((first != NULL) && (first->ai_family != list->ai_family))
+            first = first->ai_next;
+
+        if (first != NULL)
+        {
+            attempts[count].addr = first;
+            attempts[count].host = host;
+            attempts[count].fd   = NATS_SOCK_INVALID;
+            count++;
+
+            first = first->ai_next;
+        }
+
+        while ((other != NULL) && (other->ai_family == list->ai_family))
+            other = other->ai_next;
+
+        if (other != NULL)
+        {
+            attempts[count].addr = other;
+            attempts[count].host = host;
+            attempts[count].fd   = NATS_SOCK_INVALID;
+            count++;
+
+            other = other->ai_next;
+        }
+    }
+
+    return count;
 }
 
-natsStatus
-natsSock_WaitReady(bool forWrite, natsSockCtx *ctx)
+// Returns the number of milliseconds before the deadline, or -1 if there is
+// no deadline.
+static int64_t
+_timeLeft(natsSockCtx *ctx)
 {
-    struct timeval  *timeout = NULL;
-    int             res;
-    fd_set          *fdSet = ctx->fdSet;
-    natsSock        sock = ctx->fd;
-    natsDeadline    *deadline = &(ctx->deadline);
+    int64_t left;
 
-    FD_ZERO(fdSet);
-    FD_SET(sock, fdSet);
+    if (!(ctx->deadline.active))
+        return -1;
 
-    if (deadline != NULL)
-        timeout = natsDeadline_GetTimeout(deadline);
+    left = ctx->deadline.absoluteTime - nats_Now();
 
-    res = select((int) (sock + 1),
-                 (forWrite ? NULL : fdSet),
-                 (forWrite ? fdSet : NULL),
-                 NULL,
-                 timeout);
+    return (left < 0 ? 0 : left);
+}
 
-    if (res == NATS_SOCK_ERROR)
-        return nats_setError(NATS_IO_ERROR, "select error: %d", res);
+// Starts a non-blocking connect for the given attempt. Returns true if the
+// connect is in progress or completed, in which case 'connected' indicates
+// if it has completed.
+static bool
+_startAttempt(natsConnAttempt *a, bool *connected)
+{
+    int res;
 
-    if ((res == 0) || !FD_ISSET(sock, fdSet))
-        return nats_setDefaultError(NATS_TIMEOUT);
+    *connected = false;
 
-    return NATS_OK;
+    a->fd = socket(a->addr->ai_family, a->addr->ai_socktype,
+                   a->addr->ai_protocol);
+    if (a->fd == NATS_SOCK_INVALID)
+        return false;
+
+    if (natsSock_SetBlocking(a->fd, false) != NATS_OK)
+    {
+        nats_clearLastError();
+    }
+    else
+    {
+        res = connect(a->fd, a->addr->ai_addr, (natsSockLen) a->addr->ai_addrlen);
+        if (res == 0)
+        {
+            *connected = true;
+            return true;
+        }
+        if (NATS_SOCK_GET_ERROR == NATS_SOCK_CONNECT_IN_PROGRESS)
+            return true;
+    }
+
+    _closeFd(a->fd);
+    a->fd = NATS_SOCK_INVALID;
+
+    return false;
 }
 
 natsStatus
-natsSock_ConnectTcp(natsSockCtx *ctx, const char *host, int port)
+natsSock_ConnectTcpAny(natsSockCtx *ctx, const char **hosts, const int *ports,
+                       int count, int64_t attemptDelay, int *index)
 {
-    natsStatus      s    = NATS_OK;
-    int             res;
-    char            sport[6];
+    natsStatus      s           = NATS_OK;
+    struct addrinfo **servinfo  = NULL;
+    natsConnAttempt *attempts   = NULL;
+    natsConnAttempt *ordered    = NULL;
+    int             *hostCount  = NULL;
+    natsSockPollFd  *pfds       = NULL;
+    int             numAttempts = 0;
+    int             maxAddrs    = 0;
+    int             next        = 0;
+    int             pending     = 0;
+    int             winner      = -1;
+    int64_t         lastStart   = 0;
     struct addrinfo hints;
-    struct addrinfo *servinfo = NULL;
     struct addrinfo *p;
-    bool            waitForConnect = false;
-    bool            error = false;
+    char            sport[6];
+    int             res, i, h, r;
+
+    ctx->fd = NATS_SOCK_INVALID;
 
-    if (host == NULL)
+    if (count <= 0)
         return nats_setError(NATS_ADDRESS_MISSING, "%s", "No host specified");
 
-    snprintf(sport, sizeof(sport), "%d", port);
+    for (i = 0; i < count; i++)
+    {
+        if (hosts[i] == NULL)
+            return nats_setError(NATS_ADDRESS_MISSING, "%s", "No host specified");
+    }
+
+    servinfo  = (struct addrinfo**) NATS_CALLOC(count, sizeof(struct addrinfo*));
+    hostCount = (int*) NATS_CALLOC(count, sizeof(int));
+    if ((servinfo == NULL) || (hostCount == NULL))
+        s = nats_setDefaultError(NATS_NO_MEMORY);
 
-    memset(&hints,0,sizeof(hints));
+    memset(&hints, 0, sizeof(hints));
 
-    hints.ai_family = AF_INET6;
+    hints.ai_family   = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
 
-    // Start with IPv6, if it fails, try IPv4.
-    // TODO: Should this be some kind of option that would dictate the order?
-    //       This would be beneficial performance wise.
-    if ((res = getaddrinfo(host, sport, &hints, &servinfo)) != 0)
+    // Resolve all hosts. A host that can't be resolved is skipped, unless
+    // none can be.
+    for (i = 0; (s == NATS_OK) && (i < count); i++)
     {
-         hints.ai_family = AF_INET;
+        snprintf(sport, sizeof(sport), "%d", ports[i]);
 
-         if ((res = getaddrinfo(host, sport, &hints, &servinfo)) != 0)
-         {
-             s = nats_setError(NATS_SYS_ERROR, "getaddrinfo error: %s",
-                               gai_strerror(res));
-         }
+        if ((res = getaddrinfo(hosts[i], sport, &hints, &(servinfo[i]))) != 0)
+        {
+            servinfo[i] = NULL;
+            if ((numAttempts == 0) && (i == count - 1))
+                s = nats_setError(NATS_SYS_ERROR, "getaddrinfo error: %s",
+                                  gai_strerror(res));
+            continue;
+        }
+        for (p = servinfo[i]; p != NULL; p = p->ai_next)
+            numAttempts++;
     }
-    for (p = servinfo; (s == NATS_OK) && (p != NULL); p = p->ai_next)
+    if ((s == NATS_OK) && (numAttempts == 0))
+        s = nats_setDefaultError(NATS_NO_SERVER);
+    if (s == NATS_OK)
     {
-        ctx->fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (ctx->fd == NATS_SOCK_INVALID)
-            continue;
-
-        error = false;
+        attempts = (natsConnAttempt*) NATS_CALLOC(numAttempts, sizeof(natsConnAttempt));
+        ordered  = (natsConnAttempt*) NATS_CALLOC(numAttempts, sizeof(natsConnAttempt));
+        pfds     = (natsSockPollFd*) NATS_CALLOC(numAttempts, sizeof(natsSockPollFd));
+        if ((attempts == NULL) || (ordered == NULL) || (pfds == NULL))
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if (s == NATS_OK)
+    {
+        // Order the addresses of each host, then interleave the hosts so
+        // that the first address of each host is tried before the second
+        // address of any of them.
+        for (i = 0, h = 0; h < count; h++)
+        {
+            if (servinfo[h] == NULL)
+                continue;
 
-        s = natsSock_SetBlocking(ctx->fd, false);
-        if (s != NATS_OK)
-            break;
+            hostCount[h] = _orderHostAddrs(ordered + i, servinfo[h], h);
+            if (hostCount[h] > maxAddrs)
+                maxAddrs = hostCount[h];
 
-        res = connect(ctx->fd, p->ai_addr, (natsSockLen) p->ai_addrlen);
-        if ((res == NATS_SOCK_ERROR)
-            && (NATS_SOCK_GET_ERROR != NATS_SOCK_CONNECT_IN_PROGRESS))
-        {
-            error = true;
+            i += hostCount[h];
         }
-        else if (res == NATS_SOCK_ERROR)
+        numAttempts = 0;
+        for (r = 0; r < maxAddrs; r++)
         {
-            waitForConnect = true;
+            for (i = 0, h = 0; h < count; i += hostCount[h], h++)
+            {
+                if (r < hostCount[h])
+                    attempts[numAttempts++] = ordered[i + r];
+            }
         }
+    }
+
+    // Start the attempts one after the other, 'attemptDelay' apart, or as
+    // soon as the previous one fails, until one of them connects.
+    while ((s == NATS_OK) && (winner < 0))
+    {
+        int64_t         wait  = -1;
+        int64_t         left  = _timeLeft(ctx);
+        int             n     = 0;
+        bool            connected;
 
-        if (!error)
+        if ((next < numAttempts)
+            && ((pending == 0) || (nats_Now() - lastStart >= attemptDelay)))
         {
-            if (waitForConnect
-                && ((natsSock_WaitReady(true, ctx) != NATS_OK)
-                    || !natsSock_IsConnected(ctx->fd)))
+            lastStart = nats_Now();
+
+            if (_startAttempt(&(attempts[next]), &connected))
             {
-                error = true;
+                pending++;
+                if (connected)
+                    winner = next;
             }
+            next++;
+            continue;
         }
 
-        if (error)
+        if (pending == 0)
         {
-            _closeFd(ctx->fd);
-            ctx->fd = NATS_SOCK_INVALID;
-            continue;
+            s = nats_setDefaultError(NATS_NO_SERVER);
+            break;
+        }
+        if (left == 0)
+        {
+            s = nats_setDefaultError(NATS_NO_SERVER);
+            break;
         }
 
-        s = natsSock_SetCommonTcpOptions(ctx->fd);
+        if (next < numAttempts)
+        {
+            wait = attemptDelay - (nats_Now() - lastStart);
+            if (wait < 0)
+                wait = 0;
+        }
+        if ((left > 0) && ((wait < 0) || (left < wait)))
+            wait = left;
+
+        // The sockets are polled in the order of their attempts.
+        for (i = 0; i < next; i++)
+        {
+            if (attempts[i].fd == NATS_SOCK_INVALID)
+                continue;
+
+            pfds[n].fd      = attempts[i].fd;
+            pfds[n].events  = NATS_POLL_OUT;
+            pfds[n].revents = 0;
+            n++;
+        }
+
+        res = natsSock_Poll(pfds, n, wait);
+
+        if (res == NATS_SOCK_ERROR)
+        {
+            s = nats_setError(NATS_IO_ERROR, "poll error: %d",
+                              NATS_SOCK_GET_ERROR);
+            break;
+        }
+
+        for (i = 0, n = 0; (res > 0) && (winner < 0) && (i < next); i++)
+        {
+            natsSock fd = attempts[i].fd;
+
+            if ((fd == NATS_SOCK_INVALID) || (pfds[n++].revents == 0))
+                continue;
+
+            if (natsSock_IsConnected(fd))
+            {
+                winner = i;
+            }
+            else
+            {
+                // Start the next attempt without waiting.
+                _closeFd(fd);
+                attempts[i].fd = NATS_SOCK_INVALID;
+                pending--;
+                lastStart = 0;
+            }
+        }
     }
 
-    if (s == NATS_OK)
+    if (winner >= 0)
     {
-        if (ctx->fd == NATS_SOCK_INVALID)
-            s = nats_setDefaultError(NATS_NO_SERVER);
+        ctx->fd             = attempts[winner].fd;
+        attempts[winner].fd = NATS_SOCK_INVALID;
+
+        s = natsSock_SetCommonTcpOptions(ctx->fd);
+        if ((s == NATS_OK) && (index != NULL))
+            *index = attempts[winner].host;
     }
 
+    // Abandon the attempts that are still in progress.
+    for (i = 0; (attempts != NULL) && (i < next); i++)
+        _closeFd(attempts[i].fd);
+
     if (s != NATS_OK)
     {
         _closeFd(ctx->fd);
         ctx->fd = NATS_SOCK_INVALID;
     }
 
-    freeaddrinfo(servinfo);
+    for (i = 0; (servinfo != NULL) && (i < count); i++)
+    {
+        if (servinfo[i] != NULL)
+            freeaddrinfo(servinfo[i]);
+    }
+
+    NATS_FREE(pfds);
+    NATS_FREE(ordered);
+    NATS_FREE(attempts);
+    NATS_FREE(hostCount);
+    NATS_FREE(servinfo);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsSock_ConnectTcp(natsSockCtx *ctx, const char *host, int port)
+{
+    natsStatus s;
+
+    s = natsSock_ConnectTcpAny(ctx, &host, &port, 1,
+                               NATS_SOCK_CONNECT_ATTEMPT_DELAY, NULL);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
@@ -328,8 +526,6 @@ natsSock_Read(natsSockCtx *ctx, char *buffer, size_t maxBufferSize, int *n)
                                          NATS_SSL_ERR_REASON_STRING);
                 }
 
-                if (ctx->fdSet == NULL)
-                    continue;
             }
             else
 #endif
@@ -357,6 +553,167 @@ natsSock_Read(natsSockCtx *ctx, char *buffer, size_t maxBufferSize, int *n)
     return NATS_OK;
 }
 
+natsStatus
+natsSock_ReadBusyPoll(natsSockCtx *ctx, char *buffer, size_t maxBufferSize,
+                      int *n, int64_t spin)
+{
+#if defined(MSG_DONTWAIT)
+    int64_t deadline  = 0;
+    int     readBytes = 0;
+    bool    tls       = (ctx->ssl != NULL);
+
+    while (true)
+    {
+#if defined(NATS_HAS_TLS)
+        if (tls)
+        {
+            char c;
+
+            // Only check if there is something to read, SSL_read() may still
+            // block if a record is not complete.
+            if (SSL_pending(ctx->ssl) > 0)
+                break;
+
+            readBytes = recv(ctx->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        }
+        else
+#endif
+            readBytes = recv(ctx->fd, buffer, (natsRecvLen) maxBufferSize,
+                             MSG_DONTWAIT);
+
+        if (tls && (readBytes >= 0))
+            break;
+
+        if (readBytes > 0)
+        {
+            if (n != NULL)
+                *n = readBytes;
+
+            return NATS_OK;
+        }
+        else if (readBytes == 0)
+        {
+            return NATS_CONNECTION_CLOSED;
+        }
+        else if ((NATS_SOCK_GET_ERROR != NATS_SOCK_WOULD_BLOCK)
+                 && (NATS_SOCK_GET_ERROR != EAGAIN))
+        {
+            // Let the read below report the error.
+            if (tls)
+                break;
+
+            return nats_setError(NATS_IO_ERROR, "recv error: %d",
+                                 NATS_SOCK_GET_ERROR);
+        }
+
+        if (deadline == 0)
+            deadline = nats_NowInNanoSeconds() + spin;
+        else if (nats_NowInNanoSeconds() >= deadline)
+            break;
+    }
+#endif
+
+    return natsSock_Read(ctx, buffer, maxBufferSize, n);
+}
+
+natsStatus
+natsSock_TryRead(natsSockCtx *ctx, char *buffer, size_t maxBufferSize, int *n)
+{
+    int readBytes = 0;
+
+    *n = 0;
+
+#if defined(NATS_HAS_TLS)
+    if (ctx->ssl != NULL)
+        readBytes = SSL_read(ctx->ssl, buffer, (int) maxBufferSize);
+    else
+#endif
+        readBytes = recv(ctx->fd, buffer, (natsRecvLen) maxBufferSize, 0);
+
+    if (readBytes == 0)
+    {
+        return NATS_CONNECTION_CLOSED;
+    }
+    else if (readBytes == NATS_SOCK_ERROR)
+    {
+#if defined(NATS_HAS_TLS)
+        if (ctx->ssl != NULL)
+        {
+            int sslErr = SSL_get_error(ctx->ssl, readBytes);
+
+            if ((sslErr != SSL_ERROR_WANT_READ)
+                && (sslErr != SSL_ERROR_WANT_WRITE))
+            {
+                return nats_setError(NATS_IO_ERROR, "SSL_read error: %s",
+                                     NATS_SSL_ERR_REASON_STRING);
+            }
+
+            return NATS_OK;
+        }
+#endif
+        if (NATS_SOCK_GET_ERROR != NATS_SOCK_WOULD_BLOCK)
+        {
+            return nats_setError(NATS_IO_ERROR, "recv error: %d",
+                                 NATS_SOCK_GET_ERROR);
+        }
+
+        return NATS_OK;
+    }
+
+    *n = readBytes;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSock_TryWrite(natsSockCtx *ctx, const char *data, int len, int *n)
+{
+    int bytes = 0;
+
+    *n = 0;
+
+#if defined(NATS_HAS_TLS)
+    if (ctx->ssl != NULL)
+        bytes = SSL_write(ctx->ssl, data, len);
+    else
+#endif
+        bytes = send(ctx->fd, data, len, 0);
+
+    if (bytes == 0)
+    {
+        return NATS_CONNECTION_CLOSED;
+    }
+    else if (bytes == NATS_SOCK_ERROR)
+    {
+#if defined(NATS_HAS_TLS)
+        if (ctx->ssl != NULL)
+        {
+            int sslErr = SSL_get_error(ctx->ssl, bytes);
+
+            if ((sslErr != SSL_ERROR_WANT_READ)
+                && (sslErr != SSL_ERROR_WANT_WRITE))
+            {
+                return nats_setError(NATS_IO_ERROR, "SSL_write error: %s",
+                                     NATS_SSL_ERR_REASON_STRING);
+            }
+
+            return NATS_OK;
+        }
+#endif
+        if (NATS_SOCK_GET_ERROR != NATS_SOCK_WOULD_BLOCK)
+        {
+            return nats_setError(NATS_IO_ERROR, "send error: %d",
+                                 NATS_SOCK_GET_ERROR);
+        }
+
+        return NATS_OK;
+    }
+
+    *n = bytes;
+
+    return NATS_OK;
+}
+
 natsStatus
 natsSock_WriteFully(natsSockCtx *ctx, const char *data, int len)
 {
@@ -389,8 +746,6 @@ natsSock_WriteFully(natsSockCtx *ctx, const char *data, int len)
                                          NATS_SSL_ERR_REASON_STRING);
                 }
 
-                if (ctx->fdSet == NULL)
-                    continue;
             }
             else
 #endif
@@ -416,3 +771,65 @@ natsSock_WriteFully(natsSockCtx *ctx, const char *data, int len)
 
     return NATS_OK;
 }
+
+natsStatus
+natsSock_WriteFullyV(natsSockCtx *ctx, natsSockIOVec *iov, int count)
+{
+    natsStatus  s     = NATS_OK;
+    int         bytes = 0;
+
+#if defined(NATS_HAS_TLS)
+    // There is no gathering write with SSL, write the buffers one at a time.
+    if (ctx->ssl != NULL)
+    {
+        for (int i=0; (s == NATS_OK) && (i<count); i++)
+        {
+            if (NATS_IOVEC_LEN(iov[i]) > 0)
+                s = natsSock_WriteFully(ctx, NATS_IOVEC_BASE(iov[i]),
+                                        NATS_IOVEC_LEN(iov[i]));
+        }
+
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+#endif
+
+    while (count > 0)
+    {
+        bytes = natsSock_SendV(ctx->fd, iov, count);
+
+        if (bytes == 0)
+        {
+            return NATS_CONNECTION_CLOSED;
+        }
+        else if (bytes == NATS_SOCK_ERROR)
+        {
+            if (NATS_SOCK_GET_ERROR != NATS_SOCK_WOULD_BLOCK)
+            {
+                return nats_setError(NATS_IO_ERROR, "writev error: %d",
+                                     NATS_SOCK_GET_ERROR);
+            }
+
+            // For non-blocking sockets, if the write would block, we need to
+            // wait up to the deadline.
+            s = natsSock_WaitReady(true, ctx);
+            if (s != NATS_OK)
+                return NATS_UPDATE_ERR_STACK(s);
+
+            continue;
+        }
+
+        // Skip the buffers that have been fully written, and adjust the
+        // one that has been partially written.
+        while ((count > 0) && (bytes >= NATS_IOVEC_LEN(iov[0])))
+        {
+            bytes -= NATS_IOVEC_LEN(iov[0]);
+            iov++;
+            count--;
+        }
+        if (bytes > 0)
+            NATS_IOVEC_SET(iov[0], NATS_IOVEC_BASE(iov[0]) + bytes,
+                           NATS_IOVEC_LEN(iov[0]) - bytes);
+    }
+
+    return NATS_OK;
+}
@@ -5,17 +5,35 @@
 
 #include "natsp.h"
 
+// Default delay, in milliseconds, between the start of two connection
+// attempts (RFC 8305).
+#define NATS_SOCK_CONNECT_ATTEMPT_DELAY (250)
+
 natsStatus
 natsSock_ConnectTcp(natsSockCtx *ctx, const char *host, int port);
 
+// Connects to the first of the 'count' hosts to accept a connection. All
+// addresses of all hosts are tried, alternating between address families and
+// hosts, starting a new non-blocking connect every 'attemptDelay'
+// milliseconds, or as soon as an attempt fails, without waiting for the
+// previous ones to complete. The wait is bounded by the context's deadline.
+// On success, 'index' (if not NULL) is set to the index of the host.
+natsStatus
+natsSock_ConnectTcpAny(natsSockCtx *ctx, const char **hosts, const int *ports,
+                       int count, int64_t attemptDelay, int *index);
+
 natsStatus
 natsSock_SetBlocking(natsSock fd, bool blocking);
 
+// Sets the SO_BUSY_POLL option, when supported by the platform.
 natsStatus
-natsSock_CreateFDSet(fd_set **newFDSet);
+natsSock_SetBusyPoll(natsSock fd, int64_t spinMicros);
 
-void
-natsSock_DestroyFDSet(fd_set *fdSet);
+// Waits up to 'timeout' milliseconds (no limit if negative) for one of the
+// sockets to be ready, as poll() does, and returns the number of sockets
+// that are, 0 on timeout or NATS_SOCK_ERROR.
+int
+natsSock_Poll(natsSockPollFd *fds, int count, int64_t timeout);
 
 bool
 natsSock_IsConnected(natsSock fd);
@@ -46,6 +64,35 @@ natsSock_Read(natsSockCtx *ctx, char *buffer, size_t maxBufferSize, int *n);
 natsStatus
 natsSock_WriteFully(natsSockCtx *ctx, const char *data, int len);
 
+// Performs a single gathering write of the 'count' buffers described by 'iov'
+// and returns the number of bytes sent, or NATS_SOCK_ERROR. Platform specific.
+int
+natsSock_SendV(natsSock fd, natsSockIOVec *iov, int count);
+
+// Writes all the buffers described by 'iov', in order, to the socket. This
+// avoids copying them into a single buffer first. Does not return until all
+// bytes have been written, unless the socket is closed or an error occurs.
+// The content of 'iov' is modified by this call.
+natsStatus
+natsSock_WriteFullyV(natsSockCtx *ctx, natsSockIOVec *iov, int count);
+
+// Performs a single read attempt on a non-blocking socket. If no data is
+// available, NATS_OK is returned and 'n' is set to 0.
+// Same as natsSock_Read(), but first spins for up to 'spin' nanoseconds on
+// non-blocking reads before blocking. Spinning is not supported on Windows.
+natsStatus
+natsSock_ReadBusyPoll(natsSockCtx *ctx, char *buffer, size_t maxBufferSize,
+                      int *n, int64_t spin);
+
+natsStatus
+natsSock_TryRead(natsSockCtx *ctx, char *buffer, size_t maxBufferSize, int *n);
+
+// Performs a single write attempt on a non-blocking socket. On success, 'n'
+// contains the number of bytes written, which may be less than 'len' (or 0)
+// if the write would block.
+natsStatus
+natsSock_TryWrite(natsSockCtx *ctx, const char *data, int len, int *n);
+
 natsStatus
 natsSock_Flush(natsSock fd);
 
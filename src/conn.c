@@ -20,10 +20,33 @@
 #include "msg.h"
 #include "asynccb.h"
 #include "comsock.h"
+#include "probes.h"
 
 #define DEFAULT_SCRATCH_SIZE    (512)
-#define DEFAULT_BUF_SIZE        (32768)
-#define DEFAULT_PENDING_SIZE    (1024 * 1024)
+// Size of the buffer used to read the protocol lines exchanged while
+// connecting. The INFO line can be long (it lists the cluster's URLs), but
+// the buffer is only allocated for the duration of the handshake.
+#define CONTROL_LINE_BUF_SIZE   (32768)
+#define PENDING_CHUNK_SIZE      (64 * 1024)
+#define PENDING_MAX_FREE_CHUNKS (16)
+#define PENDING_REPLAY_CHUNK    (64 * 1024)
+#define PENDING_REPLAY_IOV      (8)
+#define PENDING_PROTO_TAIL      (32)
+#define SUBJ_CACHE_MAX          (256)
+
+#define CALLER_DRIVEN_IO_ERR    "The connection does not have caller driven I/O"
+#define LOCAL_DLV_ERR           "Queue and stream subscriptions are not supported with local delivery"
+
+// Upper bound of the size of the SUB and UNSUB protocols of a subscription,
+// excluding the subject and queue name.
+#define SUB_REPLAY_OVERHEAD     (64)
+
+// Max number of payload fragments of a message sent with a single
+// gathering write.
+#define MAX_MSG_IOV             (16)
+
+// Max size of the payload of a TLS record. The write buffer holds two.
+#define NATS_TLS_RECORD_SIZE    (16384)
 
 #ifdef DEV_MODE
 // For type safety
@@ -34,6 +57,9 @@ static void _release(natsConnection *nc) { nc->refs--; }
 void natsConn_Lock(natsConnection *nc)   { natsMutex_Lock(nc->mu);   }
 void natsConn_Unlock(natsConnection *nc) { natsMutex_Unlock(nc->mu); }
 
+void natsConn_writeLock(natsConnection *nc)   { natsMutex_Lock(nc->wmu);   }
+void natsConn_writeUnlock(natsConnection *nc) { natsMutex_Unlock(nc->wmu); }
+
 #else
 // We know what we are doing :-)
 
@@ -54,16 +80,25 @@ _processConnInit(natsConnection *nc);
 static void
 _close(natsConnection *nc, natsConnStatus status, bool doCBs);
 
+static void
+_cleanupSocketWatchers(natsConnection *nc);
+
+static void
+_setErrIfNone(natsConnection *nc, natsStatus s);
+
 /*
  * ----------------------------------------
  */
 
 struct threadsToJoin
 {
-    natsThread  *readLoop;
-    natsThread  *flusher;
-    natsThread  *reconnect;
-    bool        joinReconnect;
+    natsThread      *readLoop;
+    natsThread      *flusher;
+    natsThread      *reconnect;
+    bool            joinReconnect;
+
+    natsConnection  *nc;
+    natsEvLoopConn  *evConn;
 
 } threadsToJoin;
 
@@ -86,6 +121,8 @@ _initThreadsToJoin(struct threadsToJoin *ttj, natsConnection *nc, bool joinRecon
         nc->reconnectThread = NULL;
     }
 
+    natsConn_writeLock(nc);
+
     if (nc->flusherThread != NULL)
     {
         nc->flusherStop = true;
@@ -94,6 +131,15 @@ _initThreadsToJoin(struct threadsToJoin *ttj, natsConnection *nc, bool joinRecon
         ttj->flusher = nc->flusherThread;
         nc->flusherThread = NULL;
     }
+
+    if (nc->evConn != NULL)
+    {
+        ttj->nc     = nc;
+        ttj->evConn = nc->evConn;
+        nc->evConn  = NULL;
+    }
+
+    natsConn_writeUnlock(nc);
 }
 
 static void
@@ -116,6 +162,25 @@ _joinThreads(struct threadsToJoin *ttj)
         natsThread_Join(ttj->flusher);
         natsThread_Destroy(ttj->flusher);
     }
+
+    if (ttj->evConn != NULL)
+    {
+        natsConnection *nc = ttj->nc;
+
+        // If we are called from within an event loop callback, the
+        // callback will do the cleanup when returning.
+        if (natsEvLoop_Detach(ttj->evConn))
+        {
+            natsConn_Lock(nc);
+            _cleanupSocketWatchers(nc);
+        }
+        else
+        {
+            natsConn_Lock(nc);
+            nc->evLoopCleanup = true;
+            natsConn_Unlock(nc);
+        }
+    }
 }
 
 static void
@@ -128,6 +193,185 @@ _clearServerInfo(natsServerInfo *si)
     memset(si, 0, sizeof(natsServerInfo));
 }
 
+// Closes the spill file of the reconnect buffer, if any. The file is a
+// temporary file, so it is removed when closed.
+static void
+_closePendingFile(natsConnection *nc)
+{
+    if (nc->pendingFile != NULL)
+        fclose(nc->pendingFile);
+
+    nc->pendingFile     = NULL;
+    nc->pendingFileSize = 0;
+    nc->pendingFileRead = 0;
+    nc->pendingToFile   = false;
+}
+
+static void
+_destroyPending(natsConnection *nc)
+{
+    natsChain_Destroy(nc->pending);
+    nc->pending     = NULL;
+    nc->usePending  = false;
+
+    _closePendingFile(nc);
+}
+
+static bool
+_hasPending(natsConnection *nc)
+{
+    return ((nc->pending != NULL)
+            && ((natsChain_Len(nc->pending) > 0)
+                || (nc->pendingFileRead < nc->pendingFileSize)));
+}
+
+// Returns the length of the complete protocol at 'offset' in the pending
+// buffer, that is, the protocol line and, for a PUB, the payload and its
+// CRLF. Returns 0 if the protocol is incomplete.
+static int
+_pendingProtoLen(natsConnection *nc, int offset, bool *isPub)
+{
+    char        line[PENDING_PROTO_TAIL];
+    int         len   = natsChain_Len(nc->pending) - offset;
+    int         eol   = natsChain_IndexOf(nc->pending, offset, '\n');
+    int         n     = 0;
+    int         tail  = 0;
+    int         size  = 0;
+    int64_t     dataLen;
+
+    *isPub = false;
+
+    if (eol < 0)
+        return 0;
+
+    n = eol - offset + 1;
+
+    if (n <= _PUB_P_LEN_ + _CRLF_LEN_)
+        return n;
+
+    natsChain_Copy(nc->pending, offset, line, _PUB_P_LEN_);
+    if (memcmp(line, _PUB_P_, _PUB_P_LEN_) != 0)
+        return n;
+
+    // The payload size is the last field of the protocol line. Only the end
+    // of the line (without the CRLF) is needed to find it.
+    tail = n - _CRLF_LEN_;
+    if (tail > (int) sizeof(line))
+        tail = (int) sizeof(line);
+
+    natsChain_Copy(nc->pending, eol - 1 - tail, line, tail);
+    for (size = tail; (size > 0) && (line[size - 1] != ' '); size--) {}
+
+    dataLen = nats_ParseInt64(line + size, tail - size);
+    if ((dataLen < 0) || ((int64_t) n + dataLen + _CRLF_LEN_ > (int64_t) len))
+        return 0;
+
+    *isPub = true;
+
+    return n + (int) dataLen + _CRLF_LEN_;
+}
+
+// Makes sure that 'needed' more bytes can be buffered while reconnecting,
+// applying the reconnect buffer policy if the limit is reached.
+static natsStatus
+_checkPendingLimit(natsConnection *nc, int needed)
+{
+    natsOptions *opts   = nc->opts;
+    int64_t     max     = opts->reconnectBufSize;
+    int         used    = 0;
+    int         n       = 0;
+    bool        isPub   = false;
+
+    if ((max == 0) || nc->pendingToFile)
+        return NATS_OK;
+
+    used = natsChain_Len(nc->pending);
+    if ((int64_t) used + needed <= max)
+        return NATS_OK;
+
+    if (opts->reconnectBufPolicy == NATS_RECONNECT_BUF_SPILL)
+    {
+        if (nc->pendingFile == NULL)
+        {
+            nc->pendingFile = tmpfile();
+            if (nc->pendingFile == NULL)
+                return nats_setError(NATS_SYS_ERROR,
+                                     "unable to create the reconnect spill file: %d",
+                                     errno);
+        }
+
+        // Everything now goes to the file until it has been replayed, so
+        // that ordering is preserved.
+        nc->pendingToFile = true;
+
+        return NATS_OK;
+    }
+
+    if (opts->reconnectBufPolicy == NATS_RECONNECT_BUF_DROP_OLDEST)
+    {
+        while (((int64_t) used + needed > max)
+               && ((n = _pendingProtoLen(nc, 0, &isPub)) > 0)
+               && isPub)
+        {
+            natsChain_Consume(nc->pending, n);
+            used -= n;
+        }
+        if ((int64_t) used + needed <= max)
+            return NATS_OK;
+    }
+
+    return nats_setError(NATS_INSUFFICIENT_BUFFER,
+                         "reconnect buffer limit of %" PRId64 " bytes reached",
+                         max);
+}
+
+// Appends to the reconnect buffer, or to its spill file. The limit is not
+// checked here.
+static natsStatus
+_appendPending(natsConnection *nc, const char *data, int len)
+{
+    natsStatus s = NATS_OK;
+
+    if (len <= 0)
+        return NATS_OK;
+
+    if (nc->pendingToFile)
+    {
+        if ((nats_fseek(nc->pendingFile, nc->pendingFileSize) != 0)
+            || (fwrite(data, 1, (size_t) len, nc->pendingFile) != (size_t) len))
+        {
+            return nats_setError(NATS_SYS_ERROR,
+                                 "error writing to the reconnect spill file: %d",
+                                 errno);
+        }
+        nc->pendingFileSize += len;
+
+        return NATS_OK;
+    }
+
+    s = natsChain_Append(nc->pending, data, len);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static void
+_destroySubjCache(natsConnection *nc)
+{
+    natsStrHashIter iter;
+    void            *subj = NULL;
+
+    if (nc->subjCache == NULL)
+        return;
+
+    natsStrHashIter_Init(&iter, nc->subjCache);
+    while (natsStrHashIter_Next(&iter, NULL, &subj))
+        natsSubject_Release((natsSubject*) subj);
+    natsStrHashIter_Done(&iter);
+
+    natsStrHash_Destroy(nc->subjCache);
+    nc->subjCache = NULL;
+}
+
 static void
 _freeConn(natsConnection *nc)
 {
@@ -135,21 +379,32 @@ _freeConn(natsConnection *nc)
         return;
 
     natsTimer_Destroy(nc->ptmr);
-    natsBuf_Destroy(nc->pending);
+    _destroyPending(nc);
     natsBuf_Destroy(nc->scratch);
     natsBuf_Destroy(nc->bw);
     natsSrvPool_Destroy(nc->srvPool);
     _clearServerInfo(&(nc->info));
     natsCondition_Destroy(nc->flusherCond);
+    natsCondition_Destroy(nc->wmCond);
+    natsCondition_Destroy(nc->reconnectCond);
     natsCondition_Destroy(nc->pongs.cond);
     natsParser_Destroy(nc->ps);
+    natsMsgSlab_Release(nc->readSlab);
+    natsMsgPool_Release(nc->msgPool);
+    _destroySubjCache(nc);
+    natsCodec_Destroy(nc->codec);
+    natsCapture_Destroy(nc->capture);
+    NATS_FREE(nc->latency);
     natsThread_Destroy(nc->readLoopThread);
     natsThread_Destroy(nc->flusherThread);
     natsHash_Destroy(nc->subs);
+    natsHash_Destroy(nc->respMap);
+    NATS_FREE(nc->respPrefix);
     natsOptions_Destroy(nc->opts);
-    natsSock_DestroyFDSet(nc->sockCtx.fdSet);
     if (nc->sockCtx.ssl != NULL)
         SSL_free(nc->sockCtx.ssl);
+    natsMutex_Destroy(nc->subsMu);
+    natsMutex_Destroy(nc->wmu);
     natsMutex_Destroy(nc->mu);
 
     NATS_FREE(nc);
@@ -217,15 +472,19 @@ natsConn_bufferFlush(natsConnection *nc)
     if (bufLen == 0)
         return NATS_OK;
 
+    NATS_PROBE2(flush__start, bufLen, (int) nc->usePending);
+
     if (nc->usePending)
     {
-        s = natsBuf_Append(nc->pending, natsBuf_Data(nc->bw), bufLen);
+        s = _appendPending(nc, natsBuf_Data(nc->bw), bufLen);
     }
     else
     {
         s = natsSock_WriteFully(&(nc->sockCtx), natsBuf_Data(nc->bw), bufLen);
     }
 
+    NATS_PROBE2(flush__done, bufLen, (int) s);
+
     if (s == NATS_OK)
         natsBuf_Reset(nc->bw);
 
@@ -242,8 +501,16 @@ natsConn_bufferWrite(natsConnection *nc, const char *buffer, int len)
     if (len <= 0)
         return NATS_OK;
 
+    nc->writes++;
+
     if (nc->usePending)
-        return natsBuf_Append(nc->pending, buffer, len);
+    {
+        s = _checkPendingLimit(nc, len);
+        if (s == NATS_OK)
+            s = _appendPending(nc, buffer, len);
+
+        return NATS_UPDATE_ERR_STACK(s);
+    }
 
     // If we have more data that can fit..
     while ((s == NATS_OK) && (len > natsBuf_Available(nc->bw)))
@@ -285,6 +552,90 @@ natsConn_bufferWrite(natsConnection *nc, const char *buffer, int len)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+natsStatus
+natsConn_bufferWriteMsg(natsConnection *nc, const char *hdr, int hdrLen,
+                        const char *data, int dataLen)
+{
+    natsStatus  s;
+    natsIOVec   iov;
+
+    iov.data = (const void*) data;
+    iov.len  = dataLen;
+
+    s = natsConn_bufferWriteMsgV(nc, hdr, hdrLen, &iov, 1, dataLen);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_bufferWriteMsgV(natsConnection *nc, const char *hdr, int hdrLen,
+                         const natsIOVec *iov, int iovcnt, int dataLen)
+{
+    natsStatus      s = NATS_OK;
+    natsSockIOVec   sv[MAX_MSG_IOV + 3];
+    int             count = 0;
+    int             i;
+
+    nc->writes++;
+
+    // While reconnecting, the whole message is accounted against the
+    // reconnect buffer limit before being appended.
+    if (nc->usePending)
+    {
+        s = _checkPendingLimit(nc, hdrLen + dataLen + _CRLF_LEN_);
+        if (s == NATS_OK)
+            s = _appendPending(nc, hdr, hdrLen);
+        for (i=0; (s == NATS_OK) && (i<iovcnt); i++)
+            s = _appendPending(nc, (const char*) iov[i].data, iov[i].len);
+        if (s == NATS_OK)
+            s = _appendPending(nc, _CRLF_, _CRLF_LEN_);
+
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    // If the message fits in the write buffer, simply append to the buffer
+    // so that small messages are coalesced. This is also the case for
+    // payloads made of too many fragments for a single gathering write.
+    if (((hdrLen + dataLen + _CRLF_LEN_) <= natsBuf_Available(nc->bw))
+        || (iovcnt > MAX_MSG_IOV))
+    {
+        s = natsConn_bufferWrite(nc, hdr, hdrLen);
+        for (i=0; (s == NATS_OK) && (i<iovcnt); i++)
+            s = natsConn_bufferWrite(nc, (const char*) iov[i].data, iov[i].len);
+        if (s == NATS_OK)
+            s = natsConn_bufferWrite(nc, _CRLF_, _CRLF_LEN_);
+
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    // The socket write can't be avoided, so send what is already buffered,
+    // the header, the payload and the CRLF with a single gathering write,
+    // which also avoids copying the payload into the write buffer.
+    if (natsBuf_Len(nc->bw) > 0)
+    {
+        NATS_IOVEC_SET(sv[count], natsBuf_Data(nc->bw), natsBuf_Len(nc->bw));
+        count++;
+    }
+    NATS_IOVEC_SET(sv[count], hdr, hdrLen);
+    count++;
+    for (i=0; i<iovcnt; i++)
+    {
+        if (iov[i].len > 0)
+        {
+            NATS_IOVEC_SET(sv[count], iov[i].data, iov[i].len);
+            count++;
+        }
+    }
+    NATS_IOVEC_SET(sv[count], _CRLF_, _CRLF_LEN_);
+    count++;
+
+    s = natsSock_WriteFullyV(&(nc->sockCtx), sv, count);
+    if (s == NATS_OK)
+        natsBuf_Reset(nc->bw);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 natsStatus
 natsConn_bufferWriteString(natsConnection *nc, const char *string)
 {
@@ -293,26 +644,137 @@ natsConn_bufferWriteString(natsConnection *nc, const char *string)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
-// _createConn will connect to the server and do the right thing when an
-// existing connection is in place.
+// Returns the number of bytes buffered and not yet written to the socket.
+static int64_t
+_outBuffered(natsConnection *nc)
+{
+    int64_t n = (nc->bw != NULL ? (int64_t) natsBuf_Len(nc->bw) : 0);
+
+    if (nc->pending != NULL)
+    {
+        n += (int64_t) natsChain_Len(nc->pending)
+             + (nc->pendingFileSize - nc->pendingFileRead);
+    }
+
+    return n;
+}
+
+bool
+natsConn_updateWatermark(natsConnection *nc, bool *high)
+{
+    natsOptions *opts = nc->opts;
+    int64_t     buffered;
+
+    if (opts->writeHWM == 0)
+        return false;
+
+    buffered = _outBuffered(nc);
+
+    if (!(nc->wmHigh) && (buffered >= opts->writeHWM))
+    {
+        nc->wmHigh = true;
+    }
+    else if (nc->wmHigh && (buffered <= opts->writeLWM))
+    {
+        nc->wmHigh = false;
+        natsCondition_Broadcast(nc->wmCond);
+    }
+    else
+    {
+        return false;
+    }
+
+    *high = nc->wmHigh;
+
+    return (opts->watermarkCb != NULL);
+}
+
+natsStatus
+natsConn_waitWatermark(natsConnection *nc)
+{
+    natsOptions *opts    = nc->opts;
+    natsStatus  s        = NATS_OK;
+    int64_t     deadline = 0;
+
+    if (!(nc->wmHigh) || (opts->writeWMPolicy == NATS_WATERMARK_NOTIFY))
+        return NATS_OK;
+
+    if (opts->writeWMPolicy == NATS_WATERMARK_FAIL)
+        return nats_setError(NATS_INSUFFICIENT_BUFFER,
+                             "%" PRId64 " bytes buffered, over the high watermark of %" PRId64 " bytes",
+                             _outBuffered(nc), opts->writeHWM);
+
+    if (opts->writeWMTimeout > 0)
+        deadline = nats_Now() + opts->writeWMTimeout;
+
+    // The flusher (or the event loop, or the application with caller driven
+    // I/O) sends the buffer, and the reconnect thread what was buffered
+    // while reconnecting. Closing the connection releases the publishers.
+    natsConn_kickFlusher(nc);
+
+    while ((s == NATS_OK) && nc->wmHigh && !natsConn_isClosed(nc))
+    {
+        if (deadline > 0)
+            s = natsCondition_AbsoluteTimedWait(nc->wmCond, nc->wmu, deadline);
+        else
+            natsCondition_Wait(nc->wmCond, nc->wmu);
+    }
+
+    if ((s == NATS_TIMEOUT) && nc->wmHigh)
+        return nats_setError(NATS_TIMEOUT,
+                             "timeout waiting for the buffered data to drop to the low watermark of %" PRId64 " bytes",
+                             opts->writeLWM);
+
+    return NATS_OK;
+}
+
+// Creates the TCP connection to the first of the 'count' servers of the pool
+// (given by their index) that accepts it, and sets nc->url to its URL. The
+// index of the winner in 'servers' is returned in 'winner'.
 static natsStatus
-_createConn(natsConnection *nc)
+_createConnToAny(natsConnection *nc, int *servers, int count, int *winner)
 {
-    natsStatus  s = NATS_OK;
-    natsSrv     *cur = NULL;
+    natsStatus  s       = NATS_OK;
+    const char  **hosts = NULL;
+    int         *ports  = NULL;
+    int         w       = 0;
+    int         i;
 
-    cur = natsSrvPool_GetCurrentServer(nc->srvPool, nc->url, NULL);
-    if (cur == NULL)
-        return nats_setDefaultError(NATS_NO_SERVER);
+    hosts = (const char**) NATS_CALLOC(count, sizeof(char*));
+    ports = (int*) NATS_CALLOC(count, sizeof(int));
+    if ((hosts == NULL) || (ports == NULL))
+        s = nats_setDefaultError(NATS_NO_MEMORY);
 
-    cur->lastAttempt = nats_Now();
+    for (i = 0; (s == NATS_OK) && (i < count); i++)
+    {
+        natsSrv *srv = natsSrvPool_GetSrv(nc->srvPool, servers[i]);
+
+        srv->lastAttempt = nats_Now();
+
+        hosts[i] = srv->url->host;
+        ports[i] = srv->url->port;
+    }
 
     // Sets a deadline for the connect process (not just the low level
     // tcp connect. The deadline will be removed when we have received
     // the PONG to our initial PING. See _processConnInit().
     natsDeadline_Init(&(nc->sockCtx.deadline), nc->opts->timeout);
 
-    s = natsSock_ConnectTcp(&(nc->sockCtx), nc->url->host, nc->url->port);
+    if (s == NATS_OK)
+        s = natsSock_ConnectTcpAny(&(nc->sockCtx), hosts, ports, count,
+                                   nc->opts->connectAttemptDelay, &w);
+    if (s == NATS_OK)
+    {
+        nc->url = natsSrvPool_GetSrvUrl(nc->srvPool, servers[w]);
+        if (winner != NULL)
+            *winner = w;
+    }
+
+    NATS_FREE(hosts);
+    NATS_FREE(ports);
+
+    natsConn_writeLock(nc);
+
     if (s == NATS_OK)
     {
         nc->sockCtx.fdActive = true;
@@ -321,19 +783,20 @@ _createConn(natsConnection *nc)
             && (natsBuf_Len(nc->bw) > 0))
         {
             // Move to pending buffer
-            s = natsConn_bufferWrite(nc, natsBuf_Data(nc->bw),
-                                     natsBuf_Len(nc->bw));
+            s = _appendPending(nc, natsBuf_Data(nc->bw), natsBuf_Len(nc->bw));
         }
     }
 
     if (s == NATS_OK)
     {
         if (nc->bw == NULL)
-            s = natsBuf_Create(&(nc->bw), DEFAULT_BUF_SIZE);
+            s = natsBuf_Create(&(nc->bw), nc->opts->writeBufSize);
         else
             natsBuf_Reset(nc->bw);
     }
 
+    natsConn_writeUnlock(nc);
+
     if (s != NATS_OK)
     {
         // reset the deadline
@@ -343,6 +806,22 @@ _createConn(natsConnection *nc)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+// _createConn will connect to the server and do the right thing when an
+// existing connection is in place.
+static natsStatus
+_createConn(natsConnection *nc)
+{
+    natsStatus  s;
+    int         idx = 0;
+
+    if (natsSrvPool_GetCurrentServer(nc->srvPool, nc->url, &idx) == NULL)
+        return nats_setDefaultError(NATS_NO_SERVER);
+
+    s = _createConnToAny(nc, &idx, 1, NULL);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 static void
 _clearControlContent(natsControl *control)
 {
@@ -378,15 +857,21 @@ _isReconnecting(natsConnection *nc)
 static natsStatus
 _readOp(natsConnection *nc, natsControl *control)
 {
-    natsStatus  s = NATS_OK;
-    char        buffer[DEFAULT_BUF_SIZE];
+    natsStatus  s       = NATS_OK;
+    char        *buffer = NULL;
+
+    buffer = NATS_MALLOC(CONTROL_LINE_BUF_SIZE);
+    if (buffer == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
 
     buffer[0] = '\0';
 
-    s = natsSock_ReadLine(&(nc->sockCtx), buffer, sizeof(buffer));
+    s = natsSock_ReadLine(&(nc->sockCtx), buffer, CONTROL_LINE_BUF_SIZE);
     if (s == NATS_OK)
         s = nats_ParseControl(control, buffer);
 
+    NATS_FREE(buffer);
+
     return NATS_UPDATE_ERR_STACK(s);
 }
 
@@ -505,6 +990,21 @@ _processInfo(natsConnection *nc, char *info)
     if (s == NATS_OK)
         s = _parseInfo(&ptr, "max_payload", TYPE_LONG, (void**) &(nc->info.maxPayload));
 
+    // Servers don't all place the protocol version at the same position, so
+    // it is looked up from the start.
+    if (s == NATS_OK)
+    {
+        NATS_FREE(copy);
+
+        copy = NATS_STRDUP(info);
+        if (copy == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+
+        ptr = copy;
+    }
+    if (s == NATS_OK)
+        s = _parseInfo(&ptr, "proto", TYPE_INT, (void**) &(nc->info.proto));
+
 #if 0
     fprintf(stderr, "Id=%s Version=%s Host=%s Port=%d Auth=%s SSL=%s Payload=%d\n",
             nc->info.id, nc->info.version, nc->info.host, nc->info.port,
@@ -551,6 +1051,13 @@ _makeTLSConn(natsConnection *nc)
     {
         SSL_set_connect_state(ssl);
 
+#if defined(SSL_OP_ENABLE_KTLS)
+        // OpenSSL switches the socket to kernel TLS after the handshake,
+        // if the kernel and the negotiated cipher support it.
+        if (nc->opts->kernelTLS)
+            SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+
         if (SSL_set_fd(ssl, (int) nc->sockCtx.fd) != 1)
         {
             s = nats_setError(NATS_SSL_ERROR,
@@ -601,7 +1108,11 @@ _makeTLSConn(natsConnection *nc)
     }
     else
     {
-        nc->sockCtx.ssl = ssl;
+        nc->sockCtx.ssl      = ssl;
+        nc->sockCtx.ktlsSend = false;
+#if defined(BIO_get_ktls_send)
+        nc->sockCtx.ktlsSend = (BIO_get_ktls_send(SSL_get_wbio(ssl)) ? true : false);
+#endif
     }
 
     return NATS_UPDATE_ERR_STACK(s);
@@ -685,7 +1196,7 @@ _connectProto(natsConnection *nc, char **proto)
 
     res = nats_asprintf(proto,
                         "CONNECT {\"verbose\":%s,\"pedantic\":%s,%s%s%s%s%s%s%s%s%s\"tls_required\":%s," \
-                        "\"name\":\"%s\",\"lang\":\"%s\",\"version\":\"%s\"}%s",
+                        "\"name\":\"%s\",\"lang\":\"%s\",\"version\":\"%s\"%s}%s",
                         nats_GetBoolStr(opts->verbose),
                         nats_GetBoolStr(opts->pedantic),
                         (user != NULL ? "\"user\":\"" : ""),
@@ -699,7 +1210,9 @@ _connectProto(natsConnection *nc, char **proto)
                         (token != NULL ? "\"," : ""),
                         nats_GetBoolStr(opts->secure),
                         (name != NULL ? name : ""),
-                        CString, NATS_VERSION_STRING, _CRLF_);
+                        CString, NATS_VERSION_STRING,
+                        (nc->localDlv ? ",\"protocol\":1,\"echo\":false" : ""),
+                        _CRLF_);
     if (res < 0)
         return NATS_NO_MEMORY;
 
@@ -729,62 +1242,77 @@ _sendUnsubProto(natsConnection *nc, int64_t subId, int max)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+// Builds, in a single buffer sized up front, the protocols that recreate all
+// subscriptions on the server. The buffer is NULL if there are no
+// subscriptions.
 static natsStatus
-_resendSubscriptions(natsConnection *nc)
+_buildSubscriptionsReplay(natsConnection *nc, char **replay, int *replayLen)
 {
     natsStatus          s    = NATS_OK;
     natsSubscription    *sub = NULL;
+    char                *buf = NULL;
     natsHashIter        iter;
-    char                *proto;
-    int                 res;
+    int                 size = 0;
+    int                 len  = 0;
     int                 max;
+    int                 n;
+
+    *replay    = NULL;
+    *replayLen = 0;
+
+    natsMutex_Lock(nc->subsMu);
 
     natsHashIter_Init(&iter, nc->subs);
     while (natsHashIter_Next(&iter, NULL, (void**) &sub))
     {
-        proto = NULL;
+        size += (int) strlen(sub->subject) + SUB_REPLAY_OVERHEAD;
+        if (sub->queue != NULL)
+            size += (int) strlen(sub->queue);
+    }
+    natsHashIter_Done(&iter);
 
+    // Room for the terminating NULL character written by snprintf.
+    if ((size > 0) && ((buf = (char*) NATS_MALLOC(size + 1)) == NULL))
+        s = nats_setDefaultError(NATS_NO_MEMORY);
+
+    natsHashIter_Init(&iter, nc->subs);
+    while ((s == NATS_OK) && natsHashIter_Next(&iter, NULL, (void**) &sub))
+    {
         natsSub_Lock(sub);
         max = (int) sub->max;
         natsSub_Unlock(sub);
 
         // These sub's fields are immutable
-        res = nats_asprintf(&proto, _SUB_PROTO_,
-                            sub->subject,
-                            (sub->queue == NULL ? "" : sub->queue),
-                            (int) sub->sid);
-        if (res < 0)
-            s = NATS_NO_MEMORY;
-
-        if (s == NATS_OK)
+        n = snprintf(buf + len, size + 1 - len, _SUB_PROTO_,
+                     sub->subject,
+                     (sub->queue == NULL ? "" : sub->queue),
+                     (int) sub->sid);
+        if ((n > 0) && (max > 0))
         {
-            s = natsConn_bufferWriteString(nc, proto);
-            NATS_FREE(proto);
-            proto = NULL;
+            len += n;
+            n = snprintf(buf + len, size + 1 - len, _UNSUB_PROTO_,
+                         sub->sid, max);
         }
-
-        if ((s == NATS_OK) && (max > 0))
-            s = _sendUnsubProto(nc, sub->sid, max);
+        if ((n < 0) || (len + n > size))
+            s = nats_setError(NATS_ERR, "%s", "unable to build subscriptions replay");
+        else
+            len += n;
     }
+    natsHashIter_Done(&iter);
 
-    return s;
-}
+    natsMutex_Unlock(nc->subsMu);
 
-static natsStatus
-_flushReconnectPendingItems(natsConnection *nc)
-{
-    natsStatus s = NATS_OK;
-
-    if (nc->pending == NULL)
-        return NATS_OK;
-
-    if (natsBuf_Len(nc->pending) > 0)
+    if (s == NATS_OK)
+    {
+        *replay    = buf;
+        *replayLen = len;
+    }
+    else
     {
-        s = natsBuf_Append(nc->bw, natsBuf_Data(nc->pending),
-                           natsBuf_Len(nc->pending));
+        NATS_FREE(buf);
     }
 
-    return s;
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 static void
@@ -812,13 +1340,26 @@ _removePongFromList(natsConnection *nc, natsPong *pong)
 static void
 _clearPendingFlushRequests(natsConnection *nc)
 {
-    natsPong *pong = NULL;
+    natsPong    *pong = NULL;
+    natsStatus  s     = NATS_CONNECTION_DISCONNECTED;
+
+    if (natsConn_isClosed(nc))
+        s = NATS_CONNECTION_CLOSED;
 
     while ((pong = nc->pongs.head) != NULL)
     {
         // Pop from the queue
         _removePongFromList(nc, pong);
 
+        // Asynchronous flushes are completed from the thread invoking
+        // the connection's callbacks, since we hold the lock here.
+        if (pong->flushReqs != NULL)
+        {
+            natsAsyncCb_PostFlushHandler(nc, pong->flushReqs, s);
+            NATS_FREE(pong);
+            continue;
+        }
+
         // natsConnection_Flush[Timeout]() is waiting on a condition
         // variable and exit when this value is != 0. "Flush" will
         // return an error to the caller if the connection status
@@ -832,6 +1373,219 @@ _clearPendingFlushRequests(natsConnection *nc)
 
     nc->pongs.incoming      = 0;
     nc->pongs.outgoingPings = 0;
+    nc->pongs.timerPingId   = 0;
+}
+
+// When the connection is closed, unblock all natsConnection_Request() calls
+// waiting for a reply on the response subscription. The requestors remove
+// their entry from the map.
+static void
+_clearPendingRequests(natsConnection *nc)
+{
+    natsHashIter    iter;
+    natsRespInfo    *resp;
+
+    if (nc->respMap == NULL)
+        return;
+
+    natsHashIter_Init(&iter, nc->respMap);
+    while (natsHashIter_Next(&iter, NULL, (void**) &resp))
+    {
+        resp->closed = true;
+
+        // Asynchronous requests are completed from the timer thread, or
+        // from the application's thread with caller driven I/O.
+        if (resp->cb == NULL)
+        {
+            natsCondition_Signal(resp->cond);
+        }
+        else if (resp->timer != NULL)
+        {
+            natsTimer_Reset(resp->timer, 0);
+        }
+        else
+        {
+            (void) natsHashIter_RemoveCurrent(&iter);
+            natsAsyncCb_PostReplyHandler(nc, resp, NATS_CONNECTION_CLOSED);
+        }
+    }
+    natsHashIter_Done(&iter);
+}
+
+// With caller driven I/O, asynchronous requests have no timer: those whose
+// deadline has passed are completed by the next callbacks dispatch.
+static void
+_expireRequests(natsConnection *nc, int64_t now)
+{
+    natsHashIter    iter;
+    natsRespInfo    *resp;
+
+    if (nc->respMap == NULL)
+        return;
+
+    natsHashIter_Init(&iter, nc->respMap);
+    while (natsHashIter_Next(&iter, NULL, (void**) &resp))
+    {
+        if ((resp->cb != NULL) && (now >= resp->deadline))
+        {
+            (void) natsHashIter_RemoveCurrent(&iter);
+            natsAsyncCb_PostReplyHandler(nc, resp, NATS_TIMEOUT);
+        }
+    }
+    natsHashIter_Done(&iter);
+}
+
+// Returns how many bytes of the pending buffer to send in one go. When
+// the oldest messages may be dropped, only complete protocols are sent so
+// that the head of the buffer is always at the start of a protocol.
+static int
+_pendingChunkLen(natsConnection *nc, int len)
+{
+    int         total  = 0;
+    int         n      = 0;
+    bool        isPub  = false;
+
+    if (nc->opts->reconnectBufPolicy != NATS_RECONNECT_BUF_DROP_OLDEST)
+        return (len < PENDING_REPLAY_CHUNK ? len : PENDING_REPLAY_CHUNK);
+
+    while ((total < len)
+           && ((n = _pendingProtoLen(nc, total, &isPub)) > 0)
+           && ((total == 0) || (total + n <= PENDING_REPLAY_CHUNK)))
+    {
+        total += n;
+    }
+
+    return (total > 0 ? total : len);
+}
+
+// Sends the subscriptions replay, followed by the data buffered while we
+// were disconnected, one chunk at a time and holding only the write lock,
+// so that the connection is usable during the replay. Publishers append to
+// the pending buffer until it is empty. If the connection is lost again,
+// what is left of the pending data is kept for the next reconnect.
+static void
+_replayPending(natsConnection *nc, char *subs, int subsLen)
+{
+    natsStatus      s       = NATS_OK;
+    char            *chunk  = NULL;
+    bool            done    = false;
+    bool            notify  = false;
+    bool            high    = false;
+    int             subsPos = 0;
+    int             len     = 0;
+    int             sent    = 0;
+    int             count   = 0;
+    int             bytes   = 0;
+    size_t          n       = 0;
+    natsSockIOVec   iov[PENDING_REPLAY_IOV];
+
+    while (!done && (s == NATS_OK))
+    {
+        natsConn_writeLock(nc);
+
+        if ((nc->status != CONNECTED) || !(nc->usePending))
+        {
+            natsConn_writeUnlock(nc);
+            break;
+        }
+
+        len = natsChain_Len(nc->pending);
+        if (subsPos < subsLen)
+        {
+            len = subsLen - subsPos;
+            if (len > PENDING_REPLAY_CHUNK)
+                len = PENDING_REPLAY_CHUNK;
+
+            s = natsSock_WriteFully(&(nc->sockCtx), subs + subsPos, len);
+            if (s == NATS_OK)
+                subsPos += len;
+        }
+        else if (len > 0)
+        {
+            len = _pendingChunkLen(nc, len);
+
+            // Send the chunks in place. Since what is sent is consumed only
+            // once written, the iovec may have to be refilled if the data
+            // spans more chunks than it can reference.
+            for (sent = 0; (s == NATS_OK) && (sent < len); sent += bytes)
+            {
+                count = natsChain_GetIOVec(nc->pending, iov, PENDING_REPLAY_IOV,
+                                           len - sent, &bytes);
+                s = natsSock_WriteFullyV(&(nc->sockCtx), iov, count);
+                if (s == NATS_OK)
+                    natsChain_Consume(nc->pending, bytes);
+            }
+        }
+        else if (nc->pendingFileRead < nc->pendingFileSize)
+        {
+            if ((chunk == NULL)
+                && ((chunk = (char*) NATS_MALLOC(PENDING_REPLAY_CHUNK)) == NULL))
+            {
+                s = nats_setDefaultError(NATS_NO_MEMORY);
+            }
+            if ((s == NATS_OK)
+                && ((nats_fseek(nc->pendingFile, nc->pendingFileRead) != 0)
+                    || ((n = fread(chunk, 1, PENDING_REPLAY_CHUNK, nc->pendingFile)) == 0)))
+            {
+                s = nats_setError(NATS_SYS_ERROR,
+                                  "error reading the reconnect spill file: %d",
+                                  errno);
+            }
+            if (s == NATS_OK)
+                s = natsSock_WriteFully(&(nc->sockCtx), chunk, (int) n);
+            if (s == NATS_OK)
+            {
+                nc->pendingFileRead += (int64_t) n;
+
+                // Once the file has been fully replayed, new data goes back
+                // to the pending buffer.
+                if (nc->pendingFileRead == nc->pendingFileSize)
+                    _closePendingFile(nc);
+            }
+        }
+        else
+        {
+            _destroyPending(nc);
+            done = true;
+        }
+
+        notify = natsConn_updateWatermark(nc, &high);
+
+        natsConn_writeUnlock(nc);
+
+        if (notify)
+            natsAsyncCb_PostWatermarkHandler(nc, high);
+    }
+
+    NATS_FREE(chunk);
+
+    if (s != NATS_OK)
+        _setErrIfNone(nc, s);
+}
+
+// Returns how long to wait, in milliseconds, between two attempts to
+// reconnect to the given server. Lock held on entry.
+static int64_t
+_reconnectDelay(natsConnection *nc, natsSrv *srv)
+{
+    natsOptions *opts = nc->opts;
+    int64_t     wait  = opts->reconnectWait;
+
+    // Double the wait after each failed attempt, up to the maximum.
+    for (int i = 1; (i < srv->reconnects) && (wait < opts->reconnectMaxWait); i++)
+        wait *= 2;
+
+    if ((opts->reconnectMaxWait > opts->reconnectWait)
+        && (wait > opts->reconnectMaxWait))
+    {
+        wait = opts->reconnectMaxWait;
+    }
+
+    if (opts->reconnectJitter > 0)
+        wait += (int64_t) (nats_NextRandom(&(nc->reconnectRnd))
+                           % (uint64_t) (opts->reconnectJitter + 1));
+
+    return wait;
 }
 
 // Try to reconnect using the option parameters.
@@ -843,10 +1597,14 @@ _doReconnect(void *arg)
     natsConnection          *nc = (natsConnection*) arg;
     natsThread              *tReconnect = NULL;
     natsSrv                 *cur;
-    int64_t                 elapsed;
+    int64_t                 target;
     natsSrvPool             *pool = NULL;
+    char                    *subs = NULL;
+    int                     subsLen = 0;
     struct threadsToJoin    ttj;
 
+    nats_threadStarted(NATS_THREAD_RECONNECT, nc->opts);
+
     natsConn_Lock(nc);
 
     _initThreadsToJoin(&ttj, nc, false);
@@ -870,6 +1628,8 @@ _doReconnect(void *arg)
     if (nc->opts->disconnectedCb != NULL)
         natsAsyncCb_PostConnHandler(nc, ASYNC_DISCONNECTED);
 
+    NATS_PROBE0(reconnect__start);
+
     // Note that the pool's size may decrement after the call to
     // natsSrvPool_GetNextServer.
     while ((s == NATS_OK) && (natsSrvPool_GetSize(pool) > 0))
@@ -882,19 +1642,13 @@ _doReconnect(void *arg)
             break;
         }
 
-        // Sleep appropriate amount of time before the
+        // Wait the appropriate amount of time before the
         // connection attempt if connecting to same server
-        // we just got disconnected from..
-        if (((elapsed = nats_Now() - cur->lastAttempt)) < nc->opts->reconnectWait)
-        {
-            int64_t sleepTime = (nc->opts->reconnectWait - elapsed);
-
-            natsConn_Unlock(nc);
-
-            nats_Sleep(sleepTime);
-
-            natsConn_Lock(nc);
-        }
+        // we just got disconnected from. This wait is
+        // interrupted if the connection is closed.
+        target = cur->lastAttempt + _reconnectDelay(nc, cur);
+        while (!natsConn_isClosed(nc) && (nats_Now() < target))
+            natsCondition_AbsoluteTimedWait(nc->reconnectCond, nc->mu, target);
 
         // Check if we have been closed first.
         if (natsConn_isClosed(nc))
@@ -903,6 +1657,8 @@ _doReconnect(void *arg)
         // Mark that we tried a reconnect
         cur->reconnects += 1;
 
+        NATS_PROBE2(reconnect__attempt, cur->url->fullUrl, cur->reconnects);
+
         // Try to create a new connection
         s = _createConn(nc);
         if (s != NATS_OK)
@@ -919,6 +1675,10 @@ _doReconnect(void *arg)
             continue;
         }
 
+        // From now on, publishers have to wait until we are done with the
+        // connect handshake and the replay of the pending data.
+        natsConn_writeLock(nc);
+
         // We have a valid FD and the writer buffer was moved to pending.
         // We are now going to send data directly to the newly connected
         // server, so we need to disable the use of 'pending' for the
@@ -926,23 +1686,23 @@ _doReconnect(void *arg)
         nc->usePending = false;
 
         // We are reconnected
-        nc->stats.reconnects += 1;
+        NATS_ATOMIC64_ADD(&(nc->stats.reconnects), 1);
 
         // Process Connect logic
         s = _processConnInit(nc);
 
-        // Send existing subscription state
-        if (s == NATS_OK)
-            s = _resendSubscriptions(nc);
-
-        // Now send off and clear pending buffer
+        // Prepare the existing subscription state. It is sent, with
+        // the data buffered while we were disconnected, once the
+        // handshake is complete.
         if (s == NATS_OK)
-            s = _flushReconnectPendingItems(nc);
+            s = _buildSubscriptionsReplay(nc, &subs, &subsLen);
 
         // This is where we are truly connected.
         if (s == NATS_OK)
             nc->status = CONNECTED;
 
+        NATS_PROBE1(reconnect__handshake, (int) s);
+
         if (s != NATS_OK)
         {
             // In case we were at the last iteration, this is the error
@@ -963,6 +1723,8 @@ _doReconnect(void *arg)
             natsBuf_Reset(nc->bw);
 
             nc->status = RECONNECTING;
+
+            natsConn_writeUnlock(nc);
             continue;
         }
 
@@ -975,11 +1737,15 @@ _doReconnect(void *arg)
         tReconnect = nc->reconnectThread;
         nc->reconnectThread = NULL;
 
-        // At this point we know that we don't need the pending buffer
-        // anymore. Destroy now.
-        natsBuf_Destroy(nc->pending);
-        nc->pending     = NULL;
-        nc->usePending  = false;
+        // Until the subscriptions and the pending data have been
+        // replayed, publishers keep appending to the pending buffer
+        // so that ordering is preserved.
+        if ((subsLen > 0) || _hasPending(nc))
+            nc->usePending = true;
+        else
+            _destroyPending(nc);
+
+        natsConn_writeUnlock(nc);
 
         // Call reconnectedCB if appropriate. Since we are in a separate
         // thread, we could invoke the callback directly, however, we
@@ -990,12 +1756,22 @@ _doReconnect(void *arg)
         // Release lock here, we will return below.
         natsConn_Unlock(nc);
 
+        NATS_PROBE1(reconnect__replay, subsLen);
+
+        _replayPending(nc, subs, subsLen);
+
+        NATS_FREE(subs);
+
         // Make sure we flush everything
         (void) natsConnection_Flush(nc);
 
+        NATS_PROBE1(reconnect__done, (int) NATS_OK);
+
         natsThread_Join(tReconnect);
         natsThread_Destroy(tReconnect);
 
+        natsConn_release(nc);
+
         return;
     }
 
@@ -1003,9 +1779,13 @@ _doReconnect(void *arg)
     if (nc->err == NATS_OK)
         nc->err = NATS_NO_SERVER;
 
+    NATS_PROBE1(reconnect__done, (int) nc->err);
+
     natsConn_Unlock(nc);
 
     _close(nc, CLOSED, true);
+
+    natsConn_release(nc);
 }
 
 // Notifies the flusher thread that there is pending data to send to the
@@ -1013,9 +1793,43 @@ _doReconnect(void *arg)
 void
 natsConn_kickFlusher(natsConnection *nc)
 {
+    natsOptions *opts = nc->opts;
+
+    if (opts->flushPolicy == NATS_FLUSH_ADAPTIVE)
+    {
+        int64_t now    = nats_NowInNanoSeconds();
+        int64_t delta  = now - nc->flusherLastKick;
+        int64_t linger = opts->flushMaxLinger * 1000;
+
+        // Keep track of the average interval between publishes, and of
+        // whether the connection was idle before this flush request. Idle
+        // periods count as the max linger time in the average.
+        if (!(nc->flusherSignaled))
+            nc->flusherWasIdle = (delta > linger);
+
+        if (delta > linger)
+            delta = linger;
+
+        nc->flusherAvgInterval = (nc->flusherAvgInterval * 7 + delta) / 8;
+        nc->flusherLastKick    = now;
+    }
+
     if (!(nc->flusherSignaled) && (nc->bw != NULL))
     {
         nc->flusherSignaled = true;
+
+        if (nc->evConn != NULL)
+            natsEvLoop_Flush(nc->evConn);
+        else if (opts->callerDrivenIO && (opts->writeInterestCb != NULL))
+            (*(opts->writeInterestCb))(nc, opts->writeInterestCbClosure);
+        else
+            natsCondition_Signal(nc->flusherCond);
+    }
+    else if (nc->flusherLingering
+             && (opts->flushMaxBytes > 0)
+             && (natsBuf_Len(nc->bw) >= opts->flushMaxBytes))
+    {
+        // Enough data has accumulated, no need for the flusher to wait more.
         natsCondition_Signal(nc->flusherCond);
     }
 }
@@ -1025,13 +1839,13 @@ _sendProto(natsConnection *nc, const char* proto, int protoLen)
 {
     natsStatus  s;
 
-    natsConn_Lock(nc);
+    natsConn_writeLock(nc);
 
     s = natsConn_bufferWrite(nc, proto, protoLen);
     if (s == NATS_OK)
         natsConn_kickFlusher(nc);
 
-    natsConn_Unlock(nc);
+    natsConn_writeUnlock(nc);
 
     return s;
 }
@@ -1041,7 +1855,13 @@ _sendConnect(natsConnection *nc)
 {
     natsStatus  s       = NATS_OK;
     char        *cProto = NULL;
-    char        buffer[DEFAULT_BUF_SIZE];
+    int64_t     start   = 0;
+    natsSrv     *srv;
+    char        *buffer = NULL;
+
+    buffer = NATS_MALLOC(CONTROL_LINE_BUF_SIZE);
+    if (buffer == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
 
     buffer[0] = '\0';
 
@@ -1060,11 +1880,15 @@ _sendConnect(natsConnection *nc)
 
     // Flush the buffer
     if (s == NATS_OK)
+    {
+        start = nats_NowInNanoSeconds();
         s = natsConn_bufferFlush(nc);
+    }
 
     // Now read the response from the server.
     if (s == NATS_OK)
-        s = natsSock_ReadLine(&(nc->sockCtx), buffer, sizeof(buffer));
+        s = natsSock_ReadLine(&(nc->sockCtx), buffer,
+                              CONTROL_LINE_BUF_SIZE);
 
     // If Verbose is set, we expect +OK first.
     if ((s == NATS_OK) && nc->opts->verbose)
@@ -1079,7 +1903,8 @@ _sendConnect(natsConnection *nc)
 
         // Read the rest now...
         if (s == NATS_OK)
-            s = natsSock_ReadLine(&(nc->sockCtx), buffer, sizeof(buffer));
+            s = natsSock_ReadLine(&(nc->sockCtx), buffer,
+                              CONTROL_LINE_BUF_SIZE);
     }
 
     // We except the PONG protocol
@@ -1110,9 +1935,16 @@ _sendConnect(natsConnection *nc)
     }
 
     if (s == NATS_OK)
+    {
         nc->status = CONNECTED;
 
+        srv = natsSrvPool_GetCurrentServer(nc->srvPool, nc->url, NULL);
+        if (srv != NULL)
+            natsSrvPool_UpdateRTT(srv, nats_NowInNanoSeconds() - start);
+    }
+
     free(cProto);
+    NATS_FREE(buffer);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
@@ -1122,11 +1954,18 @@ _processConnInit(natsConnection *nc)
 {
     natsStatus s = NATS_OK;
 
+    natsConn_writeLock(nc);
+
     nc->status = CONNECTING;
 
     // Process the INFO protocol that we should be receiving
     s = _processExpectedInfo(nc);
 
+    // Messages published on this connection would be delivered twice to its
+    // subscriptions if the server could not be asked not to send them back.
+    if (s == NATS_OK)
+        nc->localDlv = (nc->opts->localDelivery && (nc->info.proto >= 1));
+
     // Send the CONNECT and PING protocol, and wait for the PONG.
     if (s == NATS_OK)
         s = _sendConnect(nc);
@@ -1134,14 +1973,26 @@ _processConnInit(natsConnection *nc)
     // Clear our deadline, regardless of error
     natsDeadline_Clear(&(nc->sockCtx.deadline));
 
-    // Switch to blocking socket here...
-    if (s == NATS_OK)
+    // Switch to blocking socket here, unless the socket is going to be
+    // handled by the shared event loop or by the application.
+    if ((s == NATS_OK) && !(nc->opts->useSharedEvLoop)
+        && !(nc->opts->callerDrivenIO))
         s = natsSock_SetBlocking(nc->sockCtx.fd, true);
 
+    // The kernel's busy-polling is an optimization that is typically not
+    // permitted to unprivileged processes, so failing to enable it is fine.
+    if ((s == NATS_OK) && (nc->opts->busyPoll > 0)
+        && (natsSock_SetBusyPoll(nc->sockCtx.fd, nc->opts->busyPoll) != NATS_OK))
+    {
+        nats_clearLastError();
+    }
+
     // Start the readLoop and flusher threads
     if (s == NATS_OK)
         s = _spinUpSocketWatchers(nc);
 
+    natsConn_writeUnlock(nc);
+
     return NATS_UPDATE_ERR_STACK(s);
 }
 
@@ -1149,25 +2000,47 @@ _processConnInit(natsConnection *nc)
 static natsStatus
 _connect(natsConnection *nc)
 {
-    natsStatus  s     = NATS_OK;
-    natsStatus  retSts= NATS_OK;
-    natsSrvPool *pool = NULL;
+    natsStatus  s       = NATS_OK;
+    natsStatus  retSts  = NATS_OK;
+    natsSrvPool *pool   = NULL;
+    bool        *tried  = NULL;
+    int         *batch  = NULL;
+    int         size    = 0;
+    int         n       = 0;
+    int         w       = 0;
     int         i;
 
     natsConn_Lock(nc);
 
     pool = nc->srvPool;
+    size = natsSrvPool_GetSize(pool);
+
+    tried = (bool*) NATS_CALLOC(size, sizeof(bool));
+    batch = (int*) NATS_CALLOC(size, sizeof(int));
+    if ((tried == NULL) || (batch == NULL))
+        retSts = s = nats_setDefaultError(NATS_NO_MEMORY);
 
     // Create actual socket connection
     // For first connect we walk all servers in the pool and try
-    // to connect immediately.
-    for (i = 0; i < natsSrvPool_GetSize(pool); i++)
+    // to connect immediately. Up to 'connectMaxServers' servers are
+    // raced, in pool order, and the first to accept the connection is
+    // the one we perform the handshake with.
+    while ((tried != NULL) && (batch != NULL))
     {
-        nc->url = natsSrvPool_GetSrvUrl(pool,i);
+        for (i = 0, n = 0; (i < size) && (n < nc->opts->connectMaxServers); i++)
+        {
+            if (!tried[i])
+                batch[n++] = i;
+        }
+        if (n == 0)
+            break;
 
-        s = _createConn(nc);
+        s = _createConnToAny(nc, batch, n, &w);
         if (s == NATS_OK)
         {
+            i = batch[w];
+            tried[i] = true;
+
             s = _processConnInit(nc);
 
             if (s == NATS_OK)
@@ -1192,11 +2065,17 @@ _connect(natsConnection *nc)
         }
         else
         {
+            for (i = 0; i < n; i++)
+                tried[batch[i]] = true;
+
             if (s == NATS_IO_ERROR)
                 retSts = NATS_OK;
         }
     }
 
+    NATS_FREE(tried);
+    NATS_FREE(batch);
+
     if ((retSts == NATS_OK) && (nc->status != CONNECTED))
     {
         s = nats_setDefaultError(NATS_NO_SERVER);
@@ -1226,6 +2105,8 @@ _processOpError(natsConnection *nc, natsStatus s)
     {
         natsStatus ls;
 
+        natsConn_writeLock(nc);
+
         // Set our new status
         nc->status = RECONNECTING;
 
@@ -1241,15 +2122,37 @@ _processOpError(natsConnection *nc, natsStatus s)
         }
 
         // Create the pending buffer to hold all write requests while we try
-        // to reconnect.
-        ls = natsBuf_Create(&(nc->pending), DEFAULT_PENDING_SIZE);
-        if (ls == NATS_OK)
+        // to reconnect. If we were disconnected while replaying it, keep
+        // what has not been sent yet.
+        // Chunks are no bigger than the write buffer, so that a connection
+        // set up for a small footprint stays small while reconnecting.
+        ls = NATS_OK;
+        if (nc->pending == NULL)
         {
+            int chunkSize = PENDING_CHUNK_SIZE;
+
+            if (nc->opts->writeBufSize < chunkSize)
+                chunkSize = nc->opts->writeBufSize;
+
+            ls = natsChain_Create(&(nc->pending), chunkSize,
+                                  PENDING_MAX_FREE_CHUNKS);
+        }
+        if (ls == NATS_OK)
             nc->usePending = true;
 
+        natsConn_writeUnlock(nc);
+
+        if (ls == NATS_OK)
+        {
+            // The reconnect thread holds a reference to the connection,
+            // which it releases when done.
+            _retain(nc);
+
             // Start the reconnect thread
             ls = natsThread_Create(&(nc->reconnectThread),
                                   _doReconnect, (void*) nc);
+            if (ls != NATS_OK)
+                _release(nc);
         }
         if (ls ==  NATS_OK)
         {
@@ -1261,7 +2164,10 @@ _processOpError(natsConnection *nc, natsStatus s)
 
     // reconnect not allowed or we failed to setup the reconnect code.
 
+    natsConn_writeLock(nc);
     nc->status = DISCONNECTED;
+    natsConn_writeUnlock(nc);
+
     nc->err = s;
 
     natsConn_Unlock(nc);
@@ -1276,26 +2182,110 @@ natsConn_clearSSL(natsConnection *nc)
         return;
 
     SSL_free(nc->sockCtx.ssl);
-    nc->sockCtx.ssl = NULL;
+    nc->sockCtx.ssl      = NULL;
+    nc->sockCtx.ktlsSend = false;
+}
+
+// Closes the socket and releases the resources that are otherwise released
+// by the _readLoop thread. The lock is held on entry and released on exit.
+static void
+_cleanupSocketWatchers(natsConnection *nc)
+{
+    natsConn_writeLock(nc);
+
+    natsSock_Close(nc->sockCtx.fd);
+    nc->sockCtx.fd       = NATS_SOCK_INVALID;
+    nc->sockCtx.fdActive = false;
+
+    // We need to cleanup some things if the connection was SSL.
+    if (nc->sockCtx.ssl != NULL)
+        natsConn_clearSSL(nc);
+
+    natsConn_writeUnlock(nc);
+
+    natsParser_Destroy(nc->ps);
+    nc->ps = NULL;
+
+    natsMsgSlab_Release(nc->readSlab);
+    nc->readSlab = NULL;
+
+    // This unlocks and releases the connection to compensate for the retain
+    // when the socket watchers were started.
+    natsConn_unlockAndRelease(nc);
+}
+
+// Returns the slab to read the socket into. If the current slab is still
+// referenced by some messages, a new one is created.
+static natsStatus
+_getReadSlab(natsConnection *nc, natsMsgSlab **slab)
+{
+    natsStatus s = NATS_OK;
+
+    if ((nc->readSlab != NULL) && natsMsgSlab_IsShared(nc->readSlab))
+    {
+        natsMsgSlab_Release(nc->readSlab);
+        nc->readSlab = NULL;
+    }
+    if (nc->readSlab == NULL)
+        s = natsMsgSlab_Create(&(nc->readSlab), nc->opts->readBufSize);
+
+    if (s == NATS_OK)
+        *slab = nc->readSlab;
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static natsStatus
+_parseSlab(natsConnection *nc, natsMsgSlab *slab, int n)
+{
+    natsStatus s;
+
+    // Let messages reference the slab only if the read was large enough,
+    // otherwise, a few small messages could pin down a whole slab.
+    if (n >= (slab->size / 2))
+        nc->curSlab = slab;
+
+    // Counted before parsing, so that a PONG in this data sees it.
+    NATS_ATOMIC64_ADD(&(nc->reads), 1);
+
+    if (nc->capture != NULL)
+        natsCapture_Write(nc->capture, slab->data, n);
+
+    s = natsParser_Parse(nc, slab->data, n);
+
+    nc->curSlab = NULL;
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Lets the subscription know that the message it is being streamed will not
+// be completed, since the connection was lost. Invoked with no lock held.
+static void
+_abortStream(natsConnection *nc, natsStatus s)
+{
+    if ((nc->ps != NULL) && nc->ps->streaming)
+        natsConn_endStream(nc, s);
 }
 
 static void
 _readLoop(void  *arg)
 {
     natsStatus  s = NATS_OK;
-    char        buffer[DEFAULT_BUF_SIZE];
-    natsSock    fd;
+    natsMsgSlab *slab = NULL;
     int         n;
 
     natsConnection *nc = (natsConnection*) arg;
 
+    // Busy-poll spin budget, in nanoseconds.
+    int64_t     spin = nc->opts->busyPoll * 1000;
+
+    nats_threadStarted(NATS_THREAD_READ_LOOP, nc->opts);
+
     natsConn_Lock(nc);
 
     if (nc->sockCtx.ssl != NULL)
         nats_sslRegisterThreadForCleanup();
 
-    fd = nc->sockCtx.fd;
-
     if (nc->ps == NULL)
         s = natsParser_Create(&(nc->ps));
 
@@ -1307,76 +2297,166 @@ _readLoop(void  *arg)
 
         n = 0;
 
-        s = natsSock_Read(&(nc->sockCtx), buffer, sizeof(buffer), &n);
+        s = _getReadSlab(nc, &slab);
+        if ((s == NATS_OK) && (spin > 0))
+            s = natsSock_ReadBusyPoll(&(nc->sockCtx), slab->data,
+                                      (size_t) slab->size, &n, spin);
+        else if (s == NATS_OK)
+            s = natsSock_Read(&(nc->sockCtx), slab->data, (size_t) slab->size, &n);
         if (s == NATS_OK)
-            s = natsParser_Parse(nc, buffer, n);
+            s = _parseSlab(nc, slab, n);
 
         if (s != NATS_OK)
+        {
+            _abortStream(nc, s);
             _processOpError(nc, s);
+        }
 
         natsConn_Lock(nc);
     }
 
-    natsSock_Close(fd);
-    nc->sockCtx.fd       = NATS_SOCK_INVALID;
-    nc->sockCtx.fdActive = false;
+    _cleanupSocketWatchers(nc);
+}
 
-    // We need to cleanup some things if the connection was SSL.
-    if (nc->sockCtx.ssl != NULL)
-        natsConn_clearSSL(nc);
+// Records an error that happened on the write path, unless there is already
+// one. The write lock must not be held, since it is acquired after the
+// connection's lock.
+static void
+_setErrIfNone(natsConnection *nc, natsStatus s)
+{
+    natsConn_Lock(nc);
 
-    natsParser_Destroy(nc->ps);
-    nc->ps = NULL;
+    if (nc->err == NATS_OK)
+        nc->err = s;
 
-    // This unlocks and releases the connection to compensate for the retain
-    // when this thread was created.
-    natsConn_unlockAndRelease(nc);
+    natsConn_Unlock(nc);
 }
 
-static void
-_flusher(void *arg)
+// Returns true if the flusher should try to fill TLS records, that is, if
+// this was requested and the encryption is not done by the kernel.
+static bool
+_batchTLSRecords(natsConnection *nc)
 {
-    natsConnection  *nc  = (natsConnection*) arg;
-    natsStatus      s;
+    return (nc->opts->tlsBatchRecords
+            && (nc->sockCtx.ssl != NULL)
+            && !(nc->sockCtx.ktlsSend));
+}
 
-    while (true)
+// Returns how long, in nanoseconds, the flusher should wait before flushing
+// the write buffer, based on the flush policy.
+static int64_t
+_getFlusherLinger(natsConnection *nc)
+{
+    natsOptions *opts   = nc->opts;
+    int64_t     linger  = opts->flushMaxLinger * 1000;
+
+    // Small writes would produce small TLS records.
+    if (_batchTLSRecords(nc))
+        return linger;
+
+    switch (opts->flushPolicy)
     {
-        natsConn_Lock(nc);
+        case NATS_FLUSH_IMMEDIATE:
+            return 0;
+
+        case NATS_FLUSH_ADAPTIVE:
+        {
+            // Flush right away a publish following an idle period, otherwise
+            // wait long enough for a couple more publishes at the current rate.
+            if (nc->flusherWasIdle)
+                return 0;
+
+            if ((nc->flusherAvgInterval * 2) < linger)
+                linger = nc->flusherAvgInterval * 2;
+
+            return linger;
+        }
+
+        default:
+            return linger;
+    }
+}
+
+static void
+_flusherLinger(natsConnection *nc)
+{
+    int     maxBytes = nc->opts->flushMaxBytes;
+    int64_t linger   = _getFlusherLinger(nc);
+    int64_t target;
+
+    if (linger <= 0)
+        return;
+
+    if (_batchTLSRecords(nc)
+        && ((maxBytes == 0) || (maxBytes > NATS_TLS_RECORD_SIZE)))
+    {
+        maxBytes = NATS_TLS_RECORD_SIZE;
+    }
+
+    target = nats_NowInNanoSeconds() + linger;
+
+    nc->flusherLingering = true;
+
+    while (!(nc->flusherStop)
+           && ((maxBytes == 0) || (natsBuf_Len(nc->bw) < maxBytes))
+           && (natsCondition_AbsoluteTimedWaitNano(nc->flusherCond, nc->wmu,
+                                                   target) != NATS_TIMEOUT))
+    {
+        // Keep waiting until the deadline, spurious wakeup or not.
+    }
+
+    nc->flusherLingering = false;
+}
+
+static void
+_flusher(void *arg)
+{
+    natsConnection  *nc     = (natsConnection*) arg;
+    natsStatus      s;
+    bool            notify;
+    bool            high;
+
+    nats_threadStarted(NATS_THREAD_FLUSHER, nc->opts);
+
+    while (true)
+    {
+        // Only the write lock is needed here, so that a blocking socket
+        // write does not hold up the processing of inbound messages.
+        natsConn_writeLock(nc);
 
         while (!(nc->flusherSignaled) && !(nc->flusherStop))
-            natsCondition_Wait(nc->flusherCond, nc->mu);
+            natsCondition_Wait(nc->flusherCond, nc->wmu);
 
         if (nc->flusherStop)
         {
-            natsConn_Unlock(nc);
+            natsConn_writeUnlock(nc);
             break;
         }
 
-        //TODO: If we process the request right away, performance
-        //      will suffer when sending quickly very small messages.
-        //      The buffer is going to be always flushed, which
-        //      defeats the purpose of a write buffer.
-        //      We need to revisit this.
-
-        // Give a chance to accumulate more requests...
-        natsCondition_TimedWait(nc->flusherCond, nc->mu, 1);
+        // Give a chance to accumulate more requests, based on the policy.
+        _flusherLinger(nc);
 
         nc->flusherSignaled = false;
 
         if (natsConn_isClosed(nc) || _isReconnecting(nc))
         {
-            natsConn_Unlock(nc);
+            natsConn_writeUnlock(nc);
             break;
         }
 
+        s = NATS_OK;
         if (nc->sockCtx.fdActive && (natsBuf_Len(nc->bw) > 0))
-        {
             s = natsConn_bufferFlush(nc);
-            if ((s != NATS_OK) && (nc->err == NATS_OK))
-                nc->err = s;
-        }
 
-        natsConn_Unlock(nc);
+        notify = natsConn_updateWatermark(nc, &high);
+
+        natsConn_writeUnlock(nc);
+
+        if (notify)
+            natsAsyncCb_PostWatermarkHandler(nc, high);
+
+        if (s != NATS_OK)
+            _setErrIfNone(nc, s);
     }
 
     // Release the connection to compensate for the retain when this thread
@@ -1384,10 +2464,14 @@ _flusher(void *arg)
     natsConn_release(nc);
 }
 
-static void
+static natsStatus
 _sendPing(natsConnection *nc, natsPong *pong)
 {
-    natsStatus  s     = NATS_OK;
+    natsStatus  s       = NATS_OK;
+    bool        notify  = false;
+    bool        high    = false;
+
+    natsConn_writeLock(nc);
 
     s = natsConn_bufferWrite(nc, _PING_PROTO_, _PING_PROTO_LEN_);
     if (s == NATS_OK)
@@ -1395,6 +2479,16 @@ _sendPing(natsConnection *nc, natsPong *pong)
         // Flush the buffer in place.
         s = natsConn_bufferFlush(nc);
     }
+    if ((s == NATS_OK) && (pong != NULL))
+        pong->writes = nc->writes;
+
+    notify = natsConn_updateWatermark(nc, &high);
+
+    natsConn_writeUnlock(nc);
+
+    if (notify)
+        natsAsyncCb_PostWatermarkHandler(nc, high);
+
     if (s == NATS_OK)
     {
         // Now that we know the PING was sent properly, update
@@ -1418,12 +2512,16 @@ _sendPing(natsConnection *nc, natsPong *pong)
                 nc->pongs.head = pong;
         }
     }
+
+    return s;
 }
 
 static void
 _processPingTimer(natsTimer *timer, void *arg)
 {
-    natsConnection  *nc = (natsConnection*) arg;
+    natsConnection  *nc   = (natsConnection*) arg;
+    int64_t         sent  = 0;
+    int64_t         reads = 0;
 
     natsConn_Lock(nc);
 
@@ -1433,6 +2531,18 @@ _processPingTimer(natsTimer *timer, void *arg)
         return;
     }
 
+    // Data received since the last tick shows that the connection is
+    // alive, so there is no need for a PING (and its forced flush). The
+    // PONG of the previous PING does not count, otherwise an idle
+    // connection would send a PING only every other tick.
+    reads = NATS_ATOMIC64_GET(&(nc->reads));
+    if (reads != nc->pingReads)
+    {
+        nc->pingReads = reads;
+        natsConn_Unlock(nc);
+        return;
+    }
+
     // If we have more PINGs out than PONGs in, consider
     // the connection stale.
     if (++(nc->pout) > nc->opts->maxPingsOut)
@@ -1442,7 +2552,16 @@ _processPingTimer(natsTimer *timer, void *arg)
         return;
     }
 
-    _sendPing(nc, NULL);
+    sent = nc->pongs.outgoingPings;
+
+    (void) _sendPing(nc, NULL);
+
+    // Time this PING, unless the previous one has not been answered yet.
+    if ((nc->pongs.timerPingId == 0) && (nc->pongs.outgoingPings != sent))
+    {
+        nc->pongs.timerPingId   = nc->pongs.outgoingPings;
+        nc->pongs.timerPingSent = nats_NowInNanoSeconds();
+    }
 
     natsConn_Unlock(nc);
 }
@@ -1455,6 +2574,158 @@ _pingStopppedCb(natsTimer *timer, void *closure)
     natsConn_release(nc);
 }
 
+// Attaches the connection's socket to one of the library's shared event
+// loops, which then plays the role of both the readLoop and flusher threads.
+static natsStatus
+_attachToEvLoop(natsConnection *nc)
+{
+    natsStatus  s       = NATS_OK;
+    natsEvLoop  *loop   = NULL;
+
+    if (nc->ps == NULL)
+        s = natsParser_Create(&(nc->ps));
+
+    if (s == NATS_OK)
+        s = nats_getEvLoop(&loop);
+
+    if (s == NATS_OK)
+    {
+        natsConn_writeLock(nc);
+
+        nc->flusherSignaled = false;
+        nc->evLoopCleanup   = false;
+
+        // Same than for the readLoop thread, the loop holds a reference to
+        // the connection until it is detached.
+        _retain(nc);
+
+        s = natsEvLoop_Attach(&(nc->evConn), loop, nc, nc->sockCtx.fd);
+        if (s != NATS_OK)
+            _release(nc);
+
+        natsConn_writeUnlock(nc);
+
+        natsEvLoop_Release(loop);
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+bool
+natsConn_evLoopRead(natsConnection *nc)
+{
+    natsStatus  s       = NATS_OK;
+    natsMsgSlab *slab   = NULL;
+    bool        more    = false;
+    int         reads   = 0;
+    int         n;
+
+    natsConn_Lock(nc);
+
+    if (nc->sockCtx.ssl != NULL)
+        nats_sslRegisterThreadForCleanup();
+
+    if (natsConn_isClosed(nc) || _isReconnecting(nc))
+    {
+        natsConn_Unlock(nc);
+        return false;
+    }
+
+    natsConn_Unlock(nc);
+
+    // Read until the socket would block, but do not starve the other
+    // connections handled by this loop. The loop being level-triggered, we
+    // will be notified again if there is more to read. With SSL, there may
+    // be decrypted data pending while the socket itself has nothing to read,
+    // so in this case, we need to read until the socket would block.
+    do
+    {
+        n = 0;
+
+        s = _getReadSlab(nc, &slab);
+        if (s == NATS_OK)
+            s = natsSock_TryRead(&(nc->sockCtx), slab->data,
+                                 (size_t) slab->size, &n);
+        if ((s == NATS_OK) && (n > 0))
+            s = _parseSlab(nc, slab, n);
+    }
+    while ((s == NATS_OK)
+           && (n > 0)
+           && ((nc->sockCtx.ssl != NULL) || (++reads < 16)));
+
+    if (s != NATS_OK)
+    {
+        _abortStream(nc, s);
+        _processOpError(nc, s);
+    }
+
+    natsConn_Lock(nc);
+
+    // The connection may have been closed from within this callback, in
+    // which case the socket cleanup was left to us.
+    if (nc->evLoopCleanup)
+    {
+        nc->evLoopCleanup = false;
+        _cleanupSocketWatchers(nc);
+
+        return false;
+    }
+
+    more = (!natsConn_isClosed(nc) && !_isReconnecting(nc));
+
+    natsConn_Unlock(nc);
+
+    return more;
+}
+
+bool
+natsConn_evLoopWrite(natsConnection *nc)
+{
+    natsStatus  s       = NATS_OK;
+    bool        more    = false;
+    bool        notify  = false;
+    bool        high    = false;
+    int         n       = 0;
+
+    natsConn_writeLock(nc);
+
+    nc->flusherSignaled = false;
+
+    if (!natsConn_isClosed(nc)
+        && !_isReconnecting(nc)
+        && nc->sockCtx.fdActive
+        && (natsBuf_Len(nc->bw) > 0))
+    {
+        if (nc->sockCtx.ssl != NULL)
+        {
+            // SSL_write() needs to be retried with the same buffer if it
+            // would block, so use the regular (blocking) flush.
+            s = natsConn_bufferFlush(nc);
+        }
+        else
+        {
+            s = natsSock_TryWrite(&(nc->sockCtx), natsBuf_Data(nc->bw),
+                                  natsBuf_Len(nc->bw), &n);
+            if (s == NATS_OK)
+                natsBuf_Consume(nc->bw, n);
+
+            more = (natsBuf_Len(nc->bw) > 0);
+        }
+    }
+
+    notify = natsConn_updateWatermark(nc, &high);
+
+    natsConn_writeUnlock(nc);
+
+    if (notify)
+        natsAsyncCb_PostWatermarkHandler(nc, high);
+
+    if (s != NATS_OK)
+        _setErrIfNone(nc, s);
+
+    return more;
+}
+
 static natsStatus
 _spinUpSocketWatchers(natsConnection *nc)
 {
@@ -1463,22 +2734,42 @@ _spinUpSocketWatchers(natsConnection *nc)
     nc->pout        = 0;
     nc->flusherStop = false;
 
-    // Let's not rely on the created threads acquiring lock that would make it
-    // safe to retain only on success.
+    if (nc->opts->callerDrivenIO)
+    {
+        // The application reads and writes from its own thread, and sends
+        // the PINGs from natsConnection_ProcessTimers().
+        nc->flusherSignaled = false;
+        nc->nextPing        = nats_Now() + nc->opts->pingInterval;
 
-    _retain(nc);
+        s = NATS_OK;
+        if (nc->ps == NULL)
+            s = natsParser_Create(&(nc->ps));
 
-    s = natsThread_Create(&(nc->readLoopThread), _readLoop, (void*) nc);
-    if (s != NATS_OK)
-        _release(nc);
-
-    if (s == NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+    else if (nc->opts->useSharedEvLoop)
     {
+        s = _attachToEvLoop(nc);
+    }
+    else
+    {
+        // Let's not rely on the created threads acquiring lock that would make
+        // it safe to retain only on success.
+
         _retain(nc);
 
-        s = natsThread_Create(&(nc->flusherThread), _flusher, (void*) nc);
+        s = natsThread_Create(&(nc->readLoopThread), _readLoop, (void*) nc);
         if (s != NATS_OK)
             _release(nc);
+
+        if (s == NATS_OK)
+        {
+            _retain(nc);
+
+            s = natsThread_Create(&(nc->flusherThread), _flusher, (void*) nc);
+            if (s != NATS_OK)
+                _release(nc);
+        }
     }
 
     if ((s == NATS_OK) && (nc->opts->pingInterval > 0))
@@ -1512,6 +2803,8 @@ _removeAllSubscriptions(natsConnection *nc)
     natsHashIter     iter;
     natsSubscription *sub;
 
+    natsMutex_Lock(nc->subsMu);
+
     natsHashIter_Init(&iter, nc->subs);
     while (natsHashIter_Next(&iter, NULL, (void**) &sub))
     {
@@ -1521,6 +2814,204 @@ _removeAllSubscriptions(natsConnection *nc)
 
         natsSub_release(sub);
     }
+    natsHashIter_Done(&iter);
+
+    natsMutex_Unlock(nc->subsMu);
+}
+
+// Adds the subscription at the end of the connection's inline run queue.
+// Must be invoked with 'subsMu' held.
+static void
+_pushInlineSub(natsConnection *nc, natsSubscription *sub)
+{
+    sub->dlvNext = NULL;
+
+    if (nc->inlineSubsTail != NULL)
+        nc->inlineSubsTail->dlvNext = sub;
+    else
+        nc->inlineSubs = sub;
+
+    nc->inlineSubsTail = sub;
+}
+
+static natsSubscription*
+_popInlineSub(natsConnection *nc)
+{
+    natsSubscription *sub = nc->inlineSubs;
+
+    if (sub != NULL)
+    {
+        nc->inlineSubs = sub->dlvNext;
+        if (nc->inlineSubs == NULL)
+            nc->inlineSubsTail = NULL;
+
+        sub->dlvNext = NULL;
+    }
+
+    return sub;
+}
+
+// Schedules the delivery of the subscription's messages from
+// natsConnection_ProcessIO(), unless already scheduled. Must be invoked
+// with 'subsMu' held.
+static void
+_scheduleInline(natsConnection *nc, natsSubscription *sub)
+{
+    if (!NATS_ATOMIC_CAS(&(sub->dlvScheduled), 0, 1))
+        return;
+
+    // The queue holds a reference while the subscription is scheduled.
+    natsSub_retain(sub);
+
+    _pushInlineSub(nc, sub);
+}
+
+static void
+_clearInlineSubs(natsConnection *nc)
+{
+    natsSubscription *sub = NULL;
+
+    natsMutex_Lock(nc->subsMu);
+
+    while ((sub = _popInlineSub(nc)) != NULL)
+    {
+        NATS_ATOMIC_SET(&(sub->dlvScheduled), 0);
+        natsSub_release(sub);
+    }
+
+    natsMutex_Unlock(nc->subsMu);
+}
+
+// Delivers the messages of the scheduled subscriptions, a batch at a time
+// so that each subscription gets its turn.
+static void
+_deliverInline(natsConnection *nc)
+{
+    natsSubscription *sub = NULL;
+
+    for (;;)
+    {
+        natsMutex_Lock(nc->subsMu);
+        sub = _popInlineSub(nc);
+        natsMutex_Unlock(nc->subsMu);
+
+        if (sub == NULL)
+            break;
+
+        // If there are more messages, the subscription is still scheduled
+        // and we still own the queue's reference.
+        if (natsSub_deliverMsgsFromPool(sub))
+        {
+            natsMutex_Lock(nc->subsMu);
+            _pushInlineSub(nc, sub);
+            natsMutex_Unlock(nc->subsMu);
+        }
+    }
+}
+
+void
+natsConn_postInlineCb(natsConnection *nc, natsAsyncCbInfo *cb)
+{
+    natsConn_Lock(nc);
+
+    cb->next = NULL;
+
+    if (nc->inlineCbsTail != NULL)
+        nc->inlineCbsTail->next = cb;
+    else
+        nc->inlineCbs = cb;
+
+    nc->inlineCbsTail = cb;
+
+    natsConn_Unlock(nc);
+}
+
+// Invokes the callbacks queued by natsConn_postInlineCb(). The caller must
+// hold a reference on the connection, since each callback releases one.
+static void
+_dispatchInlineCbs(natsConnection *nc)
+{
+    natsAsyncCbInfo *cb = NULL;
+
+    natsConn_Lock(nc);
+
+    while ((cb = nc->inlineCbs) != NULL)
+    {
+        nc->inlineCbs = cb->next;
+        if (nc->inlineCbs == NULL)
+            nc->inlineCbsTail = NULL;
+
+        natsConn_Unlock(nc);
+
+        natsAsyncCb_Dispatch(cb);
+        natsAsyncCb_Destroy(cb);
+
+        natsConn_Lock(nc);
+    }
+
+    natsConn_Unlock(nc);
+}
+
+static void
+_processIO(natsConnection *nc, int events)
+{
+    if ((events & NATS_IO_READ) != 0)
+        (void) natsConn_evLoopRead(nc);
+
+    if ((events & NATS_IO_WRITE) != 0)
+        (void) natsConn_evLoopWrite(nc);
+
+    _deliverInline(nc);
+    _dispatchInlineCbs(nc);
+
+    // The buffer may have been flushed in place (by a flush or a direct
+    // publish), in which case the write interest callback needs to be
+    // invoked again the next time that data is buffered.
+    natsConn_writeLock(nc);
+    if ((nc->bw == NULL) || (natsBuf_Len(nc->bw) == 0))
+        nc->flusherSignaled = false;
+    natsConn_writeUnlock(nc);
+}
+
+natsStatus
+natsConn_waitAndProcessIO(natsConnection *nc, int64_t target)
+{
+    natsSockPollFd  pfd;
+    int64_t         timeout = target - nats_Now();
+    int             res     = 0;
+    int             events  = 0;
+
+    if (timeout <= 0)
+        return NATS_TIMEOUT;
+
+    pfd.fd      = nc->sockCtx.fd;
+    pfd.events  = NATS_POLL_IN;
+    pfd.revents = 0;
+
+    // What the caller wrote (a request) may still be buffered.
+    natsConn_writeLock(nc);
+    if ((nc->bw != NULL) && (natsBuf_Len(nc->bw) > 0))
+        pfd.events |= NATS_POLL_OUT;
+    natsConn_writeUnlock(nc);
+
+    natsConn_Unlock(nc);
+
+    res = natsSock_Poll(&pfd, 1, timeout);
+    if (res > 0)
+    {
+        if ((pfd.revents & NATS_POLL_OUT) != 0)
+            events |= NATS_IO_WRITE;
+
+        // Errors and hang ups are reported by the read.
+        if ((pfd.revents & ~NATS_POLL_OUT) != 0)
+            events |= NATS_IO_READ;
+
+        _processIO(nc, events);
+    }
+
+    natsConn_Lock(nc);
+
+    return NATS_OK;
 }
 
 
@@ -1538,13 +3029,22 @@ _close(natsConnection *nc, natsConnStatus status, bool doCBs)
 
     if (natsConn_isClosed(nc))
     {
+        natsConn_writeLock(nc);
         nc->status = status;
+        natsConn_writeUnlock(nc);
 
         natsConn_unlockAndRelease(nc);
         return;
     }
 
+    natsConn_writeLock(nc);
     nc->status = CLOSED;
+    if (nc->wmCond != NULL)
+        natsCondition_Broadcast(nc->wmCond);
+    natsConn_writeUnlock(nc);
+
+    // Interrupt the reconnect thread if it is waiting between attempts.
+    natsCondition_Broadcast(nc->reconnectCond);
 
     _initThreadsToJoin(&ttj, nc, true);
 
@@ -1558,15 +3058,27 @@ _close(natsConnection *nc, natsConnStatus status, bool doCBs)
     // and unblock NextMsg() calls.
     _removeAllSubscriptions(nc);
 
+    // The response subscription has been closed above, release the
+    // connection's reference (this breaks the subscription's reference on
+    // the connection), and kick out pending requests.
+    natsSub_release(nc->respMux);
+    nc->respMux = NULL;
+
+    _clearPendingRequests(nc);
+
+    _clearInlineSubs(nc);
+
     // Go ahead and make sure we have flushed the outbound buffer.
+    natsConn_writeLock(nc);
     nc->status = CLOSED;
     if (nc->sockCtx.fdActive)
     {
         natsConn_bufferFlush(nc);
 
-        // If there is no readLoop, then it is our responsibility to close
-        // the socket. Otherwise, _readLoop is the one doing it.
-        if (ttj.readLoop == NULL)
+        // If there is no readLoop (or event loop), then it is our
+        // responsibility to close the socket. Otherwise, _readLoop (or the
+        // event loop detach) is the one doing it.
+        if ((ttj.readLoop == NULL) && (ttj.evConn == NULL))
         {
             natsSock_Close(nc->sockCtx.fd);
             nc->sockCtx.fd = NATS_SOCK_INVALID;
@@ -1584,6 +3096,7 @@ _close(natsConnection *nc, natsConnStatus status, bool doCBs)
         nc->sockCtx.fdActive = false;
         sockWasActive = true;
     }
+    natsConn_writeUnlock(nc);
 
     // Perform appropriate callback if needed for a disconnect.
     // Do not invoke if we were disconnected and failed to reconnect (since
@@ -1601,7 +3114,9 @@ _close(natsConnection *nc, natsConnStatus status, bool doCBs)
     if (doCBs && (nc->opts->closedCb != NULL))
         natsAsyncCb_PostConnHandler(nc, ASYNC_CLOSED);
 
+    natsConn_writeLock(nc);
     nc->status = status;
+    natsConn_writeUnlock(nc);
 
     natsConn_unlockAndRelease(nc);
 }
@@ -1611,33 +3126,316 @@ _processSlowConsumer(natsConnection *nc, natsSubscription *sub)
 {
     nc->err = NATS_SLOW_CONSUMER;
 
-    if (!(sub->slowConsumer) && (nc->opts->asyncErrCb != NULL))
+    if (NATS_ATOMIC_CAS(&(sub->slowConsumer), 0, 1)
+        && (nc->opts->asyncErrCb != NULL))
+    {
         natsAsyncCb_PostErrHandler(nc, sub, NATS_SLOW_CONSUMER);
+    }
+}
+
+// Returns the shared subject a message received on this subscription can
+// reference, or NULL if the subject needs to be copied. Must be invoked
+// with 'subsMu' held.
+static natsSubject*
+_getSharedSubject(natsConnection *nc, natsSubscription *sub,
+                  const char *subject, int subjLen)
+{
+    natsStatus  s     = NATS_OK;
+    natsSubject *subj = sub->literalSubj;
+
+    if (subj != NULL)
+    {
+        if ((subj->len == subjLen) && (memcmp(subj->data, subject, subjLen) == 0))
+            return subj;
+
+        return NULL;
+    }
 
-    sub->slowConsumer = true;
+    // Replies to requests are each received on a different subject.
+    if (sub == nc->respMux)
+        return NULL;
+
+    if (nc->subjCache != NULL)
+    {
+        subj = (natsSubject*) natsStrHash_GetEx(nc->subjCache, subject, subjLen);
+        if (subj != NULL)
+            return subj;
+
+        // Start over once full, so that the cache follows the subjects
+        // in use.
+        if (natsStrHash_Count(nc->subjCache) >= SUBJ_CACHE_MAX)
+            _destroySubjCache(nc);
+    }
+
+    if ((nc->subjCache == NULL)
+        && (natsStrHash_Create(&(nc->subjCache), 16) != NATS_OK))
+    {
+        nats_clearLastError();
+        return NULL;
+    }
+
+    s = natsSubject_Create(&subj, subject, subjLen);
+    if (s == NATS_OK)
+    {
+        s = natsStrHash_Set(nc->subjCache, subj->data, false, (void*) subj, NULL);
+        if (s != NATS_OK)
+        {
+            natsSubject_Release(subj);
+            subj = NULL;
+        }
+    }
+    if (s != NATS_OK)
+        nats_clearLastError();
+
+    return subj;
 }
 
 static natsStatus
-_createMsg(natsMsg **newMsg, natsConnection *nc, char *buf, int bufLen)
+_createMsg(natsMsg **newMsg, natsConnection *nc, natsSubscription *sub,
+           char *buf, int bufLen)
 {
     natsStatus  s        = NATS_OK;
     int         subjLen  = 0;
     char        *reply   = NULL;
     int         replyLen = 0;
+    natsSubject *subj    = NULL;
+    const char  *decoded = NULL;
+    int         decLen   = 0;
+
+    subjLen = natsBuf_Len(nc->ps->ma.subject);
+
+    if (nc->ps->ma.reply != NULL)
+    {
+        reply    = natsBuf_Data(nc->ps->ma.reply);
+        replyLen = natsBuf_Len(nc->ps->ma.reply);
+    }
+
+    // A decoded payload is in the codec's buffer, so it is copied. The
+    // publisher could not send an original payload over the max payload.
+    if (nc->codec != NULL)
+    {
+        s = natsCodec_Decode(nc->codec, buf, bufLen, nc->info.maxPayload,
+                             &decoded, &decLen);
+        if (s != NATS_OK)
+            return NATS_UPDATE_ERR_STACK(s);
+
+        if (decoded != NULL)
+        {
+            buf    = (char*) decoded;
+            bufLen = decLen;
+        }
+    }
+
+    // If the protocol line and the payload are in the read slab (that is,
+    // the parser did not have to copy them because they were split across
+    // reads), the message can point into the slab.
+    if ((decoded == NULL)
+        && (nc->curSlab != NULL)
+        && (nc->ps->argBuf == NULL)
+        && (nc->ps->msgBuf == NULL))
+    {
+        s = natsMsg_createFromSlab(newMsg, nc->msgPool, nc->curSlab,
+                                   natsBuf_Data(nc->ps->ma.subject), subjLen,
+                                   reply, replyLen,
+                                   buf, bufLen);
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    subj = _getSharedSubject(nc, sub, natsBuf_Data(nc->ps->ma.subject), subjLen);
+
+    s = natsMsg_create(newMsg, nc->msgPool, subj,
+                       (const char*) natsBuf_Data(nc->ps->ma.subject), subjLen,
+                       (const char*) reply, replyLen,
+                       (const char*) buf, bufLen);
+    return s;
+}
+
+// Returns the subscription the message being parsed is streamed to, with a
+// reference, or NULL if it has been removed.
+static natsSubscription*
+_getStreamSub(natsConnection *nc)
+{
+    natsSubscription *sub = NULL;
+
+    natsMutex_Lock(nc->subsMu);
+
+    sub = natsHash_Get(nc->subs, nc->ps->ma.sid);
+    if ((sub != NULL) && sub->streaming)
+        natsSub_retain(sub);
+    else
+        sub = NULL;
+
+    natsMutex_Unlock(nc->subsMu);
+
+    return sub;
+}
+
+// Invoked by the parser when the arguments of a message have been parsed.
+// Returns true if the payload of the message is to be handed over to
+// natsConn_streamChunk() instead of natsConn_processMsg().
+bool
+natsConn_beginStream(natsConnection *nc)
+{
+    natsParser          *ps     = nc->ps;
+    natsSubscription    *sub    = NULL;
+    char                subj[MAX_CONTROL_LINE_SIZE + 1];
+    char                reply[MAX_CONTROL_LINE_SIZE + 1];
+    uint64_t            delivered;
+    uint64_t            max;
+    bool                closed;
+
+    sub = _getStreamSub(nc);
+    if (sub == NULL)
+        return false;
+
+    NATS_ATOMIC64_ADD(&(nc->stats.inMsgs), 1);
+    NATS_ATOMIC64_ADD(&(nc->stats.inBytes), (uint64_t) ps->ma.size);
+
+    natsSub_Lock(sub);
+    closed    = sub->closed;
+    delivered = ++(sub->delivered);
+    max       = sub->max;
+    natsSub_Unlock(sub);
+
+    ps->streaming  = true;
+    ps->streamLeft = ps->ma.size;
+    ps->streamSkip = (closed || ((max > 0) && (delivered > max)));
+
+    if (!(ps->streamSkip))
+    {
+        snprintf(subj, sizeof(subj), "%.*s",
+                 natsBuf_Len(ps->ma.subject), natsBuf_Data(ps->ma.subject));
+        if (ps->ma.reply != NULL)
+            snprintf(reply, sizeof(reply), "%.*s",
+                     natsBuf_Len(ps->ma.reply), natsBuf_Data(ps->ma.reply));
+
+        (*(sub->streamBeginCb))(nc, sub, subj,
+                                (ps->ma.reply != NULL ? reply : NULL),
+                                ps->ma.size, sub->msgCbClosure);
+    }
+
+    natsSub_release(sub);
+
+    return true;
+}
+
+void
+natsConn_streamChunk(natsConnection *nc, const char *data, int dataLen)
+{
+    natsSubscription *sub = NULL;
+
+    if (nc->ps->streamSkip)
+        return;
+
+    // The subscription may have been closed since the last part.
+    sub = _getStreamSub(nc);
+    if (sub == NULL)
+    {
+        nc->ps->streamSkip = true;
+        return;
+    }
+
+    (*(sub->streamChunkCb))(nc, sub, data, dataLen, sub->msgCbClosure);
+
+    natsSub_release(sub);
+}
+
+// Invoked by the parser when the payload is complete, or when the
+// connection is lost in the middle of it.
+void
+natsConn_endStream(natsConnection *nc, natsStatus status)
+{
+    natsSubscription    *sub    = NULL;
+    bool                remove  = false;
+
+    nc->ps->streaming = false;
+
+    if (nc->ps->streamSkip)
+        return;
+
+    sub = _getStreamSub(nc);
+    if (sub == NULL)
+        return;
+
+    (*(sub->streamEndCb))(nc, sub, status, sub->msgCbClosure);
+
+    natsSub_Lock(sub);
+    remove = ((sub->max > 0) && (sub->delivered >= sub->max));
+    natsSub_Unlock(sub);
+
+    // If we have hit the max for delivered msgs, remove sub.
+    if (remove)
+        natsConn_removeSubscription(nc, sub, true);
+
+    natsSub_release(sub);
+}
+
+// Queues the message to the subscription, or drops it if the subscription
+// is over its pending limits, in which case the subscription is retained and
+// true is returned: the caller then needs to invoke _processSlowConsumer()
+// once 'subsMu' is released. Must be invoked with 'subsMu' held.
+static bool
+_queueMsg(natsConnection *nc, natsSubscription *sub, natsMsg *msg,
+          int64_t bytes)
+{
+    bool slow = false;
+
+    // The subscription's lock is not needed to queue the message. It is
+    // acquired only if the consumer needs to be woken up.
+    if ((natsMsgQueue_Count(&(sub->msgList)) >= sub->pendingMax)
+        || (natsMsgQueue_Bytes(&(sub->msgList)) + bytes > sub->pendingBytesMax))
+    {
+        natsMsg_Destroy(msg);
+
+        NATS_ATOMIC64_ADD(&(sub->dropped), 1);
+
+        // The connection's lock is acquired before the subscriptions lock,
+        // so keep the subscription alive while we release the latter.
+        natsSub_retain(sub);
+        slow = true;
+    }
+    else
+    {
+        int     count;
+        int64_t pending;
+
+        if (NATS_ATOMIC_GET(&(sub->slowConsumer)) != 0)
+            NATS_ATOMIC_SET(&(sub->slowConsumer), 0);
 
-    subjLen = natsBuf_Len(nc->ps->ma.subject);
+        if (nc->latency != NULL)
+            msg->queuedAt = nats_NowInNanoSeconds();
 
-    if (nc->ps->ma.reply != NULL)
-    {
-        reply    = natsBuf_Data(nc->ps->ma.reply);
-        replyLen = natsBuf_Len(nc->ps->ma.reply);
+        count = natsMsgQueue_Push(&(sub->msgList), msg);
+
+        // Producers hold 'subsMu', so the high-water marks can't be
+        // raised concurrently.
+        if (count > NATS_ATOMIC_GET(&(sub->pendingMsgsHWM)))
+            NATS_ATOMIC_SET(&(sub->pendingMsgsHWM), count);
+        pending = natsMsgQueue_Bytes(&(sub->msgList));
+        if (pending > (int64_t) NATS_ATOMIC64_GET(&(sub->pendingBytesHWM)))
+            NATS_ATOMIC64_SET(&(sub->pendingBytesHWM), pending);
+
+        if (sub->dlvPool != NULL)
+        {
+            natsSub_scheduleDelivery(sub);
+        }
+        else if (sub->inlineDlv)
+        {
+            _scheduleInline(nc, sub);
+        }
+        else if (((count == 1) || (count == sub->signalLimit))
+                 && (NATS_ATOMIC_GET(&(sub->inWait)) > 0))
+        {
+            // Only the message that makes the list non empty, or that
+            // reaches the limit the delivery thread may be waiting for,
+            // needs to wake up the consumer. Others would find it busy.
+            natsSub_Lock(sub);
+            natsCondition_Broadcast(sub->cond);
+            natsSub_Unlock(sub);
+        }
     }
 
-    s = natsMsg_create(newMsg,
-                       (const char*) natsBuf_Data(nc->ps->ma.subject), subjLen,
-                       (const char*) reply, replyLen,
-                       (const char*) buf, bufLen);
-    return s;
+    return slow;
 }
 
 natsStatus
@@ -1646,69 +3444,176 @@ natsConn_processMsg(natsConnection *nc, char *buf, int bufLen)
     natsStatus       s    = NATS_OK;
     natsSubscription *sub = NULL;
     natsMsg          *msg = NULL;
+    bool             slow = false;
 
-    natsConn_Lock(nc);
+    NATS_ATOMIC64_ADD(&(nc->stats.inMsgs), 1);
+    NATS_ATOMIC64_ADD(&(nc->stats.inBytes), (uint64_t) bufLen);
 
-    nc->stats.inMsgs  += 1;
-    nc->stats.inBytes += (uint64_t) bufLen;
+    // Only the subscriptions lock is needed to dispatch the message, so that
+    // publishers and the flusher don't hold up the read loop, and vice-versa.
+    // Holding it prevents the subscription from being freed.
+    natsMutex_Lock(nc->subsMu);
 
     sub = natsHash_Get(nc->subs, nc->ps->ma.sid);
     if (sub == NULL)
     {
-        natsConn_Unlock(nc);
+        natsMutex_Unlock(nc->subsMu);
         return NATS_OK;
     }
 
     // Do this outside of sub's lock, even if we end-up having to destroy
-    // it because we have reached the maxPendingMsgs count. This reduces
-    // lock contention.
-    s = _createMsg(&msg, nc, buf, bufLen);
+    // it because we have reached the pending limits. This reduces lock
+    // contention.
+    s = _createMsg(&msg, nc, sub, buf, bufLen);
     if (s != NATS_OK)
     {
-        natsConn_Unlock(nc);
+        natsMutex_Unlock(nc->subsMu);
         return s;
     }
 
-    natsSub_Lock(sub);
+    slow = _queueMsg(nc, sub, msg, (int64_t) bufLen);
+
+    natsMutex_Unlock(nc->subsMu);
 
-    if (sub->msgList.count >= sub->pendingMax)
+    NATS_PROBE3(process__msg, nc->ps->ma.sid, bufLen, (int) slow);
+
+    if (slow)
     {
-        natsMsg_Destroy(msg);
+        NATS_PROBE2(slow__consumer, nc->ps->ma.sid, bufLen);
 
+        natsConn_Lock(nc);
         _processSlowConsumer(nc, sub);
+        natsConn_Unlock(nc);
+
+        natsSub_release(sub);
     }
-    else
-    {
-        sub->slowConsumer = false;
 
-        if (sub->msgList.head == NULL)
-            sub->msgList.head = msg;
+    return s;
+}
+
+// Returns true if the literal subject 'subj' matches the subject of a
+// subscription, which may contain wildcards.
+static bool
+_subjectMatches(const char *pattern, const char *subj, int subjLen)
+{
+    const char  *p   = pattern;
+    const char  *s   = subj;
+    const char  *end = subj + subjLen;
 
-        if (sub->msgList.tail != NULL)
-            sub->msgList.tail->next = msg;
+    while (*p != '\0')
+    {
+        const char *tokEnd = s;
 
-        sub->msgList.tail = msg;
+        // The full wildcard matches one or more tokens.
+        if ((p[0] == '>') && (p[1] == '\0'))
+            return (s < end);
 
-        sub->msgList.count++;
+        while ((tokEnd < end) && (*tokEnd != '.'))
+            tokEnd++;
 
-        if ((sub->noDelay)
-            || (sub->msgList.count >= sub->signalLimit))
+        if ((p[0] == '*') && ((p[1] == '.') || (p[1] == '\0')))
         {
-            if (sub->inWait > 0)
-                natsCondition_Broadcast(sub->cond);
+            p++;
         }
-        else if (sub->signalTimerInterval != 1)
+        else
         {
-            sub->signalTimerInterval = 1;
-            natsTimer_Reset(sub->signalTimer, 1);
+            for (; (*p != '\0') && (*p != '.'); p++, s++)
+            {
+                if ((s == tokEnd) || (*p != *s))
+                    return false;
+            }
+            if (s != tokEnd)
+                return false;
         }
+
+        s = tokEnd;
+
+        if (*p == '\0')
+            return (s == end);
+
+        // Both need another token.
+        p++;
+        if (s == end)
+            return false;
+        s++;
     }
 
-    natsSub_Unlock(sub);
+    return false;
+}
 
-    natsConn_Unlock(nc);
+natsStatus
+natsConn_deliverLocal(natsConnection *nc, const char *subj, int subjLen,
+                      const char *reply, int replyLen,
+                      const natsIOVec *iov, int iovcnt, int dataLen)
+{
+    natsStatus          s           = NATS_OK;
+    natsSubscription    *sub        = NULL;
+    natsMsg             *msg        = NULL;
+    natsSubscription    *slowLocal[8];
+    natsSubscription    **slowSubs  = slowLocal;
+    int                 slowCap     = (int) (sizeof(slowLocal) / sizeof(slowLocal[0]));
+    int                 slowCount   = 0;
+    natsHashIter        iter;
 
-    return s;
+    natsMutex_Lock(nc->subsMu);
+
+    natsHashIter_Init(&iter, nc->subs);
+    while ((s == NATS_OK) && natsHashIter_Next(&iter, NULL, (void**) &sub))
+    {
+        // There are no queue or streamed subscriptions (see _subscribe()).
+        if (!_subjectMatches(sub->subject, subj, subjLen))
+            continue;
+
+        s = natsMsg_createV(&msg, nc->msgPool,
+                            _getSharedSubject(nc, sub, subj, subjLen),
+                            subj, subjLen, reply, replyLen,
+                            iov, iovcnt, dataLen);
+        if (s != NATS_OK)
+            break;
+
+        NATS_ATOMIC64_ADD(&(nc->stats.inMsgs), 1);
+        NATS_ATOMIC64_ADD(&(nc->stats.inBytes), (uint64_t) dataLen);
+
+        if (!_queueMsg(nc, sub, msg, (int64_t) dataLen))
+            continue;
+
+        if (slowCount == slowCap)
+        {
+            natsSubscription **subs = NULL;
+
+            subs = (natsSubscription**) NATS_MALLOC(2 * slowCap * sizeof(natsSubscription*));
+            if (subs == NULL)
+            {
+                // The message is still accounted as dropped.
+                natsSub_release(sub);
+                continue;
+            }
+            memcpy(subs, slowSubs, slowCount * sizeof(natsSubscription*));
+            if (slowSubs != slowLocal)
+                NATS_FREE(slowSubs);
+            slowSubs = subs;
+            slowCap *= 2;
+        }
+        slowSubs[slowCount++] = sub;
+    }
+    natsHashIter_Done(&iter);
+
+    natsMutex_Unlock(nc->subsMu);
+
+    if (slowCount > 0)
+    {
+        natsConn_Lock(nc);
+        for (int i=0; i<slowCount; i++)
+            _processSlowConsumer(nc, slowSubs[i]);
+        natsConn_Unlock(nc);
+
+        for (int i=0; i<slowCount; i++)
+            natsSub_release(slowSubs[i]);
+    }
+    if (slowSubs != slowLocal)
+        NATS_FREE(slowSubs);
+
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 void
@@ -1748,15 +3653,47 @@ natsConn_processPing(natsConnection *nc)
     _sendProto(nc, _PONG_PROTO_, _PONG_PROTO_LEN_);
 }
 
+void
+natsConn_completeFlushRequests(natsConnection *nc, natsFlushReq *reqs,
+                               natsStatus s)
+{
+    natsFlushReq *req;
+
+    while ((req = reqs) != NULL)
+    {
+        reqs = req->next;
+
+        (*(req->cb))(nc, s, req->closure);
+
+        NATS_FREE(req);
+    }
+}
+
 void
 natsConn_processPong(natsConnection *nc)
 {
-    natsPong *pong = NULL;
+    natsPong        *pong = NULL;
+    natsSrv         *srv  = NULL;
+    natsFlushReq    *reqs = NULL;
 
     natsConn_Lock(nc);
 
     nc->pongs.incoming++;
 
+    // PONGs come back in order, so this is the answer to the timed PING.
+    if ((nc->pongs.timerPingId != 0)
+        && (nc->pongs.timerPingId == nc->pongs.incoming))
+    {
+        srv = natsSrvPool_GetCurrentServer(nc->srvPool, nc->url, NULL);
+        if (srv != NULL)
+            natsSrvPool_UpdateRTT(srv, nats_NowInNanoSeconds()
+                                       - nc->pongs.timerPingSent);
+
+        nc->pongs.timerPingId = 0;
+    }
+
+    nc->pingReads = NATS_ATOMIC64_GET(&(nc->reads));
+
     // Check if the first pong's id in the list matches the incoming Id.
     if (((pong = nc->pongs.head) != NULL)
         && (pong->id == nc->pongs.incoming))
@@ -1764,18 +3701,30 @@ natsConn_processPong(natsConnection *nc)
         // Remove the pong from the list
         _removePongFromList(nc, pong);
 
-        // Release the Flush[Timeout] call
-        pong->id = 0;
+        if (pong->flushReqs != NULL)
+        {
+            // Asynchronous flushes are completed after releasing the lock.
+            reqs = pong->flushReqs;
+            NATS_FREE(pong);
+        }
+        else
+        {
+            // Release the Flush[Timeout] call
+            pong->id = 0;
 
-        // There may be more than one thread waiting on this
-        // condition variable, so we use broadcast instead of
-        // signal.
-        natsCondition_Broadcast(nc->pongs.cond);
+            // There may be more than one thread waiting on this
+            // condition variable, so we use broadcast instead of
+            // signal.
+            natsCondition_Broadcast(nc->pongs.cond);
+        }
     }
 
     nc->pout = 0;
 
     natsConn_Unlock(nc);
+
+    if (reqs != NULL)
+        natsConn_completeFlushRequests(nc, reqs, NATS_OK);
 }
 
 natsStatus
@@ -1784,7 +3733,10 @@ natsConn_addSubcription(natsConnection *nc, natsSubscription *sub)
     natsStatus          s       = NATS_OK;
     natsSubscription    *oldSub = NULL;
 
+    natsMutex_Lock(nc->subsMu);
     s = natsHash_Set(nc->subs, sub->sid, (void*) sub, (void**) &oldSub);
+    natsMutex_Unlock(nc->subsMu);
+
     if (s == NATS_OK)
     {
         assert(oldSub == NULL);
@@ -1802,12 +3754,19 @@ natsConn_removeSubscription(natsConnection *nc, natsSubscription *removedSub, bo
     if (needsLock)
         natsConn_Lock(nc);
 
+    natsMutex_Lock(nc->subsMu);
     sub = natsHash_Remove(nc->subs, removedSub->sid);
+    natsMutex_Unlock(nc->subsMu);
 
     // Note that the sub may have already been removed, so 'sub == NULL'
     // is not an error.
     if (sub != NULL)
+    {
+        if (sub->streaming)
+            (void) NATS_ATOMIC_DEC(&(nc->streamSubs));
+
         natsSub_close(sub, false);
+    }
 
     if (needsLock)
         natsConn_Unlock(nc);
@@ -1819,10 +3778,14 @@ natsConn_removeSubscription(natsConnection *nc, natsSubscription *removedSub, bo
 
 // subscribe is the internal subscribe function that indicates interest in a
 // subject.
-natsStatus
-natsConn_subscribe(natsSubscription **newSub,
-                   natsConnection *nc, const char *subj, const char *queue,
-                   natsMsgHandler cb, void *cbClosure, bool noDelay)
+static natsStatus
+_subscribe(natsSubscription **newSub,
+           natsConnection *nc, const char *subj, const char *queue,
+           natsMsgHandler cb, natsMsgBatchHandler batchCb,
+           int maxBatch, int64_t maxWait, void *cbClosure, bool noDelay,
+           natsStreamBeginHandler beginCb, natsStreamChunkHandler chunkCb,
+           natsStreamEndHandler endCb, int workers, natsMsgKeyHandler keyCb,
+           bool balanced)
 {
     natsStatus          s    = NATS_OK;
     natsSubscription    *sub = NULL;
@@ -1842,11 +3805,39 @@ natsConn_subscribe(natsSubscription **newSub,
         return nats_setDefaultError(NATS_CONNECTION_CLOSED);
     }
 
-    s = natsSub_create(&sub, nc, subj, queue, cb, cbClosure, noDelay);
+    // The messages published by this connection would never reach them:
+    // the server does not send them back, and they are not delivered
+    // locally. This is checked against the option, not against what the
+    // server supports, since it may change on reconnect.
+    if (nc->opts->localDelivery && ((queue != NULL) || (chunkCb != NULL)))
+    {
+        natsConn_Unlock(nc);
+
+        return nats_setError(NATS_ILLEGAL_STATE, "%s", LOCAL_DLV_ERR);
+    }
+
+    s = natsSub_create(&sub, nc, subj, queue, cb, batchCb, maxBatch, maxWait,
+                       cbClosure, noDelay, workers, keyCb);
+    if (s == NATS_OK)
+    {
+        // The delivery and worker threads read it once they get the
+        // connection's lock.
+        sub->balanced = balanced;
+    }
+    if ((s == NATS_OK) && (chunkCb != NULL))
+    {
+        // Set before the subscription can be found by the parser.
+        sub->streaming     = true;
+        sub->streamBeginCb = beginCb;
+        sub->streamChunkCb = chunkCb;
+        sub->streamEndCb   = endCb;
+    }
     if (s == NATS_OK)
     {
         sub->sid = ++(nc->ssid);
         s = natsConn_addSubcription(nc, sub);
+        if ((s == NATS_OK) && sub->streaming)
+            (void) NATS_ATOMIC_INC(&(nc->streamSubs));
     }
 
     if (s == NATS_OK)
@@ -1867,95 +3858,352 @@ natsConn_subscribe(natsSubscription **newSub,
 
             if (s == NATS_OK)
             {
+                natsConn_writeLock(nc);
+
                 s = natsConn_bufferWriteString(nc, proto);
                 if (s == NATS_OK)
                     natsConn_kickFlusher(nc);
 
+                natsConn_writeUnlock(nc);
+
                 // We should not return a failure if we get an issue
                 // with the buffer write (except if it is no memory).
                 // For IO errors (if we just got disconnected), the
                 // reconnect logic will resend the sub protocol.
 
-                if (s != NATS_NO_MEMORY)
-                    s = NATS_OK;
-            }
+                if (s != NATS_NO_MEMORY)
+                    s = NATS_OK;
+            }
+
+            NATS_FREE(proto);
+        }
+    }
+
+    if (s == NATS_OK)
+    {
+        *newSub = sub;
+    }
+    else if (sub != NULL)
+    {
+        // A delivery thread may have been started, but the subscription not
+        // added to the connection's subscription map. So this is necessary
+        // for the delivery thread to unroll.
+        natsSub_close(sub, false);
+
+        natsConn_removeSubscription(nc, sub, false);
+
+        natsSub_release(sub);
+    }
+
+    natsConn_Unlock(nc);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribe(natsSubscription **newSub,
+                   natsConnection *nc, const char *subj, const char *queue,
+                   natsMsgHandler cb, void *cbClosure, bool noDelay)
+{
+    natsStatus s;
+
+    s = _subscribe(newSub, nc, subj, queue, cb, NULL, 0, 0, cbClosure, noDelay,
+                   NULL, NULL, NULL, 0, NULL, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribeBatch(natsSubscription **newSub,
+                        natsConnection *nc, const char *subj,
+                        natsMsgBatchHandler batchCb, int maxBatch,
+                        int64_t maxWait, void *cbClosure)
+{
+    natsStatus s;
+
+    s = _subscribe(newSub, nc, subj, NULL, NULL, batchCb, maxBatch, maxWait,
+                   cbClosure, false, NULL, NULL, NULL, 0, NULL, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribeKeyed(natsSubscription **newSub,
+                        natsConnection *nc, const char *subj,
+                        natsMsgHandler cb, void *cbClosure, int workers,
+                        natsMsgKeyHandler keyCb)
+{
+    natsStatus s;
+
+    s = _subscribe(newSub, nc, subj, NULL, cb, NULL, 0, 0, cbClosure, false,
+                   NULL, NULL, NULL, workers, keyCb, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribeWorkers(natsSubscription **newSub,
+                          natsConnection *nc, const char *subj,
+                          const char *queue, natsMsgHandler cb,
+                          void *cbClosure, int workers)
+{
+    natsStatus s;
+
+    s = _subscribe(newSub, nc, subj, queue, cb, NULL, 0, 0, cbClosure, false,
+                   NULL, NULL, NULL, workers, NULL, true);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribeStream(natsSubscription **newSub,
+                         natsConnection *nc, const char *subj,
+                         natsStreamBeginHandler beginCb,
+                         natsStreamChunkHandler chunkCb,
+                         natsStreamEndHandler endCb, void *cbClosure)
+{
+    natsStatus s;
+
+    s = _subscribe(newSub, nc, subj, NULL, NULL, NULL, 0, 0, cbClosure, false,
+                   beginCb, chunkCb, endCb, 0, NULL, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Performs the low level unsubscribe to the server.
+natsStatus
+natsConn_unsubscribe(natsConnection *nc, natsSubscription *sub, int max)
+{
+    natsStatus      s = NATS_OK;
+
+    natsConn_Lock(nc);
+
+    if (natsConn_isClosed(nc))
+    {
+        natsConn_Unlock(nc);
+        return nats_setDefaultError(NATS_CONNECTION_CLOSED);
+    }
+
+    sub = natsHash_Get(nc->subs, sub->sid);
+    if (sub == NULL)
+    {
+        // Already unsubscribed
+        natsConn_Unlock(nc);
+        return NATS_OK;
+    }
+
+    natsSub_Lock(sub);
+    sub->max = max;
+    natsSub_Unlock(sub);
+
+    if (max == 0)
+        natsConn_removeSubscription(nc, sub, false);
+
+    if (!_isReconnecting(nc))
+    {
+        // We will send these for all subs when we reconnect
+        // so that we can suppress here.
+        natsConn_writeLock(nc);
+
+        s = _sendUnsubProto(nc, sub->sid, max);
+        if (s == NATS_OK)
+            natsConn_kickFlusher(nc);
+
+        natsConn_writeUnlock(nc);
+
+        // We should not return a failure if we get an issue
+        // with the buffer write (except if it is no memory).
+        // For IO errors (if we just got disconnected), the
+        // reconnect logic will resend the unsub protocol.
+        if ((s != NATS_OK) && (s != NATS_NO_MEMORY))
+        {
+            nats_clearLastError();
+            s = NATS_OK;
+        }
+    }
+
+    natsConn_Unlock(nc);
+
+    return s;
+}
+
+// Writes the 'len' bytes of the protocols of several subscriptions at once.
+// Must be invoked with the connection lock held.
+static natsStatus
+_sendSubsProtos(natsConnection *nc, const char *protos, int len)
+{
+    natsStatus s = NATS_OK;
+
+    // We will send these for all subs when we reconnect
+    // so that we can suppress here.
+    if (_isReconnecting(nc) || (len == 0))
+        return NATS_OK;
+
+    natsConn_writeLock(nc);
+
+    s = natsConn_bufferWrite(nc, protos, len);
+    if (s == NATS_OK)
+        natsConn_kickFlusher(nc);
+
+    natsConn_writeUnlock(nc);
+
+    // As for a single subscription, only a memory issue is reported. The
+    // reconnect logic will resend the protocols otherwise.
+    if ((s != NATS_OK) && (s != NATS_NO_MEMORY))
+    {
+        nats_clearLastError();
+        s = NATS_OK;
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConn_subscribeMany(natsSubscription **subs, natsConnection *nc,
+                       const char **subjects, int count,
+                       natsMsgHandler cb, void *cbClosure)
+{
+    natsStatus          s       = NATS_OK;
+    natsSubscription    *sub    = NULL;
+    char                *buf    = NULL;
+    int                 size    = 0;
+    int                 len     = 0;
+    int                 created = 0;
+    int                 n;
+
+    if ((nc == NULL) || (subs == NULL) || (subjects == NULL) || (count <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
 
-            NATS_FREE(proto);
-        }
+    for (int i = 0; i < count; i++)
+    {
+        if ((subjects[i] == NULL) || (subjects[i][0] == '\0'))
+            return nats_setDefaultError(NATS_INVALID_SUBJECT);
+
+        size += (int) strlen(subjects[i]) + SUB_REPLAY_OVERHEAD;
     }
 
+    // Room for the terminating NULL character written by snprintf.
+    buf = (char*) NATS_MALLOC(size + 1);
+    if (buf == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    natsConn_Lock(nc);
+
+    if (natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+
     if (s == NATS_OK)
     {
-        *newSub = sub;
+        natsMutex_Lock(nc->subsMu);
+        s = natsHash_Reserve(nc->subs, count);
+        natsMutex_Unlock(nc->subsMu);
     }
-    else if (sub != NULL)
+
+    for (int i = 0; (s == NATS_OK) && (i < count); i++)
     {
-        // A delivery thread may have been started, but the subscription not
-        // added to the connection's subscription map. So this is necessary
-        // for the delivery thread to unroll.
-        natsSub_close(sub, false);
+        sub = NULL;
 
-        natsConn_removeSubscription(nc, sub, false);
+        s = natsSub_create(&sub, nc, subjects[i], NULL, cb, NULL, 0, 0,
+                           cbClosure, false, 0, NULL);
+        if (s == NATS_OK)
+        {
+            sub->sid = ++(nc->ssid);
+            s = natsConn_addSubcription(nc, sub);
+        }
+        if (s == NATS_OK)
+        {
+            n = snprintf(buf + len, size + 1 - len, _SUB_PROTO_,
+                         subjects[i], "", (int) sub->sid);
+            if ((n < 0) || (len + n > size))
+                s = nats_setError(NATS_ERR, "%s", "unable to build subscriptions protocols");
+            else
+                len += n;
+        }
+        if (s == NATS_OK)
+        {
+            subs[created++] = sub;
+        }
+        else if (sub != NULL)
+        {
+            natsSub_close(sub, false);
+            natsConn_removeSubscription(nc, sub, false);
+            natsSub_release(sub);
+        }
+    }
 
-        natsSub_release(sub);
+    if (s == NATS_OK)
+        s = _sendSubsProtos(nc, buf, len);
+
+    if (s != NATS_OK)
+    {
+        // Don't leave any of the subscriptions created so far, the server
+        // has not been notified of any of them.
+        for (int i = 0; i < created; i++)
+        {
+            natsConn_removeSubscription(nc, subs[i], false);
+            natsSub_release(subs[i]);
+            subs[i] = NULL;
+        }
     }
 
     natsConn_Unlock(nc);
 
+    NATS_FREE(buf);
+
     return NATS_UPDATE_ERR_STACK(s);
 }
 
-// Performs the low level unsubscribe to the server.
 natsStatus
-natsConn_unsubscribe(natsConnection *nc, natsSubscription *sub, int max)
+natsConn_unsubscribeMany(natsConnection *nc, natsSubscription **subs,
+                         int count)
 {
-    natsStatus      s = NATS_OK;
+    natsStatus          s    = NATS_OK;
+    natsSubscription    *sub = NULL;
+    char                *buf = NULL;
+    int                 size = count * SUB_REPLAY_OVERHEAD;
+    int                 len  = 0;
+    int                 n;
+
+    // Room for the terminating NULL character written by snprintf.
+    buf = (char*) NATS_MALLOC(size + 1);
+    if (buf == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
 
     natsConn_Lock(nc);
 
     if (natsConn_isClosed(nc))
-    {
-        natsConn_Unlock(nc);
-        return nats_setDefaultError(NATS_CONNECTION_CLOSED);
-    }
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
 
-    sub = natsHash_Get(nc->subs, sub->sid);
-    if (sub == NULL)
+    for (int i = 0; (s == NATS_OK) && (i < count); i++)
     {
-        // Already unsubscribed
-        natsConn_Unlock(nc);
-        return NATS_OK;
-    }
-
-    natsSub_Lock(sub);
-    sub->max = max;
-    natsSub_Unlock(sub);
+        sub = natsHash_Get(nc->subs, subs[i]->sid);
+        if (sub == NULL)
+        {
+            // Already unsubscribed
+            continue;
+        }
 
-    if (max == 0)
-        natsConn_removeSubscription(nc, sub, false);
+        natsSub_Lock(sub);
+        sub->max = 0;
+        natsSub_Unlock(sub);
 
-    if (!_isReconnecting(nc))
-    {
-        // We will send these for all subs when we reconnect
-        // so that we can suppress here.
-        s = _sendUnsubProto(nc, sub->sid, max);
-        if (s == NATS_OK)
-            natsConn_kickFlusher(nc);
+        n = snprintf(buf + len, size + 1 - len, _UNSUB_NO_MAX_PROTO_, sub->sid);
+        if ((n < 0) || (len + n > size))
+            s = nats_setError(NATS_ERR, "%s", "unable to build unsubscribe protocols");
+        else
+            len += n;
 
-        // We should not return a failure if we get an issue
-        // with the buffer write (except if it is no memory).
-        // For IO errors (if we just got disconnected), the
-        // reconnect logic will resend the unsub protocol.
-        if ((s != NATS_OK) && (s != NATS_NO_MEMORY))
-        {
-            nats_clearLastError();
-            s = NATS_OK;
-        }
+        natsConn_removeSubscription(nc, sub, false);
     }
 
+    if (s == NATS_OK)
+        s = _sendSubsProtos(nc, buf, len);
+
     natsConn_Unlock(nc);
 
-    return s;
+    NATS_FREE(buf);
+
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 static natsStatus
@@ -1995,21 +4243,45 @@ natsConn_create(natsConnection **newConn, natsOptions *options)
     nc->sockCtx.fd  = NATS_SOCK_INVALID;
     nc->opts        = options;
 
+    // Connections of different processes, or of the same one, started at
+    // the same time must not reconnect in lockstep.
+    nc->reconnectRnd = ((uint64_t) nats_NowInNanoSeconds())
+                       ^ (((uint64_t) nats_getpid()) << 32)
+                       ^ ((uint64_t) (uintptr_t) nc);
+
     if (nc->opts->maxPingsOut == 0)
         nc->opts->maxPingsOut = NATS_OPTS_DEFAULT_MAX_PING_OUT;
 
     if (nc->opts->maxPendingMsgs == 0)
         nc->opts->maxPendingMsgs = NATS_OPTS_DEFAULT_MAX_PENDING_MSGS;
 
+    if (nc->opts->maxPendingBytes == 0)
+        nc->opts->maxPendingBytes = NATS_OPTS_DEFAULT_MAX_PENDING_BYTES;
+
+    // There is no thread to reconnect, and the application replaces both
+    // the event loop and the delivery threads. A blocked publisher would
+    // wait for the very thread that writes the buffer, so it fails instead.
+    if (nc->opts->callerDrivenIO)
+    {
+        nc->opts->allowReconnect   = false;
+        nc->opts->useSharedEvLoop  = false;
+        nc->opts->useSharedDlvPool = false;
+
+        if (nc->opts->writeWMPolicy == NATS_WATERMARK_BLOCK)
+            nc->opts->writeWMPolicy = NATS_WATERMARK_FAIL;
+    }
+
     nc->errStr[0] = '\0';
 
-    s = natsMutex_Create(&(nc->mu));
+    s = natsMutex_CreateEx(&(nc->mu), NATS_LOCK_CONN);
+    if (s == NATS_OK)
+        s = natsMutex_CreateEx(&(nc->wmu), NATS_LOCK_CONN_WRITE);
+    if (s == NATS_OK)
+        s = natsMutex_CreateEx(&(nc->subsMu), NATS_LOCK_CONN_SUBS);
     if (s == NATS_OK)
         s = _setupServerPool(nc);
     if (s == NATS_OK)
         s = natsHash_Create(&(nc->subs), 8);
-    if (s == NATS_OK)
-        s =  natsSock_CreateFDSet(&(nc->sockCtx.fdSet));
     if (s == NATS_OK)
     {
         s = natsBuf_Create(&(nc->scratch), DEFAULT_SCRATCH_SIZE);
@@ -2018,8 +4290,29 @@ natsConn_create(natsConnection **newConn, natsOptions *options)
     }
     if (s == NATS_OK)
         s = natsCondition_Create(&(nc->flusherCond));
+    if ((s == NATS_OK) && (nc->opts->writeHWM > 0))
+        s = natsCondition_Create(&(nc->wmCond));
+    if (s == NATS_OK)
+        s = natsCondition_Create(&(nc->reconnectCond));
     if (s == NATS_OK)
         s = natsCondition_Create(&(nc->pongs.cond));
+    if ((s == NATS_OK) && (nc->opts->msgPoolSize > 0))
+        s = natsMsgPool_Create(&(nc->msgPool), nc->opts->msgPoolSize);
+    if ((s == NATS_OK) && nc->opts->latencyStats)
+    {
+        nc->latency = (natsHistogram*) NATS_CALLOC(NATS_LATENCY_TYPES,
+                                                   sizeof(natsHistogram));
+        if (nc->latency == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if ((s == NATS_OK) && (nc->opts->codecId != 0))
+    {
+        s = natsCodec_Create(&(nc->codec), nc->opts->codecId,
+                             nc->opts->codecEncoder, nc->opts->codecDecoder,
+                             nc->opts->codecClosure, nc->opts->codecMinSize);
+    }
+    if ((s == NATS_OK) && (nc->opts->captureFile != NULL))
+        s = natsCapture_Create(&(nc->capture), nc->opts->captureFile);
 
     if (s == NATS_OK)
         *newConn = nc;
@@ -2118,6 +4411,23 @@ natsConnection_IsReconnecting(natsConnection *nc)
     return reconnecting;
 }
 
+bool
+natsConnection_IsKernelTLS(natsConnection *nc)
+{
+    bool ktls;
+
+    if (nc == NULL)
+        return false;
+
+    natsConn_Lock(nc);
+
+    ktls = nc->sockCtx.ktlsSend;
+
+    natsConn_Unlock(nc);
+
+    return ktls;
+}
+
 // Returns the current state of the connection.
 natsConnStatus
 natsConnection_Status(natsConnection *nc)
@@ -2151,6 +4461,7 @@ natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout)
 {
     natsStatus  s       = NATS_OK;
     int64_t     target  = 0;
+    int64_t     start   = 0;
     natsPong    *pong   = NULL;
 
     if (nc == NULL)
@@ -2179,8 +4490,11 @@ natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout)
 
     if (s == NATS_OK)
     {
+        if (nc->latency != NULL)
+            start = nats_NowInNanoSeconds();
+
         // Send the ping (and add the pong to the list)
-        _sendPing(nc, pong);
+        (void) _sendPing(nc, pong);
 
         target = nats_Now() + timeout;
 
@@ -2191,7 +4505,10 @@ natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout)
                && !natsConn_isClosed(nc)
                && (pong->id > 0))
         {
-            s = natsCondition_AbsoluteTimedWait(nc->pongs.cond, nc->mu, target);
+            if (nc->opts->callerDrivenIO)
+                s = natsConn_waitAndProcessIO(nc, target);
+            else
+                s = natsCondition_AbsoluteTimedWait(nc->pongs.cond, nc->mu, target);
         }
 
         if ((s == NATS_OK) && (nc->status == CLOSED))
@@ -2212,6 +4529,10 @@ natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout)
             // error occurred. Make sure the request is no longer in the list.
             _removePongFromList(nc, pong);
         }
+        else if (nc->latency != NULL)
+        {
+            natsHistogram_RecordSince(&(nc->latency[NATS_LATENCY_FLUSH]), start);
+        }
 
         // We are done with the pong
         _destroyPong(nc, pong);
@@ -2222,6 +4543,73 @@ natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+natsStatus
+natsConnection_FlushAsync(natsConnection *nc, natsFlushHandler cb,
+                          void *closure)
+{
+    natsStatus      s       = NATS_OK;
+    natsFlushReq    *req    = NULL;
+    natsPong        *pong   = NULL;
+    bool            share   = false;
+
+    if ((nc == NULL) || (cb == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsConn_Lock(nc);
+
+    if (natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+
+    if (s == NATS_OK)
+    {
+        req = (natsFlushReq*) NATS_CALLOC(1, sizeof(natsFlushReq));
+        if (req == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if (s == NATS_OK)
+    {
+        req->cb      = cb;
+        req->closure = closure;
+
+        // If nothing was written since the last PING sent for asynchronous
+        // flushes, its PONG completes this flush too.
+        pong = nc->pongs.tail;
+        if ((pong != NULL) && (pong->flushReqs != NULL))
+        {
+            natsConn_writeLock(nc);
+            share = (pong->writes == nc->writes);
+            natsConn_writeUnlock(nc);
+        }
+        if (share)
+        {
+            req->next       = pong->flushReqs;
+            pong->flushReqs = req;
+        }
+        else
+        {
+            pong = (natsPong*) NATS_CALLOC(1, sizeof(natsPong));
+            if (pong == NULL)
+                s = nats_setDefaultError(NATS_NO_MEMORY);
+
+            if (s == NATS_OK)
+            {
+                pong->flushReqs = req;
+
+                s = _sendPing(nc, pong);
+            }
+            if (s != NATS_OK)
+            {
+                NATS_FREE(pong);
+                NATS_FREE(req);
+            }
+        }
+    }
+
+    natsConn_Unlock(nc);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 natsStatus
 natsConnection_Flush(natsConnection *nc)
 {
@@ -2237,12 +4625,12 @@ natsConnection_Buffered(natsConnection *nc)
     if (nc == NULL)
         return nats_setDefaultError(NATS_INVALID_ARG);
 
-    natsConn_Lock(nc);
+    natsConn_writeLock(nc);
 
     if ((nc->status != CLOSED) && (nc->bw != NULL))
         buffered = natsBuf_Len(nc->bw);
 
-    natsConn_Unlock(nc);
+    natsConn_writeUnlock(nc);
 
     return buffered;
 }
@@ -2272,13 +4660,28 @@ natsConnection_GetStats(natsConnection *nc, natsStatistics *stats)
     if ((nc == NULL) || (stats == NULL))
         return nats_setDefaultError(NATS_INVALID_ARG);
 
-    natsConn_Lock(nc);
+    // The counters are updated atomically, so we don't need the
+    // connection's lock, which would otherwise be contended with the
+    // read and write paths.
+    stats->inMsgs     = NATS_ATOMIC64_GET(&(nc->stats.inMsgs));
+    stats->inBytes    = NATS_ATOMIC64_GET(&(nc->stats.inBytes));
+    stats->outMsgs    = NATS_ATOMIC64_GET(&(nc->stats.outMsgs));
+    stats->outBytes   = NATS_ATOMIC64_GET(&(nc->stats.outBytes));
+    stats->reconnects = NATS_ATOMIC64_GET(&(nc->stats.reconnects));
 
-    memcpy(stats, &(nc->stats), sizeof(natsStatistics));
+    stats->msgPoolHits   = 0;
+    stats->msgPoolMisses = 0;
 
-    natsConn_Unlock(nc);
+    // The pool is created with the connection and released when it is freed.
+    if (nc->msgPool != NULL)
+        natsMsgPool_GetCounts(nc->msgPool, &(stats->msgPoolHits),
+                              &(stats->msgPoolMisses));
 
-    return s;
+    // So are the histograms.
+    if (nc->latency != NULL)
+        s = natsStatistics_setLatency(stats, nc->latency);
+
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 natsStatus
@@ -2366,6 +4769,9 @@ natsConnection_Close(natsConnection *nc)
 
     _close(nc, CLOSED, true);
 
+    if (nc->opts->callerDrivenIO)
+        _dispatchInlineCbs(nc);
+
     nats_doNotUpdateErrStack(false);
 }
 
@@ -2379,8 +4785,109 @@ natsConnection_Destroy(natsConnection *nc)
 
     _close(nc, CLOSED, true);
 
+    if (nc->opts->callerDrivenIO)
+        _dispatchInlineCbs(nc);
+
     nats_doNotUpdateErrStack(false);
 
     natsConn_release(nc);
 }
 
+natsStatus
+natsConnection_GetFd(natsConnection *nc, natsSock *fd)
+{
+    natsStatus s = NATS_OK;
+
+    if ((nc == NULL) || (fd == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsConn_Lock(nc);
+
+    if (!(nc->opts->callerDrivenIO))
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s", CALLER_DRIVEN_IO_ERR);
+    else if (natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+    else
+        *fd = nc->sockCtx.fd;
+
+    natsConn_Unlock(nc);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnection_ProcessIO(natsConnection *nc, int events)
+{
+    natsStatus s = NATS_OK;
+
+    if (nc == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsConn_lockAndRetain(nc);
+
+    if (!(nc->opts->callerDrivenIO))
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s", CALLER_DRIVEN_IO_ERR);
+
+    natsConn_Unlock(nc);
+
+    if (s == NATS_OK)
+    {
+        _processIO(nc, events);
+
+        natsConn_Lock(nc);
+        if (natsConn_isClosed(nc))
+            s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+        natsConn_Unlock(nc);
+    }
+
+    natsConn_release(nc);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnection_ProcessTimers(natsConnection *nc, int64_t now)
+{
+    natsStatus  s       = NATS_OK;
+    bool        ping    = false;
+
+    if (nc == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsConn_lockAndRetain(nc);
+
+    if (!(nc->opts->callerDrivenIO))
+    {
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s", CALLER_DRIVEN_IO_ERR);
+    }
+    else if ((nc->opts->pingInterval > 0)
+             && (nc->status == CONNECTED)
+             && (now >= nc->nextPing))
+    {
+        nc->nextPing = now + nc->opts->pingInterval;
+        ping         = true;
+    }
+
+    if (s == NATS_OK)
+        _expireRequests(nc, now);
+
+    natsConn_Unlock(nc);
+
+    if (s == NATS_OK)
+    {
+        if (ping)
+            _processPingTimer(NULL, (void*) nc);
+
+        _dispatchInlineCbs(nc);
+
+        natsConn_Lock(nc);
+        if (natsConn_isClosed(nc))
+            s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+        natsConn_Unlock(nc);
+    }
+
+    natsConn_release(nc);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
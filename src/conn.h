@@ -10,6 +10,8 @@
 
 void natsConn_Lock(natsConnection *nc);
 void natsConn_Unlock(natsConnection *nc);
+void natsConn_writeLock(natsConnection *nc);
+void natsConn_writeUnlock(natsConnection *nc);
 
 #else
 // We know what we are doing :-)
@@ -17,6 +19,9 @@ void natsConn_Unlock(natsConnection *nc);
 #define natsConn_Lock(c)    (natsMutex_Lock((c)->mu))
 #define natsConn_Unlock(c)  (natsMutex_Unlock((c)->mu))
 
+#define natsConn_writeLock(c)   (natsMutex_Lock((c)->wmu))
+#define natsConn_writeUnlock(c) (natsMutex_Unlock((c)->wmu))
+
 #endif // DEV_MODE
 
 natsStatus
@@ -28,21 +33,88 @@ natsConn_retain(natsConnection *nc);
 void
 natsConn_release(natsConnection *nc);
 
+// The natsConn_buffer*() functions and natsConn_kickFlusher() must be called
+// with the connection's write lock held.
 natsStatus
 natsConn_bufferWrite(natsConnection *nc, const char *buffer, int len);
 
+// Writes a message, that is, the protocol header 'hdr', the payload 'data'
+// and the trailing CRLF. Messages that don't fit in the write buffer are
+// written along with the buffered data using a single gathering socket write,
+// without copying the payload.
+natsStatus
+natsConn_bufferWriteMsg(natsConnection *nc, const char *hdr, int hdrLen,
+                        const char *data, int dataLen);
+
+// Same as natsConn_bufferWriteMsg() with a payload made of the 'iovcnt'
+// fragments of 'iov', whose total length is 'dataLen'.
+natsStatus
+natsConn_bufferWriteMsgV(natsConnection *nc, const char *hdr, int hdrLen,
+                         const natsIOVec *iov, int iovcnt, int dataLen);
+
 natsStatus
 natsConn_bufferFlush(natsConnection *nc);
 
+// Updates the state of the write watermarks, with the write lock held, once
+// data has been buffered or written. Returns true if the callback has to be
+// posted, after the write lock is released, with 'high' telling which
+// watermark was crossed.
+bool
+natsConn_updateWatermark(natsConnection *nc, bool *high);
+
+// Applies the policy of the write watermarks before a publish, with the
+// write lock held: fails, or waits (releasing the lock), while over the
+// high watermark.
+natsStatus
+natsConn_waitWatermark(natsConnection *nc);
+
 bool
 natsConn_isClosed(natsConnection *nc);
 
 void
 natsConn_kickFlusher(natsConnection *nc);
 
+// Invoked by the shared event loop when the connection's socket is readable.
+// Returns 'false' if the loop should stop watching the socket.
+bool
+natsConn_evLoopRead(natsConnection *nc);
+
+// Invoked by the shared event loop to flush the connection's write buffer.
+// Returns 'true' if some data could not be written without blocking.
+bool
+natsConn_evLoopWrite(natsConnection *nc);
+
+// Queues a callback of a connection with caller driven I/O, to be invoked
+// from the application's thread.
+void
+natsConn_postInlineCb(natsConnection *nc, natsAsyncCbInfo *cb);
+
+// With caller driven I/O, there is no thread to read the reply a blocking
+// call waits for, so wait until 'target' for the socket to be ready and
+// process it. Invoked with the connection's lock held once, which is
+// released during the wait.
+natsStatus
+natsConn_waitAndProcessIO(natsConnection *nc, int64_t target);
+
 natsStatus
 natsConn_processMsg(natsConnection *nc, char *buf, int bufLen);
 
+// Delivers a message published on this connection to its subscriptions
+// whose subject matches (see natsOptions_SetLocalDelivery()).
+natsStatus
+natsConn_deliverLocal(natsConnection *nc, const char *subj, int subjLen,
+                      const char *reply, int replyLen,
+                      const natsIOVec *iov, int iovcnt, int dataLen);
+
+bool
+natsConn_beginStream(natsConnection *nc);
+
+void
+natsConn_streamChunk(natsConnection *nc, const char *data, int dataLen);
+
+void
+natsConn_endStream(natsConnection *nc, natsStatus status);
+
 void
 natsConn_processOK(natsConnection *nc);
 
@@ -55,14 +127,56 @@ natsConn_processPing(natsConnection *nc);
 void
 natsConn_processPong(natsConnection *nc);
 
+// Invokes the callbacks of, and frees, the list of asynchronous flushes.
+void
+natsConn_completeFlushRequests(natsConnection *nc, natsFlushReq *reqs,
+                               natsStatus s);
+
 natsStatus
 natsConn_subscribe(natsSubscription **newSub,
                    natsConnection *nc, const char *subj, const char *queue,
                    natsMsgHandler cb, void *cbClosure, bool noDelay);
 
+natsStatus
+natsConn_subscribeBatch(natsSubscription **newSub,
+                        natsConnection *nc, const char *subj,
+                        natsMsgBatchHandler batchCb, int maxBatch,
+                        int64_t maxWait, void *cbClosure);
+
+natsStatus
+natsConn_subscribeKeyed(natsSubscription **newSub,
+                        natsConnection *nc, const char *subj,
+                        natsMsgHandler cb, void *cbClosure, int workers,
+                        natsMsgKeyHandler keyCb);
+
+natsStatus
+natsConn_subscribeWorkers(natsSubscription **newSub,
+                          natsConnection *nc, const char *subj,
+                          const char *queue, natsMsgHandler cb,
+                          void *cbClosure, int workers);
+
+natsStatus
+natsConn_subscribeStream(natsSubscription **newSub,
+                         natsConnection *nc, const char *subj,
+                         natsStreamBeginHandler beginCb,
+                         natsStreamChunkHandler chunkCb,
+                         natsStreamEndHandler endCb, void *cbClosure);
+
+natsStatus
+natsConn_subscribeMany(natsSubscription **subs, natsConnection *nc,
+                       const char **subjects, int count,
+                       natsMsgHandler cb, void *cbClosure);
+
 natsStatus
 natsConn_unsubscribe(natsConnection *nc, natsSubscription *sub, int max);
 
+natsStatus
+natsConn_unsubscribeMany(natsConnection *nc, natsSubscription **subs,
+                         int count);
+
+natsStatus
+natsConn_addSubcription(natsConnection *nc, natsSubscription *sub);
+
 void
 natsConn_removeSubscription(natsConnection *nc, natsSubscription *sub, bool needsLock);
 
@@ -0,0 +1,247 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "hash.h"
+#include "stats.h"
+
+natsStatus
+natsConnectionGroup_Connect(natsConnectionGroup **newGroup, natsOptions *options,
+                            int size, natsGroupSharding sharding)
+{
+    natsStatus          s      = NATS_OK;
+    natsConnectionGroup *group = NULL;
+
+    if ((newGroup == NULL)
+        || (size < 1)
+        || (sharding < NATS_GROUP_BY_SUBJECT)
+        || (sharding > NATS_GROUP_ROUND_ROBIN))
+    {
+        return nats_setDefaultError(NATS_INVALID_ARG);
+    }
+
+    group = (natsConnectionGroup*) NATS_CALLOC(1, sizeof(natsConnectionGroup));
+    if (group == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    group->sharding = sharding;
+    group->conns    = (natsConnection**) NATS_CALLOC(size, sizeof(natsConnection*));
+    if (group->conns == NULL)
+        s = nats_setDefaultError(NATS_NO_MEMORY);
+
+    for (int i = 0; (s == NATS_OK) && (i < size); i++)
+    {
+        s = natsConnection_Connect(&(group->conns[i]), options);
+        if (s == NATS_OK)
+            group->size++;
+    }
+
+    if (s == NATS_OK)
+        *newGroup = group;
+    else
+        natsConnectionGroup_Destroy(group);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+int
+natsConnectionGroup_GetSize(natsConnectionGroup *group)
+{
+    if (group == NULL)
+        return 0;
+
+    return group->size;
+}
+
+natsConnection*
+natsConnectionGroup_GetConnection(natsConnectionGroup *group, int index)
+{
+    if ((group == NULL) || (index < 0) || (index >= group->size))
+        return NULL;
+
+    return group->conns[index];
+}
+
+natsConnection*
+natsConnectionGroup_GetConnectionFor(natsConnectionGroup *group,
+                                     const char *subject)
+{
+    uint32_t h;
+
+    if ((group == NULL) || (subject == NULL))
+        return NULL;
+
+    h = natsStrHash_Hash(subject, (int) strlen(subject));
+
+    return group->conns[h % (uint32_t) group->size];
+}
+
+// Returns the connection to use to publish on 'subj'. If the subject is
+// invalid, the connection's publish call reports the error.
+static natsConnection*
+_pubConn(natsConnectionGroup *group, const char *subj)
+{
+    uint32_t n;
+
+    if ((group->sharding == NATS_GROUP_BY_SUBJECT) && (subj != NULL))
+        return natsConnectionGroup_GetConnectionFor(group, subj);
+
+    n = (uint32_t) NATS_ATOMIC_INC(&(group->next));
+
+    return group->conns[n % (uint32_t) group->size];
+}
+
+natsStatus
+natsConnectionGroup_Publish(natsConnectionGroup *group, const char *subj,
+                            const void *data, int dataLen)
+{
+    natsStatus s;
+
+    if (group == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConnection_Publish(_pubConn(group, subj), subj, data, dataLen);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_PublishString(natsConnectionGroup *group, const char *subj,
+                                  const char *str)
+{
+    natsStatus s;
+
+    if (group == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConnection_PublishString(_pubConn(group, subj), subj, str);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_PublishMsg(natsConnectionGroup *group, natsMsg *msg)
+{
+    natsStatus s;
+
+    if ((group == NULL) || (msg == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConnection_PublishMsg(_pubConn(group, natsMsg_GetSubject(msg)), msg);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_FlushTimeout(natsConnectionGroup *group, int64_t timeout)
+{
+    natsStatus  s        = NATS_OK;
+    int64_t     deadline = 0;
+    int64_t     left     = 0;
+
+    if ((group == NULL) || (timeout <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    deadline = nats_Now() + timeout;
+
+    for (int i = 0; (s == NATS_OK) && (i < group->size); i++)
+    {
+        left = deadline - nats_Now();
+        if (left <= 0)
+            s = nats_setDefaultError(NATS_TIMEOUT);
+        else
+            s = natsConnection_FlushTimeout(group->conns[i], left);
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_GetStats(natsConnectionGroup *group, natsStatistics *stats)
+{
+    natsStatus      s       = NATS_OK;
+    natsStatistics  *member = NULL;
+
+    if ((group == NULL) || (stats == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    stats->inMsgs        = 0;
+    stats->outMsgs       = 0;
+    stats->inBytes       = 0;
+    stats->outBytes      = 0;
+    stats->reconnects    = 0;
+    stats->msgPoolHits   = 0;
+    stats->msgPoolMisses = 0;
+
+    if (stats->latency != NULL)
+        memset(stats->latency, 0, NATS_LATENCY_TYPES * sizeof(natsHistogram));
+
+    s = natsStatistics_Create(&member);
+    for (int i = 0; (s == NATS_OK) && (i < group->size); i++)
+    {
+        s = natsConnection_GetStats(group->conns[i], member);
+        if (s == NATS_OK)
+            s = natsStatistics_add(stats, member);
+    }
+
+    natsStatistics_Destroy(member);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_Subscribe(natsSubscription **sub, natsConnectionGroup *group,
+                              const char *subject, natsMsgHandler cb,
+                              void *cbClosure)
+{
+    natsStatus s;
+
+    if (group == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConnection_Subscribe(sub, natsConnectionGroup_GetConnectionFor(group, subject),
+                                 subject, cb, cbClosure);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsConnectionGroup_SubscribeSync(natsSubscription **sub, natsConnectionGroup *group,
+                                  const char *subject)
+{
+    natsStatus s;
+
+    if (group == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConnection_SubscribeSync(sub, natsConnectionGroup_GetConnectionFor(group, subject),
+                                     subject);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+void
+natsConnectionGroup_Close(natsConnectionGroup *group)
+{
+    if (group == NULL)
+        return;
+
+    for (int i = 0; i < group->size; i++)
+        natsConnection_Close(group->conns[i]);
+}
+
+void
+natsConnectionGroup_Destroy(natsConnectionGroup *group)
+{
+    if (group == NULL)
+        return;
+
+    for (int i = 0; i < group->size; i++)
+        natsConnection_Destroy(group->conns[i]);
+
+    NATS_FREE(group->conns);
+    NATS_FREE(group);
+}
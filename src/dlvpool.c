@@ -0,0 +1,351 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include "mem.h"
+#include "sub.h"
+#include "dlvpool.h"
+
+typedef struct __natsDlvWorker
+{
+    natsDlvPool         *pool;
+    int                 index;
+    natsThread          *thread;
+
+    // Protects the run queue.
+    natsMutex           *mu;
+    natsSubscription    *head;
+    natsSubscription    *tail;
+
+    // Number of subscriptions in the run queue (atomically updated so that
+    // other workers can check it without the lock).
+    int32_t             count;
+
+    bool                stopped;
+
+} natsDlvWorker;
+
+struct __natsDlvPool
+{
+    // Protects 'stopped' and is used with 'cond' for idle workers.
+    natsMutex           *mu;
+    natsCondition       *cond;
+    int                 refs;
+    bool                stopped;
+
+    // Number of workers waiting for work (atomically updated).
+    int32_t             idle;
+
+    natsDlvWorker       *workers;
+    int                 count;
+    int                 started;
+    int                 next;
+};
+
+static void
+_freePool(natsDlvPool *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = 0; i < pool->count; i++)
+    {
+        natsThread_Destroy(pool->workers[i].thread);
+        natsMutex_Destroy(pool->workers[i].mu);
+    }
+    NATS_FREE(pool->workers);
+
+    natsCondition_Destroy(pool->cond);
+    natsMutex_Destroy(pool->mu);
+
+    NATS_FREE(pool);
+}
+
+void
+natsDlvPool_Retain(natsDlvPool *pool)
+{
+    natsMutex_Lock(pool->mu);
+
+    pool->refs++;
+
+    natsMutex_Unlock(pool->mu);
+}
+
+void
+natsDlvPool_Release(natsDlvPool *pool)
+{
+    int refs = 0;
+
+    if (pool == NULL)
+        return;
+
+    natsMutex_Lock(pool->mu);
+
+    refs = --(pool->refs);
+
+    natsMutex_Unlock(pool->mu);
+
+    if (refs == 0)
+        _freePool(pool);
+}
+
+static natsSubscription*
+_popSub(natsDlvWorker *w)
+{
+    natsSubscription *sub = NULL;
+
+    if (NATS_ATOMIC_GET(&(w->count)) == 0)
+        return NULL;
+
+    natsMutex_Lock(w->mu);
+
+    if ((sub = w->head) != NULL)
+    {
+        w->head = sub->dlvNext;
+        if (w->head == NULL)
+            w->tail = NULL;
+
+        sub->dlvNext = NULL;
+
+        (void) NATS_ATOMIC_DEC(&(w->count));
+    }
+
+    natsMutex_Unlock(w->mu);
+
+    return sub;
+}
+
+static bool
+_pushSub(natsDlvWorker *w, natsSubscription *sub)
+{
+    natsMutex_Lock(w->mu);
+
+    if (w->stopped)
+    {
+        natsMutex_Unlock(w->mu);
+        return false;
+    }
+
+    sub->dlvNext = NULL;
+
+    if (w->tail != NULL)
+        w->tail->dlvNext = sub;
+    else
+        w->head = sub;
+
+    w->tail = sub;
+
+    (void) NATS_ATOMIC_INC(&(w->count));
+
+    natsMutex_Unlock(w->mu);
+
+    return true;
+}
+
+// Takes a subscription from the run queue of one of the other workers.
+static natsSubscription*
+_steal(natsDlvPool *pool, natsDlvWorker *w)
+{
+    natsSubscription    *sub = NULL;
+    int                 i;
+
+    for (i = 1; (sub == NULL) && (i < pool->count); i++)
+        sub = _popSub(&(pool->workers[(w->index + i) % pool->count]));
+
+    return sub;
+}
+
+static bool
+_hasWork(natsDlvPool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->count; i++)
+    {
+        if (NATS_ATOMIC_GET(&(pool->workers[i].count)) > 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void
+_workerThread(void *arg)
+{
+    natsDlvWorker       *w    = (natsDlvWorker*) arg;
+    natsDlvPool         *pool = w->pool;
+    natsSubscription    *sub  = NULL;
+
+    nats_threadStarted(NATS_THREAD_DELIVERY_POOL, NULL);
+
+    while (true)
+    {
+        sub = _popSub(w);
+        if (sub == NULL)
+            sub = _steal(pool, w);
+
+        if (sub != NULL)
+        {
+            // If the subscription still has messages after its batch, put
+            // it at the end of our queue so that others get to run.
+            if (natsSub_deliverMsgsFromPool(sub) && !_pushSub(w, sub))
+            {
+                NATS_ATOMIC_SET(&(sub->dlvScheduled), 0);
+                natsSub_release(sub);
+            }
+            continue;
+        }
+
+        natsMutex_Lock(pool->mu);
+
+        if (pool->stopped)
+        {
+            natsMutex_Unlock(pool->mu);
+            break;
+        }
+
+        // Announce that we are idle before checking the queues, so that
+        // a scheduler either sees us idle or we see its subscription.
+        (void) NATS_ATOMIC_INC(&(pool->idle));
+
+        if (!_hasWork(pool))
+            natsCondition_Wait(pool->cond, pool->mu);
+
+        (void) NATS_ATOMIC_DEC(&(pool->idle));
+
+        natsMutex_Unlock(pool->mu);
+    }
+
+    natsLib_Release();
+}
+
+natsStatus
+natsDlvPool_Create(natsDlvPool **newPool, int threads)
+{
+    natsStatus  s     = NATS_OK;
+    natsDlvPool *pool = NULL;
+    int         i;
+
+    pool = (natsDlvPool*) NATS_CALLOC(1, sizeof(natsDlvPool));
+    if (pool == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    pool->refs = 1;
+
+    s = natsMutex_CreateEx(&(pool->mu), NATS_LOCK_DELIVERY_POOL);
+    if (s == NATS_OK)
+        s = natsCondition_Create(&(pool->cond));
+    if (s == NATS_OK)
+    {
+        pool->workers = (natsDlvWorker*) NATS_CALLOC(threads, sizeof(natsDlvWorker));
+        if (pool->workers == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    for (i = 0; (s == NATS_OK) && (i < threads); i++)
+    {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+
+        s = natsMutex_CreateEx(&(pool->workers[i].mu), NATS_LOCK_DELIVERY_POOL);
+        if (s == NATS_OK)
+            pool->count++;
+    }
+    for (i = 0; (s == NATS_OK) && (i < threads); i++)
+    {
+        // Like the other library threads, workers hold a reference to the
+        // library.
+        natsLib_Retain();
+
+        s = natsThread_Create(&(pool->workers[i].thread), _workerThread,
+                              (void*) &(pool->workers[i]));
+        if (s == NATS_OK)
+            pool->started++;
+        else
+            natsLib_Release();
+    }
+
+    if (s == NATS_OK)
+    {
+        *newPool = pool;
+    }
+    else
+    {
+        natsDlvPool_Stop(pool);
+        _freePool(pool);
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+int
+natsDlvPool_AssignWorker(natsDlvPool *pool)
+{
+    int worker;
+
+    natsMutex_Lock(pool->mu);
+
+    worker     = pool->next;
+    pool->next = (pool->next + 1) % pool->count;
+
+    natsMutex_Unlock(pool->mu);
+
+    return worker;
+}
+
+bool
+natsDlvPool_Schedule(natsDlvPool *pool, int worker, natsSubscription *sub)
+{
+    if (!_pushSub(&(pool->workers[worker]), sub))
+        return false;
+
+    if (NATS_ATOMIC_GET(&(pool->idle)) > 0)
+    {
+        natsMutex_Lock(pool->mu);
+        natsCondition_Signal(pool->cond);
+        natsMutex_Unlock(pool->mu);
+    }
+
+    return true;
+}
+
+void
+natsDlvPool_Stop(natsDlvPool *pool)
+{
+    natsSubscription    *sub;
+    int                 i;
+
+    natsMutex_Lock(pool->mu);
+
+    if (pool->stopped)
+    {
+        natsMutex_Unlock(pool->mu);
+        return;
+    }
+
+    pool->stopped = true;
+    natsCondition_Broadcast(pool->cond);
+
+    natsMutex_Unlock(pool->mu);
+
+    for (i = 0; i < pool->started; i++)
+        natsThread_Join(pool->workers[i].thread);
+
+    // No worker is running anymore, release what was still scheduled and
+    // refuse further scheduling.
+    for (i = 0; i < pool->count; i++)
+    {
+        natsDlvWorker *w = &(pool->workers[i]);
+
+        natsMutex_Lock(w->mu);
+        w->stopped = true;
+        natsMutex_Unlock(w->mu);
+
+        while ((sub = _popSub(w)) != NULL)
+        {
+            NATS_ATOMIC_SET(&(sub->dlvScheduled), 0);
+            natsSub_release(sub);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef DLVPOOL_H_
+#define DLVPOOL_H_
+
+#include "status.h"
+
+#define NATS_DLVPOOL_DEFAULT_THREADS    (2)
+
+// Max number of messages a worker delivers to a subscription before giving
+// other scheduled subscriptions a chance to run.
+#define NATS_DLVPOOL_MAX_BATCH          (64)
+
+struct __natsSubscription;
+struct __natsDlvPool;
+
+typedef struct __natsDlvPool    natsDlvPool;
+
+// Creates a pool of 'threads' workers delivering messages to asynchronous
+// subscriptions. The returned pool has a reference count of 1.
+natsStatus
+natsDlvPool_Create(natsDlvPool **newPool, int threads);
+
+void
+natsDlvPool_Retain(natsDlvPool *pool);
+
+void
+natsDlvPool_Release(natsDlvPool *pool);
+
+// Returns the worker a new subscription should be scheduled on. Workers are
+// assigned in a round-robin fashion.
+int
+natsDlvPool_AssignWorker(natsDlvPool *pool);
+
+// Adds the subscription to the run queue of the given worker. An idle worker
+// is woken up, which may steal the subscription if its worker is busy. The
+// caller must have retained the subscription, and a subscription must not
+// be scheduled again until natsSub_deliverMsgsFromPool() returns. Returns
+// 'false' if the pool has been stopped, in which case the subscription has
+// not been added.
+bool
+natsDlvPool_Schedule(natsDlvPool *pool, int worker,
+                     struct __natsSubscription *sub);
+
+// Stops the workers and waits for them to exit. Subscriptions that were
+// still scheduled are released.
+void
+natsDlvPool_Stop(natsDlvPool *pool);
+
+#endif /* DLVPOOL_H_ */
@@ -16,7 +16,20 @@
 natsStatus
 nats_setErrorReal(const char *fileName, const char *funcName, int line, natsStatus errSts, const void *errTxtFmt, ...);
 
-#define NATS_UPDATE_ERR_STACK(s) (s == NATS_OK ? s : nats_updateErrStack(s, __FUNCTION__))
+#if defined(__GNUC__)
+#define NATS_UNLIKELY(c)    __builtin_expect(!!(c), 0)
+#else
+#define NATS_UNLIKELY(c)    (c)
+#endif
+
+// The stack only matters once an error is set, so it is never touched while
+// 's' is NATS_OK. Building with NATS_NO_ERR_STACK removes the updates, and
+// the stack is then reduced to the function that set the error.
+#if defined(NATS_NO_ERR_STACK)
+#define NATS_UPDATE_ERR_STACK(s) (s)
+#else
+#define NATS_UPDATE_ERR_STACK(s) (NATS_UNLIKELY(s != NATS_OK) ? nats_updateErrStack(s, __func__) : s)
+#endif
 
 natsStatus
 nats_updateErrStack(natsStatus err, const char *func);
@@ -0,0 +1,596 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include "mem.h"
+#include "conn.h"
+#include "evloop.h"
+
+#if defined(NATS_HAS_EVLOOP)
+
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define EVLOOP_MAX_EVENTS   (64)
+
+// How long (in milliseconds) flush requests are delayed to give a chance to
+// accumulate more data.
+#define EVLOOP_FLUSH_DELAY  (1)
+
+struct __natsEvLoopConn
+{
+    natsEvLoop              *loop;
+    natsConnection          *nc;
+    natsSock                fd;
+
+    // The socket is registered in the epoll set.
+    bool                    watching;
+
+    // EPOLLOUT is part of the registered events.
+    bool                    writing;
+
+    // The connection is in the loop's flush list.
+    bool                    flushPending;
+
+    bool                    detached;
+
+    struct __natsEvLoopConn *nextFlush;
+    struct __natsEvLoopConn *nextDead;
+};
+
+struct __natsEvLoop
+{
+    natsMutex       *mu;
+    natsCondition   *cond;
+    int             refs;
+
+    natsThread      *thread;
+    bool            running;
+    bool            stopped;
+
+    int             epfd;
+    int             wakeFd;
+
+    // The connection the loop's thread is currently invoking a callback for.
+    natsEvLoopConn  *busy;
+
+    natsEvLoopConn  *flushHead;
+    natsEvLoopConn  *flushTail;
+    int64_t         flushTime;
+
+    // Detached connections, freed by the loop's thread when it is guaranteed
+    // that no pending epoll event references them.
+    natsEvLoopConn  *dead;
+};
+
+static void
+_freeDeadConns(natsEvLoop *loop)
+{
+    natsEvLoopConn *ec;
+
+    while ((ec = loop->dead) != NULL)
+    {
+        loop->dead = ec->nextDead;
+        NATS_FREE(ec);
+    }
+}
+
+static void
+_freeLoop(natsEvLoop *loop)
+{
+    if (loop == NULL)
+        return;
+
+    _freeDeadConns(loop);
+
+    if (loop->epfd >= 0)
+        close(loop->epfd);
+    if (loop->wakeFd >= 0)
+        close(loop->wakeFd);
+
+    natsThread_Destroy(loop->thread);
+    natsCondition_Destroy(loop->cond);
+    natsMutex_Destroy(loop->mu);
+
+    NATS_FREE(loop);
+}
+
+void
+natsEvLoop_Retain(natsEvLoop *loop)
+{
+    natsMutex_Lock(loop->mu);
+
+    loop->refs++;
+
+    natsMutex_Unlock(loop->mu);
+}
+
+void
+natsEvLoop_Release(natsEvLoop *loop)
+{
+    int refs = 0;
+
+    if (loop == NULL)
+        return;
+
+    natsMutex_Lock(loop->mu);
+
+    refs = --(loop->refs);
+
+    natsMutex_Unlock(loop->mu);
+
+    if (refs == 0)
+        _freeLoop(loop);
+}
+
+static void
+_wakeUp(natsEvLoop *loop)
+{
+    uint64_t    one = 1;
+    ssize_t     res;
+
+    res = write(loop->wakeFd, &one, sizeof(one));
+    (void) res;
+}
+
+static void
+_drainWakeUp(natsEvLoop *loop)
+{
+    uint64_t    val;
+    ssize_t     res;
+
+    res = read(loop->wakeFd, &val, sizeof(val));
+    (void) res;
+}
+
+static void
+_updateEvents(natsEvLoop *loop, natsEvLoopConn *ec, bool writing)
+{
+    struct epoll_event ev;
+
+    if (!(ec->watching) || (ec->writing == writing))
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | (writing ? EPOLLOUT : 0);
+    ev.data.ptr = (void*) ec;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, ec->fd, &ev) == 0)
+        ec->writing = writing;
+}
+
+static void
+_stopWatching(natsEvLoop *loop, natsEvLoopConn *ec)
+{
+    if (!(ec->watching))
+        return;
+
+    (void) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, ec->fd, NULL);
+
+    ec->watching = false;
+    ec->writing  = false;
+}
+
+static void
+_removeFromFlushList(natsEvLoop *loop, natsEvLoopConn *ec)
+{
+    natsEvLoopConn *cur  = loop->flushHead;
+    natsEvLoopConn *prev = NULL;
+
+    while ((cur != NULL) && (cur != ec))
+    {
+        prev = cur;
+        cur  = cur->nextFlush;
+    }
+
+    // Not found: the loop's thread may have already taken it out of the list
+    // and is processing it.
+    if (cur == NULL)
+        return;
+
+    if (prev != NULL)
+        prev->nextFlush = ec->nextFlush;
+    else
+        loop->flushHead = ec->nextFlush;
+
+    if (loop->flushTail == ec)
+        loop->flushTail = prev;
+
+    ec->nextFlush    = NULL;
+    ec->flushPending = false;
+}
+
+// Invokes one of the connection's callback. The loop's lock is held on entry
+// and on exit, but released while the callback is invoked.
+static bool
+_invoke(natsEvLoop *loop, natsEvLoopConn *ec, bool forRead)
+{
+    bool res;
+
+    loop->busy = ec;
+
+    natsMutex_Unlock(loop->mu);
+
+    if (forRead)
+        res = natsConn_evLoopRead(ec->nc);
+    else
+        res = natsConn_evLoopWrite(ec->nc);
+
+    natsMutex_Lock(loop->mu);
+
+    loop->busy = NULL;
+
+    // Unblock natsEvLoop_Detach() calls waiting for this callback to return.
+    natsCondition_Broadcast(loop->cond);
+
+    return res;
+}
+
+static void
+_processFlushes(natsEvLoop *loop)
+{
+    natsEvLoopConn  *ec;
+    natsEvLoopConn  *next;
+    bool            more;
+
+    // Take the whole list. Connections that request a flush while we are
+    // processing this list are added to the loop's list and flushed in the
+    // next iteration.
+    ec = loop->flushHead;
+    loop->flushHead = NULL;
+    loop->flushTail = NULL;
+
+    for (; ec != NULL; ec = next)
+    {
+        next = ec->nextFlush;
+
+        ec->nextFlush    = NULL;
+        ec->flushPending = false;
+
+        if (ec->detached)
+            continue;
+
+        more = _invoke(loop, ec, false);
+
+        if (!(ec->detached))
+            _updateEvents(loop, ec, more);
+    }
+}
+
+static void
+_evLoopThread(void *arg)
+{
+    natsEvLoop          *loop = (natsEvLoop*) arg;
+    struct epoll_event  events[EVLOOP_MAX_EVENTS];
+    natsEvLoopConn      *ec;
+    int64_t             wait;
+    int                 timeout;
+    int                 n, i;
+    bool                more;
+
+    nats_threadStarted(NATS_THREAD_EVENT_LOOP, NULL);
+
+    natsMutex_Lock(loop->mu);
+
+    while (!(loop->stopped))
+    {
+        // All events from the previous epoll_wait() have been processed,
+        // so it is now safe to free the detached connections.
+        _freeDeadConns(loop);
+
+        timeout = -1;
+        if (loop->flushHead != NULL)
+        {
+            wait    = loop->flushTime - nats_Now();
+            timeout = (wait > 0 ? (int) wait : 0);
+        }
+
+        natsMutex_Unlock(loop->mu);
+
+        n = epoll_wait(loop->epfd, events, EVLOOP_MAX_EVENTS, timeout);
+
+        natsMutex_Lock(loop->mu);
+
+        for (i = 0; !(loop->stopped) && (i < n); i++)
+        {
+            ec = (natsEvLoopConn*) events[i].data.ptr;
+            if (ec == NULL)
+            {
+                _drainWakeUp(loop);
+                continue;
+            }
+
+            if (ec->detached)
+                continue;
+
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                more = _invoke(loop, ec, true);
+
+                // The connection is closing or reconnecting, stop watching
+                // the socket. It will be closed when detached.
+                if (!more && !(ec->detached))
+                    _stopWatching(loop, ec);
+            }
+
+            if (!(ec->detached)
+                && ec->watching
+                && (events[i].events & EPOLLOUT))
+            {
+                more = _invoke(loop, ec, false);
+
+                if (!(ec->detached))
+                    _updateEvents(loop, ec, more);
+            }
+        }
+
+        if (!(loop->stopped)
+            && (loop->flushHead != NULL)
+            && (nats_Now() >= loop->flushTime))
+        {
+            _processFlushes(loop);
+        }
+    }
+
+    loop->running = false;
+    natsCondition_Broadcast(loop->cond);
+
+    natsMutex_Unlock(loop->mu);
+
+    natsLib_Release();
+}
+
+natsStatus
+natsEvLoop_Create(natsEvLoop **newLoop)
+{
+    natsStatus          s     = NATS_OK;
+    natsEvLoop          *loop = NULL;
+    struct epoll_event  ev;
+
+    loop = (natsEvLoop*) NATS_CALLOC(1, sizeof(natsEvLoop));
+    if (loop == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    loop->refs   = 1;
+    loop->epfd   = -1;
+    loop->wakeFd = -1;
+
+    s = natsMutex_CreateEx(&(loop->mu), NATS_LOCK_EVENT_LOOP);
+    if (s == NATS_OK)
+        s = natsCondition_Create(&(loop->cond));
+    if (s == NATS_OK)
+    {
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epfd < 0)
+            s = nats_setError(NATS_SYS_ERROR, "epoll_create error: %d", errno);
+    }
+    if (s == NATS_OK)
+    {
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->wakeFd < 0)
+            s = nats_setError(NATS_SYS_ERROR, "eventfd error: %d", errno);
+    }
+    if (s == NATS_OK)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events   = EPOLLIN;
+        ev.data.ptr = NULL;
+
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakeFd, &ev) != 0)
+            s = nats_setError(NATS_SYS_ERROR, "epoll_ctl error: %d", errno);
+    }
+    if (s == NATS_OK)
+    {
+        loop->running = true;
+
+        // The loop's thread holds a reference to the library, like the
+        // other library threads.
+        natsLib_Retain();
+
+        s = natsThread_Create(&(loop->thread), _evLoopThread, (void*) loop);
+        if (s != NATS_OK)
+        {
+            loop->running = false;
+            natsLib_Release();
+        }
+    }
+
+    if (s == NATS_OK)
+        *newLoop = loop;
+    else
+        _freeLoop(loop);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsEvLoop_Attach(natsEvLoopConn **newConn, natsEvLoop *loop,
+                  natsConnection *nc, natsSock fd)
+{
+    natsEvLoopConn      *ec = NULL;
+    struct epoll_event  ev;
+
+    ec = (natsEvLoopConn*) NATS_CALLOC(1, sizeof(natsEvLoopConn));
+    if (ec == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    ec->loop = loop;
+    ec->nc   = nc;
+    ec->fd   = fd;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = (void*) ec;
+
+    natsMutex_Lock(loop->mu);
+
+    if (loop->stopped)
+    {
+        natsMutex_Unlock(loop->mu);
+        NATS_FREE(ec);
+
+        return nats_setError(NATS_ILLEGAL_STATE, "%s",
+                             "The shared event loop has been stopped");
+    }
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        natsMutex_Unlock(loop->mu);
+        NATS_FREE(ec);
+
+        return nats_setError(NATS_SYS_ERROR, "epoll_ctl error: %d", errno);
+    }
+
+    ec->watching = true;
+
+    // The attached connection holds a reference to the loop.
+    loop->refs++;
+
+    natsMutex_Unlock(loop->mu);
+
+    *newConn = ec;
+
+    return NATS_OK;
+}
+
+bool
+natsEvLoop_Detach(natsEvLoopConn *ec)
+{
+    natsEvLoop  *loop    = ec->loop;
+    bool        inLoop   = false;
+
+    natsMutex_Lock(loop->mu);
+
+    ec->detached = true;
+
+    _stopWatching(loop, ec);
+
+    if (ec->flushPending)
+        _removeFromFlushList(loop, ec);
+
+    if (loop->running)
+    {
+        inLoop = natsThread_IsCurrent(loop->thread);
+
+        // Wait for a callback in progress for this connection to return.
+        while (!inLoop && loop->running && (loop->busy == ec))
+            natsCondition_Wait(loop->cond, loop->mu);
+    }
+
+    if (loop->running)
+    {
+        // Pending events may still reference this connection, let the
+        // loop's thread free it.
+        ec->nextDead = loop->dead;
+        loop->dead   = ec;
+    }
+    else
+    {
+        NATS_FREE(ec);
+    }
+
+    natsMutex_Unlock(loop->mu);
+
+    natsEvLoop_Release(loop);
+
+    return !inLoop;
+}
+
+void
+natsEvLoop_Flush(natsEvLoopConn *ec)
+{
+    natsEvLoop  *loop = ec->loop;
+    bool        wake  = false;
+
+    natsMutex_Lock(loop->mu);
+
+    if (!(ec->detached) && !(ec->flushPending))
+    {
+        ec->flushPending = true;
+
+        if (loop->flushTail != NULL)
+        {
+            loop->flushTail->nextFlush = ec;
+        }
+        else
+        {
+            loop->flushHead = ec;
+            loop->flushTime = nats_Now() + EVLOOP_FLUSH_DELAY;
+
+            // The loop may be in an infinite wait, so wake it up so that it
+            // computes its new timeout.
+            wake = true;
+        }
+
+        loop->flushTail = ec;
+    }
+
+    natsMutex_Unlock(loop->mu);
+
+    if (wake)
+        _wakeUp(loop);
+}
+
+void
+natsEvLoop_Stop(natsEvLoop *loop)
+{
+    natsMutex_Lock(loop->mu);
+
+    if (loop->stopped)
+    {
+        natsMutex_Unlock(loop->mu);
+        return;
+    }
+
+    loop->stopped = true;
+
+    natsMutex_Unlock(loop->mu);
+
+    _wakeUp(loop);
+
+    natsThread_Join(loop->thread);
+}
+
+#else
+
+natsStatus
+natsEvLoop_Create(natsEvLoop **newLoop)
+{
+    return nats_setError(NATS_ILLEGAL_STATE, "%s", NATS_EVLOOP_NOT_SUPPORTED_ERR);
+}
+
+void
+natsEvLoop_Retain(natsEvLoop *loop)
+{
+}
+
+void
+natsEvLoop_Release(natsEvLoop *loop)
+{
+}
+
+natsStatus
+natsEvLoop_Attach(natsEvLoopConn **newConn, natsEvLoop *loop,
+                  natsConnection *nc, natsSock fd)
+{
+    return nats_setError(NATS_ILLEGAL_STATE, "%s", NATS_EVLOOP_NOT_SUPPORTED_ERR);
+}
+
+bool
+natsEvLoop_Detach(natsEvLoopConn *conn)
+{
+    return true;
+}
+
+void
+natsEvLoop_Flush(natsEvLoopConn *conn)
+{
+}
+
+void
+natsEvLoop_Stop(natsEvLoop *loop)
+{
+}
+
+#endif
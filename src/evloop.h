@@ -0,0 +1,61 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef EVLOOP_H_
+#define EVLOOP_H_
+
+#include "status.h"
+
+#if defined(LINUX)
+#define NATS_HAS_EVLOOP                 (1)
+#endif
+
+#define NATS_EVLOOP_DEFAULT_THREADS     (2)
+
+#define NATS_EVLOOP_NOT_SUPPORTED_ERR   "The shared event loop is not supported on this platform!"
+
+struct __natsConnection;
+struct __natsEvLoop;
+struct __natsEvLoopConn;
+
+typedef struct __natsEvLoop     natsEvLoop;
+typedef struct __natsEvLoopConn natsEvLoopConn;
+
+// Creates an event loop and starts its thread. The returned loop has a
+// reference count of 1.
+natsStatus
+natsEvLoop_Create(natsEvLoop **newLoop);
+
+void
+natsEvLoop_Retain(natsEvLoop *loop);
+
+void
+natsEvLoop_Release(natsEvLoop *loop);
+
+// Registers the socket 'fd' of the connection 'nc' with the loop. The loop
+// will invoke natsConn_evLoopRead() when the socket is readable and
+// natsConn_evLoopWrite() when a flush has been requested or when the socket
+// becomes writable again after a partial write.
+natsStatus
+natsEvLoop_Attach(natsEvLoopConn **newConn, natsEvLoop *loop,
+                  struct __natsConnection *nc, natsSock fd);
+
+// Unregisters the connection from its loop. On return, the loop is guaranteed
+// not to invoke any callback for this connection anymore, and no callback is
+// in progress, unless this is called from the loop's thread itself, in which
+// case this function returns 'false' and the caller (the callback currently
+// executing) is responsible for the connection's socket cleanup.
+bool
+natsEvLoop_Detach(natsEvLoopConn *conn);
+
+// Requests the loop to flush the connection's write buffer. Flush requests
+// are batched for up to a millisecond to give a chance to accumulate more
+// data, similar to what the connection's flusher thread does.
+void
+natsEvLoop_Flush(natsEvLoopConn *conn);
+
+// Stops the loop's thread and waits for it to exit. Connections still
+// attached can be detached afterwards.
+void
+natsEvLoop_Stop(natsEvLoop *loop);
+
+#endif /* EVLOOP_H_ */
@@ -8,8 +8,6 @@
 #include "mem.h"
 #include "hash.h"
 
-#define _freeEntry(e)   { NATS_FREE(e); (e) = NULL; }
-
 #define _OFF32  (2166136261)
 #define _YP32   (709607)
 
@@ -21,12 +19,16 @@ static int _DDWSZ  = _WSZ << 2; // 16
 
 static int _MAX_BKT_SIZE = (1 << 30) - 1;
 
+// Returns true if the number of buckets that are not empty is above 3/4 of
+// the total number of buckets.
+#define _overLoaded(h)  (((int64_t) ((h)->used + (h)->deleted)) * 4 > ((int64_t) (h)->numBkts) * 3)
+
 natsStatus
 natsHash_Create(natsHash **newHash, int initialSize)
 {
     natsHash    *hash = NULL;
 
-    if ((initialSize == 0) || ((initialSize & (initialSize - 1)) != 0))
+    if ((initialSize <= 0) || ((initialSize & (initialSize - 1)) != 0))
     {
         // Size of buckets must be power of 2
         return nats_setDefaultError(NATS_INVALID_ARG);
@@ -39,7 +41,7 @@ natsHash_Create(natsHash **newHash, int initialSize)
     hash->mask      = (initialSize - 1);
     hash->numBkts   = initialSize;
     hash->canResize = true;
-    hash->bkts      = (natsHashEntry**) NATS_CALLOC(initialSize, sizeof(natsHashEntry*));
+    hash->bkts      = (natsHashEntry*) NATS_CALLOC(initialSize, sizeof(natsHashEntry));
     if (hash->bkts == NULL)
     {
         NATS_FREE(hash);
@@ -54,35 +56,34 @@ natsHash_Create(natsHash **newHash, int initialSize)
 static natsStatus
 _resize(natsHash *hash, int newSize)
 {
-    natsHashEntry   **bkts    = NULL;
-    int             newMask   = newSize - 1;
-    natsHashEntry   *ne;
+    natsHashEntry   *bkts    = NULL;
+    int             newMask  = newSize - 1;
     natsHashEntry   *e;
     int             k;
     int             newIndex;
 
-    bkts = (natsHashEntry**) NATS_CALLOC(newSize, sizeof(natsHashEntry*));
+    bkts = (natsHashEntry*) NATS_CALLOC(newSize, sizeof(natsHashEntry));
     if (bkts == NULL)
         return nats_setDefaultError(NATS_NO_MEMORY);
 
     for (k = 0; k < hash->numBkts; k++)
     {
-        e = hash->bkts[k];
-        while (e != NULL)
-        {
-            ne = e;
-            e  = e->next;
+        e = &(hash->bkts[k]);
+        if (e->state != NATS_HASH_USED)
+            continue;
 
-            newIndex = ne->key & newMask;
-            ne->next = bkts[newIndex];
-            bkts[newIndex] = ne;
-        }
+        newIndex = (int) (e->key & newMask);
+        while (bkts[newIndex].state != NATS_HASH_EMPTY)
+            newIndex = (newIndex + 1) & newMask;
+
+        bkts[newIndex] = *e;
     }
 
     NATS_FREE(hash->bkts);
-    hash->bkts = bkts;
-    hash->mask = newMask;
+    hash->bkts    = bkts;
+    hash->mask    = newMask;
     hash->numBkts = newSize;
+    hash->deleted = 0;
 
     return NATS_OK;
 }
@@ -97,6 +98,17 @@ _grow(natsHash *hash)
     return _resize(hash, 2 * (hash->numBkts));
 }
 
+// Invoked when too many buckets are used or deleted: drops the deleted
+// entries, and doubles the size if live entries use more than half of it.
+static natsStatus
+_rehash(natsHash *hash)
+{
+    if (hash->used * 2 > hash->numBkts)
+        return _grow(hash);
+
+    return _resize(hash, hash->numBkts);
+}
+
 static void
 _shrink(natsHash *hash)
 {
@@ -108,36 +120,55 @@ _shrink(natsHash *hash)
     (void) _resize(hash, hash->numBkts / 2);
 }
 
-static natsHashEntry*
-_createEntry(int64_t key, void *data)
+natsStatus
+natsHash_Reserve(natsHash *hash, int count)
 {
-    natsHashEntry *e = (natsHashEntry*) NATS_MALLOC(sizeof(natsHashEntry));
+    int64_t needed  = (int64_t) hash->used + hash->deleted + count;
+    int64_t newSize = hash->numBkts;
 
-    if (e == NULL)
-        return NULL;
+    if (!hash->canResize)
+        return NATS_OK;
+
+    while ((needed * 4 > newSize * 3) && (newSize < _MAX_BKT_SIZE))
+        newSize *= 2;
+
+    if (newSize > _MAX_BKT_SIZE)
+        return nats_setDefaultError(NATS_NO_MEMORY);
 
-    e->key  = key;
-    e->data = data;
-    e->next = NULL;
+    if (newSize == hash->numBkts)
+        return NATS_OK;
 
-    return e;
+    return _resize(hash, (int) newSize);
 }
 
 natsStatus
 natsHash_Set(natsHash *hash, int64_t key, void *data, void **oldData)
 {
-    natsStatus      s         = NATS_OK;
-    int             index     = (int) (key & hash->mask);
-    natsHashEntry   *newEntry = NULL;
+    natsStatus      s       = NATS_OK;
+    int             index   = (int) (key & hash->mask);
+    int             freeIdx = -1;
     natsHashEntry   *e;
+    int             n;
 
     if (oldData != NULL)
         *oldData = NULL;
 
-    e = (natsHashEntry*) hash->bkts[index];
-    while (e != NULL)
+    for (n = 0; n < hash->numBkts; n++)
     {
-        if (e->key == key)
+        e = &(hash->bkts[index]);
+
+        if (e->state == NATS_HASH_EMPTY)
+        {
+            if (freeIdx < 0)
+                freeIdx = index;
+            break;
+        }
+        else if (e->state == NATS_HASH_DELETED)
+        {
+            if (freeIdx < 0)
+                freeIdx = index;
+        }
+        else if (e->key == key)
         {
             // Success, replace data field
             if (oldData != NULL)
@@ -146,21 +177,33 @@ natsHash_Set(natsHash *hash, int64_t key, void *data, void **oldData)
             return NATS_OK;
         }
 
-        e = e->next;
+        index = (index + 1) & hash->mask;
+    }
+
+    if (freeIdx < 0)
+    {
+        // All buckets are in use, which can happen only while iterating,
+        // since otherwise the hash would have been resized.
+        s = _grow(hash);
+        if (s == NATS_OK)
+            s = natsHash_Set(hash, key, data, NULL);
+
+        return NATS_UPDATE_ERR_STACK(s);
     }
 
     // We have a new entry here
-    newEntry = _createEntry(key, data);
-    if (newEntry == NULL)
-        return nats_setDefaultError(NATS_NO_MEMORY);
+    e = &(hash->bkts[freeIdx]);
+    if (e->state == NATS_HASH_DELETED)
+        hash->deleted--;
 
-    newEntry->next = hash->bkts[index];
-    hash->bkts[index] = newEntry;
+    e->key   = key;
+    e->data  = data;
+    e->state = NATS_HASH_USED;
     hash->used++;
 
     // Check for resizing
-    if (hash->canResize && (hash->used > hash->numBkts))
-        s = _grow(hash);
+    if (hash->canResize && _overLoaded(hash))
+        s = _rehash(hash);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
@@ -168,15 +211,21 @@ natsHash_Set(natsHash *hash, int64_t key, void *data, void **oldData)
 void*
 natsHash_Get(natsHash *hash, int64_t key)
 {
-    natsHashEntry *e;
+    int             index = (int) (key & hash->mask);
+    natsHashEntry   *e;
+    int             n;
 
-    e = hash->bkts[key & hash->mask];
-    while (e != NULL)
+    for (n = 0; n < hash->numBkts; n++)
     {
-        if (e->key == key)
+        e = &(hash->bkts[index]);
+
+        if (e->state == NATS_HASH_EMPTY)
+            break;
+
+        if ((e->state == NATS_HASH_USED) && (e->key == key))
             return e->data;
 
-        e = e->next;
+        index = (index + 1) & hash->mask;
     }
 
     return NULL;
@@ -185,24 +234,48 @@ natsHash_Get(natsHash *hash, int64_t key)
 void*
 natsHash_Remove(natsHash *hash, int64_t key)
 {
-    natsHashEntry *entryRemoved = NULL;
-    void          *dataRemoved  = NULL;
-    natsHashEntry **e;
+    void            *dataRemoved  = NULL;
+    int             index         = (int) (key & hash->mask);
+    natsHashEntry   *e;
+    int             n;
 
-    e = (natsHashEntry**) &(hash->bkts[key & hash->mask]);
-    while (*e != NULL)
+    for (n = 0; n < hash->numBkts; n++)
     {
-        if ((*e)->key == key)
+        e = &(hash->bkts[index]);
+
+        if (e->state == NATS_HASH_EMPTY)
+            break;
+
+        if ((e->state == NATS_HASH_USED) && (e->key == key))
         {
             // Success
-            entryRemoved = *e;
-            dataRemoved  = entryRemoved->data;
-
-            *e = entryRemoved->next;
-            _freeEntry(entryRemoved);
+            dataRemoved = e->data;
+            e->data     = NULL;
 
             hash->used--;
 
+            // If the next bucket is empty, no other entry can be found past
+            // this one, so there is no need to keep a deleted marker, here
+            // or in the buckets that precede it. Entries are not moved, so
+            // this is safe while iterating.
+            if (hash->bkts[(index + 1) & hash->mask].state == NATS_HASH_EMPTY)
+            {
+                e->state = NATS_HASH_EMPTY;
+
+                index = (index - 1) & hash->mask;
+                while (hash->bkts[index].state == NATS_HASH_DELETED)
+                {
+                    hash->bkts[index].state = NATS_HASH_EMPTY;
+                    hash->deleted--;
+                    index = (index - 1) & hash->mask;
+                }
+            }
+            else
+            {
+                e->state = NATS_HASH_DELETED;
+                hash->deleted++;
+            }
+
             // Check for resizing
             if (hash->canResize
                 && (hash->numBkts > _BSZ)
@@ -214,7 +287,7 @@ natsHash_Remove(natsHash *hash, int64_t key)
             break;
         }
 
-        e = (natsHashEntry**) &((*e)->next);
+        index = (index + 1) & hash->mask;
     }
 
     return dataRemoved;
@@ -223,25 +296,9 @@ natsHash_Remove(natsHash *hash, int64_t key)
 void
 natsHash_Destroy(natsHash *hash)
 {
-    natsHashEntry   *e, *ne;
-    int             i;
-
     if (hash == NULL)
         return;
 
-    for (i = 0; i < hash->numBkts; i++)
-    {
-        e = hash->bkts[i];
-        while (e != NULL)
-        {
-            ne = e->next;
-
-            _freeEntry(e);
-
-            e = ne;
-        }
-    }
-
     NATS_FREE(hash->bkts);
     NATS_FREE(hash);
 }
@@ -253,65 +310,52 @@ natsHashIter_Init(natsHashIter *iter, natsHash *hash)
 
     hash->canResize = false;
     iter->hash      = hash;
-    iter->current   = hash->bkts[0];
-    iter->next      = iter->current;
+    iter->currBkt   = -1;
 }
 
 bool
 natsHashIter_Next(natsHashIter *iter, int64_t *key, void **value)
 {
-    if ((iter->started) && (iter->next == NULL))
-        return false;
-
-    if (!(iter->started) && (iter->current == NULL))
-    {
-        while ((iter->next == NULL)
-               && (iter->currBkt < (iter->hash->numBkts - 1)))
-        {
-            iter->next = iter->hash->bkts[++(iter->currBkt)];
-        }
-
-        if (iter->next == NULL)
-        {
-            iter->started = true;
-            return false;
-        }
-    }
+    natsHash        *hash = iter->hash;
+    natsHashEntry   *e;
+    int             i;
 
     iter->started = true;
 
-    iter->current = iter->next;
-    if (iter->current != NULL)
+    for (i = iter->currBkt + 1; i < hash->numBkts; i++)
     {
+        e = &(hash->bkts[i]);
+        if (e->state != NATS_HASH_USED)
+            continue;
+
+        iter->currBkt = i;
+
         if (key != NULL)
-            *key = iter->current->key;
+            *key = e->key;
         if (value != NULL)
-            *value = iter->current->data;
+            *value = e->data;
 
-        iter->next = iter->current->next;
+        return true;
     }
 
-    while ((iter->next == NULL)
-           && (iter->currBkt < (iter->hash->numBkts - 1)))
-    {
-        iter->next = iter->hash->bkts[++(iter->currBkt)];
-    }
+    iter->currBkt = hash->numBkts;
 
-    return true;
+    return false;
 }
 
 natsStatus
 natsHashIter_RemoveCurrent(natsHashIter *iter)
 {
-    int64_t key;
+    natsHash *hash = iter->hash;
 
-    if (iter->current == NULL)
+    if ((iter->currBkt < 0)
+        || (iter->currBkt >= hash->numBkts)
+        || (hash->bkts[iter->currBkt].state != NATS_HASH_USED))
+    {
         return nats_setDefaultError(NATS_NOT_FOUND);
+    }
 
-    key = iter->current->key;
-    iter->current = iter->next;
-
-    (void) natsHash_Remove(iter->hash, key);
+    (void) natsHash_Remove(hash, hash->bkts[iter->currBkt].key);
 
     return NATS_OK;
 }
@@ -366,7 +410,7 @@ natsStrHash_Create(natsStrHash **newHash, int initialSize)
 {
     natsStrHash *hash = NULL;
 
-    if ((initialSize == 0) || ((initialSize & (initialSize - 1)) != 0))
+    if ((initialSize <= 0) || ((initialSize & (initialSize - 1)) != 0))
     {
         // Size of buckets must be power of 2
         return nats_setDefaultError(NATS_INVALID_ARG);
@@ -379,7 +423,7 @@ natsStrHash_Create(natsStrHash **newHash, int initialSize)
     hash->mask      = (initialSize - 1);
     hash->numBkts   = initialSize;
     hash->canResize = true;
-    hash->bkts      = (natsStrHashEntry**) NATS_CALLOC(initialSize, sizeof(natsStrHashEntry*));
+    hash->bkts      = (natsStrHashEntry*) NATS_CALLOC(initialSize, sizeof(natsStrHashEntry));
     if (hash->bkts == NULL)
     {
         NATS_FREE(hash);
@@ -394,35 +438,34 @@ natsStrHash_Create(natsStrHash **newHash, int initialSize)
 static natsStatus
 _resizeStr(natsStrHash *hash, int newSize)
 {
-    natsStrHashEntry    **bkts    = NULL;
-    int                 newMask   = newSize - 1;
-    natsStrHashEntry    *ne;
+    natsStrHashEntry    *bkts    = NULL;
+    int                 newMask  = newSize - 1;
     natsStrHashEntry    *e;
     int                 k;
     int                 newIndex;
 
-    bkts = (natsStrHashEntry**) NATS_CALLOC(newSize, sizeof(natsStrHashEntry*));
+    bkts = (natsStrHashEntry*) NATS_CALLOC(newSize, sizeof(natsStrHashEntry));
     if (bkts == NULL)
         return nats_setDefaultError(NATS_NO_MEMORY);
 
     for (k = 0; k < hash->numBkts; k++)
     {
-        e = hash->bkts[k];
-        while (e != NULL)
-        {
-            ne = e;
-            e  = e->next;
+        e = &(hash->bkts[k]);
+        if (e->state != NATS_HASH_USED)
+            continue;
 
-            newIndex = ne->hk & newMask;
-            ne->next = bkts[newIndex];
-            bkts[newIndex] = ne;
-        }
+        newIndex = (int) (e->hk & newMask);
+        while (bkts[newIndex].state != NATS_HASH_EMPTY)
+            newIndex = (newIndex + 1) & newMask;
+
+        bkts[newIndex] = *e;
     }
 
     NATS_FREE(hash->bkts);
-    hash->bkts = bkts;
-    hash->mask = newMask;
+    hash->bkts    = bkts;
+    hash->mask    = newMask;
     hash->numBkts = newSize;
+    hash->deleted = 0;
 
     return NATS_OK;
 }
@@ -437,6 +480,15 @@ _growStr(natsStrHash *hash)
     return _resizeStr(hash, 2 * (hash->numBkts));
 }
 
+static natsStatus
+_rehashStr(natsStrHash *hash)
+{
+    if (hash->used * 2 > hash->numBkts)
+        return _growStr(hash);
+
+    return _resizeStr(hash, hash->numBkts);
+}
+
 static void
 _shrinkStr(natsStrHash *hash)
 {
@@ -448,52 +500,69 @@ _shrinkStr(natsStrHash *hash)
     (void) _resizeStr(hash, hash->numBkts / 2);
 }
 
-
-static natsStrHashEntry*
-_createStrEntry(uint32_t hk, char *key, bool copyKey, void *data)
+// Returns the index of the bucket holding 'key', or -1 if not found.
+static int
+_findStr(natsStrHash *hash, uint32_t hk, const char *key)
 {
-    natsStrHashEntry *e = (natsStrHashEntry*) NATS_MALLOC(sizeof(natsStrHashEntry));
+    int                 index = (int) (hk & hash->mask);
+    natsStrHashEntry    *e;
+    int                 n;
 
-    if (e == NULL)
-        return NULL;
+    for (n = 0; n < hash->numBkts; n++)
+    {
+        e = &(hash->bkts[index]);
 
-    e->hk       = hk;
-    e->key      = (copyKey ? NATS_STRDUP(key) : key);
-    e->freeKey  = copyKey;
-    e->data     = data;
-    e->next     = NULL;
+        if (e->state == NATS_HASH_EMPTY)
+            break;
 
-    if (e->key == NULL)
-    {
-        NATS_FREE(e);
-        return NULL;
+        if ((e->state == NATS_HASH_USED)
+            && (e->hk == hk)
+            && (strcmp(e->key, key) == 0))
+        {
+            return index;
+        }
+
+        index = (index + 1) & hash->mask;
     }
 
-    return e;
+    return -1;
 }
 
 natsStatus
 natsStrHash_Set(natsStrHash *hash, char *key, bool copyKey,
                 void *data, void **oldData)
 {
-    natsStatus          s         = NATS_OK;
-    uint32_t            hk        = 0;
-    int                 index     = 0;
-    natsStrHashEntry    *newEntry = NULL;
+    natsStatus          s       = NATS_OK;
+    uint32_t            hk      = 0;
+    int                 index   = 0;
+    int                 freeIdx = -1;
     natsStrHashEntry    *e;
     char                *oldKey;
+    int                 n;
 
     if (oldData != NULL)
         *oldData = NULL;
 
     hk    = natsStrHash_Hash(key, (int) strlen(key));
-    index = hk & hash->mask;
+    index = (int) (hk & hash->mask);
 
-    e = (natsStrHashEntry*) hash->bkts[index];
-    while (e != NULL)
+    for (n = 0; n < hash->numBkts; n++)
     {
-        if ((e->hk == hk)
-            && (strcmp(e->key, key) == 0))
+        e = &(hash->bkts[index]);
+
+        if (e->state == NATS_HASH_EMPTY)
+        {
+            if (freeIdx < 0)
+                freeIdx = index;
+            break;
+        }
+        else if (e->state == NATS_HASH_DELETED)
+        {
+            if (freeIdx < 0)
+                freeIdx = index;
+        }
+        else if ((e->hk == hk)
+                 && (strcmp(e->key, key) == 0))
         {
             // Success, replace data field
             if (oldData != NULL)
@@ -513,21 +582,39 @@ natsStrHash_Set(natsStrHash *hash, char *key, bool copyKey,
             return NATS_OK;
         }
 
-        e = e->next;
+        index = (index + 1) & hash->mask;
+    }
+
+    if (freeIdx < 0)
+    {
+        // All buckets are in use, which can happen only while iterating,
+        // since otherwise the hash would have been resized.
+        s = _growStr(hash);
+        if (s == NATS_OK)
+            s = natsStrHash_Set(hash, key, copyKey, data, NULL);
+
+        return NATS_UPDATE_ERR_STACK(s);
     }
 
     // We have a new entry here
-    newEntry = _createStrEntry(hk, key, copyKey, data);
-    if (newEntry == NULL)
+    e = &(hash->bkts[freeIdx]);
+
+    e->key = (copyKey ? NATS_STRDUP(key) : key);
+    if (e->key == NULL)
         return nats_setDefaultError(NATS_NO_MEMORY);
 
-    newEntry->next = hash->bkts[index];
-    hash->bkts[index] = newEntry;
+    if (e->state == NATS_HASH_DELETED)
+        hash->deleted--;
+
+    e->hk      = hk;
+    e->freeKey = copyKey;
+    e->data    = data;
+    e->state   = NATS_HASH_USED;
     hash->used++;
 
     // Check for resizing
-    if (hash->canResize && (hash->used > hash->numBkts))
-        s = _growStr(hash);
+    if (hash->canResize && _overLoaded(hash))
+        s = _rehashStr(hash);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
@@ -535,19 +622,37 @@ natsStrHash_Set(natsStrHash *hash, char *key, bool copyKey,
 void*
 natsStrHash_Get(natsStrHash *hash, char *key)
 {
+    int index = _findStr(hash, natsStrHash_Hash(key, (int) strlen(key)), key);
+
+    if (index < 0)
+        return NULL;
+
+    return hash->bkts[index].data;
+}
+
+void*
+natsStrHash_GetEx(natsStrHash *hash, const char *key, int keyLen)
+{
+    uint32_t            hk    = natsStrHash_Hash(key, keyLen);
+    int                 index = (int) (hk & hash->mask);
     natsStrHashEntry    *e;
-    uint32_t            hk = natsStrHash_Hash(key, (int) strlen(key));
 
-    e = hash->bkts[hk & hash->mask];
-    while (e != NULL)
+    for (int n = 0; n < hash->numBkts; n++)
     {
-        if ((e->hk == hk)
-            && (strcmp(e->key, key) == 0))
+        e = &(hash->bkts[index]);
+
+        if (e->state == NATS_HASH_EMPTY)
+            break;
+
+        if ((e->state == NATS_HASH_USED)
+            && (e->hk == hk)
+            && (strncmp(e->key, key, keyLen) == 0)
+            && (e->key[keyLen] == '\0'))
         {
             return e->data;
         }
 
-        e = e->next;
+        index = (index + 1) & hash->mask;
     }
 
     return NULL;
@@ -559,46 +664,55 @@ _freeStrEntry(natsStrHashEntry *e)
     if (e->freeKey)
         NATS_FREE(e->key);
 
-    NATS_FREE(e);
+    e->key     = NULL;
+    e->freeKey = false;
+    e->data    = NULL;
 }
 
 void*
 natsStrHash_Remove(natsStrHash *hash, char *key)
 {
-    natsStrHashEntry    *entryRemoved = NULL;
-    void                *dataRemoved  = NULL;
-    natsStrHashEntry    **e;
-    uint32_t            hk;
+    void                *dataRemoved = NULL;
+    natsStrHashEntry    *e;
+    int                 index;
 
-    hk = natsStrHash_Hash(key, (int) strlen(key));
+    index = _findStr(hash, natsStrHash_Hash(key, (int) strlen(key)), key);
+    if (index < 0)
+        return NULL;
 
-    e = (natsStrHashEntry**) &(hash->bkts[hk & hash->mask]);
-    while (*e != NULL)
-    {
-        if (((*e)->hk == hk)
-            && (strcmp((*e)->key, key) == 0))
-        {
-            // Success
-            entryRemoved = *e;
-            dataRemoved  = entryRemoved->data;
+    // Success
+    e           = &(hash->bkts[index]);
+    dataRemoved = e->data;
 
-            *e = entryRemoved->next;
-            _freeStrEntry(entryRemoved);
+    _freeStrEntry(e);
 
-            hash->used--;
+    hash->used--;
 
-            // Check for resizing
-            if (hash->canResize
-                && (hash->numBkts > _BSZ)
-                && (hash->used < hash->numBkts / 4))
-            {
-                _shrinkStr(hash);
-            }
+    // See natsHash_Remove()
+    if (hash->bkts[(index + 1) & hash->mask].state == NATS_HASH_EMPTY)
+    {
+        e->state = NATS_HASH_EMPTY;
 
-            break;
+        index = (index - 1) & hash->mask;
+        while (hash->bkts[index].state == NATS_HASH_DELETED)
+        {
+            hash->bkts[index].state = NATS_HASH_EMPTY;
+            hash->deleted--;
+            index = (index - 1) & hash->mask;
         }
+    }
+    else
+    {
+        e->state = NATS_HASH_DELETED;
+        hash->deleted++;
+    }
 
-        e = (natsStrHashEntry**) &((*e)->next);
+    // Check for resizing
+    if (hash->canResize
+        && (hash->numBkts > _BSZ)
+        && (hash->used < hash->numBkts / 4))
+    {
+        _shrinkStr(hash);
     }
 
     return dataRemoved;
@@ -607,23 +721,15 @@ natsStrHash_Remove(natsStrHash *hash, char *key)
 void
 natsStrHash_Destroy(natsStrHash *hash)
 {
-    natsStrHashEntry    *e, *ne;
-    int                 i;
+    int i;
 
     if (hash == NULL)
         return;
 
     for (i = 0; i < hash->numBkts; i++)
     {
-        e = hash->bkts[i];
-        while (e != NULL)
-        {
-            ne = e->next;
-
-            _freeStrEntry(e);
-
-            e = ne;
-        }
+        if (hash->bkts[i].state == NATS_HASH_USED)
+            _freeStrEntry(&(hash->bkts[i]));
     }
 
     NATS_FREE(hash->bkts);
@@ -637,65 +743,59 @@ natsStrHashIter_Init(natsStrHashIter *iter, natsStrHash *hash)
 
     hash->canResize = false;
     iter->hash      = hash;
-    iter->current   = hash->bkts[0];
-    iter->next      = iter->current;
+    iter->currBkt   = -1;
 }
 
 bool
 natsStrHashIter_Next(natsStrHashIter *iter, char **key, void **value)
 {
-    if ((iter->started) && (iter->next == NULL))
-        return false;
-
-    if (!(iter->started) && (iter->current == NULL))
-    {
-        while ((iter->next == NULL)
-               && (iter->currBkt < (iter->hash->numBkts - 1)))
-        {
-            iter->next = iter->hash->bkts[++(iter->currBkt)];
-        }
-
-        if (iter->next == NULL)
-        {
-            iter->started = true;
-            return false;
-        }
-    }
+    natsStrHash         *hash = iter->hash;
+    natsStrHashEntry    *e;
+    int                 i;
 
     iter->started = true;
 
-    iter->current = iter->next;
-    if (iter->current != NULL)
+    for (i = iter->currBkt + 1; i < hash->numBkts; i++)
     {
+        e = &(hash->bkts[i]);
+        if (e->state != NATS_HASH_USED)
+            continue;
+
+        iter->currBkt = i;
+
         if (key != NULL)
-            *key = iter->current->key;
+            *key = e->key;
         if (value != NULL)
-            *value = iter->current->data;
+            *value = e->data;
 
-        iter->next = iter->current->next;
+        return true;
     }
 
-    while ((iter->next == NULL)
-           && (iter->currBkt < (iter->hash->numBkts - 1)))
-    {
-        iter->next = iter->hash->bkts[++(iter->currBkt)];
-    }
+    iter->currBkt = hash->numBkts;
 
-    return true;
+    return false;
 }
 
 natsStatus
 natsStrHashIter_RemoveCurrent(natsStrHashIter *iter)
 {
-    char *key;
+    natsStrHash         *hash = iter->hash;
+    natsStrHashEntry    *e;
 
-    if (iter->current == NULL)
+    if ((iter->currBkt < 0)
+        || (iter->currBkt >= hash->numBkts)
+        || (hash->bkts[iter->currBkt].state != NATS_HASH_USED))
+    {
         return nats_setDefaultError(NATS_NOT_FOUND);
+    }
 
-    key = iter->current->key;
-    iter->current = iter->next;
+    e = &(hash->bkts[iter->currBkt]);
 
-    (void) natsStrHash_Remove(iter->hash, key);
+    _freeStrEntry(e);
+    e->state = NATS_HASH_DELETED;
+
+    hash->used--;
+    hash->deleted++;
 
     return NATS_OK;
 }
@@ -703,5 +803,5 @@ natsStrHashIter_RemoveCurrent(natsStrHashIter *iter)
 void
 natsStrHashIter_Done(natsStrHashIter *iter)
 {
-    natsHashIter_Done((natsHashIter*) iter);
+    iter->hash->canResize = true;
 }
@@ -4,22 +4,29 @@
 #ifndef HASH_H_
 #define HASH_H_
 
-struct __natsHashEntry;
+// The hash tables use open addressing with linear probing: entries are
+// stored in the bucket array itself, so a lookup does not chase pointers.
+// Removed entries are marked as deleted until the table is resized, which
+// keeps the position of other entries stable while iterating.
+#define NATS_HASH_EMPTY     (0)
+#define NATS_HASH_USED      (1)
+#define NATS_HASH_DELETED   (2)
 
 typedef struct __natsHashEntry
 {
-    int64_t                 key;
-    void                    *data;
-    struct __natsHashEntry  *next;
+    int64_t         key;
+    void            *data;
+    uint8_t         state;
 
 } natsHashEntry;
 
 typedef struct __natsHash
 {
-    natsHashEntry   **bkts;
+    natsHashEntry   *bkts;
     int             numBkts;
     int             mask;
     int             used;
+    int             deleted;
     bool            canResize;
 
 } natsHash;
@@ -27,8 +34,6 @@ typedef struct __natsHash
 typedef struct __natsHashIter
 {
     natsHash        *hash;
-    natsHashEntry   *current;
-    natsHashEntry   *next;
     int             currBkt;
     bool            started;
 
@@ -36,20 +41,21 @@ typedef struct __natsHashIter
 
 typedef struct __natsStrHashEntry
 {
-    uint32_t                    hk;
-    char                        *key;
-    bool                        freeKey;
-    void                        *data;
-    struct __natsStrHashEntry   *next;
+    uint32_t        hk;
+    bool            freeKey;
+    uint8_t         state;
+    char            *key;
+    void            *data;
 
 } natsStrHashEntry;
 
 typedef struct __natsStrHash
 {
-    natsStrHashEntry    **bkts;
+    natsStrHashEntry    *bkts;
     int                 numBkts;
     int                 mask;
     int                 used;
+    int                 deleted;
     bool                canResize;
 
 } natsStrHash;
@@ -57,8 +63,6 @@ typedef struct __natsStrHash
 typedef struct __natsStrHashIter
 {
     natsStrHash         *hash;
-    natsStrHashEntry    *current;
-    natsStrHashEntry    *next;
     int                 currBkt;
     bool                started;
 
@@ -73,6 +77,11 @@ typedef struct __natsStrHashIter
 natsStatus
 natsHash_Create(natsHash **newHash, int initialSize);
 
+// Grows the hash, if needed, so that 'count' more entries can be added
+// without resizing it.
+natsStatus
+natsHash_Reserve(natsHash *hash, int count);
+
 natsStatus
 natsHash_Set(natsHash *hash, int64_t key, void *data, void **oldData);
 
@@ -116,6 +125,11 @@ natsStrHash_Set(natsStrHash *hash, char *key, bool copyKey,
 void*
 natsStrHash_Get(natsStrHash *hash, char *key);
 
+// Same as natsStrHash_Get() but for a key of 'keyLen' bytes that does not
+// need to be NULL terminated.
+void*
+natsStrHash_GetEx(natsStrHash *hash, const char *key, int keyLen);
+
 void*
 natsStrHash_Remove(natsStrHash *hash, char *key);
 
@@ -10,15 +10,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#ifdef DARWIN
-#define FD_SETSIZE  (32768)
-#else
 #include <sys/types.h>
-#undef __FD_SETSIZE
-#define __FD_SETSIZE (32768)
-#include <sys/select.h>
-#endif
-
+#include <poll.h>
 #include <sys/time.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
@@ -27,16 +20,29 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
 #include <errno.h>
 
+#include "../nats.h"
+
 typedef pthread_t       natsThread;
 typedef pthread_key_t   natsThreadLocal;
-typedef pthread_mutex_t natsMutex;
+typedef struct __natsMutex
+{
+    pthread_mutex_t mu;
+
+    // Estimate of the number of spins needed to acquire the lock when it
+    // is contended (see natsMutex_Lock()), and the role of the lock.
+    int32_t         spins;
+    int             role;
+
+} natsMutex;
 typedef pthread_cond_t  natsCondition;
 typedef pthread_once_t  natsInitOnceType;
-typedef int             natsSock;
 typedef socklen_t       natsSockLen;
 typedef size_t          natsRecvLen;
+typedef struct iovec    natsSockIOVec;
+typedef struct pollfd   natsSockPollFd;
 
 #define NATS_ONCE_STATIC_INIT   PTHREAD_ONCE_INIT
 
@@ -48,8 +54,34 @@ typedef size_t          natsRecvLen;
 #define NATS_SOCK_ERROR                 (-1)
 #define NATS_SOCK_GET_ERROR             (errno)
 
+#define NATS_POLL_IN                    (POLLIN)
+#define NATS_POLL_OUT                   (POLLOUT)
+
+#define NATS_IOVEC_SET(v, b, l)         { (v).iov_base = (void*) (b); (v).iov_len = (size_t) (l); }
+#define NATS_IOVEC_BASE(v)              ((char*) (v).iov_base)
+#define NATS_IOVEC_LEN(v)               ((int) (v).iov_len)
+
+// Sequentially consistent atomic operations on 32-bit integers and pointers.
+#define NATS_ATOMIC_GET(p)              __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_SET(p, v)           __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_INC(p)              __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_DEC(p)              __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_ADD(p, v)           ((void) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST))
+#define NATS_ATOMIC_CAS(p, o, n)        __sync_bool_compare_and_swap((p), (o), (n))
+#define NATS_ATOMIC_GET_PTR(p)          __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_XCHG_PTR(p, v)      __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define NATS_ATOMIC_CAS_PTR(p, o, n)    __sync_bool_compare_and_swap((p), (o), (n))
+
+// Atomic operations on 64-bit counters.
+#define NATS_ATOMIC64_GET(p)            __atomic_load_n((p), __ATOMIC_RELAXED)
+#define NATS_ATOMIC64_ADD(p, v)         ((void) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED))
+#define NATS_ATOMIC64_SET(p, v)         __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define NATS_ATOMIC64_CAS(p, o, n)      __sync_bool_compare_and_swap((p), (o), (n))
+
 #define nats_asprintf       asprintf
 #define nats_strcasestr     strcasestr
 #define nats_strcasecmp     strcasecmp
+#define nats_fseek(f, o)    fseeko((f), (off_t) (o), SEEK_SET)
+#define nats_getpid()       ((int64_t) getpid())
 
 #endif /* N_UNIX_H_ */
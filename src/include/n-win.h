@@ -15,6 +15,8 @@
 #pragma comment(lib, "Ws2_32.lib")
 #pragma warning(disable : 4996)
 
+#include "../nats.h"
+
 typedef struct __natsThread
 {
     HANDLE  t;
@@ -27,9 +29,19 @@ typedef DWORD               natsThreadLocal;
 typedef CRITICAL_SECTION    natsMutex;
 typedef CONDITION_VARIABLE  natsCondition;
 typedef INIT_ONCE           natsInitOnceType;
-typedef SOCKET              natsSock;
 typedef int                 natsSockLen;
 typedef int                 natsRecvLen;
+typedef WSABUF              natsSockIOVec;
+
+// WSAPoll() does not report failed connects on all versions of Windows, so
+// natsSock_Poll() is implemented with select() on this platform.
+typedef struct
+{
+    natsSock    fd;
+    short       events;
+    short       revents;
+
+} natsSockPollFd;
 
 #define NATS_ONCE_TYPE          INIT_ONCE
 #define NATS_ONCE_STATIC_INIT   INIT_ONCE_STATIC_INIT
@@ -42,10 +54,38 @@ typedef int                 natsRecvLen;
 #define NATS_SOCK_ERROR                 (SOCKET_ERROR)
 #define NATS_SOCK_GET_ERROR             WSAGetLastError()
 
+#define NATS_POLL_IN                    (0x1)
+#define NATS_POLL_OUT                   (0x4)
+#define NATS_POLL_ERR                   (0x8)
+
+#define NATS_IOVEC_SET(v, b, l)         { (v).buf = (CHAR*) (b); (v).len = (ULONG) (l); }
+#define NATS_IOVEC_BASE(v)              ((char*) (v).buf)
+#define NATS_IOVEC_LEN(v)               ((int) (v).len)
+
+// Sequentially consistent atomic operations on 32-bit integers and pointers.
+#define NATS_ATOMIC_GET(p)              InterlockedCompareExchange((volatile LONG*) (p), 0, 0)
+#define NATS_ATOMIC_SET(p, v)           InterlockedExchange((volatile LONG*) (p), (LONG) (v))
+#define NATS_ATOMIC_INC(p)              InterlockedIncrement((volatile LONG*) (p))
+#define NATS_ATOMIC_DEC(p)              InterlockedDecrement((volatile LONG*) (p))
+#define NATS_ATOMIC_ADD(p, v)           ((void) InterlockedExchangeAdd((volatile LONG*) (p), (LONG) (v)))
+#define NATS_ATOMIC_CAS(p, o, n)        (InterlockedCompareExchange((volatile LONG*) (p), (LONG) (n), (LONG) (o)) == (LONG) (o))
+#define NATS_ATOMIC_GET_PTR(p)          InterlockedCompareExchangePointer((PVOID volatile*) (p), NULL, NULL)
+#define NATS_ATOMIC_XCHG_PTR(p, v)      InterlockedExchangePointer((PVOID volatile*) (p), (PVOID) (v))
+#define NATS_ATOMIC_CAS_PTR(p, o, n)    (InterlockedCompareExchangePointer((PVOID volatile*) (p), (PVOID) (n), (PVOID) (o)) == (PVOID) (o))
+
+// Atomic operations on 64-bit counters.
+#define NATS_ATOMIC64_GET(p)            ((uint64_t) InterlockedCompareExchange64((volatile LONGLONG*) (p), 0, 0))
+#define NATS_ATOMIC64_ADD(p, v)         ((void) InterlockedExchangeAdd64((volatile LONGLONG*) (p), (LONGLONG) (v)))
+#define NATS_ATOMIC64_SET(p, v)         ((void) InterlockedExchange64((volatile LONGLONG*) (p), (LONGLONG) (v)))
+#define NATS_ATOMIC64_CAS(p, o, n)      (InterlockedCompareExchange64((volatile LONGLONG*) (p), (LONGLONG) (n), (LONGLONG) (o)) == (LONGLONG) (o))
+
 // Windows doesn't have those..
 #define snprintf    _snprintf
 #define strcasecmp  _stricmp
 
+#define nats_fseek(f, o)    _fseeki64((f), (__int64) (o), SEEK_SET)
+#define nats_getpid()       ((int64_t) GetCurrentProcessId())
+
 int
 nats_asprintf(char **newStr, const char *fmt, ...);
 
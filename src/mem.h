@@ -5,6 +5,24 @@
 
 #include <stdlib.h>
 
+#ifdef NATS_MEM_COUNTERS
+#include <stdint.h>
+
+// Counts the allocations made by the library, for the microbenchmarks. The
+// counter is not updated atomically, so it is accurate only when a single
+// thread is allocating.
+extern int64_t natsMem_Allocs;
+
+#define NATS_MALLOC(s)      (natsMem_Allocs++, malloc((s)))
+#define NATS_CALLOC(c,s)    (natsMem_Allocs++, calloc((c), (s)))
+#define NATS_REALLOC(p, s)  (natsMem_Allocs++, realloc((p), (s)))
+
+#ifdef _WIN32
+#define NATS_STRDUP(s)      (natsMem_Allocs++, _strdup((s)))
+#else
+#define NATS_STRDUP(s)      (natsMem_Allocs++, strdup((s)))
+#endif
+#else
 #define NATS_MALLOC(s)      malloc((s))
 #define NATS_CALLOC(c,s)    calloc((c), (s))
 #define NATS_REALLOC(p, s)  realloc((p), (s))
@@ -14,6 +32,7 @@
 #else
 #define NATS_STRDUP(s)      strdup((s))
 #endif
+#endif
 #define NATS_FREE(p)        free((p))
 
 
@@ -8,6 +8,110 @@
 
 #include "mem.h"
 
+static void
+_freePool(natsMsgPool *pool)
+{
+    natsMsg *msg;
+
+    for (int i=0; i<NATS_MSG_POOL_CLASSES; i++)
+    {
+        while ((msg = pool->free[i]) != NULL)
+        {
+            pool->free[i] = msg->next;
+            NATS_FREE(msg);
+        }
+        pool->count[i] = 0;
+    }
+}
+
+// Returns a block of at least 'size' bytes, from the pool if possible.
+static natsMsg*
+_allocMsg(natsMsgPool *pool, int size)
+{
+    natsMsg *msg  = NULL;
+    int     c     = 0;
+    int     bSize = NATS_MSG_POOL_MIN_BLOCK;
+
+    if (pool != NULL)
+    {
+        while ((c < NATS_MSG_POOL_CLASSES) && (bSize < size))
+        {
+            c++;
+            bSize *= 2;
+        }
+    }
+    if ((pool == NULL) || (c == NATS_MSG_POOL_CLASSES))
+    {
+        msg = (natsMsg*) NATS_MALLOC(size);
+        if (msg != NULL)
+            msg->pool = NULL;
+
+        return msg;
+    }
+
+    natsMutex_Lock(pool->mu);
+
+    if ((msg = pool->free[c]) != NULL)
+    {
+        pool->free[c] = msg->next;
+        pool->count[c]--;
+        pool->hits++;
+    }
+    else
+    {
+        pool->misses++;
+    }
+    pool->refs++;
+
+    natsMutex_Unlock(pool->mu);
+
+    if (msg == NULL)
+    {
+        msg = (natsMsg*) NATS_MALLOC(bSize);
+        if (msg == NULL)
+        {
+            natsMsgPool_Release(pool);
+            return NULL;
+        }
+    }
+
+    msg->pool      = pool;
+    msg->poolClass = c;
+
+    return msg;
+}
+
+static void
+_returnToPool(natsMsg *msg)
+{
+    natsMsgPool *pool = msg->pool;
+    int         c     = msg->poolClass;
+    int         refs;
+
+    natsMutex_Lock(pool->mu);
+
+    if (pool->count[c] < pool->maxPerClass)
+    {
+        msg->next     = pool->free[c];
+        pool->free[c] = msg;
+        pool->count[c]++;
+        msg = NULL;
+    }
+    refs = --(pool->refs);
+
+    natsMutex_Unlock(pool->mu);
+
+    if (msg != NULL)
+        NATS_FREE(msg);
+
+    if (refs == 0)
+    {
+        _freePool(pool);
+        natsMutex_Destroy(pool->mu);
+        NATS_FREE(pool);
+    }
+}
+
 void
 natsMsg_free(void *object)
 {
@@ -18,7 +122,16 @@ natsMsg_free(void *object)
 
     msg = (natsMsg*) object;
 
-    NATS_FREE(msg);
+    if (msg->slab != NULL)
+        natsMsgSlab_Release(msg->slab);
+
+    if (msg->subj != NULL)
+        natsSubject_Release(msg->subj);
+
+    if (msg->pool != NULL)
+        _returnToPool(msg);
+    else
+        NATS_FREE(msg);
 }
 
 void
@@ -27,12 +140,69 @@ natsMsg_Destroy(natsMsg *msg)
     if (msg == NULL)
         return;
 
-    if (natsGC_collect((natsGCItem *) msg))
+    // Pooled messages are cheap to release, so bypass the garbage collector.
+    if ((msg->pool == NULL) && natsGC_collect((natsGCItem *) msg))
         return;
 
     natsMsg_free((void*) msg);
 }
 
+natsStatus
+natsMsgPool_Create(natsMsgPool **newPool, int maxPerClass)
+{
+    natsMsgPool *pool = (natsMsgPool*) NATS_CALLOC(1, sizeof(natsMsgPool));
+
+    if (pool == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    if (natsMutex_CreateEx(&(pool->mu), NATS_LOCK_MSG_POOL) != NATS_OK)
+    {
+        NATS_FREE(pool);
+        return NATS_UPDATE_ERR_STACK(NATS_NO_MEMORY);
+    }
+
+    pool->refs        = 1;
+    pool->maxPerClass = maxPerClass;
+
+    *newPool = pool;
+
+    return NATS_OK;
+}
+
+void
+natsMsgPool_GetCounts(natsMsgPool *pool, uint64_t *hits, uint64_t *misses)
+{
+    natsMutex_Lock(pool->mu);
+    *hits   = pool->hits;
+    *misses = pool->misses;
+    natsMutex_Unlock(pool->mu);
+}
+
+void
+natsMsgPool_Release(natsMsgPool *pool)
+{
+    int refs;
+
+    if (pool == NULL)
+        return;
+
+    natsMutex_Lock(pool->mu);
+
+    refs = --(pool->refs);
+
+    // The owner is gone, don't keep blocks around any longer.
+    pool->maxPerClass = 0;
+    _freePool(pool);
+
+    natsMutex_Unlock(pool->mu);
+
+    if (refs == 0)
+    {
+        natsMutex_Destroy(pool->mu);
+        NATS_FREE(pool);
+    }
+}
+
 const char*
 natsMsg_GetSubject(natsMsg *msg)
 {
@@ -70,23 +240,41 @@ natsMsg_GetDataLength(natsMsg *msg)
 }
 
 natsStatus
-natsMsg_create(natsMsg **newMsg,
+natsMsg_create(natsMsg **newMsg, natsMsgPool *pool, natsSubject *subj,
                const char *subject, int subjLen,
                const char *reply, int replyLen,
                const char *buf, int bufLen)
+{
+    natsIOVec iov;
+
+    iov.data = buf;
+    iov.len  = bufLen;
+
+    return natsMsg_createV(newMsg, pool, subj, subject, subjLen,
+                           reply, replyLen, &iov, 1, bufLen);
+}
+
+natsStatus
+natsMsg_createV(natsMsg **newMsg, natsMsgPool *pool, natsSubject *subj,
+                const char *subject, int subjLen,
+                const char *reply, int replyLen,
+                const natsIOVec *iov, int iovcnt, int bufLen)
 {
     natsMsg     *msg      = NULL;
     char        *ptr      = NULL;
     int         bufSize   = 0;
 
-    bufSize  = subjLen;
-    bufSize += 1;
+    if (subj == NULL)
+    {
+        bufSize  = subjLen;
+        bufSize += 1;
+    }
     bufSize += replyLen;
     bufSize += 1;
     bufSize += bufLen;
     bufSize += 1;
 
-    msg = NATS_MALLOC(sizeof(natsMsg) + bufSize);
+    msg = _allocMsg(pool, (int) sizeof(natsMsg) + bufSize);
     if (msg == NULL)
         return nats_setDefaultError(NATS_NO_MEMORY);
 
@@ -100,13 +288,23 @@ natsMsg_create(natsMsg **newMsg,
     memset(&(msg->gc), 0, sizeof(natsGCItem));
 
     msg->next = NULL;
+    msg->slab = NULL;
+    msg->subj = subj;
 
     ptr = (char*) (((char*) &(msg->next)) + sizeof(msg->next));
 
-    msg->subject = (const char*) ptr;
-    memcpy(ptr, subject, subjLen);
-    ptr += subjLen;
-    *(ptr++) = '\0';
+    if (subj != NULL)
+    {
+        natsSubject_Retain(subj);
+        msg->subject = (const char*) subj->data;
+    }
+    else
+    {
+        msg->subject = (const char*) ptr;
+        memcpy(ptr, subject, subjLen);
+        ptr += subjLen;
+        *(ptr++) = '\0';
+    }
 
     msg->reply = (const char*) ptr;
     if (replyLen > 0)
@@ -118,8 +316,12 @@ natsMsg_create(natsMsg **newMsg,
 
     msg->data    = (const char*) ptr;
     msg->dataLen = bufLen;
-    memcpy(ptr, buf, bufLen);
-    ptr += bufLen;
+    for (int i=0; i<iovcnt; i++)
+    {
+        if (iov[i].len > 0)
+            memcpy(ptr, iov[i].data, iov[i].len);
+        ptr += iov[i].len;
+    }
     *(ptr) = '\0';
 
     // Setting the callback will trigger garbage collection when
@@ -131,6 +333,249 @@ natsMsg_create(natsMsg **newMsg,
     return NATS_OK;
 }
 
+natsStatus
+natsMsg_createFromSlab(natsMsg **newMsg, natsMsgPool *pool, natsMsgSlab *slab,
+                       char *subject, int subjLen,
+                       char *reply, int replyLen,
+                       char *buf, int bufLen)
+{
+    natsMsg *msg = NULL;
+
+    msg = _allocMsg(pool, (int) sizeof(natsMsg));
+    if (msg == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    memset(&(msg->gc), 0, sizeof(natsGCItem));
+
+    msg->next = NULL;
+    msg->subj = NULL;
+
+    // The subject, reply and payload are followed by a space or CR in the
+    // slab, which have already been consumed by the parser.
+    subject[subjLen] = '\0';
+    msg->subject = (const char*) subject;
+
+    if (replyLen > 0)
+    {
+        reply[replyLen] = '\0';
+        msg->reply = (const char*) reply;
+    }
+    else
+    {
+        msg->reply = "";
+    }
+
+    buf[bufLen]  = '\0';
+    msg->data    = (const char*) buf;
+    msg->dataLen = bufLen;
+
+    natsMsgSlab_Retain(slab);
+    msg->slab = slab;
+
+    msg->gc.freeCb = natsMsg_free;
+
+    *newMsg = msg;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubject_Create(natsSubject **newSubj, const char *subject, int len)
+{
+    natsSubject *subj = NULL;
+
+    subj = (natsSubject*) NATS_MALLOC(sizeof(natsSubject) + len);
+    if (subj == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    subj->refs = 1;
+    subj->len  = len;
+    memcpy(subj->data, subject, len);
+    subj->data[len] = '\0';
+
+    *newSubj = subj;
+
+    return NATS_OK;
+}
+
+void
+natsSubject_Retain(natsSubject *subj)
+{
+    NATS_ATOMIC_INC(&(subj->refs));
+}
+
+void
+natsSubject_Release(natsSubject *subj)
+{
+    if ((subj != NULL) && (NATS_ATOMIC_DEC(&(subj->refs)) == 0))
+        NATS_FREE(subj);
+}
+
+natsStatus
+natsMsgSlab_Create(natsMsgSlab **newSlab, int size)
+{
+    natsMsgSlab *slab = NULL;
+
+    slab = (natsMsgSlab*) NATS_MALLOC(sizeof(natsMsgSlab) + size);
+    if (slab == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    if (natsMutex_CreateEx(&(slab->mu), NATS_LOCK_MSG_POOL) != NATS_OK)
+    {
+        NATS_FREE(slab);
+        return NATS_UPDATE_ERR_STACK(NATS_NO_MEMORY);
+    }
+
+    slab->refs = 1;
+    slab->size = size;
+    slab->data = ((char*) slab) + sizeof(natsMsgSlab);
+
+    *newSlab = slab;
+
+    return NATS_OK;
+}
+
+void
+natsMsgSlab_Retain(natsMsgSlab *slab)
+{
+    natsMutex_Lock(slab->mu);
+    slab->refs++;
+    natsMutex_Unlock(slab->mu);
+}
+
+void
+natsMsgSlab_Release(natsMsgSlab *slab)
+{
+    int refs;
+
+    if (slab == NULL)
+        return;
+
+    natsMutex_Lock(slab->mu);
+    refs = --(slab->refs);
+    natsMutex_Unlock(slab->mu);
+
+    if (refs == 0)
+    {
+        natsMutex_Destroy(slab->mu);
+        NATS_FREE(slab);
+    }
+}
+
+bool
+natsMsgSlab_IsShared(natsMsgSlab *slab)
+{
+    bool shared;
+
+    natsMutex_Lock(slab->mu);
+    shared = (slab->refs > 1);
+    natsMutex_Unlock(slab->mu);
+
+    return shared;
+}
+
+int
+natsMsgQueue_Push(natsMsgQueue *q, natsMsg *msg)
+{
+    natsMsg *first;
+
+    do
+    {
+        first     = NATS_ATOMIC_GET_PTR(&(q->inbox));
+        msg->next = first;
+    }
+    while (!NATS_ATOMIC_CAS_PTR(&(q->inbox), first, msg));
+
+    NATS_ATOMIC64_ADD(&(q->bytes), (int64_t) msg->dataLen);
+
+    return (int) NATS_ATOMIC_INC(&(q->count));
+}
+
+// Moves the messages pushed so far to the consumer's list. Returns false
+// if there is none.
+static bool
+_takeInbox(natsMsgQueue *q)
+{
+    natsMsg *msg  = NULL;
+    natsMsg *prev = NULL;
+    natsMsg *next = NULL;
+
+    msg = NATS_ATOMIC_XCHG_PTR(&(q->inbox), NULL);
+    if (msg == NULL)
+        return false;
+
+    // The inbox is in reverse order.
+    while (msg != NULL)
+    {
+        next      = msg->next;
+        msg->next = prev;
+        prev      = msg;
+        msg       = next;
+    }
+    q->head = prev;
+
+    return true;
+}
+
+natsMsg*
+natsMsgQueue_Pop(natsMsgQueue *q)
+{
+    natsMsg *msg;
+
+    if ((q->head == NULL) && !_takeInbox(q))
+        return NULL;
+
+    msg     = q->head;
+    q->head = msg->next;
+
+    msg->next = NULL;
+
+    (void) NATS_ATOMIC_DEC(&(q->count));
+    NATS_ATOMIC64_ADD(&(q->bytes), -((int64_t) msg->dataLen));
+
+    return msg;
+}
+
+int
+natsMsgQueue_PopMany(natsMsgQueue *q, natsMsg **msgs, int max)
+{
+    natsMsg *msg;
+    int64_t bytes = 0;
+    int     count = 0;
+
+    while (count < max)
+    {
+        if ((q->head == NULL) && !_takeInbox(q))
+            break;
+
+        msg     = q->head;
+        q->head = msg->next;
+
+        msg->next = NULL;
+
+        bytes += (int64_t) msg->dataLen;
+        msgs[count++] = msg;
+    }
+
+    // Update the counters once for the whole batch.
+    if (count > 0)
+    {
+        NATS_ATOMIC_ADD(&(q->count), -count);
+        NATS_ATOMIC64_ADD(&(q->bytes), -bytes);
+    }
+
+    return count;
+}
+
+void
+natsMsgQueue_Clear(natsMsgQueue *q)
+{
+    natsMsg *msg;
+
+    while ((msg = natsMsgQueue_Pop(q)) != NULL)
+        natsMsg_Destroy(msg);
+}
+
 natsStatus
 natsMsg_Create(natsMsg **newMsg, const char *subj, const char *reply,
                const char *data, int dataLen)
@@ -144,7 +589,7 @@ natsMsg_Create(natsMsg **newMsg, const char *subj, const char *reply,
         return nats_setDefaultError(NATS_INVALID_ARG);
     }
 
-    s = natsMsg_create(newMsg,
+    s = natsMsg_create(newMsg, NULL, NULL,
                        subj, (int) strlen(subj),
                        reply, (reply == NULL ? 0 : (int) strlen(reply)),
                        data, dataLen);
@@ -8,6 +8,58 @@
 
 struct __natsMsg;
 
+// A reference counted subject. Inbound messages reference the subject of
+// their subscription when it has no wildcard, or one cached by the
+// connection, instead of having their own copy.
+typedef struct __natsSubject
+{
+    int32_t             refs;
+    int                 len;
+
+    // NULL terminated, the memory follows this structure.
+    char                data[1];
+
+} natsSubject;
+
+// A reference counted buffer the connection reads into. Inbound messages
+// that are fully contained in a single read point into the slab instead of
+// having their content copied. The slab is freed when the connection and
+// all the messages referencing it are done with it.
+typedef struct __natsMsgSlab
+{
+    natsMutex           *mu;
+    int                 refs;
+    int                 size;
+
+    // Points to the memory right after this structure.
+    char                *data;
+
+} natsMsgSlab;
+
+// Number of size classes of the message pool. The smallest class holds
+// blocks of NATS_MSG_POOL_MIN_BLOCK bytes (message structure included), and
+// each class doubles the size of the previous one.
+#define NATS_MSG_POOL_CLASSES   (6)
+#define NATS_MSG_POOL_MIN_BLOCK (128)
+
+// A per-connection pool of message blocks. Messages allocated from the pool
+// return their block to the pool when destroyed, bypassing the garbage
+// collector. The pool is referenced by its connection and by each message
+// that was allocated from it.
+typedef struct __natsMsgPool
+{
+    natsMutex           *mu;
+    int                 refs;
+    int                 maxPerClass;
+
+    struct __natsMsg    *free[NATS_MSG_POOL_CLASSES];
+    int                 count[NATS_MSG_POOL_CLASSES];
+
+    uint64_t            hits;
+    uint64_t            misses;
+
+} natsMsgPool;
+
 struct __natsMsg
 {
     natsGCItem          gc;
@@ -15,11 +67,24 @@ struct __natsMsg
     // The message is allocated as a single memory block that contains
     // this structure and enough space for the payload. The msg payload
     // starts after the 'next' pointer.
+    // If 'slab' is not NULL, the subject, reply and data point into
+    // that slab instead. If 'subj' is not NULL, the subject points to it.
     const char          *subject;
     const char          *reply;
     const char          *data;
     int                 dataLen;
 
+    natsMsgSlab         *slab;
+    natsSubject         *subj;
+
+    // If not NULL, the pool this message's block needs to be returned to.
+    natsMsgPool         *pool;
+    int                 poolClass;
+
+    // When the message was queued to its subscription, in nanoseconds. Set
+    // only if the connection records latencies.
+    int64_t             queuedAt;
+
     // Must be last field!
     struct __natsMsg    *next;
 
@@ -27,12 +92,116 @@ struct __natsMsg
 
 };
 
+// A queue of messages with a single producer (the connection's reader) and
+// a single consumer at a time (the subscription's delivery thread or the
+// NextMsg caller, serialized by the subscription's lock). The producer never
+// blocks: it pushes messages onto 'inbox' with a compare-and-swap. The
+// consumer takes the whole inbox with an atomic exchange when its own list
+// is empty, and reverses it to restore the arrival order. Messages are
+// linked through their 'next' field, so the queue does not need memory of
+// its own.
+typedef struct __natsMsgQueue
+{
+    // Producer side, most recent message first.
+    struct __natsMsg    *inbox;
+
+    // Consumer side, oldest message first.
+    struct __natsMsg    *head;
+
+    // Total number of messages in the queue (inbox and consumer list).
+    int32_t             count;
+
+    // Total size of the payloads of those messages.
+    int64_t             bytes;
+
+} natsMsgQueue;
+
+// Adds the message to the queue and returns the new count. Producer only.
+int
+natsMsgQueue_Push(natsMsgQueue *q, natsMsg *msg);
+
+// Removes and returns the oldest message, or NULL if the queue is empty.
+// Consumer only.
+natsMsg*
+natsMsgQueue_Pop(natsMsgQueue *q);
+
+// Removes up to 'max' of the oldest messages, stores them in 'msgs' and
+// returns how many were removed. Consumer only.
+int
+natsMsgQueue_PopMany(natsMsgQueue *q, natsMsg **msgs, int max);
+
+#define natsMsgQueue_Count(q)   ((int) NATS_ATOMIC_GET(&((q)->count)))
+#define natsMsgQueue_Bytes(q)   ((int64_t) NATS_ATOMIC64_GET(&((q)->bytes)))
+
+// Destroys all messages in the queue. No producer or consumer must be
+// using the queue.
+void
+natsMsgQueue_Clear(natsMsgQueue *q);
+
+// Creates a message, copying the subject, reply and payload. If 'pool' is
+// not NULL, the memory block is taken from the pool when possible. If
+// 'subj' is not NULL, it is retained and used as the subject of the
+// message, and 'subject' is ignored.
 natsStatus
-natsMsg_create(natsMsg **newMsg,
+natsMsg_create(natsMsg **newMsg, natsMsgPool *pool, natsSubject *subj,
                const char *subject, int subjLen,
                const char *reply, int replyLen,
                const char *buf, int bufLen);
 
+// Same as natsMsg_create(), but the payload is made of the 'iovcnt'
+// fragments of 'iov', 'bufLen' bytes in total.
+natsStatus
+natsMsg_createV(natsMsg **newMsg, natsMsgPool *pool, natsSubject *subj,
+                const char *subject, int subjLen,
+                const char *reply, int replyLen,
+                const natsIOVec *iov, int iovcnt, int bufLen);
+
+// Creates a message whose subject, reply and data point into the given slab.
+// The bytes that follow the subject, reply and data in the slab are replaced
+// with '\0', so they must no longer be needed. The slab is retained by the
+// message.
+natsStatus
+natsMsg_createFromSlab(natsMsg **newMsg, natsMsgPool *pool, natsMsgSlab *slab,
+                       char *subject, int subjLen,
+                       char *reply, int replyLen,
+                       char *buf, int bufLen);
+
+natsStatus
+natsSubject_Create(natsSubject **newSubj, const char *subject, int len);
+
+void
+natsSubject_Retain(natsSubject *subj);
+
+void
+natsSubject_Release(natsSubject *subj);
+
+natsStatus
+natsMsgSlab_Create(natsMsgSlab **newSlab, int size);
+
+void
+natsMsgSlab_Retain(natsMsgSlab *slab);
+
+void
+natsMsgSlab_Release(natsMsgSlab *slab);
+
+// Returns 'true' if the slab is referenced by some messages besides its
+// owner, in which case its content can't be overwritten.
+bool
+natsMsgSlab_IsShared(natsMsgSlab *slab);
+
+// Creates a pool that keeps at most 'maxPerClass' free blocks per size class.
+natsStatus
+natsMsgPool_Create(natsMsgPool **newPool, int maxPerClass);
+
+// Gets the hits and misses counts of the pool.
+void
+natsMsgPool_GetCounts(natsMsgPool *pool, uint64_t *hits, uint64_t *misses);
+
+// Releases the owner's reference. Blocks returned to the pool after this
+// call are freed instead of being recycled.
+void
+natsMsgPool_Release(natsMsgPool *pool);
+
 // This needs to follow the nats_FreeObjectCb prototype (see gc.h)
 void
 natsMsg_free(void *object);
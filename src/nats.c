@@ -12,6 +12,10 @@
 #include "timer.h"
 #include "util.h"
 #include "asynccb.h"
+#include "conn.h"
+#include "evloop.h"
+#include "dlvpool.h"
+#include "nuid.h"
 
 #define WAIT_LIB_INITIALIZED \
         natsMutex_Lock(gLib.lock); \
@@ -36,35 +40,109 @@ typedef struct __natsLibTimers
     natsMutex       *lock;
     natsCondition   *cond;
     natsThread      *thread;
-    natsTimer       *timers;
+
+    // Binary min-heap of the active timers, ordered by absolute time (and
+    // sequence). 'cap' is always at least the number of existing timers,
+    // so that inserting never needs to allocate.
+    natsTimer       **heap;
+    int             len;
+    int             cap;
+    int             created;
+    uint64_t        seq;
+
     int             count;
     bool            changed;
     bool            shutdown;
 
+    // Set to 1 once the thread is started (atomically updated).
+    int32_t         started;
+
 } natsLibTimers;
 
+#define NATS_ASYNC_CB_THREADS   (4)
+
+// Each connection has its own queue of callbacks. The connections that have
+// some are in a list, from which the threads pick them in turn. A connection
+// is handled by a single thread at a time, so that its callbacks are
+// invoked in order, and is put back at the end of the list after each
+// callback, so that a slow callback delays only its own connection.
 typedef struct __natsLibAsyncCbs
 {
     natsMutex       *lock;
     natsCondition   *cond;
-    natsThread      *thread;
-    natsAsyncCbInfo *head;
-    natsAsyncCbInfo *tail;
+    natsThread      *threads[NATS_ASYNC_CB_THREADS];
+    natsConnection  *head;
+    natsConnection  *tail;
     bool            shutdown;
 
+    // Set to 1 once the threads are started (atomically updated).
+    int32_t         started;
+
 } natsLibAsyncCbs;
 
+#define NATS_GC_SHARDS  (4)
+
+// Items are queued to one of several lists, so that threads destroying
+// objects concurrently do not contend on a single lock. A thread always
+// uses the same shard, assigned in a round-robin fashion.
+typedef struct __natsGCShard
+{
+    natsMutex       *lock;
+    natsGCItem      *head;
+
+    // Number of items in the list (atomically updated so that the
+    // collector can check it without the lock).
+    int32_t         count;
+
+    uint64_t        queued;
+
+} natsGCShard;
+
 typedef struct __natsGCList
 {
     natsMutex       *lock;
     natsCondition   *cond;
     natsThread      *thread;
-    natsGCItem      *head;
     bool            shutdown;
-    bool            inWait;
+
+    // Set to 1 once the thread is started (atomically updated).
+    int32_t         started;
+
+    natsGCShard     shards[NATS_GC_SHARDS];
+    natsThreadLocal shardKey;
+    bool            shardKeyCreated;
+    int32_t         nextShard;
+
+    // Set to 1 while the collector waits (atomically updated).
+    int32_t         inWait;
+
+    // If 1, natsGC_collect() lets the caller free the item (atomically
+    // updated).
+    int32_t         freeInline;
+
+    // Number of items freed by the collector (under 'lock').
+    uint64_t        freed;
 
 } natsGCList;
 
+typedef struct __natsLibEvLoops
+{
+    natsMutex       *lock;
+    natsEvLoop      **loops;
+    int             count;
+    int             next;
+    int             threads;
+
+} natsLibEvLoops;
+
+typedef struct __natsLibDlvPool
+{
+    natsMutex       *lock;
+    natsDlvPool     *pool;
+    int             threads;
+
+} natsLibDlvPool;
+
 typedef struct __natsLib
 {
     // Leave these fields before 'refs'
@@ -73,6 +151,8 @@ typedef struct __natsLib
     bool            sslInitialized;
     natsThreadLocal errTLKey;
     natsThreadLocal sslTLKey;
+    natsThreadLocal nuidTLKey;
+    bool            nuidTLKeyCreated;
     bool            initialized;
     bool            closed;
     // Do not move 'refs' without checking _freeLib()
@@ -85,20 +165,47 @@ typedef struct __natsLib
 
     natsCondition   *cond;
 
-    natsMutex       *inboxesLock;
-    uint64_t        inboxesSeq;
-
     natsGCList      gc;
 
+    natsLibEvLoops  evLoops;
+
+    natsLibDlvPool  dlvPool;
+
 } natsLib;
 
 int64_t gLockSpinCount = 2000;
 
+#if defined(NATS_LOCK_STATS)
+natsLockStats gLockStats[NATS_LOCK_ROLES];
+#endif
+
+#ifdef NATS_MEM_COUNTERS
+int64_t natsMem_Allocs = 0;
+#endif
+
 static const char *inboxPrefix = "_INBOX.";
+#define _INBOX_PREFIX_LEN_  (7)
 
 static natsInitOnceType gInitOnce = NATS_ONCE_STATIC_INIT;
 static natsLib          gLib;
 
+// Set by nats_SetThreadStartCB(), which may be called before the library
+// is opened, so these are not part of 'gLib'.
+static natsThreadStartHandler   gThreadStartCb          = NULL;
+static void                     *gThreadStartCbClosure  = NULL;
+
+static const char *threadNames[] = {
+    "nats-read",
+    "nats-flush",
+    "nats-reconnect",
+    "nats-deliver",
+    "nats-dlvpool",
+    "nats-evloop",
+    "nats-timer",
+    "nats-asynccb",
+    "nats-gc",
+};
+
 static void
 _destroyErrTL(void *localStorage)
 {
@@ -107,6 +214,14 @@ _destroyErrTL(void *localStorage)
     NATS_FREE(err);
 }
 
+static void
+_destroyNUIDTL(void *localStorage)
+{
+    natsNUID *nuid = (natsNUID*) localStorage;
+
+    NATS_FREE(nuid);
+}
+
 static void
 _cleanupThreadSSL(void *localStorage)
 {
@@ -153,6 +268,13 @@ _cleanupThreadLocals(void)
     if (tl != NULL)
         _destroyErrTL(tl);
 
+    if (gLib.nuidTLKeyCreated)
+    {
+        tl = natsThreadLocal_Get(gLib.nuidTLKey);
+        if (tl != NULL)
+            _destroyNUIDTL(tl);
+    }
+
     tl = NULL;
 
     natsMutex_Lock(gLib.lock);
@@ -213,14 +335,17 @@ _freeTimers(void)
     natsThread_Destroy(timers->thread);
     natsCondition_Destroy(timers->cond);
     natsMutex_Destroy(timers->lock);
+    NATS_FREE(timers->heap);
 }
 
 static void
 _freeAsyncCbs(void)
 {
     natsLibAsyncCbs *cbs = &(gLib.asyncCbs);
+    int             i;
 
-    natsThread_Destroy(cbs->thread);
+    for (i = 0; i < NATS_ASYNC_CB_THREADS; i++)
+        natsThread_Destroy(cbs->threads[i]);
     natsCondition_Destroy(cbs->cond);
     natsMutex_Destroy(cbs->lock);
 }
@@ -228,11 +353,32 @@ _freeAsyncCbs(void)
 static void
 _freeGC(void)
 {
-    natsGCList *gc = &(gLib.gc);
+    natsGCList  *gc = &(gLib.gc);
+    int         i;
 
     natsThread_Destroy(gc->thread);
     natsCondition_Destroy(gc->cond);
     natsMutex_Destroy(gc->lock);
+
+    for (i = 0; i < NATS_GC_SHARDS; i++)
+        natsMutex_Destroy(gc->shards[i].lock);
+
+    if (gc->shardKeyCreated)
+        natsThreadLocal_DestroyKey(gc->shardKey);
+}
+
+static void
+_freeEvLoops(void)
+{
+    natsLibEvLoops *evLoops = &(gLib.evLoops);
+
+    natsMutex_Destroy(evLoops->lock);
+}
+
+static void
+_freeDlvPool(void)
+{
+    natsMutex_Destroy(gLib.dlvPool.lock);
 }
 
 static void
@@ -241,8 +387,9 @@ _freeLib(void)
     _freeTimers();
     _freeAsyncCbs();
     _freeGC();
+    _freeEvLoops();
+    _freeDlvPool();
 
-    natsMutex_Destroy(gLib.inboxesLock);
     natsCondition_Destroy(gLib.cond);
 
     memset(&(gLib.refs), 0, sizeof(natsLib) - ((char *)&(gLib.refs) - (char*)&gLib));
@@ -278,6 +425,57 @@ natsLib_Release(void)
         _freeLib();
 }
 
+static void
+_timerThread(void *arg);
+
+static void
+_asyncCbsThread(void *arg);
+
+static void
+_garbageCollector(void *closure);
+
+// The library's threads are started the first time they are needed, so
+// that applications that do not use timers, callbacks or the garbage
+// collector don't pay for them. The library is retained for each thread
+// before acquiring 'lock', since nats_Close() acquires that lock while
+// holding the library's one. Returns NATS_NOT_INITIALIZED, without setting
+// an error, if the library is being closed.
+static natsStatus
+_startLibThreads(natsMutex *lock, bool *shutdown, int32_t *started,
+                 natsThread **threads, int count, natsThreadCb cb)
+{
+    natsStatus  s       = NATS_OK;
+    int         created = 0;
+    int         i;
+
+    for (i = 0; i < count; i++)
+        natsLib_Retain();
+
+    natsMutex_Lock(lock);
+
+    if (*shutdown)
+        s = NATS_NOT_INITIALIZED;
+
+    for (i = 0; (s == NATS_OK) && (i < count); i++)
+    {
+        if (threads[i] != NULL)
+            continue;
+
+        s = natsThread_Create(&(threads[i]), cb, NULL);
+        if (s == NATS_OK)
+            created++;
+    }
+    if (s == NATS_OK)
+        NATS_ATOMIC_SET(started, 1);
+
+    natsMutex_Unlock(lock);
+
+    for (i = created; i < count; i++)
+        natsLib_Release();
+
+    return s;
+}
+
 static void
 _doInitOnce(void)
 {
@@ -293,36 +491,97 @@ _doInitOnce(void)
     natsSys_Init();
 }
 
+// Returns true if timer 'a' should fire before timer 'b'.
+static bool
+_timerBefore(natsTimer *a, natsTimer *b)
+{
+    if (a->absoluteTime != b->absoluteTime)
+        return (a->absoluteTime < b->absoluteTime);
+
+    return (a->seq < b->seq);
+}
+
 static void
-_insertTimer(natsTimer *t)
+_heapSet(natsTimer **heap, int idx, natsTimer *t)
 {
-    natsTimer *cur  = gLib.timers.timers;
-    natsTimer *prev = NULL;
+    heap[idx]  = t;
+    t->heapIdx = idx;
+}
 
-    while ((cur != NULL) && (cur->absoluteTime <= t->absoluteTime))
-    {
-        prev = cur;
-        cur  = cur->next;
-    }
+static void
+_heapUp(natsLibTimers *timers, int idx)
+{
+    natsTimer   **heap = timers->heap;
+    natsTimer   *t     = heap[idx];
+    int         parent;
 
-    if (cur != NULL)
+    while (idx > 0)
     {
-        t->prev = prev;
-        t->next = cur;
-        cur->prev = t;
+        parent = (idx - 1) / 2;
+        if (!_timerBefore(t, heap[parent]))
+            break;
 
-        if (prev != NULL)
-            prev->next = t;
+        _heapSet(heap, idx, heap[parent]);
+        idx = parent;
     }
-    else if (prev != NULL)
+    _heapSet(heap, idx, t);
+}
+
+static void
+_heapDown(natsLibTimers *timers, int idx)
+{
+    natsTimer   **heap = timers->heap;
+    natsTimer   *t     = heap[idx];
+    int         child;
+
+    while ((child = 2 * idx + 1) < timers->len)
     {
-        prev->next = t;
-        t->prev = prev;
-        t->next = NULL;
+        if ((child + 1 < timers->len) && _timerBefore(heap[child + 1], heap[child]))
+            child++;
+
+        if (!_timerBefore(heap[child], t))
+            break;
+
+        _heapSet(heap, idx, heap[child]);
+        idx = child;
     }
+    _heapSet(heap, idx, t);
+}
+
+// Locks must be held before entering this function. Returns true if the
+// timer is now the first one to fire.
+static bool
+_insertTimer(natsLibTimers *timers, natsTimer *t)
+{
+    t->seq = ++(timers->seq);
+
+    _heapSet(timers->heap, timers->len, t);
+    timers->len++;
+
+    _heapUp(timers, t->heapIdx);
+
+    return (t->heapIdx == 0);
+}
+
+// Locks must be held before entering this function
+static void
+_removeFromHeap(natsLibTimers *timers, natsTimer *t)
+{
+    int         idx   = t->heapIdx;
+    natsTimer   *last = NULL;
+
+    t->heapIdx = -1;
+
+    last = timers->heap[--(timers->len)];
+    if (last == t)
+        return;
 
-    if (prev == NULL)
-        gLib.timers.timers = t;
+    // Move the last timer in the hole, and restore the heap property.
+    _heapSet(timers->heap, idx, last);
+    if ((idx > 0) && _timerBefore(last, timers->heap[(idx - 1) / 2]))
+        _heapUp(timers, idx);
+    else
+        _heapDown(timers, idx);
 }
 
 // Locks must be held before entering this function
@@ -333,29 +592,73 @@ _removeTimer(natsLibTimers *timers, natsTimer *t)
     t->stopped = true;
 
     // It the timer was in the callback, it has already been removed from the
-    // list, so skip that.
-    if (!(t->inCallback))
+    // heap, so skip that.
+    if (t->heapIdx >= 0)
+        _removeFromHeap(timers, t);
+
+    // Decrease the global count of timers
+    timers->count--;
+}
+
+// Makes room in the heap for a new timer. Called when a timer is created.
+natsStatus
+nats_reserveTimer(void)
+{
+    natsLibTimers   *timers = &(gLib.timers);
+    natsStatus      s       = NATS_OK;
+
+    if (NATS_ATOMIC_GET(&(timers->started)) == 0)
     {
-        if (t->prev != NULL)
-            t->prev->next = t->next;
-        if (t->next != NULL)
-            t->next->prev = t->prev;
+        s = _startLibThreads(timers->lock, &(timers->shutdown),
+                             &(timers->started), &(timers->thread), 1,
+                             _timerThread);
+        if (s == NATS_NOT_INITIALIZED)
+            return nats_setDefaultError(s);
+        if (s != NATS_OK)
+            return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    natsMutex_Lock(timers->lock);
 
-        if (t == gLib.timers.timers)
-            gLib.timers.timers = t->next;
+    if (timers->created == timers->cap)
+    {
+        int         newCap  = (timers->cap == 0 ? 16 : 2 * timers->cap);
+        natsTimer   **heap  = NULL;
 
-        t->prev = NULL;
-        t->next = NULL;
+        heap = (natsTimer**) NATS_REALLOC(timers->heap,
+                                          newCap * sizeof(natsTimer*));
+        if (heap == NULL)
+        {
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+        }
+        else
+        {
+            timers->heap = heap;
+            timers->cap  = newCap;
+        }
     }
+    if (s == NATS_OK)
+        timers->created++;
 
-    // Decrease the global count of timers
-    timers->count--;
+    natsMutex_Unlock(timers->lock);
+
+    return s;
+}
+
+// Called when a timer is freed.
+void
+nats_unreserveTimer(void)
+{
+    natsMutex_Lock(gLib.timers.lock);
+    gLib.timers.created--;
+    natsMutex_Unlock(gLib.timers.lock);
 }
 
 void
 nats_resetTimer(natsTimer *t, int64_t newInterval)
 {
-    natsLibTimers *timers = &(gLib.timers);
+    natsLibTimers   *timers = &(gLib.timers);
+    bool            first   = false;
 
     natsMutex_Lock(timers->lock);
     natsMutex_Lock(t->mu);
@@ -380,15 +683,20 @@ nats_resetTimer(natsTimer *t, int64_t newInterval)
     if (!(t->inCallback))
     {
         t->absoluteTime = nats_Now() + t->interval;
-        _insertTimer(t);
+        first = _insertTimer(timers, t);
     }
 
     natsMutex_Unlock(t->mu);
 
-    if (!(timers->changed))
-        natsCondition_Signal(timers->cond);
+    // The timer thread needs to be woken up only if it now has to fire
+    // sooner than it had planned.
+    if (first)
+    {
+        if (!(timers->changed))
+            natsCondition_Signal(timers->cond);
 
-    timers->changed = true;
+        timers->changed = true;
+    }
 
     natsMutex_Unlock(timers->lock);
 }
@@ -411,17 +719,13 @@ nats_stopTimer(natsTimer *t)
         return;
     }
 
+    // No need to wake up the timer thread. If this was the first timer,
+    // the thread will find out when it wakes up that nothing is due.
     _removeTimer(timers, t);
 
     doCb = (!(t->inCallback) && (t->stopCb != NULL));
 
     natsMutex_Unlock(t->mu);
-
-    if (!(timers->changed))
-        natsCondition_Signal(timers->cond);
-
-    timers->changed = true;
-
     natsMutex_Unlock(timers->lock);
 
     if (doCb)
@@ -446,22 +750,24 @@ int
 nats_getTimersCountInList(void)
 {
     int         count = 0;
-    natsTimer   *t;
 
     natsMutex_Lock(gLib.timers.lock);
 
-    t = gLib.timers.timers;
-    while (t != NULL)
-    {
-        count++;
-        t = t->next;
-    }
+    count = gLib.timers.len;
 
     natsMutex_Unlock(gLib.timers.lock);
 
     return count;
 }
 
+void
+nats_getLibThreadsStarted(bool *timers, bool *asyncCbs, bool *gc)
+{
+    *timers   = (NATS_ATOMIC_GET(&(gLib.timers.started)) != 0);
+    *asyncCbs = (NATS_ATOMIC_GET(&(gLib.asyncCbs.started)) != 0);
+    *gc       = (NATS_ATOMIC_GET(&(gLib.gc.started)) != 0);
+}
+
 
 static void
 _timerThread(void *arg)
@@ -474,12 +780,14 @@ _timerThread(void *arg)
 
     WAIT_LIB_INITIALIZED;
 
+    nats_threadStarted(NATS_THREAD_TIMER, NULL);
+
     natsMutex_Lock(timers->lock);
 
     while (!(timers->shutdown))
     {
         // Take the first timer that needs to fire.
-        t = timers->timers;
+        t = (timers->len > 0 ? timers->heap[0] : NULL);
 
         if (t == NULL)
         {
@@ -506,18 +814,19 @@ _timerThread(void *arg)
         if (timers->shutdown)
             break;
 
-        if ((t == NULL) || timers->changed)
+        if (timers->changed)
             continue;
 
-        natsMutex_Lock(t->mu);
+        // The timer we were waiting for may have been stopped or reset
+        // without waking us up, so check what is due now.
+        t = (timers->len > 0 ? timers->heap[0] : NULL);
+        if ((t == NULL) || (t->absoluteTime > nats_Now()))
+            continue;
 
-        // Remove timer from the list:
-        timers->timers = t->next;
-        if (t->next != NULL)
-            t->next->prev = NULL;
+        natsMutex_Lock(t->mu);
 
-        t->prev = NULL;
-        t->next = NULL;
+        // Remove timer from the heap:
+        _removeFromHeap(timers, t);
 
         t->inCallback = true;
 
@@ -540,15 +849,16 @@ _timerThread(void *arg)
         // the window the locks were released.
         doStopCb = (t->stopped && (t->stopCb != NULL));
 
-        // If not stopped, we need to put it back in our list
-        if (!doStopCb)
+        // If not stopped, we need to put it back in our heap (a timer
+        // without stop callback may have been stopped too).
+        if (!(t->stopped))
         {
             // Reset our view of what is the time this timer should fire
             // because:
             // 1- the callback may have taken longer than it should
             // 2- the user may have called Reset() with a new interval
             t->absoluteTime = nats_Now() + t->interval;
-            _insertTimer(t);
+            (void) _insertTimer(timers, t);
         }
 
         natsMutex_Unlock(t->mu);
@@ -564,20 +874,22 @@ _timerThread(void *arg)
         natsMutex_Lock(timers->lock);
     }
 
-    // Process the timers that were left in the list (not stopped) when the
+    // Process the timers that were left in the heap (not stopped) when the
     // library is shutdown.
-    while ((t = timers->timers) != NULL)
+    while (timers->len > 0)
     {
+        t = timers->heap[0];
+
         natsMutex_Lock(t->mu);
 
         // Check if we should invoke the callback. Note that although we are
-        // releasing the locks below, a timer present in the list here is
+        // releasing the locks below, a timer present in the heap here is
         // guaranteed not to have been stopped (because it would not be in
-        // the list otherwise, since there is no chance that it is in the
+        // the heap otherwise, since there is no chance that it is in the
         // timer's callback). So just check if there is a stopCb to invoke.
         doStopCb = (t->stopCb != NULL);
 
-        // Remove the timer from the list.
+        // Remove the timer from the heap.
         _removeTimer(timers, t);
 
         natsMutex_Unlock(t->mu);
@@ -598,21 +910,40 @@ _timerThread(void *arg)
     natsLib_Release();
 }
 
+// Must be invoked with the callbacks lock held.
+static void
+_scheduleAsyncCbs(natsLibAsyncCbs *asyncCbs, natsConnection *nc)
+{
+    nc->asyncCbsNext = NULL;
+
+    if (asyncCbs->tail != NULL)
+        asyncCbs->tail->asyncCbsNext = nc;
+    else
+        asyncCbs->head = nc;
+
+    asyncCbs->tail = nc;
+
+    natsCondition_Signal(asyncCbs->cond);
+}
+
 static void
 _asyncCbsThread(void *arg)
 {
     natsLibAsyncCbs *asyncCbs = &(gLib.asyncCbs);
-    natsAsyncCbInfo *cb       = NULL;
     natsConnection  *nc       = NULL;
+    natsAsyncCbInfo *cb       = NULL;
+    natsAsyncCbInfo *left     = NULL;
 
     WAIT_LIB_INITIALIZED;
 
+    nats_threadStarted(NATS_THREAD_ASYNC_CB, NULL);
+
     natsMutex_Lock(asyncCbs->lock);
 
     while (!(asyncCbs->shutdown))
     {
         while (!(asyncCbs->shutdown)
-               && ((cb = asyncCbs->head) == NULL))
+               && ((nc = asyncCbs->head) == NULL))
         {
             natsCondition_Wait(asyncCbs->cond, asyncCbs->lock);
         }
@@ -620,134 +951,221 @@ _asyncCbsThread(void *arg)
         if (asyncCbs->shutdown)
             break;
 
-        asyncCbs->head = cb->next;
-
-        if (asyncCbs->tail == cb)
+        asyncCbs->head = nc->asyncCbsNext;
+        if (asyncCbs->tail == nc)
             asyncCbs->tail = NULL;
 
+        cb = nc->asyncCbs;
+        nc->asyncCbs = cb->next;
+        if (nc->asyncCbs == NULL)
+            nc->asyncCbsTail = NULL;
+
         cb->next = NULL;
 
         natsMutex_Unlock(asyncCbs->lock);
 
-        nc = cb->nc;
+        natsAsyncCb_Dispatch(cb);
 
-        switch (cb->type)
-        {
-            case ASYNC_CLOSED:
-               (*(nc->opts->closedCb))(nc, nc->opts->closedCbClosure);
-               break;
-            case ASYNC_DISCONNECTED:
-                (*(nc->opts->disconnectedCb))(nc, nc->opts->disconnectedCbClosure);
-                break;
-            case ASYNC_RECONNECTED:
-                (*(nc->opts->reconnectedCb))(nc, nc->opts->reconnectedCbClosure);
-                break;
-            case ASYNC_ERROR:
-                (*(nc->opts->asyncErrCb))(nc, cb->sub, cb->err, nc->opts->asyncErrCbClosure);
-                break;
-            default:
-                break;
-        }
+        natsMutex_Lock(asyncCbs->lock);
+
+        // The callbacks still queued hold references on the connection.
+        if (nc->asyncCbs != NULL)
+            _scheduleAsyncCbs(asyncCbs, nc);
+        else
+            nc->asyncCbsScheduled = false;
+
+        natsMutex_Unlock(asyncCbs->lock);
 
         natsAsyncCb_Destroy(cb);
 
         natsMutex_Lock(asyncCbs->lock);
     }
 
-    while ((cb = asyncCbs->head) != NULL)
+    // Each thread exiting drops what is left, including the callbacks of a
+    // connection that another thread has put back in the list.
+    while ((nc = asyncCbs->head) != NULL)
     {
-        asyncCbs->head = cb->next;
+        asyncCbs->head = nc->asyncCbsNext;
 
-        natsAsyncCb_Destroy(cb);
+        nc->asyncCbsTail->next = left;
+        left = nc->asyncCbs;
+
+        nc->asyncCbs          = NULL;
+        nc->asyncCbsTail      = NULL;
+        nc->asyncCbsScheduled = false;
     }
+    asyncCbs->tail = NULL;
 
     natsMutex_Unlock(asyncCbs->lock);
 
+    while ((cb = left) != NULL)
+    {
+        left = cb->next;
+
+        natsAsyncCb_Destroy(cb);
+    }
+
     natsLib_Release();
 }
 
 natsStatus
 nats_postAsyncCbInfo(natsAsyncCbInfo *info)
 {
-    natsMutex_Lock(gLib.asyncCbs.lock);
+    natsLibAsyncCbs *asyncCbs = &(gLib.asyncCbs);
+    natsConnection  *nc       = info->nc;
+    natsStatus      s         = NATS_OK;
+
+    if (NATS_ATOMIC_GET(&(asyncCbs->started)) == 0)
+    {
+        s = _startLibThreads(asyncCbs->lock, &(asyncCbs->shutdown),
+                             &(asyncCbs->started), asyncCbs->threads,
+                             NATS_ASYNC_CB_THREADS, _asyncCbsThread);
+        if (s != NATS_OK)
+            return s;
+    }
+
+    natsMutex_Lock(asyncCbs->lock);
 
-    if (gLib.asyncCbs.shutdown)
+    if (asyncCbs->shutdown)
     {
-        natsMutex_Unlock(gLib.asyncCbs.lock);
+        natsMutex_Unlock(asyncCbs->lock);
         return NATS_NOT_INITIALIZED;
     }
 
     info->next = NULL;
 
-    if (gLib.asyncCbs.head == NULL)
-        gLib.asyncCbs.head = info;
+    if (nc->asyncCbsTail != NULL)
+        nc->asyncCbsTail->next = info;
+    else
+        nc->asyncCbs = info;
+
+    nc->asyncCbsTail = info;
+
+    if (!(nc->asyncCbsScheduled))
+    {
+        nc->asyncCbsScheduled = true;
+        _scheduleAsyncCbs(asyncCbs, nc);
+    }
 
-    if (gLib.asyncCbs.tail != NULL)
-        gLib.asyncCbs.tail->next = info;
+    natsMutex_Unlock(asyncCbs->lock);
 
-    gLib.asyncCbs.tail = info;
+    return NATS_OK;
+}
 
-    natsCondition_Signal(gLib.asyncCbs.cond);
+bool
+nats_coalesceAsyncErr(natsConnection *nc, natsSubscription *sub,
+                      natsStatus err)
+{
+    natsAsyncCbInfo *cb     = NULL;
+    bool            found   = false;
+
+    natsMutex_Lock(gLib.asyncCbs.lock);
+
+    for (cb = nc->asyncCbs; !found && (cb != NULL); cb = cb->next)
+    {
+        found = ((cb->type == ASYNC_ERROR) && (cb->sub == sub)
+                 && (cb->err == err));
+    }
 
     natsMutex_Unlock(gLib.asyncCbs.lock);
 
-    return NATS_OK;
+    return found;
+}
+
+static bool
+_gcHasWork(natsGCList *gc)
+{
+    int i;
+
+    for (i = 0; i < NATS_GC_SHARDS; i++)
+    {
+        if (NATS_ATOMIC_GET(&(gc->shards[i].count)) > 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Empties all shards and returns the number of items freed.
+static uint64_t
+_gcFreeAll(natsGCList *gc)
+{
+    natsGCShard *shard;
+    natsGCItem  *item;
+    natsGCItem  *list;
+    uint64_t    freed = 0;
+    int         i;
+
+    for (i = 0; i < NATS_GC_SHARDS; i++)
+    {
+        shard = &(gc->shards[i]);
+
+        if (NATS_ATOMIC_GET(&(shard->count)) == 0)
+            continue;
+
+        // Under the lock, we will switch to a local list and reset the
+        // shard's list, so that others can add to it while we free.
+        natsMutex_Lock(shard->lock);
+
+        list        = shard->head;
+        shard->head = NULL;
+        NATS_ATOMIC_SET(&(shard->count), 0);
+
+        natsMutex_Unlock(shard->lock);
+
+        while ((item = list) != NULL)
+        {
+            // Pops item from the beginning of the list.
+            list = item->next;
+            item->next = NULL;
+
+            // Invoke the freeCb associated with this object
+            (*(item->freeCb))((void*) item);
+
+            freed++;
+        }
+    }
+
+    return freed;
 }
 
 static void
 _garbageCollector(void *closure)
 {
-    natsGCList *gc = &(gLib.gc);
-    natsGCItem *item;
-    natsGCItem *list;
+    natsGCList  *gc = &(gLib.gc);
+    uint64_t    freed;
 
     WAIT_LIB_INITIALIZED;
 
+    nats_threadStarted(NATS_THREAD_GC, NULL);
+
     natsMutex_Lock(gc->lock);
 
     // Repeat until notified to shutdown.
     while (!(gc->shutdown))
     {
-        // Go into wait until we are notified to shutdown
-        // or there is something to garbage collect
-        gc->inWait = true;
+        // Announce that we are going to wait before checking the shards,
+        // so that a producer either sees us waiting or we see its item.
+        NATS_ATOMIC_SET(&(gc->inWait), 1);
 
-        while (!(gc->shutdown) && (gc->head == NULL))
-        {
+        while (!(gc->shutdown) && !_gcHasWork(gc))
             natsCondition_Wait(gc->cond, gc->lock);
-        }
 
-        // Out of the wait. Setting this boolean avoids unnecessary
-        // signaling when an item is added to the collector.
-        gc->inWait = false;
+        NATS_ATOMIC_SET(&(gc->inWait), 0);
 
-        // Do not break out on shutdown here, we want to clear the list,
+        // Do not break out on shutdown here, we want to clear the lists,
         // even on exit so that valgrind and the like are happy.
-
-        // Under the lock, we will switch to a local list and reset the
-        // GC's list (so that others can add to the list without contention
-        // (at least from the GC itself).
         do
         {
-            list = gc->head;
-            gc->head = NULL;
-
             natsMutex_Unlock(gc->lock);
 
-            // Now that we are outside of the lock, we can empty the list.
-            while ((item = list) != NULL)
-            {
-                // Pops item from the beginning of the list.
-                list = item->next;
-                item->next = NULL;
-
-                // Invoke the freeCb associated with this object
-                (*(item->freeCb))((void*) item);
-            }
+            freed = _gcFreeAll(gc);
 
             natsMutex_Lock(gc->lock);
+
+            gc->freed += freed;
         }
-        while (gc->head != NULL);
+        while (_gcHasWork(gc));
     }
 
     natsMutex_Unlock(gc->lock);
@@ -755,11 +1173,28 @@ _garbageCollector(void *closure)
     natsLib_Release();
 }
 
+static natsGCShard*
+_getGCShard(natsGCList *gc)
+{
+    intptr_t idx = (intptr_t) natsThreadLocal_Get(gc->shardKey);
+
+    // The thread local holds the shard index plus one.
+    if (idx == 0)
+    {
+        idx = (intptr_t) (NATS_ATOMIC_INC(&(gc->nextShard)) % NATS_GC_SHARDS) + 1;
+
+        (void) natsThreadLocal_SetEx(gc->shardKey, (const void*) idx, false);
+    }
+
+    return &(gc->shards[idx - 1]);
+}
+
 bool
 natsGC_collect(natsGCItem *item)
 {
     natsGCList  *gc;
-    bool        signal;
+    natsGCShard *shard;
+    bool        wasEmpty;
 
     // If the object was not setup for garbage collection, return false
     // so the caller frees the object.
@@ -768,33 +1203,376 @@ natsGC_collect(natsGCItem *item)
 
     gc = &(gLib.gc);
 
-    natsMutex_Lock(gc->lock);
+    // Same if the application wants objects to be freed inline.
+    if (NATS_ATOMIC_GET(&(gc->freeInline)) != 0)
+        return false;
 
-    // We will signal only if the GC is in the condition wait.
-    signal = gc->inWait;
+    // Or if the collector can't be started.
+    if ((NATS_ATOMIC_GET(&(gc->started)) == 0)
+        && (_startLibThreads(gc->lock, &(gc->shutdown), &(gc->started),
+                             &(gc->thread), 1, _garbageCollector) != NATS_OK))
+    {
+        return false;
+    }
+
+    shard = _getGCShard(gc);
+
+    natsMutex_Lock(shard->lock);
 
     // Add to the front of the list.
-    item->next = gc->head;
+    item->next  = shard->head;
+    shard->head = item;
+    shard->queued++;
+
+    wasEmpty = (NATS_ATOMIC_INC(&(shard->count)) == 1);
 
-    // Update head.
-    gc->head = item;
+    natsMutex_Unlock(shard->lock);
 
-    if (signal)
+    // The collector needs to be signaled only if it is waiting, in which
+    // case all shards were empty.
+    if (wasEmpty && (NATS_ATOMIC_GET(&(gc->inWait)) != 0))
+    {
+        natsMutex_Lock(gc->lock);
         natsCondition_Signal(gc->cond);
+        natsMutex_Unlock(gc->lock);
+    }
+
+    return true;
+}
+
+void
+nats_SetThreadStartCB(natsThreadStartHandler cb, void *closure)
+{
+    gThreadStartCb          = cb;
+    gThreadStartCbClosure   = closure;
+}
+
+void
+nats_threadStarted(natsThreadRole role, natsOptions *opts)
+{
+    natsThreadStartHandler  cb       = gThreadStartCb;
+    void                    *closure = gThreadStartCbClosure;
+    const char              *name    = threadNames[role];
+
+    natsThread_SetName(name);
+
+    // The connection's options are immutable, no need to lock them.
+    if ((opts != NULL) && (opts->threadStartCb != NULL))
+    {
+        cb       = opts->threadStartCb;
+        closure  = opts->threadStartCbClosure;
+    }
+
+    if (cb != NULL)
+        (*cb)(role, name, closure);
+}
+
+natsStatus
+nats_GetLockStats(natsLockRole role, natsLockStats *stats)
+{
+    if (((int) role < 0) || ((int) role >= NATS_LOCK_ROLES) || (stats == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+#if defined(NATS_LOCK_STATS)
+    stats->acquisitions  = NATS_ATOMIC64_GET(&(gLockStats[role].acquisitions));
+    stats->contended     = NATS_ATOMIC64_GET(&(gLockStats[role].contended));
+    stats->spinSuccesses = NATS_ATOMIC64_GET(&(gLockStats[role].spinSuccesses));
+    stats->waitTime      = NATS_ATOMIC64_GET(&(gLockStats[role].waitTime));
+
+    return NATS_OK;
+#else
+    return nats_setError(NATS_ILLEGAL_STATE, "%s",
+                         "The library was not built with lock statistics");
+#endif
+}
+
+natsStatus
+nats_ResetLockStats(void)
+{
+#if defined(NATS_LOCK_STATS)
+    int i;
+
+    for (i=0; i<NATS_LOCK_ROLES; i++)
+    {
+        NATS_ATOMIC64_SET(&(gLockStats[i].acquisitions), 0);
+        NATS_ATOMIC64_SET(&(gLockStats[i].contended), 0);
+        NATS_ATOMIC64_SET(&(gLockStats[i].spinSuccesses), 0);
+        NATS_ATOMIC64_SET(&(gLockStats[i].waitTime), 0);
+    }
+
+    return NATS_OK;
+#else
+    return nats_setError(NATS_ILLEGAL_STATE, "%s",
+                         "The library was not built with lock statistics");
+#endif
+}
+
+natsStatus
+nats_SetInlineMessageFree(bool freeInline)
+{
+    natsStatus s = nats_Open(-1);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    NATS_ATOMIC_SET(&(gLib.gc.freeInline), (freeInline ? 1 : 0));
+
+    return NATS_OK;
+}
 
+natsStatus
+nats_GetGarbageCollectorCounts(uint64_t *queued, uint64_t *freed)
+{
+    natsGCList  *gc = &(gLib.gc);
+    natsStatus  s   = NATS_OK;
+    uint64_t    q   = 0;
+    int         i;
+
+    if ((queued == NULL) || (freed == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = nats_Open(-1);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    for (i = 0; i < NATS_GC_SHARDS; i++)
+    {
+        natsMutex_Lock(gc->shards[i].lock);
+        q += gc->shards[i].queued;
+        natsMutex_Unlock(gc->shards[i].lock);
+    }
+
+    natsMutex_Lock(gc->lock);
+    *freed = gc->freed;
     natsMutex_Unlock(gc->lock);
 
-    return true;
+    *queued = q;
+
+    return NATS_OK;
+}
+
+// Returns one of the library's shared event loops (creating them on first
+// use). Connections are assigned to the loops in a round-robin fashion.
+// The returned loop is retained and needs to be released by the caller.
+natsStatus
+nats_getEvLoop(natsEvLoop **loop)
+{
+    natsLibEvLoops  *evLoops = &(gLib.evLoops);
+    natsStatus      s        = NATS_OK;
+    int             i;
+
+    natsMutex_Lock(evLoops->lock);
+
+    if (gLib.closed)
+        s = nats_setDefaultError(NATS_NOT_INITIALIZED);
+
+    if ((s == NATS_OK) && (evLoops->loops == NULL))
+    {
+        int count = evLoops->threads;
+
+        if (count <= 0)
+            count = NATS_EVLOOP_DEFAULT_THREADS;
+
+        evLoops->loops = (natsEvLoop**) NATS_CALLOC(count, sizeof(natsEvLoop*));
+        if (evLoops->loops == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+
+        for (i = 0; (s == NATS_OK) && (i < count); i++)
+        {
+            s = natsEvLoop_Create(&(evLoops->loops[i]));
+            if (s == NATS_OK)
+                evLoops->count++;
+        }
+
+        if (s != NATS_OK)
+        {
+            for (i = 0; i < evLoops->count; i++)
+            {
+                natsEvLoop_Stop(evLoops->loops[i]);
+                natsEvLoop_Release(evLoops->loops[i]);
+            }
+
+            NATS_FREE(evLoops->loops);
+            evLoops->loops = NULL;
+            evLoops->count = 0;
+        }
+    }
+
+    if (s == NATS_OK)
+    {
+        *loop = evLoops->loops[evLoops->next];
+        natsEvLoop_Retain(*loop);
+
+        evLoops->next = (evLoops->next + 1) % evLoops->count;
+    }
+
+    natsMutex_Unlock(evLoops->lock);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+nats_SetSharedEventLoopThreads(int count)
+{
+#if defined(NATS_HAS_EVLOOP)
+    natsStatus s = NATS_OK;
+
+    if (count <= 0)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = nats_Open(-1);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    natsMutex_Lock(gLib.evLoops.lock);
+
+    if (gLib.evLoops.loops != NULL)
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s",
+                          "The shared event loops have already been started");
+    else
+        gLib.evLoops.threads = count;
+
+    natsMutex_Unlock(gLib.evLoops.lock);
+
+    return s;
+#else
+    return nats_setError(NATS_ILLEGAL_STATE, "%s", NATS_EVLOOP_NOT_SUPPORTED_ERR);
+#endif
+}
+
+static void
+_stopEvLoops(void)
+{
+    natsLibEvLoops  *evLoops = &(gLib.evLoops);
+    natsEvLoop      **loops  = NULL;
+    int             count    = 0;
+    int             i;
+
+    if (evLoops->lock == NULL)
+        return;
+
+    natsMutex_Lock(evLoops->lock);
+
+    loops = evLoops->loops;
+    count = evLoops->count;
+
+    evLoops->loops = NULL;
+    evLoops->count = 0;
+    evLoops->next  = 0;
+
+    natsMutex_Unlock(evLoops->lock);
+
+    // Connections still attached keep a reference to their loop, so the
+    // loop is freed when the last one is detached.
+    for (i = 0; i < count; i++)
+    {
+        natsEvLoop_Stop(loops[i]);
+        natsEvLoop_Release(loops[i]);
+    }
+
+    NATS_FREE(loops);
+}
+
+// Returns the library's shared delivery pool (creating it on first use).
+// The returned pool is retained and needs to be released by the caller.
+natsStatus
+nats_getDlvPool(natsDlvPool **pool)
+{
+    natsLibDlvPool  *dlvPool = &(gLib.dlvPool);
+    natsStatus      s        = NATS_OK;
+
+    natsMutex_Lock(dlvPool->lock);
+
+    if (gLib.closed)
+        s = nats_setDefaultError(NATS_NOT_INITIALIZED);
+
+    if ((s == NATS_OK) && (dlvPool->pool == NULL))
+    {
+        int count = dlvPool->threads;
+
+        if (count <= 0)
+            count = NATS_DLVPOOL_DEFAULT_THREADS;
+
+        s = natsDlvPool_Create(&(dlvPool->pool), count);
+    }
+
+    if (s == NATS_OK)
+    {
+        *pool = dlvPool->pool;
+        natsDlvPool_Retain(*pool);
+    }
+
+    natsMutex_Unlock(dlvPool->lock);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+nats_SetSharedDeliveryPoolThreads(int count)
+{
+    natsStatus s = NATS_OK;
+
+    if (count <= 0)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = nats_Open(-1);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    natsMutex_Lock(gLib.dlvPool.lock);
+
+    if (gLib.dlvPool.pool != NULL)
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s",
+                          "The shared delivery pool has already been started");
+    else
+        gLib.dlvPool.threads = count;
+
+    natsMutex_Unlock(gLib.dlvPool.lock);
+
+    return s;
+}
+
+static void
+_stopDlvPool(void)
+{
+    natsLibDlvPool  *dlvPool = &(gLib.dlvPool);
+    natsDlvPool     *pool    = NULL;
+
+    if (dlvPool->lock == NULL)
+        return;
+
+    natsMutex_Lock(dlvPool->lock);
+
+    pool = dlvPool->pool;
+    dlvPool->pool = NULL;
+
+    natsMutex_Unlock(dlvPool->lock);
+
+    // Subscriptions still alive keep a reference to the pool, so the pool
+    // is freed when the last one is destroyed.
+    if (pool != NULL)
+    {
+        natsDlvPool_Stop(pool);
+        natsDlvPool_Release(pool);
+    }
 }
 
 static void
 _libTearDown(void)
 {
+    int i;
+
+    _stopEvLoops();
+    _stopDlvPool();
+
     if (gLib.timers.thread != NULL)
         natsThread_Join(gLib.timers.thread);
 
-    if (gLib.asyncCbs.thread != NULL)
-        natsThread_Join(gLib.asyncCbs.thread);
+    for (i = 0; i < NATS_ASYNC_CB_THREADS; i++)
+    {
+        if (gLib.asyncCbs.threads[i] != NULL)
+            natsThread_Join(gLib.asyncCbs.threads[i]);
+    }
 
     if (gLib.gc.thread != NULL)
         natsThread_Join(gLib.gc.thread);
@@ -805,7 +1583,8 @@ _libTearDown(void)
 natsStatus
 nats_Open(int64_t lockSpinCount)
 {
-    natsStatus s = NATS_OK;
+    natsStatus  s = NATS_OK;
+    int         i;
 
     if (!nats_InitOnce(&gInitOnce, _doInitOnce))
         return NATS_FAILED_TO_INITIALIZE;
@@ -830,8 +1609,6 @@ nats_Open(int64_t lockSpinCount)
     signal(SIGPIPE, SIG_IGN);
 #endif
 
-    srand((unsigned int) nats_NowInNanoSeconds());
-
     gLib.refs = 1;
 
     // If the caller specifies negative value, then we use the default
@@ -839,42 +1616,39 @@ nats_Open(int64_t lockSpinCount)
         gLockSpinCount = lockSpinCount;
 
     s = natsCondition_Create(&(gLib.cond));
-    if (s == NATS_OK)
-        s = natsMutex_Create(&(gLib.inboxesLock));
 
     if (s == NATS_OK)
-        s = natsMutex_Create(&(gLib.timers.lock));
+        s = natsMutex_CreateEx(&(gLib.timers.lock), NATS_LOCK_LIB_TIMERS);
     if (s == NATS_OK)
         s = natsCondition_Create(&(gLib.timers.cond));
     if (s == NATS_OK)
-    {
-        s = natsThread_Create(&(gLib.timers.thread), _timerThread, NULL);
-        if (s == NATS_OK)
-            gLib.refs++;
-    }
-
-    if (s == NATS_OK)
-        s = natsMutex_Create(&(gLib.asyncCbs.lock));
+        s = natsMutex_CreateEx(&(gLib.asyncCbs.lock), NATS_LOCK_ASYNC_CBS);
     if (s == NATS_OK)
         s = natsCondition_Create(&(gLib.asyncCbs.cond));
     if (s == NATS_OK)
-    {
-        s = natsThread_Create(&(gLib.asyncCbs.thread), _asyncCbsThread, NULL);
-        if (s == NATS_OK)
-            gLib.refs++;
-    }
-    if (s == NATS_OK)
-        s = natsMutex_Create(&(gLib.gc.lock));
+        s = natsMutex_CreateEx(&(gLib.gc.lock), NATS_LOCK_GC);
     if (s == NATS_OK)
         s = natsCondition_Create(&(gLib.gc.cond));
+    for (i = 0; (s == NATS_OK) && (i < NATS_GC_SHARDS); i++)
+        s = natsMutex_CreateEx(&(gLib.gc.shards[i].lock), NATS_LOCK_GC);
+    if (s == NATS_OK)
+        s = natsThreadLocal_CreateKey(&(gLib.gc.shardKey), NULL);
+    if (s == NATS_OK)
+        gLib.gc.shardKeyCreated = true;
+    if (s == NATS_OK)
+        s = natsMutex_CreateEx(&(gLib.evLoops.lock), NATS_LOCK_EVENT_LOOP);
     if (s == NATS_OK)
+        s = natsMutex_CreateEx(&(gLib.dlvPool.lock), NATS_LOCK_DELIVERY_POOL);
+    if (s == NATS_OK)
+        s = natsThreadLocal_CreateKey(&(gLib.errTLKey), _destroyErrTL);
+    // Like the error key, this one is kept if the library is closed and
+    // opened again, but unlike it, it is created only once.
+    if ((s == NATS_OK) && !(gLib.nuidTLKeyCreated))
     {
-        s = natsThread_Create(&(gLib.gc.thread), _garbageCollector, NULL);
+        s = natsThreadLocal_CreateKey(&(gLib.nuidTLKey), _destroyNUIDTL);
         if (s == NATS_OK)
-            gLib.refs++;
+            gLib.nuidTLKeyCreated = true;
     }
-    if (s == NATS_OK)
-        s = natsThreadLocal_CreateKey(&(gLib.errTLKey), _destroyErrTL);
 
     if (s == NATS_OK)
         gLib.initialized = true;
@@ -903,29 +1677,67 @@ nats_Open(int64_t lockSpinCount)
     return s;
 }
 
+natsStatus
+natsInbox_Init(char *buf, int bufLen)
+{
+    natsStatus  s     = NATS_OK;
+    natsNUID    *nuid = NULL;
+
+    if (buf == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    if (bufLen < NATS_INBOX_ARRAY_SIZE)
+        return nats_setDefaultError(NATS_INSUFFICIENT_BUFFER);
+
+    // Avoid the library's lock once it has been opened.
+    if (!(gLib.wasOpenedOnce))
+    {
+        s = nats_Open(-1);
+        if (s != NATS_OK)
+            return s;
+    }
+
+    nuid = (natsNUID*) natsThreadLocal_Get(gLib.nuidTLKey);
+    if (nuid == NULL)
+    {
+        nuid = (natsNUID*) NATS_MALLOC(sizeof(natsNUID));
+        if (nuid == NULL)
+            return nats_setDefaultError(NATS_NO_MEMORY);
+
+        natsNUID_Init(nuid);
+
+        s = natsThreadLocal_Set(gLib.nuidTLKey, (const void*) nuid);
+        if (s != NATS_OK)
+        {
+            NATS_FREE(nuid);
+            return NATS_UPDATE_ERR_STACK(s);
+        }
+    }
+
+    memcpy(buf, inboxPrefix, _INBOX_PREFIX_LEN_);
+    natsNUID_Next(nuid, buf + _INBOX_PREFIX_LEN_);
+    buf[_INBOX_PREFIX_LEN_ + NATS_NUID_LEN] = '\0';
+
+    return NATS_OK;
+}
+
 natsStatus
 natsInbox_Create(natsInbox **newInbox)
 {
     natsStatus  s      = NATS_OK;
     char        *inbox = NULL;
-    int         res    = 0;
-
-    s = nats_Open(-1);
-    if (s != NATS_OK)
-        return s;
 
-    natsMutex_Lock(gLib.inboxesLock);
+    inbox = (char*) NATS_MALLOC(NATS_INBOX_ARRAY_SIZE);
+    if (inbox == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
 
-    res = nats_asprintf(&inbox, "%s%x.%" PRIu64, inboxPrefix,
-                        rand(), ++(gLib.inboxesSeq));
-    if (res < 0)
-        s = nats_setDefaultError(NATS_NO_MEMORY);
-    else
+    s = natsInbox_Init(inbox, NATS_INBOX_ARRAY_SIZE);
+    if (s == NATS_OK)
         *newInbox = inbox;
+    else
+        NATS_FREE(inbox);
 
-    natsMutex_Unlock(gLib.inboxesLock);
-
-    return s;
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 void
@@ -963,7 +1775,7 @@ nats_Close(void)
 
     natsMutex_Lock(gLib.asyncCbs.lock);
     gLib.asyncCbs.shutdown = true;
-    natsCondition_Signal(gLib.asyncCbs.cond);
+    natsCondition_Broadcast(gLib.asyncCbs.cond);
     natsMutex_Unlock(gLib.asyncCbs.lock);
 
     natsMutex_Lock(gLib.gc.lock);
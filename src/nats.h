@@ -12,6 +12,10 @@
 #include "status.h"
 #include "version.h"
 
+#if defined(_WIN32)
+#include <winsock2.h>
+#endif
+
 /** \def NATS_EXTERN
  *  \brief Needed for shared library.
  *
@@ -66,6 +70,14 @@ extern "C" {
  */
 #define NATS_DEFAULT_URL "nats://localhost:4222"
 
+/** \brief The size of an array able to hold an inbox.
+ *
+ *  An inbox is made of the `_INBOX.` prefix followed by 22 characters.
+ *  This is the size, including the terminating `NULL` character, of a
+ *  buffer passed to #natsInbox_Init().
+ */
+#define NATS_INBOX_ARRAY_SIZE   (30)
+
 //
 // Types.
 //
@@ -82,6 +94,34 @@ extern "C" {
  */
 typedef struct __natsConnection     natsConnection;
 
+/** \brief A socket.
+ *
+ * The platform's socket type, as returned by #natsConnection_GetFd().
+ */
+#if defined(_WIN32)
+typedef SOCKET                      natsSock;
+#else
+typedef int                         natsSock;
+#endif
+
+/** \brief The socket is readable.
+ *
+ * Event passed to #natsConnection_ProcessIO().
+ */
+#define NATS_IO_READ    (0x1)
+
+/** \brief The socket is writable.
+ *
+ * Event passed to #natsConnection_ProcessIO().
+ */
+#define NATS_IO_WRITE   (0x2)
+
+/** \brief Id of the built-in LZ4 payload codec.
+ *
+ * See #natsOptions_SetPayloadCodec().
+ */
+#define NATS_CODEC_LZ4  (1)
+
 /** \brief Statistics of a #natsConnection
  *
  * Tracks various statistics received and sent on a connection,
@@ -89,12 +129,139 @@ typedef struct __natsConnection     natsConnection;
  */
 typedef struct __natsStatistics     natsStatistics;
 
+/** \brief The latencies recorded in the statistics.
+ *
+ * Latencies are recorded only if the connection was created with
+ * #natsOptions_SetLatencyStats() enabled.
+ *
+ * @see natsStatistics_GetLatency()
+ * @see natsStatistics_GetLatencyPercentile()
+ */
+typedef enum
+{
+    NATS_LATENCY_FLUSH = 0,     ///< Round-trip time of #natsConnection_FlushTimeout() calls.
+    NATS_LATENCY_REQUEST,       ///< Time for #natsConnection_Request() calls to get their reply.
+    NATS_LATENCY_DWELL,         ///< Time messages wait in a subscription before being delivered.
+
+} natsLatencyType;
+
 /** \brief Interest on a given subject.
  *
  * A #natsSubscription represents interest in a given subject.
  */
 typedef struct __natsSubscription   natsSubscription;
 
+/** \brief A subject prepared for repeated publishing.
+ *
+ * A #natsPublisher holds a subject (and optional reply subject) that is
+ * validated and encoded once, which reduces the cost of publishing many
+ * messages to the same subject.
+ *
+ * @see #natsConnection_PreparePublish()
+ */
+typedef struct __natsPublisher      natsPublisher;
+
+/** \brief A set of connections used as one.
+ *
+ * A #natsConnectionGroup opens several connections with the same options
+ * and spreads the publish calls over them, so that the publish throughput
+ * is not limited to what a single connection can do.
+ *
+ * @see #natsConnectionGroup_Connect()
+ */
+typedef struct __natsConnectionGroup natsConnectionGroup;
+
+/** \brief Routes the messages of one subscription to many handlers.
+ *
+ * A #natsSubscriptionMux has a single subscription on the server, usually
+ * with a wildcard subject, and invokes the handler registered locally for
+ * the subject of each message it receives.
+ *
+ * @see #natsSubscriptionMux_Create()
+ */
+typedef struct __natsSubscriptionMux natsSubscriptionMux;
+
+/** \brief How publish calls are spread over the connections of a group.
+ *
+ * @see natsConnectionGroup_Connect()
+ */
+typedef enum
+{
+    NATS_GROUP_BY_SUBJECT = 0,  ///< The connection is selected by a hash of the subject, which keeps the order of messages published on a given subject (the default).
+    NATS_GROUP_ROUND_ROBIN,     ///< Each publish call uses the next connection. The order of messages is not preserved.
+
+} natsGroupSharding;
+
+/** \brief The role of a thread created by the library.
+ *
+ * Passed to the #natsThreadStartHandler callback so that the application
+ * can tell the library's threads apart.
+ *
+ * @see natsOptions_SetThreadStartCB()
+ * @see nats_SetThreadStartCB()
+ */
+typedef enum
+{
+    NATS_THREAD_READ_LOOP = 0,  ///< Reads and processes the data from a connection's socket ("nats-read").
+    NATS_THREAD_FLUSHER,        ///< Writes the data buffered by a connection to its socket ("nats-flush").
+    NATS_THREAD_RECONNECT,      ///< Reconnects a connection after it has been disconnected ("nats-reconnect").
+    NATS_THREAD_SUB_DELIVERY,   ///< Invokes the message callback of an asynchronous subscription ("nats-deliver").
+    NATS_THREAD_DELIVERY_POOL,  ///< A worker of the shared delivery pool ("nats-dlvpool").
+    NATS_THREAD_EVENT_LOOP,     ///< A shared event loop ("nats-evloop").
+    NATS_THREAD_TIMER,          ///< Fires the library's timers ("nats-timer").
+    NATS_THREAD_ASYNC_CB,       ///< Invokes the connections' asynchronous callbacks ("nats-asynccb").
+    NATS_THREAD_GC,             ///< The library's garbage collector ("nats-gc").
+
+} natsThreadRole;
+
+/** \brief The role of a lock used by the library.
+ *
+ * Lock statistics are aggregated per role.
+ *
+ * @see nats_GetLockStats()
+ */
+typedef enum
+{
+    NATS_LOCK_OTHER = 0,        ///< Any lock not listed below (library, options, ...).
+    NATS_LOCK_CONN,             ///< The main lock of a connection.
+    NATS_LOCK_CONN_WRITE,       ///< The lock of a connection's write path.
+    NATS_LOCK_CONN_SUBS,        ///< The lock of a connection's subscriptions map.
+    NATS_LOCK_SUB,              ///< The lock of a subscription.
+    NATS_LOCK_TIMER,            ///< The lock of a timer.
+    NATS_LOCK_LIB_TIMERS,       ///< The lock of the library's list of timers.
+    NATS_LOCK_ASYNC_CBS,        ///< The lock of the library's asynchronous callbacks queue.
+    NATS_LOCK_GC,               ///< The locks of the library's garbage collector.
+    NATS_LOCK_MSG_POOL,         ///< The locks of the message pools and read slabs.
+    NATS_LOCK_DELIVERY_POOL,    ///< The locks of the shared delivery pool.
+    NATS_LOCK_EVENT_LOOP,       ///< The locks of the shared event loops.
+
+} natsLockRole;
+
+/** \brief Contention statistics of the locks of a given role.
+ *
+ * @see nats_GetLockStats()
+ */
+typedef struct natsLockStats
+{
+    uint64_t    acquisitions;   ///< Number of times a lock was acquired.
+    uint64_t    contended;      ///< Number of acquisitions that found the lock held.
+    uint64_t    spinSuccesses;  ///< Number of contended acquisitions that succeeded while spinning, without blocking.
+    uint64_t    waitTime;       ///< Total time, in nanoseconds, spent waiting for contended locks.
+
+} natsLockStats;
+
+/** \brief A fragment of a message payload.
+ *
+ * Used by #natsConnection_PublishV() to publish a payload made of several
+ * buffers without first concatenating them.
+ */
+typedef struct natsIOVec
+{
+    const void  *data;  ///< The start of the fragment (can be `NULL` if `len` is `0`).
+    int         len;    ///< The length of the fragment.
+
+} natsIOVec;
+
 /** \brief A structure holding a subject, optional reply and payload.
  *
  * #natsMsg is a structure used by Subscribers and
@@ -117,6 +284,76 @@ typedef struct __natsOptions        natsOptions;
  */
 typedef char                        natsInbox;
 
+/** \brief Policy used by the flusher to decide when to send buffered data.
+ *
+ * When the application publishes, data is accumulated in the connection's
+ * write buffer and the flusher is signaled. The policy decides how long the
+ * flusher waits, after being signaled, before writing the buffer to the
+ * socket.
+ *
+ * @see natsOptions_SetFlushPolicy()
+ */
+typedef enum
+{
+    NATS_FLUSH_LINGER = 0,  ///< Waits up to the maximum linger time, or until the maximum number of bytes are buffered (the default).
+    NATS_FLUSH_IMMEDIATE,   ///< Flushes as soon as the flusher is signaled.
+    NATS_FLUSH_ADAPTIVE,    ///< Flushes immediately after an idle period, otherwise lingers based on the recent publish rate.
+
+} natsFlushPolicy;
+
+/** \brief Policy used to select the server to reconnect to.
+ *
+ * @see natsOptions_SetServerSelection()
+ */
+typedef enum
+{
+    NATS_SERVER_SELECTION_ROUND_ROBIN = 0,  ///< Servers are tried in the order of the list (the default).
+    NATS_SERVER_SELECTION_LOWEST_RTT,       ///< Prefers the healthy server with the lowest measured round-trip time.
+
+} natsServerSelection;
+
+/** \brief Policy applied when the reconnect buffer is full.
+ *
+ * While the connection is reconnecting, published messages are buffered and
+ * sent once the connection is reestablished. This policy decides what
+ * happens when the buffer has reached the size set with
+ * natsOptions_SetReconnectBufSize().
+ *
+ * @see natsOptions_SetReconnectBufSize()
+ */
+typedef enum
+{
+    NATS_RECONNECT_BUF_ERROR = 0,   ///< The publish call fails with #NATS_INSUFFICIENT_BUFFER (the default).
+    NATS_RECONNECT_BUF_DROP_OLDEST, ///< The oldest buffered messages are dropped to make room for the new one.
+    NATS_RECONNECT_BUF_SPILL,       ///< Messages that don't fit are appended to a temporary file.
+
+} natsReconnectBufPolicy;
+
+/** \brief Policy applied to publishers when the data buffered by a
+ *         connection is over its high watermark.
+ *
+ * @see natsOptions_SetWriteWatermarks()
+ */
+typedef enum
+{
+    NATS_WATERMARK_NOTIFY = 0,  ///< Publish calls proceed, only the #natsWatermarkHandler callback is invoked (the default).
+    NATS_WATERMARK_FAIL,        ///< Publish calls fail with #NATS_INSUFFICIENT_BUFFER.
+    NATS_WATERMARK_BLOCK,       ///< Publish calls wait until the buffered data is at or below the low watermark.
+
+} natsWatermarkPolicy;
+
+/** \brief Sets of buffer sizes and limits for a given memory budget.
+ *
+ * @see natsOptions_SetMemoryProfile()
+ */
+typedef enum
+{
+    NATS_MEMORY_PROFILE_DEFAULT = 0,    ///< The library's defaults.
+    NATS_MEMORY_PROFILE_SMALL,          ///< A few KB per connection, for memory constrained devices.
+    NATS_MEMORY_PROFILE_THROUGHPUT,     ///< Larger socket buffers, to reduce the number of system calls.
+
+} natsMemoryProfile;
+
 /** @} */ // end of typesGroup
 
 //
@@ -141,6 +378,134 @@ typedef char                        natsInbox;
 typedef void (*natsMsgHandler)(
         natsConnection *nc, natsSubscription *sub, natsMsg *msg, void *closure);
 
+/** \brief Callback used to deliver batches of messages to the application.
+ *
+ * This is the callback that one provides when creating an asynchronous
+ * subscription with #natsConnection_SubscribeBatch. The library invokes
+ * this callback with up to the subscription's maximum batch size messages,
+ * in the order they were received.
+ *
+ * The array belongs to the library and must not be used after the callback
+ * returns, but the messages belong to the application, which needs to
+ * destroy each of them with #natsMsg_Destroy.
+ *
+ * @see natsConnection_SubscribeBatch()
+ */
+typedef void (*natsMsgBatchHandler)(
+        natsConnection *nc, natsSubscription *sub, natsMsg **msgs, int count,
+        void *closure);
+
+/** \brief Callback returning the key of a message.
+ *
+ * This is the callback that one provides when creating a subscription with
+ * #natsConnection_SubscribeKeyed. Messages with the same key are delivered
+ * in order, by the same worker thread. Only the returned value matters, so
+ * it is typically a hash of the part of the message identifying the
+ * entity the messages are about.
+ *
+ * The callback is invoked from the subscription's delivery thread, before
+ * the message is handed to a worker. The message must not be destroyed.
+ *
+ * @see natsConnection_SubscribeKeyed()
+ */
+typedef uint32_t (*natsMsgKeyHandler)(natsMsg *msg, void *closure);
+
+/** \brief Callback invoked when a streamed message starts.
+ *
+ * This is the first of the callbacks that one provides when creating a
+ * subscription with #natsConnection_SubscribeStream. It is invoked when the
+ * message's header has been read, with the total size of the payload, which
+ * is then handed over with #natsStreamChunkHandler calls.
+ *
+ * `subject` and `reply` (`NULL` if the message has no reply subject) are
+ * only valid for the duration of the call.
+ *
+ * @see natsConnection_SubscribeStream()
+ */
+typedef void (*natsStreamBeginHandler)(
+        natsConnection *nc, natsSubscription *sub, const char *subject,
+        const char *reply, int size, void *closure);
+
+/** \brief Callback invoked with a part of a streamed message's payload.
+ *
+ * The parts are passed in order, as they are read from the socket. `data`
+ * points to the library's read buffer and is only valid for the duration
+ * of the call.
+ *
+ * @see natsConnection_SubscribeStream()
+ */
+typedef void (*natsStreamChunkHandler)(
+        natsConnection *nc, natsSubscription *sub, const char *data,
+        int dataLen, void *closure);
+
+/** \brief Callback invoked when a streamed message ends.
+ *
+ * `status` is `NATS_OK` when the whole payload has been handed over. If the
+ * connection is lost in the middle of the payload, it is the error that
+ * caused the loss of the connection.
+ *
+ * @see natsConnection_SubscribeStream()
+ */
+typedef void (*natsStreamEndHandler)(
+        natsConnection *nc, natsSubscription *sub, natsStatus status,
+        void *closure);
+
+/** \brief Callback used to encode the payload of published messages.
+ *
+ * This is the encoder that one provides with #natsOptions_SetPayloadCodec.
+ * It encodes the `srcLen` bytes of `src` to `dst`, which has room for
+ * `*dstLen` bytes, and sets `*dstLen` to the encoded size.
+ *
+ * The room never exceeds the size of the original payload: if the encoded
+ * payload does not fit, the callback returns #NATS_INSUFFICIENT_BUFFER
+ * and the message is sent as is.
+ *
+ * \warning The callback is invoked with the connection's internal lock
+ * held, and must not call any NATS function.
+ */
+typedef natsStatus (*natsPayloadEncoder)(
+        char *dst, int *dstLen, const char *src, int srcLen, void *closure);
+
+/** \brief Callback used to decode the payload of received messages.
+ *
+ * This is the decoder that one provides with #natsOptions_SetPayloadCodec.
+ * It decodes the `srcLen` bytes of `src`, which must produce the `dstLen`
+ * bytes (the size of the original payload) of `dst`. If it does not return
+ * `NATS_OK`, the message is delivered as received.
+ *
+ * \warning The callback is invoked from the thread reading from the socket,
+ * and must not call any NATS function.
+ */
+typedef natsStatus (*natsPayloadDecoder)(
+        char *dst, int dstLen, const char *src, int srcLen, void *closure);
+
+/** \brief Callback used to complete an asynchronous request.
+ *
+ * This is the callback that one provides when sending a request with
+ * #natsConnection_RequestAsync. It is invoked exactly once per request:
+ * with the reply and `NATS_OK`, or with a `NULL` reply and #NATS_TIMEOUT
+ * or #NATS_CONNECTION_CLOSED.
+ *
+ * The reply belongs to the application, which needs to destroy it with
+ * #natsMsg_Destroy.
+ *
+ * @see natsConnection_RequestAsync()
+ */
+typedef void (*natsReplyHandler)(
+        natsConnection *nc, natsMsg *reply, natsStatus status, void *closure);
+
+/** \brief Callback used to complete an asynchronous flush.
+ *
+ * This is the callback that one provides when calling
+ * #natsConnection_FlushAsync. It is invoked exactly once per call, with
+ * `NATS_OK` when the server has processed everything sent before the
+ * flush, or with #NATS_CONNECTION_DISCONNECTED or #NATS_CONNECTION_CLOSED.
+ *
+ * @see natsConnection_FlushAsync()
+ */
+typedef void (*natsFlushHandler)(
+        natsConnection *nc, natsStatus status, void *closure);
+
 /** \brief Callback used to notify the user of asynchronous connection events.
  *
  * This callback is used for asynchronous events such as disconnected
@@ -150,6 +515,11 @@ typedef void (*natsMsgHandler)(
  * @see natsOptions_SetDisconnectedCB()
  * @see natsOptions_SetReconnectedCB()
  *
+ * The callbacks of a connection are invoked in order, by one of a small
+ * pool of library threads shared by all connections. A callback that takes
+ * long delays the later callbacks of its own connection, not those of the
+ * others.
+ *
  * \warning Such callback is invoked from a dedicated thread and the state
  *          of the connection that triggered the event may have changed since
  *          that event was generated.
@@ -162,11 +532,45 @@ typedef void (*natsConnectionHandler)(
  *
  * This callback is used to process asynchronous errors encountered while processing
  * inbound messages, such as #NATS_SLOW_CONSUMER.
+ *
+ * If a subscription becomes a slow consumer again before the callback for
+ * the previous time has been invoked, a single callback is invoked for both.
+ * The number of messages dropped is returned by natsSubscription_GetStats().
  */
 typedef void (*natsErrHandler)(
         natsConnection *nc, natsSubscription *subscription, natsStatus err,
         void *closure);
 
+/** \brief Callback used to notify the user that the data buffered by a
+ *         connection crossed one of its watermarks.
+ *
+ * This callback is invoked with `high` set to `true` when the number of
+ * bytes buffered by the connection, and not yet written to the socket,
+ * reaches the high watermark, and with `high` set to `false` when it then
+ * drops to the low watermark. Producers can use it to throttle themselves.
+ *
+ * @see natsOptions_SetWriteWatermarks()
+ * @see natsOptions_SetWatermarkCB()
+ */
+typedef void (*natsWatermarkHandler)(
+        natsConnection *nc, bool high, void *closure);
+
+/** \brief Callback used to notify the user that a library thread started.
+ *
+ * This callback is invoked from the new thread itself, before it does any
+ * work, which makes it the place to set the CPU affinity or the scheduling
+ * priority of the thread (for instance with `pthread_setaffinity_np()` or
+ * `SetThreadAffinityMask()`). The library has already named the thread
+ * `name` where the platform supports it.
+ *
+ * The callback must not call any NATS function that could block.
+ *
+ * @see natsOptions_SetThreadStartCB()
+ * @see nats_SetThreadStartCB()
+ */
+typedef void (*natsThreadStartHandler)(
+        natsThreadRole role, const char *name, void *closure);
+
 /** @} */ // end of callbacksGroup
 
 //
@@ -317,6 +721,115 @@ nats_GetLastErrorStack(char *buffer, size_t bufLen);
 NATS_EXTERN void
 nats_PrintLastErrorStack(FILE *file);
 
+/** \brief Sets the number of threads of the shared event loop.
+ *
+ * Connections created with #natsOptions_UseSharedEventLoop set to `true`
+ * do not have their own threads to read from and write to the socket.
+ * Instead, their sockets are multiplexed by a small, fixed pool of
+ * threads. This call sets the size of this pool. It needs to be invoked
+ * before the first connection using the shared event loop is created,
+ * otherwise #NATS_ILLEGAL_STATE is returned.
+ *
+ * The default is 2 threads.
+ *
+ * @param count the number of threads (must be positive).
+ */
+NATS_EXTERN natsStatus
+nats_SetSharedEventLoopThreads(int count);
+
+/** \brief Sets the number of threads of the shared delivery pool.
+ *
+ * Asynchronous subscriptions created on connections with
+ * #natsOptions_UseSharedDeliveryPool set to `true` do not have their own
+ * thread to invoke their message callback. Instead, callbacks are invoked
+ * by a fixed pool of worker threads. This call sets the size of this pool.
+ * It needs to be invoked before the first subscription using the pool is
+ * created, otherwise #NATS_ILLEGAL_STATE is returned.
+ *
+ * The default is 2 threads.
+ *
+ * @param count the number of threads (must be positive).
+ */
+NATS_EXTERN natsStatus
+nats_SetSharedDeliveryPoolThreads(int count);
+
+/** \brief Indicates if destroyed messages are freed inline.
+ *
+ * By default, #natsMsg_Destroy() hands the message to the library's
+ * garbage collector thread, which frees it later, so that the thread
+ * destroying the message (typically a message callback) does not pay for
+ * the memory release. Applications destroying messages at very high rates
+ * from many threads can set this to `true` to free the messages directly
+ * in #natsMsg_Destroy() instead.
+ *
+ * The default is `false`.
+ *
+ * @param freeInline `true` to free messages inline, `false` to use the
+ * garbage collector.
+ */
+NATS_EXTERN natsStatus
+nats_SetInlineMessageFree(bool freeInline);
+
+/** \brief Returns the garbage collector counters.
+ *
+ * Returns the total number of objects handed to the garbage collector, and
+ * the number of those that it has freed. Objects freed inline (see
+ * #nats_SetInlineMessageFree) are not counted.
+ *
+ * @param queued the location where to store the number of objects handed
+ * to the garbage collector.
+ * @param freed the location where to store the number of objects freed by
+ * the garbage collector.
+ */
+NATS_EXTERN natsStatus
+nats_GetGarbageCollectorCounts(uint64_t *queued, uint64_t *freed);
+
+/** \brief Sets the callback invoked when a library thread starts.
+ *
+ * The callback is invoked at the start of each thread created by the
+ * library: the timer, asynchronous callbacks and garbage collector threads,
+ * the shared event loops and delivery pool, and the threads of connections
+ * whose options do not have their own callback (see
+ * #natsOptions_SetThreadStartCB()).
+ *
+ * The timer, asynchronous callbacks and garbage collector threads are
+ * created when the library is opened, so this call needs to be made
+ * before #nats_Open() (or any other call that opens the library) for
+ * the callback to see them. Threads already running are not affected.
+ *
+ * @param cb the callback, or `NULL` to remove it.
+ * @param closure a pointer to an user object that will be passed to
+ * the callback. `closure` can be `NULL`.
+ */
+NATS_EXTERN void
+nats_SetThreadStartCB(natsThreadStartHandler cb, void *closure);
+
+/** \brief Returns the contention statistics of the locks of a given role.
+ *
+ * The statistics are recorded only if the library was built with the
+ * `NATS_BUILD_LOCK_STATS` CMake option, otherwise this call returns
+ * #NATS_ILLEGAL_STATE. This is not supported on Windows.
+ *
+ * \note Recording the statistics adds atomic updates of counters shared by
+ * all locks of a role to each acquisition, so this is meant for profiling,
+ * not for production builds.
+ *
+ * @param role the role of the locks.
+ * @param stats the location where to store the statistics.
+ */
+NATS_EXTERN natsStatus
+nats_GetLockStats(natsLockRole role, natsLockStats *stats);
+
+/** \brief Resets the contention statistics of all locks.
+ *
+ * Returns #NATS_ILLEGAL_STATE if the library was not built with the
+ * `NATS_BUILD_LOCK_STATS` CMake option.
+ *
+ * @see nats_GetLockStats()
+ */
+NATS_EXTERN natsStatus
+nats_ResetLockStats(void);
+
 /** \brief Tear down the library.
  *
  * Releases memory used by the library.
@@ -391,6 +904,66 @@ natsStatistics_GetCounts(natsStatistics *stats,
                          uint64_t *outMsgs, uint64_t *outBytes,
                          uint64_t *reconnects);
 
+/** \brief Extracts the message pool counts.
+ *
+ * Gets the number of inbound messages whose memory was taken from the
+ * connection's message pool (hits), and the number of those that required
+ * a new allocation (misses).
+ *
+ * \note You can pass `NULL` to any of the count your are not interested in
+ * getting.
+ *
+ * @see natsOptions_SetMsgPoolSize()
+ * @see natsConnection_GetStats()
+ *
+ * @param stats the pointer to the #natsStatistics object to get the values from.
+ * @param hits number of message allocations satisfied by the pool.
+ * @param misses number of message allocations not satisfied by the pool.
+ */
+NATS_EXTERN natsStatus
+natsStatistics_GetMsgPoolCounts(natsStatistics *stats,
+                                uint64_t *hits, uint64_t *misses);
+
+/** \brief Extracts a latency summary.
+ *
+ * Gets the number of recorded latencies of the given type, their mean and
+ * their maximum, in microseconds. All values are 0 if the connection did
+ * not record latencies.
+ *
+ * \note You can pass `NULL` to any of the values your are not interested in
+ * getting.
+ *
+ * @see natsOptions_SetLatencyStats()
+ * @see natsConnection_GetStats()
+ *
+ * @param stats the pointer to the #natsStatistics object to get the values from.
+ * @param type the #natsLatencyType to get the values for.
+ * @param count number of recorded latencies.
+ * @param mean mean latency, in microseconds.
+ * @param max max latency, in microseconds.
+ */
+NATS_EXTERN natsStatus
+natsStatistics_GetLatency(natsStatistics *stats, natsLatencyType type,
+                          uint64_t *count, int64_t *mean, int64_t *max);
+
+/** \brief Extracts a latency percentile.
+ *
+ * Gets the latency, in microseconds, below which the given percentage of
+ * the recorded latencies of the given type fall. The value is accurate to
+ * about 6 percent. It is 0 if no latency has been recorded.
+ *
+ * @see natsOptions_SetLatencyStats()
+ * @see natsConnection_GetStats()
+ *
+ * @param stats the pointer to the #natsStatistics object to get the value from.
+ * @param type the #natsLatencyType to get the value for.
+ * @param percentile the percentile, between 0 and 100 (for instance 99.9).
+ * @param value the location where to store the latency, in microseconds.
+ */
+NATS_EXTERN natsStatus
+natsStatistics_GetLatencyPercentile(natsStatistics *stats, natsLatencyType type,
+                                    double percentile, int64_t *value);
+
 /** \brief Destroys the #natsStatistics object.
  *
  * Destroys the statistics object, freeing up memory.
@@ -481,6 +1054,28 @@ natsOptions_SetServers(natsOptions *opts, const char** servers, int serversCount
 NATS_EXTERN natsStatus
 natsOptions_SetNoRandomize(natsOptions *opts, bool noRandomize);
 
+/** \brief Sets how the next server is selected when reconnecting.
+ *
+ * By default, the servers are tried in the order of the list (see
+ * #natsOptions_SetNoRandomize()). With #NATS_SERVER_SELECTION_LOWEST_RTT,
+ * the library measures the round-trip time to the servers it connects to,
+ * with the PING sent during the connect handshake and the ones sent by the
+ * ping timer. When reconnecting, it then tries first the server that has
+ * failed the fewest reconnect attempts and, among those, the one with the
+ * lowest round-trip time. Servers that have never been measured come after
+ * the ones that have.
+ *
+ * The measurements are kept for the lifetime of the connection, so the
+ * initial connect still follows the order of the list. Use
+ * #natsOptions_SetParallelConnect() to connect to the server that accepts
+ * the connection first.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param policy the #natsServerSelection policy.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetServerSelection(natsOptions *opts, natsServerSelection policy);
+
 /** \brief Sets the (re)connect process timeout.
  *
  * This timeout, expressed in milliseconds, is used to interrupt a (re)connect
@@ -582,6 +1177,31 @@ natsOptions_SetCiphers(natsOptions *opts, const char *ciphers);
 NATS_EXTERN natsStatus
 natsOptions_SetExpectedHostname(natsOptions *opts, const char *hostname);
 
+/** \brief Sets how the TLS data path is optimized.
+ *
+ * If `kernelTLS` is `true` and the library was built with an OpenSSL version
+ * supporting it (`SSL_OP_ENABLE_KTLS`), the encryption of the connection is
+ * handed to the kernel (kTLS) after the handshake, if the kernel and the
+ * negotiated cipher allow it. Writes and reads then cost about the same as
+ * on a plain socket. #natsConnection_IsKernelTLS() tells if this is the case.
+ *
+ * If the encryption is done by OpenSSL, each socket write produces at least
+ * one TLS record, so small writes carry a high overhead. If `batchRecords`
+ * is `true`, the flusher waits until a full TLS record (16KB) is buffered,
+ * or the maximum linger time set with #natsOptions_SetFlushPolicy() is
+ * reached, even for the #NATS_FLUSH_IMMEDIATE policy or after an idle
+ * period with #NATS_FLUSH_ADAPTIVE. This trades latency for throughput.
+ *
+ * Both are `false` by default.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param kernelTLS `true` to use kernel TLS when available.
+ * @param batchRecords `true` to fill TLS records before writing them when
+ * the encryption is not done by the kernel.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetTLSOffload(natsOptions *opts, bool kernelTLS, bool batchRecords);
+
 /** \brief Sets the verbose mode.
  *
  * Sets the verbose mode. If `true`, sends are echoed by the server with
@@ -613,6 +1233,12 @@ natsOptions_SetPedantic(natsOptions *opts, bool pedantic);
  * Interval, expressed in milliseconds, in which the client sends `PING`
  * protocols to the `NATS Server`.
  *
+ * No `PING` is sent if data was received from the server during the last
+ * interval. Such traffic shows that the connection is alive. When nothing
+ * is received, `PING`s are sent at every interval. The connection is
+ * considered stale once more `PING`s than the value set with
+ * #natsOptions_SetMaxPingsOut() are left without an answer.
+ *
  * @param opts the pointer to the #natsOptions object.
  * @param interval the interval, in milliseconds, at which the connection
  * will send `PING` protocols to the server.
@@ -674,46 +1300,429 @@ natsOptions_SetMaxReconnect(natsOptions *opts, int maxReconnect);
 NATS_EXTERN natsStatus
 natsOptions_SetReconnectWait(natsOptions *opts, int64_t reconnectWait);
 
-/** \brief Sets the maximum number of pending messages per subscription.
+/** \brief Sets the backoff between reconnect attempts.
  *
- * Specifies the maximum number of inbound messages that can be buffered in the
- * library, for each subscription, before inbound messages are dropped and
- * #NATS_SLOW_CONSUMER status is reported to the #natsErrHandler callback (if
- * one has been set).
+ * By default, the library waits `reconnectWait` milliseconds before each
+ * new attempt to reconnect to the same server. With this option, that wait
+ * is doubled after each failed attempt to that server, up to `maxWait`
+ * milliseconds, and a random delay of up to `jitter` milliseconds is added
+ * to it. The jitter prevents a large number of clients from reconnecting
+ * to a restarted server all at the same time.
  *
- * @see natsOptions_SetErrorHandler()
+ * The wait is interrupted if the connection is closed.
+ *
+ * @see natsOptions_SetReconnectWait()
  *
  * @param opts the pointer to the #natsOptions object.
- * @param maxPending the number of messages allowed to be buffered by the
- * library before triggering a slow consumer scenario.
+ * @param maxWait the maximum time, in milliseconds, to wait between attempts
+ * to reconnect to the same server. A value less than or equal to
+ * `reconnectWait` disables the exponential backoff.
+ * @param jitter the maximum random time, in milliseconds, added to the wait.
  */
 NATS_EXTERN natsStatus
-natsOptions_SetMaxPendingMsgs(natsOptions *opts, int maxPending);
+natsOptions_SetReconnectBackoff(natsOptions *opts, int64_t maxWait,
+                                int64_t jitter);
 
-/** \brief Sets the error handler for asynchronous events.
+/** \brief Sets the size of the reconnect buffer.
  *
- * Specifies the callback to invoke when an asynchronous error
- * occurs. This is used by applications having only asynchronous
- * subscriptions that would not know otherwise that a problem with the
- * connection occurred.
+ * While the connection is reconnecting, the data published by the
+ * application is buffered in memory, and sent to the server once the
+ * connection is reestablished. This option limits the number of bytes
+ * buffered in memory, and sets what happens when that limit is reached:
  *
- * @see natsErrHandler
+ * - #NATS_RECONNECT_BUF_ERROR: the publish call returns
+ * #NATS_INSUFFICIENT_BUFFER.
+ * - #NATS_RECONNECT_BUF_DROP_OLDEST: the oldest messages are discarded to make
+ * room for the new one. Only published messages are discarded, so if the
+ * oldest buffered data is another protocol (for instance the PING of a
+ * natsConnection_Flush() call), the publish call returns
+ * #NATS_INSUFFICIENT_BUFFER.
+ * - #NATS_RECONNECT_BUF_SPILL: the data that does not fit is appended to a
+ * temporary file, which is automatically removed when no longer needed.
+ *
+ * Once reconnected, the buffered data is sent in chunks, so that the
+ * application can keep publishing during the replay. New messages are sent
+ * after the buffered ones.
+ *
+ * The default is zero, which means that there is no limit.
  *
  * @param opts the pointer to the #natsOptions object.
- * @param errHandler the error handler callback.
- * @param closure a pointer to an user object that will be passed to
- * the callback. `closure` can be `NULL`.
+ * @param maxBytes the maximum number of bytes buffered in memory while
+ * reconnecting. Zero means no limit.
+ * @param policy the #natsReconnectBufPolicy applied when the limit is reached.
  */
 NATS_EXTERN natsStatus
-natsOptions_SetErrorHandler(natsOptions *opts, natsErrHandler errHandler,
-                            void *closure);
+natsOptions_SetReconnectBufSize(natsOptions *opts, int64_t maxBytes,
+                                natsReconnectBufPolicy policy);
 
-/** \brief Sets the callback to be invoked when a connection to a server
- *         is permanently lost.
+/** \brief Sets the watermarks of the data buffered for the server.
  *
- * Specifies the callback to invoke when a connection is terminally closed,
- * that is, after all reconnect attempts have failed (when reconnection is
- * allowed).
+ * The connection counts the bytes it has buffered and not yet written to
+ * the socket, including the data buffered while reconnecting. Once that
+ * count reaches `high`, the connection is over its high watermark until
+ * the count drops to `low`. In the meantime, publish calls are subject to
+ * `policy`:
+ *
+ * - #NATS_WATERMARK_NOTIFY: publish calls proceed as usual.
+ * - #NATS_WATERMARK_FAIL: publish calls return #NATS_INSUFFICIENT_BUFFER.
+ * - #NATS_WATERMARK_BLOCK: publish calls wait, for up to `timeout`
+ * milliseconds, until the buffered data has been sent. They return
+ * #NATS_TIMEOUT if it has not. With #natsOptions_SetCallerDrivenIO(), the
+ * thread publishing is the one that has to write the data, so this policy
+ * is treated as #NATS_WATERMARK_FAIL.
+ *
+ * Whatever the policy, the callback set with natsOptions_SetWatermarkCB()
+ * is invoked when a watermark is crossed.
+ *
+ * While connected, the write buffer is written to the socket when full
+ * (see natsOptions_SetIOBufSize()), so the high watermark only applies then
+ * if it is lower than the size of that buffer. While reconnecting, it
+ * applies to the data buffered until the connection is reestablished.
+ *
+ * @note The watermarks apply to publish calls only. Other protocols, such
+ * as subscriptions, are always buffered.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param high the number of buffered bytes at which publishers are subject
+ * to `policy`. Zero disables the watermarks (the default).
+ * @param low the number of buffered bytes at which publishers are released.
+ * Must be lower than `high`.
+ * @param policy the #natsWatermarkPolicy applied over the high watermark.
+ * @param timeout the maximum time, in milliseconds, a publish call waits
+ * with the #NATS_WATERMARK_BLOCK policy. Zero means no limit.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetWriteWatermarks(natsOptions *opts, int64_t high, int64_t low,
+                               natsWatermarkPolicy policy, int64_t timeout);
+
+/** \brief Sets the callback to be invoked when a watermark is crossed.
+ *
+ * Specifies the callback to invoke when the data buffered by the connection
+ * reaches the high watermark, and when it drops back to the low watermark,
+ * as set with natsOptions_SetWriteWatermarks().
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param cb the callback to be invoked when a watermark is crossed.
+ * @param closure a pointer to an user defined object (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetWatermarkCB(natsOptions *opts, natsWatermarkHandler cb,
+                           void *closure);
+
+/** \brief Sets the maximum number of pending messages per subscription.
+ *
+ * Specifies the maximum number of inbound messages that can be buffered in the
+ * library, for each subscription, before inbound messages are dropped and
+ * #NATS_SLOW_CONSUMER status is reported to the #natsErrHandler callback (if
+ * one has been set).
+ *
+ * @see natsOptions_SetErrorHandler()
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param maxPending the number of messages allowed to be buffered by the
+ * library before triggering a slow consumer scenario.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetMaxPendingMsgs(natsOptions *opts, int maxPending);
+
+/** \brief Sets the maximum number of pending bytes per subscription.
+ *
+ * Specifies the maximum number of payload bytes of inbound messages that can
+ * be buffered in the library, for each subscription, before inbound messages
+ * are dropped and #NATS_SLOW_CONSUMER status is reported to the
+ * #natsErrHandler callback (if one has been set). This limit applies in
+ * addition to the one set with #natsOptions_SetMaxPendingMsgs. The default
+ * is 64MB.
+ *
+ * @see natsSubscription_SetPendingLimits()
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param maxPending the number of bytes allowed to be buffered by the
+ * library before triggering a slow consumer scenario.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetMaxPendingBytes(natsOptions *opts, int64_t maxPending);
+
+/** \brief Sets the policy used to flush the connection's write buffer.
+ *
+ * Publishing data does not write to the socket directly. Instead, data is
+ * accumulated in a buffer and a flusher is signaled. This option controls
+ * how long the flusher lingers before sending the data to the server, which
+ * is a trade-off between latency and throughput:
+ *
+ * - #NATS_FLUSH_LINGER: the flusher waits for `maxLinger` microseconds, or
+ * until `maxBytes` are buffered, whichever comes first.
+ * - #NATS_FLUSH_IMMEDIATE: the flusher writes the data as soon as it is
+ * signaled. This gives the lowest latency.
+ * - #NATS_FLUSH_ADAPTIVE: if the connection was idle for more than
+ * `maxLinger` before the publish, the data is flushed immediately. Otherwise,
+ * the flusher lingers for a duration based on the recent publish rate, but
+ * no more than `maxLinger` and stops waiting once `maxBytes` are buffered.
+ *
+ * The default is #NATS_FLUSH_LINGER with a linger time of 1 millisecond and
+ * no byte threshold.
+ *
+ * \note When the connection uses the shared event loop, flush requests are
+ * batched by the event loop and this option is ignored.
+ *
+ * @see natsOptions_UseSharedEventLoop()
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param policy the #natsFlushPolicy to use.
+ * @param maxLinger the maximum time, in microseconds, the flusher waits
+ * before sending the buffered data.
+ * @param maxBytes the number of buffered bytes that causes the flusher to send
+ * the data without waiting any longer. Zero means no threshold.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetFlushPolicy(natsOptions *opts, natsFlushPolicy policy,
+                           int64_t maxLinger, int maxBytes);
+
+/** \brief Sets how connection attempts are run in parallel.
+ *
+ * A server's host name may resolve to several addresses, possibly of
+ * different families (IPv6 and IPv4). Instead of trying them one after the
+ * other, each with the full timeout set with #natsOptions_SetTimeout(), the
+ * library starts a non-blocking connect to the first address and, if it has
+ * not completed after `attemptDelay` milliseconds (or as soon as it fails),
+ * starts one to the next address, alternating between address families, and
+ * so on (as described in RFC 8305). The first connection to complete is used
+ * and the others are abandoned.
+ *
+ * When creating a connection, the addresses of up to `maxServers` servers of
+ * the pool are raced that way, in the pool order. The INFO/CONNECT/PING
+ * handshake is done with the server that accepts the connection first. If
+ * it fails, the remaining servers are tried. The whole race is bounded by
+ * the connect timeout, so a server placed at the end of a large batch gets
+ * less time to respond. When reconnecting, servers are always tried one at
+ * a time, but their addresses are still raced.
+ *
+ * The default is an `attemptDelay` of 250 milliseconds and a `maxServers`
+ * of 1.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param attemptDelay the delay, in milliseconds, before starting the next
+ * connection attempt. Zero starts all attempts at once.
+ * @param maxServers the number of servers raced during the initial connect.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetParallelConnect(natsOptions *opts, int64_t attemptDelay,
+                               int maxServers);
+
+/** \brief Sets the size of the connection's message pool.
+ *
+ * Inbound messages are allocated from a per-connection pool that recycles
+ * the memory blocks of destroyed messages, grouped by size classes (from
+ * 128 bytes to 4KB, message structure included). Larger messages are always
+ * allocated and freed.
+ *
+ * This option sets the maximum number of free blocks kept for each size
+ * class. The default is 128. A value of zero disables the pool.
+ *
+ * @see natsStatistics_GetMsgPoolCounts()
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param maxPerClass the maximum number of free blocks kept per size class.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetMsgPoolSize(natsOptions *opts, int maxPerClass);
+
+/** \brief Enables the recording of latency statistics.
+ *
+ * When enabled, the connection records the round-trip time of flush calls,
+ * the time requests take to get their reply, and how long inbound messages
+ * wait in their subscription before being delivered. Those are available,
+ * as percentiles, through #natsConnection_GetStats().
+ *
+ * This is disabled by default, in which case the cost is limited to one
+ * test per operation.
+ *
+ * @see natsStatistics_GetLatency()
+ * @see natsStatistics_GetLatencyPercentile()
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param enabled `true` to record latencies.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetLatencyStats(natsOptions *opts, bool enabled);
+
+/** \brief Sets the busy-poll spin budget.
+ *
+ * When set, the thread reading from the socket spins for up to `spinMicros`
+ * microseconds on non-blocking reads before blocking, and so does
+ * #natsSubscription_NextMsg() (and the other calls waiting for messages
+ * of a synchronous subscription) before waiting on its condition variable.
+ * The socket is also given the `SO_BUSY_POLL` option with the same value
+ * where supported, which typically requires the `CAP_NET_ADMIN` capability
+ * on Linux and is otherwise silently skipped.
+ *
+ * This trades CPU for latency: a thread spinning with no data to process
+ * uses a full core for the duration of the budget.
+ *
+ * The default is 0, which disables busy-polling.
+ *
+ * \note Spinning on reads is not done on Windows, nor for connections using
+ * the shared event loop (see #natsOptions_UseSharedEventLoop).
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param spinMicros the spin budget, in microseconds.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetBusyPoll(natsOptions *opts, int64_t spinMicros);
+
+/** \brief Indicates if the connection uses the library's shared event loop.
+ *
+ * By default, each connection creates two threads: one reading from the
+ * socket and one flushing the outbound buffer. Applications creating a
+ * large number of connections can set this option to `true` so that the
+ * connection's socket is instead handled by a small pool of threads shared
+ * by all such connections (see #nats_SetSharedEventLoopThreads).
+ *
+ * The default is `false`.
+ *
+ * \note This is currently supported on Linux only. On other platforms,
+ * setting this option to `true` returns #NATS_ILLEGAL_STATE.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param useSharedEvLoop `true` to use the shared event loop, `false`
+ * otherwise.
+ */
+NATS_EXTERN natsStatus
+natsOptions_UseSharedEventLoop(natsOptions *opts, bool useSharedEvLoop);
+
+/** \brief Indicates if asynchronous subscriptions use the shared delivery pool.
+ *
+ * By default, each asynchronous subscription creates a thread that invokes
+ * its message callback. Applications creating a large number of
+ * subscriptions can set this option to `true` so that the callbacks are
+ * instead invoked by a pool of threads shared by all such subscriptions
+ * (see #nats_SetSharedDeliveryPoolThreads).
+ *
+ * Messages of a given subscription are still delivered in order, and its
+ * callback is never invoked concurrently from two threads. However, a
+ * callback that blocks prevents the worker it runs on from delivering
+ * messages to other subscriptions (idle workers take over subscriptions
+ * scheduled on a busy worker).
+ *
+ * The default is `false`.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param useSharedDlvPool `true` to use the shared delivery pool, `false`
+ * otherwise.
+ */
+NATS_EXTERN natsStatus
+natsOptions_UseSharedDeliveryPool(natsOptions *opts, bool useSharedDlvPool);
+
+/** \brief Indicates if the application drives the connection's I/O.
+ *
+ * By default, a connection has threads that read from and write to its
+ * socket, send the `PING`s, and invoke the callbacks. When this option is
+ * set to `true`, the connection has none of those. Once connected, the
+ * application gets the socket with #natsConnection_GetFd(), and:
+ *
+ * - calls #natsConnection_ProcessIO() when the socket is readable, or
+ * writable while #natsConnection_Buffered() is positive.
+ * - calls #natsConnection_ProcessTimers() periodically (at least as often
+ * as the `PING` interval) so that `PING`s are sent and asynchronous
+ * requests time out.
+ *
+ * Message callbacks of asynchronous subscriptions, and the connection's
+ * callbacks (closed, disconnected, error, #natsConnection_FlushAsync() and
+ * #natsConnection_RequestAsync() handlers), are invoked from these calls,
+ * in the application's thread. The callbacks pending when the connection
+ * is closed may also be invoked from #natsConnection_Close() or
+ * #natsConnection_Destroy().
+ *
+ * #natsConnection_FlushTimeout() and #natsConnection_Request() write to
+ * and read from the socket (and so may invoke callbacks) while waiting for
+ * the `PONG` or the reply. #natsSubscription_NextMsg() does not, so it only
+ * sees the messages already processed by #natsConnection_ProcessIO().
+ *
+ * Such a connection does not reconnect: when the connection to the server
+ * is lost, it is closed. This option takes precedence over
+ * #natsOptions_UseSharedEventLoop() and #natsOptions_UseSharedDeliveryPool(),
+ * and turns the #NATS_WATERMARK_BLOCK policy of
+ * #natsOptions_SetWriteWatermarks() into #NATS_WATERMARK_FAIL.
+ *
+ * The connection itself must be used from a single thread at a time.
+ *
+ * The default is `false`.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param callerDriven `true` if the application drives the I/O, `false`
+ * otherwise.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetCallerDrivenIO(natsOptions *opts, bool callerDriven);
+
+/** \brief Sets the callback invoked when data is buffered for writing.
+ *
+ * For connections created with #natsOptions_SetCallerDrivenIO(), this
+ * callback is invoked when data becomes buffered, so that the application
+ * can watch the socket for writability. It is not invoked again until
+ * #natsConnection_ProcessIO() has been called for the socket being writable,
+ * or until a call to #natsConnection_ProcessIO() returns with nothing left
+ * in #natsConnection_Buffered().
+ *
+ * This is what the adapters in `adapters/libuv.h` and `adapters/libevent.h`
+ * use to avoid polling for writability when there is nothing to send.
+ *
+ * \warning The callback is invoked with the connection's internal lock held,
+ * from the thread that buffered the data. It must not call any NATS function,
+ * and should only register interest for the socket being writable.
+ *
+ * The option is ignored for connections that do not drive their own I/O.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param cb the callback, or `NULL` to remove it.
+ * @param closure a pointer to an user object that will be passed to
+ * the callback. `closure` can be `NULL`.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetWriteInterestCB(natsOptions *opts, natsConnectionHandler cb,
+                               void *closure);
+
+/** \brief Indicates if requests create their own inbox and subscription.
+ *
+ * By default, #natsConnection_Request() uses a single subscription per
+ * connection to receive the replies of all requests. Setting this option
+ * to `true` restores the original behavior, where each request creates an
+ * inbox and a subscription (auto-unsubscribed after the first reply) that
+ * is destroyed when the call returns.
+ *
+ * The default is `false`.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param useOldStyle `true` to create a subscription per request, `false`
+ * otherwise.
+ */
+NATS_EXTERN natsStatus
+natsOptions_UseOldRequestStyle(natsOptions *opts, bool useOldStyle);
+
+/** \brief Sets the error handler for asynchronous events.
+ *
+ * Specifies the callback to invoke when an asynchronous error
+ * occurs. This is used by applications having only asynchronous
+ * subscriptions that would not know otherwise that a problem with the
+ * connection occurred.
+ *
+ * @see natsErrHandler
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param errHandler the error handler callback.
+ * @param closure a pointer to an user object that will be passed to
+ * the callback. `closure` can be `NULL`.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetErrorHandler(natsOptions *opts, natsErrHandler errHandler,
+                            void *closure);
+
+/** \brief Sets the callback to be invoked when a connection to a server
+ *         is permanently lost.
+ *
+ * Specifies the callback to invoke when a connection is terminally closed,
+ * that is, after all reconnect attempts have failed (when reconnection is
+ * allowed).
  *
  * @param opts the pointer to the #natsOptions object.
  * @param closedCb the callback to be invoked when the connection is closed.
@@ -768,6 +1777,152 @@ natsOptions_SetReconnectedCB(natsOptions *opts,
                              natsConnectionHandler reconnectedCb,
                              void *closure);
 
+/** \brief Sets the callback invoked when a connection's thread starts.
+ *
+ * The callback is invoked at the start of each thread created for the
+ * connection: the read loop, flusher and reconnect threads, and the
+ * delivery thread of each asynchronous subscription. It takes precedence
+ * over the library-wide callback set with #nats_SetThreadStartCB().
+ *
+ * @see natsThreadStartHandler
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param cb the callback, or `NULL` to remove it.
+ * @param closure a pointer to an user object that will be passed to
+ * the callback. `closure` can be `NULL`.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetThreadStartCB(natsOptions *opts, natsThreadStartHandler cb,
+                             void *closure);
+
+/** \brief Sets the codec used to encode the payload of messages.
+ *
+ * When set, the payload of published messages is encoded when it is at
+ * least as large as the minimum set with #natsOptions_SetPayloadCodecMinSize
+ * and when encoding makes it smaller. Encoded payloads start with a marker
+ * (the bytes `0x00`, `'N'`, `'Z'`), the id of the codec, and the size of the
+ * original payload (4 bytes, big endian), so that a connection with a codec
+ * recognizes and decodes them, and delivers the other messages as is.
+ *
+ * `codecId` #NATS_CODEC_LZ4 selects the built-in LZ4 codec, in which case
+ * `encoder` and `decoder` must be `NULL`. Other ids, up to `255`, identify
+ * an application codec whose `encoder` and `decoder` are both required.
+ * LZ4 encoded payloads are decoded whatever the codec of the connection.
+ * `0` removes the codec.
+ *
+ * All subscribers of the subjects on which encoded messages are published
+ * need to have a codec set. The payload of subscriptions created with
+ * #natsConnection_SubscribeStream is not decoded.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param codecId the id of the codec, written in the encoded payloads.
+ * @param encoder the #natsPayloadEncoder callback, or `NULL`.
+ * @param decoder the #natsPayloadDecoder callback, or `NULL`.
+ * @param closure a pointer to an user object that will be passed to
+ * the callbacks. `closure` can be `NULL`.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetPayloadCodec(natsOptions *opts, int codecId,
+                            natsPayloadEncoder encoder,
+                            natsPayloadDecoder decoder, void *closure);
+
+/** \brief Sets the size from which payloads are encoded.
+ *
+ * Payloads smaller than this are sent as is by connections that have a
+ * codec (see #natsOptions_SetPayloadCodec). The default is `512` bytes.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param minSize the minimum size, in bytes, of the payloads to encode.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetPayloadCodecMinSize(natsOptions *opts, int minSize);
+
+/** \brief Delivers published messages directly to the connection's own
+ *         subscriptions.
+ *
+ * When set, messages published on the connection are also queued directly
+ * to the subscriptions of the same connection whose subject matches, and
+ * the server is asked not to send them back. Those messages don't make the
+ * round trip to the server, which still delivers them to other
+ * connections.
+ *
+ * This is in effect only with servers that support not sending back the
+ * messages a connection publishes. With other servers, messages reach the
+ * connection's subscriptions through the server, as usual.
+ *
+ * \note Queue subscriptions, and subscriptions created with
+ * #natsConnection_SubscribeStream, could not receive the messages the
+ * connection publishes, so creating them on such a connection fails with
+ * #NATS_ILLEGAL_STATE, whatever the server supports.
+ *
+ * \note The subject of each published message is matched against all the
+ * subscriptions of the connection, which makes publishing more expensive
+ * for connections with many subscriptions.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param local `true` to deliver published messages locally, `false` to
+ * get them back from the server.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetLocalDelivery(natsOptions *opts, bool local);
+
+/** \brief Sets the size of the connection's read and write buffers.
+ *
+ * The connection reads from the socket into a buffer of `readSize` bytes,
+ * and accumulates the protocols it sends in a buffer of `writeSize` bytes,
+ * which is flushed when full. Messages bigger than the buffers are still
+ * received and published. Larger buffers reduce the number of system calls
+ * at high message rates, smaller ones the memory used by each connection.
+ *
+ * The default is 32KB for both.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param readSize the size, in bytes, of the read buffer.
+ * @param writeSize the size, in bytes, of the write buffer.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetIOBufSize(natsOptions *opts, int readSize, int writeSize);
+
+/** \brief Records the traffic received from the server in a file.
+ *
+ * Every read from the socket is appended to the file `path`, with the time
+ * of the read, so that the traffic can be replayed offline, for instance
+ * with the `replay` tool built with the `NATS_BUILD_MICROBENCH` CMake
+ * option (see `test/replay.c`). The file is created, or truncated, when
+ * the connection is created, and the connection fails to be created if
+ * the file cannot be opened. Only the protocols that follow the connect
+ * handshake are recorded.
+ *
+ * The capture is meant to reproduce performance issues: it costs a copy
+ * of every read, and includes the payload of all messages.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param path the capture file, or `NULL` to not record the traffic.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetCaptureFile(natsOptions *opts, const char *path);
+
+/** \brief Sets the buffer sizes and limits for a memory budget.
+ *
+ * Sets the options that decide how much memory a connection and its
+ * subscriptions use, replacing the values set before:
+ *
+ * Option | Default | Small | Throughput
+ * -------|---------|-------|-----------
+ * #natsOptions_SetIOBufSize() | 32KB / 32KB | 2KB / 1KB | 256KB / 256KB
+ * #natsOptions_SetMaxPendingMsgs() | 65536 | 1024 | 65536
+ * #natsOptions_SetMaxPendingBytes() | 64MB | 1MB | 64MB
+ * #natsOptions_SetMsgPoolSize() | 128 | 8 | 1024
+ * #natsOptions_SetReconnectBufSize() | no limit | 64KB | no limit
+ *
+ * Those options can be changed individually after the profile is set.
+ *
+ * @param opts the pointer to the #natsOptions object.
+ * @param profile the memory profile.
+ */
+NATS_EXTERN natsStatus
+natsOptions_SetMemoryProfile(natsOptions *opts, natsMemoryProfile profile);
+
 /** \brief Destroys a #natsOptions object.
  *
  * Destroys the natsOptions object, freeing used memory. See the note in
@@ -802,6 +1957,29 @@ natsOptions_Destroy(natsOptions *opts);
 NATS_EXTERN natsStatus
 natsInbox_Create(char **newInbox);
 
+/** \brief Writes a new inbox in the given buffer.
+ *
+ * Same as #natsInbox_Create() but the inbox, including the terminating
+ * `NULL` character, is written in the buffer provided by the caller, which
+ * must be at least #NATS_INBOX_ARRAY_SIZE bytes long.
+ *
+ * Inboxes are made of a random prefix and a sequence, generated by a
+ * state that is specific to each thread, so this call does not allocate
+ * memory (except for the first call in a given thread) and does not
+ * acquire any lock.
+ *
+ * \code{.c}
+ * char inbox[NATS_INBOX_ARRAY_SIZE];
+ *
+ * s = natsInbox_Init(inbox, (int) sizeof(inbox));
+ * \endcode
+ *
+ * @param buf the buffer where to write the inbox.
+ * @param bufLen the size of the buffer.
+ */
+NATS_EXTERN natsStatus
+natsInbox_Init(char *buf, int bufLen);
+
 /** \brief Destroys the inbox.
  *
  * Destroys the inbox.
@@ -965,6 +2143,17 @@ natsConnection_IsClosed(natsConnection *nc);
 NATS_EXTERN bool
 natsConnection_IsReconnecting(natsConnection *nc);
 
+/** \brief Test if the connection's encryption is done by the kernel.
+ *
+ * Returns `true` if the connection is secure, kernel TLS was requested with
+ * #natsOptions_SetTLSOffload() and the kernel encrypts the data sent on the
+ * connection's socket.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ */
+NATS_EXTERN bool
+natsConnection_IsKernelTLS(natsConnection *nc);
+
 /** \brief Returns the current state of the connection.
  *
  * Returns the current state of the connection.
@@ -1023,6 +2212,82 @@ natsConnection_Flush(natsConnection *nc);
 NATS_EXTERN natsStatus
 natsConnection_FlushTimeout(natsConnection *nc, int64_t timeout);
 
+/** \brief Flushes the connection without waiting.
+ *
+ * Sends a `PING` to the server, like #natsConnection_Flush(), but returns
+ * without waiting for the `PONG`. The #natsFlushHandler callback is then
+ * invoked:
+ *
+ * - with `NATS_OK` from the connection's reading thread, when the `PONG`
+ * is received.
+ * - with #NATS_CONNECTION_DISCONNECTED or #NATS_CONNECTION_CLOSED from the
+ * thread invoking the connection's event callbacks, if the connection is
+ * lost or closed before that.
+ *
+ * If several asynchronous flushes are outstanding and nothing has been
+ * written to the connection since the last `PING` was sent, the new flush
+ * shares that `PING` instead of sending another one.
+ *
+ * Since the callback runs on library threads, it should not block. If
+ * this call returns an error, the callback is not invoked.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param cb the #natsFlushHandler callback.
+ * @param closure a pointer to an user defined object (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsConnection_FlushAsync(natsConnection *nc, natsFlushHandler cb,
+                          void *closure);
+
+/** \brief Gets the connection's socket.
+ *
+ * Returns the socket of a connection created with
+ * #natsOptions_SetCallerDrivenIO(), for the application to watch.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param fd the location where to store the socket.
+ * @return #NATS_ILLEGAL_STATE if the connection does not have caller driven
+ * I/O, #NATS_CONNECTION_CLOSED if it is closed.
+ */
+NATS_EXTERN natsStatus
+natsConnection_GetFd(natsConnection *nc, natsSock *fd);
+
+/** \brief Processes socket events.
+ *
+ * For connections created with #natsOptions_SetCallerDrivenIO(), reads and
+ * parses what is available on the socket if `events` contains
+ * #NATS_IO_READ, and writes what is buffered if it contains
+ * #NATS_IO_WRITE. The socket being non-blocking, this call does not wait.
+ *
+ * The callbacks of the messages received, and the connection's callbacks
+ * of the events that occurred, are invoked before this call returns.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param events a combination of #NATS_IO_READ and #NATS_IO_WRITE.
+ * @return #NATS_CONNECTION_CLOSED once the connection is closed.
+ */
+NATS_EXTERN natsStatus
+natsConnection_ProcessIO(natsConnection *nc, int events);
+
+/** \brief Processes the connection's timers.
+ *
+ * For connections created with #natsOptions_SetCallerDrivenIO(), sends a
+ * `PING` if the `PING` interval has elapsed since the last one. If too
+ * many `PING`s are outstanding, the connection is considered stale and is
+ * closed.
+ *
+ * The asynchronous requests whose timeout has elapsed by `now` are
+ * completed with #NATS_TIMEOUT before this call returns, so how often it
+ * is called bounds the accuracy of these timeouts.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param now the current time, in milliseconds, as returned by
+ * #nats_Now().
+ * @return #NATS_CONNECTION_CLOSED once the connection is closed.
+ */
+NATS_EXTERN natsStatus
+natsConnection_ProcessTimers(natsConnection *nc, int64_t now);
+
 /** \brief Returns the maximum message payload.
  *
  * Returns the maximum message payload accepted by the server. The
@@ -1161,14 +2426,102 @@ natsConnection_PublishString(natsConnection *nc, const char *subj,
 NATS_EXTERN natsStatus
 natsConnection_PublishMsg(natsConnection *nc, natsMsg *msg);
 
-/** \brief Publishes data on a subject expecting replies on the given reply.
+/** \brief Publishes a payload made of several fragments.
  *
- * Publishes the data argument to the given subject expecting a response on
- * the reply subject. Use #natsConnection_Request() for automatically waiting
- * for a response inline.
+ * Publishes, on the given subject and with an optional reply subject, the
+ * concatenation of the `iovcnt` fragments of the `iov` array, for instance
+ * an envelope header followed by a body held in a separate buffer.
+ *
+ * The fragments are appended to the connection's buffer, or written along
+ * with it in a single gathering socket write for large messages, without
+ * first being copied into a temporary buffer.
  *
  * @param nc the pointer to the #natsConnection object.
- * @param subj the subject the request is sent to.
+ * @param subj the subject the data is sent to.
+ * @param reply the optional reply subject (can be `NULL`).
+ * @param iov the array of #natsIOVec fragments.
+ * @param iovcnt the number of fragments in the array.
+ */
+NATS_EXTERN natsStatus
+natsConnection_PublishV(natsConnection *nc, const char *subj,
+                        const char *reply, const natsIOVec *iov, int iovcnt);
+
+/** \brief Publishes an array of messages.
+ *
+ * Publishes the `count` messages of the `msgs` array, in order. This is
+ * equivalent to calling #natsConnection_PublishMsg() for each message, but
+ * the connection's lock is acquired only once and the flusher is signaled
+ * only once for the whole batch, which reduces the cost of publishing bursts
+ * of small messages.
+ *
+ * The subjects and payload sizes of all messages are validated before any
+ * message is sent. If an error occurs while writing the batch, the messages
+ * that precede the failing one may have been sent.
+ *
+ * @see #natsMsg_Create()
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param msgs the array of pointers to #natsMsg objects to send.
+ * @param count the number of messages in the array.
+ */
+NATS_EXTERN natsStatus
+natsConnection_PublishBatch(natsConnection *nc, natsMsg **msgs, int count);
+
+/** \brief Prepares a subject for repeated publishing.
+ *
+ * Validates the subject and optional reply subject, and encodes the
+ * beginning of the protocol header once. Messages published with
+ * #natsPublisher_Publish() then only need to encode the payload size,
+ * which is cheaper than calling #natsConnection_Publish() for applications
+ * sending many messages to a few fixed subjects.
+ *
+ * The subject and reply must not contain spaces, tabs, or line terminators.
+ *
+ * The publisher keeps a reference to the connection and must be destroyed
+ * with #natsPublisher_Destroy().
+ *
+ * @param newPub the location where to store the pointer to the newly
+ * created #natsPublisher object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subj the subject messages are published to.
+ * @param reply the optional reply subject, can be `NULL`.
+ */
+NATS_EXTERN natsStatus
+natsConnection_PreparePublish(natsPublisher **newPub, natsConnection *nc,
+                              const char *subj, const char *reply);
+
+/** \brief Publishes data on the prepared subject.
+ *
+ * Equivalent to #natsConnection_PublishRequest() (or
+ * #natsConnection_Publish() if no reply subject was given) with the subject
+ * and reply of the publisher. A #natsPublisher can be used by several
+ * threads at once.
+ *
+ * @param pub the pointer to the #natsPublisher object.
+ * @param data the data to send, can be `NULL`.
+ * @param dataLen the length of the data to send.
+ */
+NATS_EXTERN natsStatus
+natsPublisher_Publish(natsPublisher *pub, const void *data, int dataLen);
+
+/** \brief Destroys the #natsPublisher object.
+ *
+ * Releases the memory used by the publisher and its reference to the
+ * connection.
+ *
+ * @param pub the pointer to the #natsPublisher object to destroy.
+ */
+NATS_EXTERN void
+natsPublisher_Destroy(natsPublisher *pub);
+
+/** \brief Publishes data on a subject expecting replies on the given reply.
+ *
+ * Publishes the data argument to the given subject expecting a response on
+ * the reply subject. Use #natsConnection_Request() for automatically waiting
+ * for a response inline.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param subj the subject the request is sent to.
  * @param reply the reply on which resonses are expected.
  * @param data the data to be sent, can be `NULL`.
  * @param dataLen the length of the data to be sent.
@@ -1199,9 +2552,16 @@ natsConnection_PublishRequestString(natsConnection *nc, const char *subj,
 
 /** \brief Sends a request and waits for a reply.
  *
- * Creates a #natsInbox and performs a #natsConnection_PublishRequest() call
- * with the reply set to that inbox. Returns the first reply received.
- * This is optimized for the case of multiple responses.
+ * Performs a #natsConnection_PublishRequest() call with a reply subject
+ * unique to this request and returns the first reply received.
+ *
+ * The first request creates a subscription on a wildcard inbox
+ * (`_INBOX.<unique>.*`) that receives the replies of all requests made on
+ * this connection, so subsequent requests do not send any subscription
+ * protocol to the server. If the connection is closed while waiting,
+ * #NATS_CONNECTION_CLOSED is returned.
+ *
+ * @see #natsOptions_UseOldRequestStyle()
  *
  * @param replyMsg the location where to store the pointer to the received
  * #natsMsg reply.
@@ -1240,6 +2600,43 @@ natsConnection_RequestString(natsMsg **replyMsg, natsConnection *nc,
                              const char *subj, const char *str,
                              int64_t timeout);
 
+/** \brief Sends a request without waiting for the reply.
+ *
+ * Publishes the request, like #natsConnection_Request(), but returns
+ * without waiting. The reply, or the failure to get one, is reported to
+ * the #natsReplyHandler callback:
+ *
+ * - when the reply arrives, from the thread delivering the messages of the
+ * connection's response subscription.
+ * - when `timeout` milliseconds have elapsed without reply, or when the
+ * connection is closed, from the library's timer thread.
+ *
+ * This allows a single thread to have many requests in flight. Since the
+ * callback runs on library threads, it should not block.
+ *
+ * With #natsOptions_SetCallerDrivenIO(), the callback is instead invoked
+ * from #natsConnection_ProcessIO() when the reply arrives, and from
+ * #natsConnection_ProcessTimers() when the timeout has elapsed.
+ *
+ * Requests always use the connection's response subscription, even if
+ * #natsOptions_UseOldRequestStyle() is set.
+ *
+ * If this call returns an error, the callback is not invoked.
+ *
+ * @param nc the pointer to the #natsConnection object.
+ * @param subj the subject the request is sent to.
+ * @param data the data of the request, can be `NULL`.
+ * @param dataLen the length of the data.
+ * @param timeout in milliseconds, before the callback is invoked with
+ * #NATS_TIMEOUT if no reply has been received.
+ * @param cb the #natsReplyHandler callback.
+ * @param closure a pointer to an user defined object (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsConnection_RequestAsync(natsConnection *nc, const char *subj,
+                            const void *data, int dataLen, int64_t timeout,
+                            natsReplyHandler cb, void *closure);
+
 /** @} */ // end of connPubGroup
 
 /** \defgroup connSubGroup Subscribing
@@ -1267,6 +2664,115 @@ natsConnection_Subscribe(natsSubscription **sub, natsConnection *nc,
                          const char *subject, natsMsgHandler cb,
                          void *cbClosure);
 
+/** \brief Creates an asynchronous subscription delivering batches of messages.
+ *
+ * Similar to #natsConnection_Subscribe, but the #natsMsgBatchHandler
+ * callback is invoked with all messages pending for this subscription, up to
+ * `maxBatch` messages at a time. The pending messages are removed from the
+ * subscription in a single operation.
+ *
+ * When `maxWait` is positive and fewer than `maxBatch` messages are pending,
+ * the library waits up to `maxWait` milliseconds for more messages before
+ * invoking the callback. With `0`, the callback is invoked with whatever
+ * messages are pending.
+ *
+ * \note `maxWait` is ignored if the connection was created with
+ * #natsOptions_UseSharedDeliveryPool set to `true`, since a worker of the
+ * pool never waits for a subscription's messages.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subject the subject this subscription is created for.
+ * @param cb the #natsMsgBatchHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`). See
+ * the #natsMsgBatchHandler prototype.
+ * @param maxBatch the maximum number of messages passed to the callback
+ * (must be positive).
+ * @param maxWait the maximum time, in milliseconds, to wait for a full batch
+ * (`0` for no wait).
+ */
+NATS_EXTERN natsStatus
+natsConnection_SubscribeBatch(natsSubscription **sub, natsConnection *nc,
+                              const char *subject, natsMsgBatchHandler cb,
+                              void *cbClosure, int maxBatch, int64_t maxWait);
+
+/** \brief Creates an asynchronous subscription delivering messages from
+ *         several threads.
+ *
+ * Similar to #natsConnection_Subscribe, but the #natsMsgHandler callback is
+ * invoked concurrently by `workers` threads. The key of each message,
+ * returned by `keyCb`, decides which worker it goes to: messages with the
+ * same key are delivered in the order they were received, one at a time,
+ * while messages with different keys may be delivered in parallel. If
+ * `keyCb` is `NULL`, the key is a hash of the message's subject.
+ *
+ * The subscription's delivery thread hands the messages over to the
+ * workers. A worker holds up to a thousand messages, after which the
+ * messages are kept pending in the subscription, and the pending limits
+ * apply as usual (see #natsSubscription_SetPendingLimits). On close, the
+ * messages held by the workers are dropped.
+ *
+ * \note The subscription uses its own threads, even if the connection was
+ * created with #natsOptions_UseSharedDeliveryPool set to `true`. It can not
+ * be created on a connection with #natsOptions_SetCallerDrivenIO set to
+ * `true`.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subject the subject this subscription is created for.
+ * @param cb the #natsMsgHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`)
+ * passed to the callbacks.
+ * @param workers the number of threads invoking `cb` (must be positive).
+ * @param keyCb the #natsMsgKeyHandler callback (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsConnection_SubscribeKeyed(natsSubscription **sub, natsConnection *nc,
+                              const char *subject, natsMsgHandler cb,
+                              void *cbClosure, int workers,
+                              natsMsgKeyHandler keyCb);
+
+/** \brief Creates a subscription that streams the payload of messages.
+ *
+ * Instead of being assembled into a #natsMsg, the payload of the messages
+ * received on this subscription is handed over as it is read from the
+ * socket: `beginCb` is invoked with the subject and size of the message,
+ * then `chunkCb` with each part of the payload, then `endCb`. This allows
+ * large payloads to be written to a file or a socket without the library
+ * ever holding them in memory.
+ *
+ * The callbacks are invoked from the thread reading from the socket (or
+ * from #natsConnection_ProcessIO() for connections created with
+ * #natsOptions_SetCallerDrivenIO()), so nothing else is read from the
+ * connection while they run. They should not block for long, and must not
+ * call #natsConnection_Flush() or #natsConnection_Request() on the same
+ * connection.
+ *
+ * Such a subscription has no pending messages: #natsSubscription_NextMsg()
+ * can not be used and pending limits do not apply. If the subscription is
+ * closed in the middle of a message, no more callbacks are invoked for that
+ * message.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subject the subject this subscription is created for.
+ * @param beginCb the #natsStreamBeginHandler callback.
+ * @param chunkCb the #natsStreamChunkHandler callback.
+ * @param endCb the #natsStreamEndHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`)
+ * passed to the callbacks.
+ */
+NATS_EXTERN natsStatus
+natsConnection_SubscribeStream(natsSubscription **sub, natsConnection *nc,
+                               const char *subject,
+                               natsStreamBeginHandler beginCb,
+                               natsStreamChunkHandler chunkCb,
+                               natsStreamEndHandler endCb,
+                               void *cbClosure);
+
 /** \brief Creates a synchronous subcription.
  *
  * Similar to #natsConnection_Subscribe, but creates a synchronous subscription
@@ -1281,6 +2787,38 @@ NATS_EXTERN natsStatus
 natsConnection_SubscribeSync(natsSubscription **sub, natsConnection *nc,
                              const char *subject);
 
+/** \brief Creates subscriptions on several subjects at once.
+ *
+ * Similar to calling #natsConnection_Subscribe (or
+ * #natsConnection_SubscribeSync if `cb` is `NULL`) for each subject, but
+ * the protocols for all subscriptions are sent to the server in a single
+ * write. This is much faster when subscribing to thousands of subjects.
+ *
+ * If `timeout` is positive, this call also waits for a single PING/PONG
+ * with the server, as #natsConnection_FlushTimeout does, so that the
+ * subscriptions are known to be registered on return. If this fails, all
+ * subscriptions are unsubscribed and destroyed.
+ *
+ * If an error is returned, no subscription is created.
+ *
+ * @param subs an array of `count` locations where to store the pointers to
+ * the newly created #natsSubscription objects.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subjects the array of the `count` subjects to subscribe to.
+ * @param count the number of subjects.
+ * @param cb the #natsMsgHandler callback, invoked for the messages of all
+ * subscriptions.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`). See
+ * the #natsMsgHandler prototype.
+ * @param timeout the time, in milliseconds, to wait for the server to confirm
+ * the subscriptions, or `0` to not wait.
+ */
+NATS_EXTERN natsStatus
+natsConnection_SubscribeMany(natsSubscription **subs, natsConnection *nc,
+                             const char **subjects, int count,
+                             natsMsgHandler cb, void *cbClosure,
+                             int64_t timeout);
+
 /** \brief Creates an asynchronous queue subscriber.
  *
  * Creates an asynchronous queue subscriber on the given subject.
@@ -1303,6 +2841,42 @@ natsConnection_QueueSubscribe(natsSubscription **sub, natsConnection *nc,
                               const char *subject, const char *queueGroup,
                               natsMsgHandler cb, void *cbClosure);
 
+/** \brief Creates an asynchronous queue subscriber delivering messages from
+ *         several threads.
+ *
+ * Similar to #natsConnection_QueueSubscribe, but the #natsMsgHandler
+ * callback is invoked concurrently by `workers` threads, while the server
+ * sees a single member of the queue group. The messages are not delivered
+ * in any particular order: each one goes to the worker with the least
+ * messages to deliver, and a worker that has none takes over the oldest
+ * message of the busiest worker.
+ *
+ * As with #natsConnection_SubscribeKeyed, a worker holds up to a thousand
+ * messages, after which the messages are kept pending in the subscription,
+ * and the pending limits apply as usual. On close, the messages held by the
+ * workers are dropped.
+ *
+ * \note The subscription uses its own threads, even if the connection was
+ * created with #natsOptions_UseSharedDeliveryPool set to `true`. It can not
+ * be created on a connection with #natsOptions_SetCallerDrivenIO set to
+ * `true`.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subject the subject this subscription is created for.
+ * @param queueGroup the name of the group.
+ * @param cb the #natsMsgHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`). See
+ * the #natsMsgHandler prototype.
+ * @param workers the number of threads invoking `cb` (must be positive).
+ */
+NATS_EXTERN natsStatus
+natsConnection_QueueSubscribeWorkers(natsSubscription **sub, natsConnection *nc,
+                                     const char *subject, const char *queueGroup,
+                                     natsMsgHandler cb, void *cbClosure,
+                                     int workers);
+
 /** \brief Creates a synchronous queue subscriber.
  *
  * Similar to #natsConnection_QueueSubscribe, but creates a synchronous
@@ -1320,6 +2894,265 @@ natsConnection_QueueSubscribeSync(natsSubscription **sub, natsConnection *nc,
 
 /** @} */ // end of connSubGroup
 
+/** \defgroup connGroupGroup Connection Group
+ *
+ *  Spreading the load over several connections.
+ *  @{
+ */
+
+/** \brief Connects a group of connections.
+ *
+ * Creates `size` connections, all with the given options (or the default
+ * options if `options` is `NULL`). The call fails if any of them fails to
+ * connect.
+ *
+ * The publish calls of the group are spread over its connections according
+ * to `sharding`. With #NATS_GROUP_BY_SUBJECT, all messages published on a
+ * given subject go through the same connection, so they are received in the
+ * order they were published.
+ *
+ * @param newGroup the location where to store the pointer to the newly
+ * created #natsConnectionGroup object.
+ * @param options the options to use for all connections. Can be `NULL`.
+ * @param size the number of connections, at least 1.
+ * @param sharding the #natsGroupSharding policy.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_Connect(natsConnectionGroup **newGroup, natsOptions *options,
+                            int size, natsGroupSharding sharding);
+
+/** \brief Returns the number of connections in the group.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ */
+NATS_EXTERN int
+natsConnectionGroup_GetSize(natsConnectionGroup *group);
+
+/** \brief Returns one of the connections of the group.
+ *
+ * The connection is owned by the group and must not be closed or destroyed
+ * by the application.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param index the index of the connection, from 0 to the size of the group
+ * minus 1.
+ * @return the connection, or `NULL` if the index is out of range.
+ */
+NATS_EXTERN natsConnection*
+natsConnectionGroup_GetConnection(natsConnectionGroup *group, int index);
+
+/** \brief Returns the connection the group uses for a given subject.
+ *
+ * Returns the connection that #natsConnectionGroup_Publish() and
+ * #natsConnectionGroup_Subscribe() use for this subject. With
+ * #NATS_GROUP_ROUND_ROBIN, this is the connection used for subscriptions
+ * on this subject.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param subject the subject.
+ */
+NATS_EXTERN natsConnection*
+natsConnectionGroup_GetConnectionFor(natsConnectionGroup *group,
+                                     const char *subject);
+
+/** \brief Publishes data on a subject.
+ *
+ * Same as #natsConnection_Publish(), using the connection selected by the
+ * group's #natsGroupSharding policy.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param subj the subject the data is sent to.
+ * @param data the data to be sent, can be `NULL`.
+ * @param dataLen the length of the data to be sent.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_Publish(natsConnectionGroup *group, const char *subj,
+                            const void *data, int dataLen);
+
+/** \brief Publishes a string on a subject.
+ *
+ * Convenient function to publish a string. Same as
+ * #natsConnectionGroup_Publish() with the length of the string.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param subj the subject the data is sent to.
+ * @param str the string to be sent.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_PublishString(natsConnectionGroup *group, const char *subj,
+                                  const char *str);
+
+/** \brief Publishes a message.
+ *
+ * Same as #natsConnection_PublishMsg(), using the connection selected by
+ * the group's #natsGroupSharding policy.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param msg the pointer to the #natsMsg object to send.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_PublishMsg(natsConnectionGroup *group, natsMsg *msg);
+
+/** \brief Flushes all connections of the group.
+ *
+ * Performs a round trip to the server on each connection, and returns once
+ * all of them have completed, or when `timeout` milliseconds have elapsed.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param timeout in milliseconds, is the time allowed for all flushes to
+ * complete before #NATS_TIMEOUT error is returned.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_FlushTimeout(natsConnectionGroup *group, int64_t timeout);
+
+/** \brief Gets the statistics of the group.
+ *
+ * The counters of all connections are added up. If the connections record
+ * latencies, the histograms are merged.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param stats the pointer to a #natsStatistics object in which statistics
+ * will be copied.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_GetStats(natsConnectionGroup *group, natsStatistics *stats);
+
+/** \brief Creates an asynchronous subscription.
+ *
+ * Same as #natsConnection_Subscribe(), on the connection returned by
+ * #natsConnectionGroup_GetConnectionFor() for this subject.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param subject the subject this subscription is created for.
+ * @param cb the #natsMsgHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_Subscribe(natsSubscription **sub, natsConnectionGroup *group,
+                              const char *subject, natsMsgHandler cb,
+                              void *cbClosure);
+
+/** \brief Creates a synchronous subscription.
+ *
+ * Same as #natsConnection_SubscribeSync(), on the connection returned by
+ * #natsConnectionGroup_GetConnectionFor() for this subject.
+ *
+ * @param sub the location where to store the pointer to the newly created
+ * #natsSubscription object.
+ * @param group the pointer to the #natsConnectionGroup object.
+ * @param subject the subject this subscription is created for.
+ */
+NATS_EXTERN natsStatus
+natsConnectionGroup_SubscribeSync(natsSubscription **sub, natsConnectionGroup *group,
+                                  const char *subject);
+
+/** \brief Closes all connections of the group.
+ *
+ * @param group the pointer to the #natsConnectionGroup object.
+ */
+NATS_EXTERN void
+natsConnectionGroup_Close(natsConnectionGroup *group);
+
+/** \brief Destroys the group.
+ *
+ * Closes and destroys all connections of the group. The subscriptions
+ * created from the group still need to be destroyed by the application.
+ *
+ * @param group the pointer to the #natsConnectionGroup object to destroy.
+ */
+NATS_EXTERN void
+natsConnectionGroup_Destroy(natsConnectionGroup *group);
+
+/** @} */ // end of connGroupGroup
+
+/** \defgroup subMuxGroup Subscription Multiplexer
+ *
+ *  Many handlers on a single subscription.
+ *  @{
+ */
+
+/** \brief Creates a subscription multiplexer.
+ *
+ * Creates an asynchronous subscription on `subject`, which usually has
+ * wildcards, to which handlers for more specific subjects are then added
+ * with #natsSubscriptionMux_Add(). This has a single subscription on the
+ * server and a single delivery thread, instead of one of each per handler.
+ *
+ * Handlers are invoked from the subscription's delivery thread, in the
+ * order the messages are received. A message that matches no handler is
+ * dropped.
+ *
+ * @param newMux the location where to store the pointer to the newly
+ * created #natsSubscriptionMux object.
+ * @param nc the pointer to the #natsConnection object.
+ * @param subject the subject of the subscription on the server.
+ */
+NATS_EXTERN natsStatus
+natsSubscriptionMux_Create(natsSubscriptionMux **newMux, natsConnection *nc,
+                           const char *subject);
+
+/** \brief Adds a handler to the multiplexer.
+ *
+ * `cb` is invoked for the messages whose subject matches `subject`, which
+ * can have wildcards. If a handler was already added for the same subject,
+ * it is replaced. A message matching several handlers is passed to each of
+ * them: all but one get a copy of the message, and each needs to destroy
+ * the message it is given.
+ *
+ * Only the messages received by the multiplexer's subscription are routed,
+ * so `subject` should be included in the subject given to
+ * #natsSubscriptionMux_Create().
+ *
+ * @param mux the pointer to the #natsSubscriptionMux object.
+ * @param subject the subject of the messages handled by `cb`.
+ * @param cb the #natsMsgHandler callback.
+ * @param cbClosure a pointer to an user defined object (can be `NULL`).
+ */
+NATS_EXTERN natsStatus
+natsSubscriptionMux_Add(natsSubscriptionMux *mux, const char *subject,
+                        natsMsgHandler cb, void *cbClosure);
+
+/** \brief Removes a handler from the multiplexer.
+ *
+ * Returns #NATS_NOT_FOUND if no handler was added for this subject.
+ *
+ * \note The handler may still be invoked once for a message that was being
+ * routed when it was removed.
+ *
+ * @param mux the pointer to the #natsSubscriptionMux object.
+ * @param subject the subject given to #natsSubscriptionMux_Add().
+ */
+NATS_EXTERN natsStatus
+natsSubscriptionMux_Remove(natsSubscriptionMux *mux, const char *subject);
+
+/** \brief Returns the subscription of the multiplexer.
+ *
+ * The subscription can be used to set its pending limits or get its
+ * statistics. It is owned by the multiplexer and must not be destroyed by
+ * the application.
+ *
+ * @param mux the pointer to the #natsSubscriptionMux object.
+ */
+NATS_EXTERN natsSubscription*
+natsSubscriptionMux_GetSubscription(natsSubscriptionMux *mux);
+
+/** \brief Destroys the multiplexer.
+ *
+ * Unsubscribes and destroys the multiplexer's subscription. The messages
+ * not yet routed are dropped.
+ *
+ * \note A handler may still be invoked once for a message that was being
+ * routed when the multiplexer was destroyed.
+ *
+ * @param mux the pointer to the #natsSubscriptionMux object to destroy.
+ */
+NATS_EXTERN void
+natsSubscriptionMux_Destroy(natsSubscriptionMux *mux);
+
+/** @} */ // end of subMuxGroup
+
 /** @} */ // end of connGroup
 
 /** \defgroup subGroup Subscription
@@ -1341,6 +3174,33 @@ natsConnection_QueueSubscribeSync(natsSubscription **sub, natsConnection *nc,
 NATS_EXTERN natsStatus
 natsSubscription_NoDeliveryDelay(natsSubscription *sub);
 
+/** \brief Sets the delivery delay of an asynchronous subscription.
+ *
+ * When a message arrives while the subscription has no pending message,
+ * its delivery thread is woken up. By default, the thread then waits up to
+ * 1 millisecond for more messages to be pending before invoking the
+ * callback, which reduces the number of wake ups under high message rates.
+ *
+ * This call sets that trade-off between latency and throughput: the
+ * thread waits up to `maxDelay` milliseconds, or until `minPending`
+ * messages are pending. A `maxDelay` of 0, or a `minPending` of 1, means
+ * that messages are delivered as soon as they arrive (see
+ * #natsSubscription_NoDeliveryDelay).
+ *
+ * This applies only to asynchronous subscriptions created with
+ * #natsConnection_Subscribe() or #natsConnection_QueueSubscribe(), and not
+ * delivered by the shared delivery pool. #NATS_ILLEGAL_STATE is returned
+ * otherwise.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param minPending the number of pending messages that ends the wait.
+ * @param maxDelay the max time, in milliseconds, to wait after the first
+ * message arrives.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_SetDeliveryDelay(natsSubscription *sub, int minPending,
+                                  int64_t maxDelay);
+
 /** \brief Returns the next available message.
  *
  * Return the next message available to a synchronous subscriber or block until
@@ -1360,6 +3220,67 @@ NATS_EXTERN natsStatus
 natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub,
                          int64_t timeout);
 
+/** \brief Returns the next available messages.
+ *
+ * Similar to #natsSubscription_NextMsg(), but waits up to `timeout`
+ * milliseconds for at least one message to be available, and then removes
+ * up to `max` pending messages from the subscription in one operation.
+ *
+ * If the subscription has an auto-unsubscribe limit (see
+ * #natsSubscription_AutoUnsubscribe()), no more messages than that limit
+ * are returned.
+ *
+ * The messages belong to the application, which needs to destroy each of
+ * them with #natsMsg_Destroy.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param msgs the array, of at least `max` elements, where to store the
+ * pointers to the messages.
+ * @param max the maximum number of messages to return.
+ * @param timeout time, in milliseconds, after which this call will return
+ * #NATS_TIMEOUT if no message is available.
+ * @param count the location where to store the number of messages returned.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_NextMsgs(natsSubscription *sub, natsMsg **msgs, int max,
+                          int64_t timeout, int *count);
+
+/** \brief Returns the next available message, owned by the subscription.
+ *
+ * Same as #natsSubscription_NextMsg(), except that the returned message
+ * remains owned by the subscription: it must not be destroyed, and is valid
+ * until the next call to this function or to #natsSubscription_ReleaseMsg()
+ * for this subscription, or until the subscription is destroyed.
+ *
+ * Releasing the message returns its storage directly to the connection's
+ * message pool, or to the read buffer it references, so that with
+ * #natsOptions_SetMsgPoolSize() the synchronous consumer does not allocate
+ * memory in steady state.
+ *
+ * \warning Since each call releases the previously returned message, this
+ * should be used by a single consumer thread per subscription.
+ *
+ * @param nextMsg the location where to store the pointer to the next
+ * available message.
+ * @param sub the pointer to the #natsSubscription object.
+ * @param timeout time, in milliseconds, after which this call will return
+ * #NATS_TIMEOUT if no message is available.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_NextMsgBorrowed(natsMsg **nextMsg, natsSubscription *sub,
+                                 int64_t timeout);
+
+/** \brief Releases the message returned by #natsSubscription_NextMsgBorrowed().
+ *
+ * Releases the message lent by the last call to
+ * #natsSubscription_NextMsgBorrowed(), if any. The message must not be
+ * used after this call.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ */
+NATS_EXTERN void
+natsSubscription_ReleaseMsg(natsSubscription *sub);
+
 /** \brief Unsubscribes.
  *
  * Removes interest on the subject. Asynchronous subscription may still have
@@ -1371,6 +3292,27 @@ natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub,
 NATS_EXTERN natsStatus
 natsSubscription_Unsubscribe(natsSubscription *sub);
 
+/** \brief Unsubscribes several subscriptions at once.
+ *
+ * Similar to calling #natsSubscription_Unsubscribe for each subscription,
+ * but the protocols are sent to the server in a single write. All
+ * subscriptions must belong to the same connection.
+ *
+ * If `timeout` is positive, this call also waits for a single PING/PONG
+ * with the server, as #natsConnection_FlushTimeout does.
+ *
+ * The subscriptions still need to be destroyed with
+ * #natsSubscription_Destroy.
+ *
+ * @param subs the array of the `count` pointers to #natsSubscription objects.
+ * @param count the number of subscriptions.
+ * @param timeout the time, in milliseconds, to wait for the server to process
+ * the protocols, or `0` to not wait.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_UnsubscribeMany(natsSubscription **subs, int count,
+                                 int64_t timeout);
+
 /** \brief Auto-Unsubscribes.
  *
  * This call issues an automatic #natsSubscription_Unsubscribe that is
@@ -1395,6 +3337,107 @@ natsSubscription_AutoUnsubscribe(natsSubscription *sub, int max);
 NATS_EXTERN natsStatus
 natsSubscription_QueuedMsgs(natsSubscription *sub, uint64_t *queuedMsgs);
 
+/** \brief Sets the limits for pending messages and bytes.
+ *
+ * Overrides, for this subscription, the limits set with
+ * #natsOptions_SetMaxPendingMsgs and #natsOptions_SetMaxPendingBytes.
+ * Inbound messages that would make the subscription go over either limit
+ * are dropped and #NATS_SLOW_CONSUMER is reported.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param msgLimit the limit in number of messages.
+ * @param bytesLimit the limit in number of bytes.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_SetPendingLimits(natsSubscription *sub, int msgLimit,
+                                  int64_t bytesLimit);
+
+/** \brief Returns the limits for pending messages and bytes.
+ *
+ * Any of the locations can be `NULL` if that value is not needed.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param msgLimit the location where to store the limit in number of messages.
+ * @param bytesLimit the location where to store the limit in number of bytes.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_GetPendingLimits(natsSubscription *sub, int *msgLimit,
+                                  int64_t *bytesLimit);
+
+/** \brief Returns the number of pending messages and bytes.
+ *
+ * Returns the number of messages queued in the client for this
+ * subscription, and the total size of their payloads. Any of the locations
+ * can be `NULL` if that value is not needed.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param msgs the location where to store the number of pending messages.
+ * @param bytes the location where to store the number of pending bytes.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_GetPending(natsSubscription *sub, int *msgs, int64_t *bytes);
+
+/** \brief Returns the high-water marks of pending messages and bytes.
+ *
+ * Returns the highest number of messages, and of bytes, that have been
+ * pending for this subscription since it was created, or since the last
+ * call to #natsSubscription_ClearMaxPending. Any of the locations can be
+ * `NULL` if that value is not needed.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param msgs the location where to store the max number of pending messages.
+ * @param bytes the location where to store the max number of pending bytes.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_GetMaxPending(natsSubscription *sub, int *msgs,
+                               int64_t *bytes);
+
+/** \brief Resets the high-water marks of pending messages and bytes.
+ *
+ * @see natsSubscription_GetMaxPending()
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_ClearMaxPending(natsSubscription *sub);
+
+/** \brief Returns the statistics of the subscription.
+ *
+ * Returns, for this subscription:
+ *
+ * - the number of pending messages and bytes, as
+ * #natsSubscription_GetPending.
+ * - their high-water marks, as #natsSubscription_GetMaxPending.
+ * - the number of messages delivered to the callback or returned by
+ * #natsSubscription_NextMsg.
+ * - the number of messages dropped because the pending limits were reached
+ * (see #natsSubscription_SetPendingLimits).
+ * - the total time, in microseconds, spent in the message callback. This
+ * is measured only if the connection records latencies (see
+ * #natsOptions_SetLatencyStats), and is 0 otherwise.
+ *
+ * \note You can pass `NULL` to any of the values your are not interested in
+ * getting.
+ *
+ * @param sub the pointer to the #natsSubscription object.
+ * @param pendingMsgs the number of pending messages.
+ * @param pendingBytes the number of pending bytes.
+ * @param maxPendingMsgs the max number of pending messages.
+ * @param maxPendingBytes the max number of pending bytes.
+ * @param deliveredMsgs the number of delivered messages.
+ * @param droppedMsgs the number of dropped messages.
+ * @param callbackTime the time spent in the callback, in microseconds.
+ */
+NATS_EXTERN natsStatus
+natsSubscription_GetStats(natsSubscription *sub,
+                          int     *pendingMsgs,
+                          int64_t *pendingBytes,
+                          int     *maxPendingMsgs,
+                          int64_t *maxPendingBytes,
+                          int64_t *deliveredMsgs,
+                          int64_t *droppedMsgs,
+                          int64_t *callbackTime);
+
 /** \brief Checks the validity of the subscription.
  *
  * Returns a boolean indicating whether the subscription is still active.
@@ -24,6 +24,7 @@
 #include "err.h"
 #include "nats.h"
 #include "buf.h"
+#include "chain.h"
 #include "parser.h"
 #include "timer.h"
 #include "url.h"
@@ -33,6 +34,10 @@
 #include "hash.h"
 #include "stats.h"
 #include "natstime.h"
+#include "evloop.h"
+#include "dlvpool.h"
+#include "codec.h"
+#include "capture.h"
 
 // Comment/uncomment to replace some function calls with direct structure
 // access
@@ -94,6 +99,7 @@ typedef struct __natsServerInfo
     bool        authRequired;
     bool        tlsRequired;
     int64_t     maxPayload;
+    int         proto;
 
 } natsServerInfo;
 
@@ -118,6 +124,7 @@ struct __natsOptions
     char                    **servers;
     int                     serversCount;
     bool                    noRandomize;
+    natsServerSelection     serverSelection;
     int64_t                 timeout;
     char                    *name;
     bool                    verbose;
@@ -126,6 +133,8 @@ struct __natsOptions
     bool                    secure;
     int                     maxReconnect;
     int64_t                 reconnectWait;
+    int64_t                 reconnectMaxWait;
+    int64_t                 reconnectJitter;
 
     natsConnectionHandler   closedCb;
     void                    *closedCbClosure;
@@ -139,20 +148,125 @@ struct __natsOptions
     natsErrHandler          asyncErrCb;
     void                    *asyncErrCbClosure;
 
+    natsThreadStartHandler  threadStartCb;
+    void                    *threadStartCbClosure;
+
     int64_t                 pingInterval;
     int                     maxPingsOut;
     int                     maxPendingMsgs;
+    int64_t                 maxPendingBytes;
+
+    // Max number of bytes buffered in memory while reconnecting (no limit
+    // if 0), and what to do when that limit is reached.
+    int64_t                 reconnectBufSize;
+    natsReconnectBufPolicy  reconnectBufPolicy;
+
+    // Watermarks of the outbound buffered bytes (disabled if 'writeHWM' is
+    // 0), policy applied to publishers over the high one, and how long (in
+    // ms, no limit if 0) they may wait with NATS_WATERMARK_BLOCK.
+    int64_t                 writeHWM;
+    int64_t                 writeLWM;
+    natsWatermarkPolicy     writeWMPolicy;
+    int64_t                 writeWMTimeout;
+
+    natsWatermarkHandler    watermarkCb;
+    void                    *watermarkCbClosure;
+
+    // Flush policy, the max linger time is in microseconds.
+    natsFlushPolicy         flushPolicy;
+    int64_t                 flushMaxLinger;
+    int                     flushMaxBytes;
+
+    // Delay (in ms) between the start of two connection attempts, and
+    // number of servers raced during the initial connect.
+    int64_t                 connectAttemptDelay;
+    int                     connectMaxServers;
+
+    // Max number of free blocks per size class in the connection's
+    // message pool. The pool is disabled if 0.
+    int                     msgPoolSize;
+
+    // If true, the connection records latency histograms.
+    bool                    latencyStats;
+
+    // Busy-poll spin budget, in microseconds (disabled if 0).
+    int64_t                 busyPoll;
 
     natsSSLCtx              *sslCtx;
+
+    // If true, the TLS encryption is offloaded to the kernel when possible.
+    // Otherwise, if 'tlsBatchRecords' is true, the flusher tries to fill
+    // TLS records before writing.
+    bool                    kernelTLS;
+    bool                    tlsBatchRecords;
+
+    // If true, the connection's socket is handled by one of the library's
+    // shared event loops instead of dedicated readLoop and flusher threads.
+    bool                    useSharedEvLoop;
+
+    // If true, asynchronous subscriptions' callbacks are invoked by the
+    // library's shared delivery pool instead of a thread per subscription.
+    bool                    useSharedDlvPool;
+
+    // If true, the connection has no threads of its own: the application
+    // invokes natsConnection_ProcessIO() and natsConnection_ProcessTimers().
+    bool                    callerDrivenIO;
+
+    // Invoked (with the connection's write lock held) when a caller driven
+    // connection buffers data, see natsOptions_SetWriteInterestCB().
+    natsConnectionHandler   writeInterestCb;
+    void                    *writeInterestCbClosure;
+
+    // If true, each natsConnection_Request() call creates its own inbox and
+    // subscription instead of using the connection's response subscription.
+    bool                    useOldRequestStyle;
+
+    // Codec used to encode/decode payloads, see natsOptions_SetPayloadCodec().
+    int                     codecId;
+    natsPayloadEncoder      codecEncoder;
+    natsPayloadDecoder      codecDecoder;
+    void                    *codecClosure;
+    int                     codecMinSize;
+
+    // If true, published messages are delivered directly to the matching
+    // subscriptions of the connection, see natsOptions_SetLocalDelivery().
+    bool                    localDelivery;
+
+    // Sizes of the buffers the connection reads the socket into and
+    // accumulates outgoing protocols in.
+    int                     readBufSize;
+    int                     writeBufSize;
+
+    // If set, the bytes read from the socket are recorded in this file.
+    char                    *captureFile;
 };
 
-typedef struct __natsMsgList
+// A worker of a keyed subscription (see natsConnection_SubscribeKeyed()).
+// The subscription's delivery thread pushes the messages of a given key to
+// the same worker, which invokes the callback for them in order.
+typedef struct __natsSubWorker
 {
-    natsMsg     *head;
-    natsMsg     *tail;
-    int         count;
+    natsMutex                   *mu;
+    natsCondition               *cond;
+
+    // The delivery thread is the only producer, the worker the consumer.
+    natsMsgQueue                msgList;
+
+    // Same as the subscription's 'inWait', for the worker's condition.
+    int32_t                     inWait;
+
+    // Set when the delivery thread waits for room in 'msgList'.
+    bool                        full;
+
+    // The worker stops at once when closed, or once 'msgList' is empty
+    // when draining.
+    bool                        closed;
+    bool                        draining;
 
-} natsMsgList;
+    natsThread                  *thread;
+    struct __natsSubscription   *sub;
+
+} natsSubWorker;
 
 struct __natsSubscription
 {
@@ -169,15 +283,28 @@ struct __natsSubscription
     // have reached the max number of messages.
     uint64_t                    delivered;
 
-    // The list of messages waiting to be delivered to the callback (or
-    // returned from NextMsg).
-    natsMsgList                 msgList;
+    // The queue of messages waiting to be delivered to the callback (or
+    // returned from NextMsg). The connection pushes to it without holding
+    // the subscription's lock, the consumer pops from it with the lock held.
+    natsMsgQueue                msgList;
 
-    // The max number of messages that should go in msgList.
+    // The max number of messages, and of payload bytes, that should go
+    // in msgList.
     int                         pendingMax;
+    int64_t                     pendingBytesMax;
+
+    // The highest number of messages and bytes seen in msgList (atomically
+    // updated).
+    int32_t                     pendingMsgsHWM;
+    int64_t                     pendingBytesHWM;
+
+    // Non zero if msgList is over one of the limits (atomically updated).
+    int32_t                     slowConsumer;
 
-    // True if msgList.count is over pendingMax
-    bool                        slowConsumer;
+    // Number of messages dropped because of the limits, and total time
+    // spent in the callbacks, in nanoseconds (atomically updated).
+    int64_t                     dropped;
+    int64_t                     cbTime;
 
     // If 'true', the connection will notify the deliveryThread when a
     // message arrives (if the delivery thread is in wait).
@@ -186,24 +313,18 @@ struct __natsSubscription
     // Condition variable used to wait for message delivery.
     natsCondition               *cond;
 
-    // When 'noDelay' is false, a timer is used to check for the need
-    // to notify the deliveryMsg thread.
-    natsTimer                   *signalTimer;
-
-    // Interval of the above timer.
-    int64_t                     signalTimerInterval;
-
-    // Indicates the number of time the signal timer failed to try to
-    // acquire the lock (after which it will call Lock()).
-    int                         signalFailCount;
-
-    // Temporarily voids the use of the signalTimer when the message list
-    // count reaches a certain threshold.
+    // The connection signals the condition when a message is added to an
+    // empty list, or when the list count reaches 'signalLimit'. Once woken
+    // up by the first message, the delivery thread waits up to
+    // 'signalDelay' milliseconds for the count to reach 'signalLimit' so
+    // that messages are delivered in one go (0 favors latency).
     int                         signalLimit;
+    int64_t                     signalDelay;
 
     // This is > 0 when the delivery thread (or NextMsg) goes into a
-    // condition wait.
-    int                         inWait;
+    // condition wait (atomically updated). The connection checks it after
+    // pushing a message to know if it needs to signal the condition.
+    int32_t                     inWait;
 
     // The subscriber is closed (or closing).
     bool                        closed;
@@ -219,6 +340,10 @@ struct __natsSubscription
     // than the received subject inside a Msg if this is a wildcard.
     char                        *subject;
 
+    // If the subject has no wildcard, the shared copy referenced by the
+    // messages received on this subscription.
+    natsSubject                 *literalSubj;
+
     // Optional queue group name. If present, all subscriptions with the
     // same name will form a distributed queue, and each message will
     // only be processed by one member of the group.
@@ -230,16 +355,133 @@ struct __natsSubscription
     // Delivery thread (for async subscription).
     natsThread                  *deliverMsgsThread;
 
+    // If not NULL, the shared pool delivering this subscription's messages
+    // (instead of the delivery thread), and the worker it is assigned to.
+    natsDlvPool                 *dlvPool;
+    int                         dlvWorker;
+
+    // Set to 1 (atomically) while the subscription is in a worker's run
+    // queue or being delivered.
+    int32_t                     dlvScheduled;
+
+    // Link in the worker's run queue (or in the connection's inline run
+    // queue).
+    struct __natsSubscription   *dlvNext;
+
+    // If true, the messages are delivered from natsConnection_ProcessIO()
+    // (the connection has caller driven I/O).
+    bool                        inlineDlv;
+
     // Message callback and closure (for async subscription).
     natsMsgHandler              msgCb;
     void                        *msgCbClosure;
 
+    // Batch callback (instead of the message callback, for subscriptions
+    // created with natsConnection_SubscribeBatch), the max number of
+    // messages per batch and the max time (in ms) to wait for a full batch.
+    natsMsgBatchHandler         batchCb;
+    int                         maxBatch;
+    int64_t                     maxWait;
+
+    // Array of 'maxBatch' messages passed to the batch callback.
+    natsMsg                     **batchMsgs;
+
+    // Message lent by natsSubscription_NextMsgBorrowed(), owned by the
+    // subscription until the next such call or natsSubscription_ReleaseMsg().
+    natsMsg                     *borrowedMsg;
+
+    // For subscriptions created with natsConnection_SubscribeStream(), the
+    // payload of messages is handed over to these callbacks as it is read.
+    bool                        streaming;
+    natsStreamBeginHandler      streamBeginCb;
+    natsStreamChunkHandler      streamChunkCb;
+    natsStreamEndHandler        streamEndCb;
+
+    // For subscriptions created with natsConnection_SubscribeKeyed(), the
+    // workers invoking the message callback, and the callback returning the
+    // key of a message (if NULL, the hash of the subject is used).
+    natsSubWorker               *workers;
+    int                         workersCount;
+    natsMsgKeyHandler           keyCb;
+
+    // Set for natsConnection_QueueSubscribeWorkers(): messages go to the
+    // least busy worker instead of the one of their key, and idle workers
+    // steal from the others.
+    bool                        balanced;
+
+    // For the subscription of a natsSubscriptionMux, the multiplexer, which
+    // is freed with the subscription.
+    struct __natsSubscriptionMux *mux;
+
+};
+
+// A request waiting for its reply on the connection's response subscription.
+typedef struct __natsRespInfo
+{
+    natsCondition       *cond;
+    natsMsg             *msg;
+    bool                closed;
+
+    // Set by natsConnection_RequestAsync(): the outcome is reported to 'cb'
+    // by whoever removes the request from the response map, the response
+    // handler or the timer. The timer's stop callback frees the object.
+    // With caller driven I/O, there is no timer: the request expires at
+    // 'deadline', and the response handler or the callback info frees it.
+    natsReplyHandler    cb;
+    void                *closure;
+    natsConnection      *nc;
+    natsTimer           *timer;
+    int64_t             deadline;
+    int64_t             id;
+    int64_t             start;
+
+} natsRespInfo;
+
+// A subject (and optional reply) for which the PUB protocol header, up to
+// the size, has been encoded once (see natsConnection_PreparePublish()).
+struct __natsPublisher
+{
+    natsConnection      *nc;
+
+    // "PUB <subject> [reply ]" followed by room for the size and CRLF.
+    char                *hdr;
+    int                 prefixLen;
+    int                 subjLen;
+    int                 replyLen;
+
+};
+
+struct __natsConnectionGroup
+{
+    natsConnection      **conns;
+    int                 size;
+    natsGroupSharding   sharding;
+
+    // Incremented atomically to select the connection for round robin.
+    int32_t             next;
+
 };
 
+// An asynchronous flush waiting for a PONG (see natsConnection_FlushAsync).
+typedef struct __natsFlushReq
+{
+    natsFlushHandler        cb;
+    void                    *closure;
+
+    struct __natsFlushReq   *next;
+
+} natsFlushReq;
+
 typedef struct __natsPong
 {
     int64_t             id;
 
+    // Non NULL if the PING was sent for asynchronous flushes, in which
+    // case the pong is owned by the list. 'writes' is the connection's
+    // 'writes' count once the PING was written.
+    natsFlushReq        *flushReqs;
+    int64_t             writes;
+
     struct __natsPong   *prev;
     struct __natsPong   *next;
 
@@ -253,6 +495,11 @@ typedef struct __natsPongList
     int64_t             incoming;
     int64_t             outgoingPings;
 
+    // Id and send time (in nanoseconds) of the outstanding PING sent by
+    // the ping timer, used to measure the round-trip time to the server.
+    int64_t             timerPingId;
+    int64_t             timerPingSent;
+
     natsPong            cached;
 
     natsCondition       *cond;
@@ -266,18 +513,32 @@ typedef struct __natsSockCtx
 
     // We switch to blocking socket after receiving the PONG to the first PING
     // during the connect process. Should we make all read/writes non blocking,
-    // then we will use two different fd sets, and also probably pass deadlines
-    // individually as opposed to use one at the connection level.
-    fd_set          *fdSet;
+    // then we will probably pass deadlines individually as opposed to use one
+    // at the connection level.
     natsDeadline    deadline;
 
     SSL             *ssl;
 
+    // True if the kernel encrypts the data written to the socket (kTLS).
+    bool            ktlsSend;
+
 } natsSockCtx;
 
 struct __natsConnection
 {
     natsMutex           *mu;
+
+    // Protects the write path, that is 'bw', 'scratch', 'pending' and
+    // 'usePending', the socket writes and the flusher's state. It is acquired
+    // after 'mu' when both are needed, and is also held when 'status' and
+    // 'info' are updated so that publishers only need this lock.
+    natsMutex           *wmu;
+
+    // Protects 'subs' for the read path. The map is updated with both 'mu'
+    // and 'subsMu' held, so holding either one is enough to read it. It is
+    // acquired after 'mu' when both are needed.
+    natsMutex           *subsMu;
+
     natsOptions         *opts;
     const natsUrl       *url;
 
@@ -287,12 +548,24 @@ struct __natsConnection
 
     natsSrvPool         *srvPool;
 
-    natsBuffer          *pending;
+    // Data written while reconnecting. It is replayed, and consumed, from
+    // the front of the chain once reconnected. With the
+    // NATS_RECONNECT_BUF_SPILL policy, data that does not fit is appended
+    // to 'pendingFile' (while 'pendingToFile' is set), which is read back
+    // from offset 'pendingFileRead'.
+    natsChain           *pending;
     bool                usePending;
+    FILE                *pendingFile;
+    int64_t             pendingFileSize;
+    int64_t             pendingFileRead;
+    bool                pendingToFile;
 
     natsBuffer          *bw;
     natsBuffer          *scratch;
 
+    // Number of writes to the connection. Protected by 'wmu'.
+    int64_t             writes;
+
     natsServerInfo      info;
 
     int64_t             ssid;
@@ -303,9 +576,32 @@ struct __natsConnection
     char                errStr[256];
 
     natsParser          *ps;
+
+    // Slab the socket is read into. 'curSlab' is set to this slab while
+    // parsing a read whose messages can reference the slab directly.
+    natsMsgSlab         *readSlab;
+    natsMsgSlab         *curSlab;
+
+    // Pool used to allocate inbound messages (can be NULL).
+    natsMsgPool         *msgPool;
+
+    // Subjects of messages received on wildcard subscriptions, shared by
+    // those messages. Accessed with 'subsMu' held, created on first use.
+    natsStrHash         *subjCache;
+
+    // NATS_LATENCY_TYPES histograms, or NULL if latencies are not recorded.
+    natsHistogram       *latency;
+
     natsTimer           *ptmr;
     int                 pout;
 
+    // Number of reads from the socket (atomically updated by the thread
+    // reading), and its value at the last tick of the PING timer or the
+    // last PONG (protected by 'mu'). The timer does not send a PING if
+    // data was received in the meantime.
+    int64_t             reads;
+    int64_t             pingReads;
+
     natsPongList        pongs;
 
     natsThread          *readLoopThread;
@@ -314,10 +610,82 @@ struct __natsConnection
     natsCondition       *flusherCond;
     bool                flusherSignaled;
     bool                flusherStop;
+    bool                flusherLingering;
 
-    natsThread          *reconnectThread;
+    // Used by the adaptive flush policy: time (in nanoseconds) of the last
+    // publish, average interval between publishes, and whether the
+    // connection was idle before the current flush request.
+    int64_t             flusherLastKick;
+    int64_t             flusherAvgInterval;
+    bool                flusherWasIdle;
+
+    // Set once the outbound buffered bytes reach the high watermark, until
+    // they drop to the low one. Publishers blocked by the watermarks wait
+    // on 'wmCond'. Protected by 'wmu'.
+    bool                wmHigh;
+    natsCondition       *wmCond;
 
-    natsStatistics      stats;
+    natsThread          *reconnectThread;
+    natsCondition       *reconnectCond;
+
+    // State of the pseudo random generator of the reconnect jitter, seeded
+    // differently by each connection. Protected by 'mu'.
+    uint64_t            reconnectRnd;
+
+    // Set when the connection's socket is handled by a shared event loop.
+    natsEvLoopConn      *evConn;
+
+    // Set when the connection was detached from the event loop from within
+    // one of the loop's callbacks. The callback then does the socket cleanup.
+    bool                evLoopCleanup;
+
+    // With caller driven I/O: the subscriptions that have messages to be
+    // delivered from natsConnection_ProcessIO() (protected by 'subsMu'), the
+    // connection's callbacks to invoke from the application's thread
+    // (protected by 'mu'), and when the next PING is due (in milliseconds).
+    natsSubscription    *inlineSubs;
+    natsSubscription    *inlineSubsTail;
+    natsAsyncCbInfo     *inlineCbs;
+    natsAsyncCbInfo     *inlineCbsTail;
+    int64_t             nextPing;
+
+    // The callbacks to be invoked by the library's threads, the next
+    // connection in the library's list of those that have callbacks, and
+    // whether the connection is in that list or being dispatched (protected
+    // by the library's callbacks lock).
+    natsAsyncCbInfo     *asyncCbs;
+    natsAsyncCbInfo     *asyncCbsTail;
+    struct __natsConnection *asyncCbsNext;
+    bool                asyncCbsScheduled;
+
+    // Number of subscriptions created with natsConnection_SubscribeStream().
+    // The parser looks up the subscription of a message when it starts only
+    // if there are some.
+    int32_t             streamSubs;
+
+    // Encodes published payloads and decodes received ones, if the options
+    // have a codec.
+    natsCodec           *codec;
+
+    // Records the bytes read from the socket, if the options have a
+    // capture file.
+    natsCapture         *capture;
+
+    // True if the options ask for local delivery and the server supports
+    // not sending back the messages we publish (protected by 'wmu').
+    bool                localDlv;
+
+    // Used by natsConnection_Request(): replies are sent to the subject
+    // "<respPrefix><id>" and received by the single wildcard subscription
+    // 'respMux', which hands them to the natsRespInfo found in 'respMap'
+    // under that id.
+    char                *respPrefix;
+    int                 respPrefixLen;
+    natsSubscription    *respMux;
+    natsHash            *respMap;
+    int64_t             respId;
+
+    natsConnStats       stats;
 };
 
 //
@@ -338,22 +706,50 @@ nats_resetTimer(natsTimer *t, int64_t newInterval);
 void
 nats_stopTimer(natsTimer *t);
 
+// Reserves room for a new timer in the library's timers heap, which is
+// released with nats_unreserveTimer() when the timer is freed.
+natsStatus
+nats_reserveTimer(void);
+
+void
+nats_unreserveTimer(void);
+
 // Returns the number of timers that have been created and not stopped.
 int
 nats_getTimersCount(void);
 
-// Returns the number of timers actually in the list. This should be
+// Returns the number of timers actually in the heap. This should be
 // equal to nats_getTimersCount() or nats_getTimersCount() - 1 when a
 // timer thread is invoking a timer's callback.
 int
 nats_getTimersCountInList(void);
 
+// Indicates which of the library's threads, started on first use, are
+// running.
+void
+nats_getLibThreadsStarted(bool *timers, bool *asyncCbs, bool *gc);
+
 natsStatus
 nats_postAsyncCbInfo(natsAsyncCbInfo *info);
 
+// Returns true if an error callback for 'sub' and 'err' is queued and not
+// yet invoked, in which case a new one does not need to be posted.
+bool
+nats_coalesceAsyncErr(natsConnection *nc, natsSubscription *sub,
+                      natsStatus err);
+
+natsStatus
+nats_getEvLoop(natsEvLoop **loop);
+
+natsStatus
+nats_getDlvPool(natsDlvPool **pool);
+
 void
 nats_sslRegisterThreadForCleanup(void);
 
+void
+nats_threadStarted(natsThreadRole role, natsOptions *opts);
+
 natsStatus
 nats_sslInit(void);
 
@@ -377,6 +773,9 @@ natsThread_Detach(natsThread *t);
 void
 natsThread_Destroy(natsThread *t);
 
+void
+natsThread_SetName(const char *name);
+
 natsStatus
 natsThreadLocal_CreateKey(natsThreadLocal *tl, void (*destructor)(void*));
 
@@ -411,6 +810,12 @@ natsStatus
 natsCondition_AbsoluteTimedWait(natsCondition *cond, natsMutex *mutex,
                                 int64_t absoluteTime);
 
+// Same as natsCondition_AbsoluteTimedWait(), but the absolute time is
+// expressed in nanoseconds (see nats_NowInNanoSeconds()).
+natsStatus
+natsCondition_AbsoluteTimedWaitNano(natsCondition *cond, natsMutex *mutex,
+                                    int64_t absoluteTime);
+
 void
 natsCondition_Signal(natsCondition *cond);
 
@@ -423,8 +828,17 @@ natsCondition_Destroy(natsCondition *cond);
 //
 // Mutexes
 //
+#define NATS_LOCK_ROLES (NATS_LOCK_EVENT_LOOP + 1)
+
+#if defined(NATS_LOCK_STATS)
+// Per role counters, atomically updated by natsMutex_Lock().
+extern natsLockStats gLockStats[NATS_LOCK_ROLES];
+#endif
+
+#define natsMutex_Create(m) natsMutex_CreateEx((m), NATS_LOCK_OTHER)
+
 natsStatus
-natsMutex_Create(natsMutex **newMutex);
+natsMutex_CreateEx(natsMutex **newMutex, natsLockRole role);
 
 void
 natsMutex_Lock(natsMutex *m);
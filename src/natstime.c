@@ -50,10 +50,8 @@ nats_NowInNanoSeconds(void)
 void
 natsDeadline_Init(natsDeadline *deadline, int64_t timeout)
 {
-    deadline->active          = true;
-    deadline->absoluteTime    = nats_Now() + timeout;
-    deadline->timeout.tv_sec  = (long) timeout / 1000;
-    deadline->timeout.tv_usec = (timeout % 1000) * 1000;
+    deadline->active        = true;
+    deadline->absoluteTime  = nats_Now() + timeout;
 }
 
 void
@@ -62,18 +60,15 @@ natsDeadline_Clear(natsDeadline *deadline)
     deadline->active = false;
 }
 
-struct timeval*
+int64_t
 natsDeadline_GetTimeout(natsDeadline *deadline)
 {
     int64_t timeout;
 
     if (!(deadline->active))
-        return NULL;
+        return -1;
 
     timeout = deadline->absoluteTime - nats_Now();
 
-    deadline->timeout.tv_sec  = (long) (timeout / 1000);
-    deadline->timeout.tv_usec = (timeout % 1000) * 1000;
-
-    return &(deadline->timeout);
+    return (timeout > 0 ? timeout : 0);
 }
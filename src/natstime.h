@@ -9,7 +9,6 @@
 typedef struct __natsDeadline
 {
     int64_t             absoluteTime;
-    struct timeval      timeout;
     bool                active;
 
 } natsDeadline;
@@ -17,7 +16,9 @@ typedef struct __natsDeadline
 void
 natsDeadline_Init(natsDeadline *deadline, int64_t timeout);
 
-struct timeval*
+// Returns the number of milliseconds left before the deadline (0 if it has
+// passed), or -1 if the deadline is not active.
+int64_t
 natsDeadline_GetTimeout(natsDeadline *deadline);
 
 void
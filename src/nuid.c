@@ -0,0 +1,74 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include <string.h>
+
+#include "nuid.h"
+#include "util.h"
+
+static const char *digits = "0123456789"
+                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                            "abcdefghijklmnopqrstuvwxyz";
+
+#define _BASE_      (62)
+
+// 62^10, the number of distinct sequences.
+#define _MAX_SEQ_   ((int64_t) 839299365868340224LL)
+#define _MIN_INC_   ((int64_t) 33)
+#define _MAX_INC_   ((int64_t) 333)
+
+// Distinguishes generators seeded at the same time.
+static int32_t  gNUIDCount = 0;
+
+static uint64_t
+_nextRandom(natsNUID *nuid)
+{
+    return nats_NextRandom(&(nuid->rnd));
+}
+
+static void
+_randomize(natsNUID *nuid)
+{
+    int i;
+
+    for (i = 0; i < NATS_NUID_PRE_LEN; i++)
+        nuid->pre[i] = digits[_nextRandom(nuid) % _BASE_];
+
+    nuid->seq = (int64_t) (_nextRandom(nuid) % (uint64_t) _MAX_SEQ_);
+    nuid->inc = _MIN_INC_
+                + (int64_t) (_nextRandom(nuid) % (uint64_t) (_MAX_INC_ - _MIN_INC_));
+}
+
+void
+natsNUID_Init(natsNUID *nuid)
+{
+    uint64_t count = (uint64_t) NATS_ATOMIC_INC(&gNUIDCount);
+
+    // The time alone is not enough for threads starting at the same time,
+    // so mix in the location of the state and a process wide counter.
+    nuid->rnd = ((uint64_t) nats_NowInNanoSeconds())
+                ^ (((uint64_t) (uintptr_t) nuid) << 16)
+                ^ (count * 0xD1B54A32D192ED03ULL);
+
+    _randomize(nuid);
+}
+
+void
+natsNUID_Next(natsNUID *nuid, char *buf)
+{
+    int64_t l;
+    int     i;
+
+    nuid->seq += nuid->inc;
+    if (nuid->seq >= _MAX_SEQ_)
+        _randomize(nuid);
+
+    memcpy(buf, nuid->pre, NATS_NUID_PRE_LEN);
+
+    for (i = NATS_NUID_LEN, l = nuid->seq; i > NATS_NUID_PRE_LEN; l /= _BASE_)
+    {
+        i--;
+        buf[i] = digits[l % _BASE_];
+    }
+}
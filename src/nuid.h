@@ -0,0 +1,36 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef NUID_H_
+#define NUID_H_
+
+#include <stdint.h>
+
+// A NUID is made of a random prefix followed by a sequence, both written
+// in base 62.
+#define NATS_NUID_PRE_LEN   (12)
+#define NATS_NUID_SEQ_LEN   (10)
+#define NATS_NUID_LEN       (NATS_NUID_PRE_LEN + NATS_NUID_SEQ_LEN)
+
+// State of a NUID generator. It is not protected by any lock, so each
+// thread uses its own.
+typedef struct __natsNUID
+{
+    char        pre[NATS_NUID_PRE_LEN];
+    int64_t     seq;
+    int64_t     inc;
+
+    // State of the pseudo random generator used for the prefix.
+    uint64_t    rnd;
+
+} natsNUID;
+
+// Seeds the generator and picks a random prefix, sequence and increment.
+void
+natsNUID_Init(natsNUID *nuid);
+
+// Writes the next NUID, NATS_NUID_LEN characters (not NULL terminated),
+// in 'buf'.
+void
+natsNUID_Next(natsNUID *nuid, char *buf);
+
+#endif /* NUID_H_ */
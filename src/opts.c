@@ -106,6 +106,19 @@ natsOptions_SetNoRandomize(natsOptions *opts, bool noRandomize)
     return s;
 }
 
+natsStatus
+natsOptions_SetServerSelection(natsOptions *opts, natsServerSelection policy)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((policy < NATS_SERVER_SELECTION_ROUND_ROBIN)
+                                  || (policy > NATS_SERVER_SELECTION_LOWEST_RTT)));
+
+    opts->serverSelection = policy;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
 natsStatus
 natsOptions_SetTimeout(natsOptions *opts, int64_t timeout)
 {
@@ -558,6 +571,19 @@ natsOptions_SetExpectedHostname(natsOptions *opts, const char *hostname)
     return s;
 }
 
+natsStatus
+natsOptions_SetTLSOffload(natsOptions *opts, bool kernelTLS, bool batchRecords)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->kernelTLS       = kernelTLS;
+    opts->tlsBatchRecords = batchRecords;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
 #else
 
 natsStatus
@@ -592,6 +618,12 @@ natsOptions_SetExpectedHostname(natsOptions *opts, const char *hostname)
     return nats_setError(NATS_ILLEGAL_STATE, "%s", NO_SSL_ERR);
 }
 
+natsStatus
+natsOptions_SetTLSOffload(natsOptions *opts, bool kernelTLS, bool batchRecords)
+{
+    return nats_setError(NATS_ILLEGAL_STATE, "%s", NO_SSL_ERR);
+}
+
 #endif
 
 natsStatus
@@ -679,6 +711,71 @@ natsOptions_SetReconnectWait(natsOptions *opts, int64_t reconnectWait)
     return NATS_OK;
 }
 
+natsStatus
+natsOptions_SetReconnectBackoff(natsOptions *opts, int64_t maxWait,
+                                int64_t jitter)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((maxWait < 0) || (jitter < 0)));
+
+    opts->reconnectMaxWait = maxWait;
+    opts->reconnectJitter  = jitter;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetReconnectBufSize(natsOptions *opts, int64_t maxBytes,
+                                natsReconnectBufPolicy policy)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((maxBytes < 0)
+                                  || (policy < NATS_RECONNECT_BUF_ERROR)
+                                  || (policy > NATS_RECONNECT_BUF_SPILL)));
+
+    opts->reconnectBufSize   = maxBytes;
+    opts->reconnectBufPolicy = policy;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetWriteWatermarks(natsOptions *opts, int64_t high, int64_t low,
+                               natsWatermarkPolicy policy, int64_t timeout)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((high < 0)
+                                  || (low < 0)
+                                  || ((high > 0) && (low >= high))
+                                  || (policy < NATS_WATERMARK_NOTIFY)
+                                  || (policy > NATS_WATERMARK_BLOCK)
+                                  || (timeout < 0)));
+
+    opts->writeHWM       = high;
+    opts->writeLWM       = (high > 0 ? low : 0);
+    opts->writeWMPolicy  = policy;
+    opts->writeWMTimeout = timeout;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetWatermarkCB(natsOptions *opts, natsWatermarkHandler cb,
+                           void *closure)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->watermarkCb        = cb;
+    opts->watermarkCbClosure = closure;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
 natsStatus
 natsOptions_SetMaxPendingMsgs(natsOptions *opts, int maxPending)
 {
@@ -691,6 +788,158 @@ natsOptions_SetMaxPendingMsgs(natsOptions *opts, int maxPending)
     return NATS_OK;
 }
 
+natsStatus
+natsOptions_SetMaxPendingBytes(natsOptions *opts, int64_t maxPending)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, (maxPending <= 0));
+
+    opts->maxPendingBytes = maxPending;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetFlushPolicy(natsOptions *opts, natsFlushPolicy policy,
+                           int64_t maxLinger, int maxBytes)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((policy < NATS_FLUSH_LINGER)
+                                  || (policy > NATS_FLUSH_ADAPTIVE)
+                                  || (maxLinger < 0)
+                                  || (maxBytes < 0)));
+
+    opts->flushPolicy    = policy;
+    opts->flushMaxLinger = maxLinger;
+    opts->flushMaxBytes  = maxBytes;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetParallelConnect(natsOptions *opts, int64_t attemptDelay,
+                               int maxServers)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((attemptDelay < 0) || (maxServers < 1)));
+
+    opts->connectAttemptDelay = attemptDelay;
+    opts->connectMaxServers   = maxServers;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetMsgPoolSize(natsOptions *opts, int maxPerClass)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, (maxPerClass < 0));
+
+    opts->msgPoolSize = maxPerClass;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetLatencyStats(natsOptions *opts, bool enabled)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->latencyStats = enabled;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetBusyPoll(natsOptions *opts, int64_t spinMicros)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, (spinMicros < 0));
+
+    opts->busyPoll = spinMicros;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_UseSharedEventLoop(natsOptions *opts, bool useSharedEvLoop)
+{
+#if defined(NATS_HAS_EVLOOP)
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->useSharedEvLoop = useSharedEvLoop;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+#else
+    if (opts == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    if (!useSharedEvLoop)
+        return NATS_OK;
+
+    return nats_setError(NATS_ILLEGAL_STATE, "%s", NATS_EVLOOP_NOT_SUPPORTED_ERR);
+#endif
+}
+
+natsStatus
+natsOptions_UseSharedDeliveryPool(natsOptions *opts, bool useSharedDlvPool)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->useSharedDlvPool = useSharedDlvPool;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetCallerDrivenIO(natsOptions *opts, bool callerDriven)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->callerDrivenIO = callerDriven;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetWriteInterestCB(natsOptions *opts, natsConnectionHandler cb,
+                               void *closure)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->writeInterestCb = cb;
+    opts->writeInterestCbClosure = closure;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_UseOldRequestStyle(natsOptions *opts, bool useOldStyle)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->useOldRequestStyle = useOldStyle;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
 natsStatus
 natsOptions_SetErrorHandler(natsOptions *opts, natsErrHandler errHandler,
                             void *closure)
@@ -705,6 +954,139 @@ natsOptions_SetErrorHandler(natsOptions *opts, natsErrHandler errHandler,
     return NATS_OK;
 }
 
+natsStatus
+natsOptions_SetThreadStartCB(natsOptions *opts, natsThreadStartHandler cb,
+                             void *closure)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->threadStartCb = cb;
+    opts->threadStartCbClosure = closure;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetPayloadCodec(natsOptions *opts, int codecId,
+                            natsPayloadEncoder encoder,
+                            natsPayloadDecoder decoder, void *closure)
+{
+    LOCK_AND_CHECK_OPTIONS(opts,
+                           ((codecId < 0) || (codecId > 255)
+                            || ((codecId <= NATS_CODEC_LZ4)
+                                && ((encoder != NULL) || (decoder != NULL)))
+                            || ((codecId > NATS_CODEC_LZ4)
+                                && ((encoder == NULL) || (decoder == NULL)))));
+
+    opts->codecId      = codecId;
+    opts->codecEncoder = encoder;
+    opts->codecDecoder = decoder;
+    opts->codecClosure = closure;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetPayloadCodecMinSize(natsOptions *opts, int minSize)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, (minSize < 0));
+
+    opts->codecMinSize = minSize;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetLocalDelivery(natsOptions *opts, bool local)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, 0);
+
+    opts->localDelivery = local;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetIOBufSize(natsOptions *opts, int readSize, int writeSize)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((readSize <= 0) || (writeSize <= 0)));
+
+    opts->readBufSize  = readSize;
+    opts->writeBufSize = writeSize;
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsOptions_SetCaptureFile(natsOptions *opts, const char *path)
+{
+    natsStatus  s = NATS_OK;
+
+    LOCK_AND_CHECK_OPTIONS(opts, ((path != NULL) && (path[0] == '\0')));
+
+    NATS_FREE(opts->captureFile);
+    opts->captureFile = NULL;
+    if (path != NULL)
+    {
+        opts->captureFile = NATS_STRDUP(path);
+        if (opts->captureFile == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    UNLOCK_OPTS(opts);
+
+    return s;
+}
+
+natsStatus
+natsOptions_SetMemoryProfile(natsOptions *opts, natsMemoryProfile profile)
+{
+    LOCK_AND_CHECK_OPTIONS(opts, ((profile < NATS_MEMORY_PROFILE_DEFAULT)
+                                  || (profile > NATS_MEMORY_PROFILE_THROUGHPUT)));
+
+    // Start from the defaults, so that the result does not depend on a
+    // profile set earlier.
+    opts->readBufSize      = NATS_OPTS_DEFAULT_READ_BUF_SIZE;
+    opts->writeBufSize     = NATS_OPTS_DEFAULT_WRITE_BUF_SIZE;
+    opts->maxPendingMsgs   = NATS_OPTS_DEFAULT_MAX_PENDING_MSGS;
+    opts->maxPendingBytes  = NATS_OPTS_DEFAULT_MAX_PENDING_BYTES;
+    opts->msgPoolSize      = NATS_OPTS_DEFAULT_MSG_POOL_SIZE;
+    opts->reconnectBufSize = 0;
+
+    switch (profile)
+    {
+        case NATS_MEMORY_PROFILE_SMALL:
+            opts->readBufSize      = NATS_OPTS_SMALL_READ_BUF_SIZE;
+            opts->writeBufSize     = NATS_OPTS_SMALL_WRITE_BUF_SIZE;
+            opts->maxPendingMsgs   = NATS_OPTS_SMALL_MAX_PENDING_MSGS;
+            opts->maxPendingBytes  = NATS_OPTS_SMALL_MAX_PENDING_BYTES;
+            opts->msgPoolSize      = NATS_OPTS_SMALL_MSG_POOL_SIZE;
+            opts->reconnectBufSize = NATS_OPTS_SMALL_RECONNECT_BUF_SIZE;
+            break;
+        case NATS_MEMORY_PROFILE_THROUGHPUT:
+            opts->readBufSize      = NATS_OPTS_THROUGHPUT_READ_BUF_SIZE;
+            opts->writeBufSize     = NATS_OPTS_THROUGHPUT_WRITE_BUF_SIZE;
+            opts->msgPoolSize      = NATS_OPTS_THROUGHPUT_MSG_POOL_SIZE;
+            break;
+        default:
+            break;
+    }
+
+    UNLOCK_OPTS(opts);
+
+    return NATS_OK;
+}
+
 natsStatus
 natsOptions_SetClosedCB(natsOptions *opts, natsConnectionHandler closedCb,
                         void *closure)
@@ -758,6 +1140,7 @@ _freeOptions(natsOptions *opts)
 
     NATS_FREE(opts->url);
     NATS_FREE(opts->name);
+    NATS_FREE(opts->captureFile);
     _freeServers(opts);
     natsMutex_Destroy(opts->mu);
     natsSSLCtx_release(opts->sslCtx);
@@ -778,14 +1161,23 @@ natsOptions_Create(natsOptions **newOpts)
         return NATS_UPDATE_ERR_STACK(NATS_NO_MEMORY);
     }
 
-    opts->allowReconnect = true;
-    opts->secure         = false;
-    opts->maxReconnect   = NATS_OPTS_DEFAULT_MAX_RECONNECT;
-    opts->reconnectWait  = NATS_OPTS_DEFAULT_RECONNECT_WAIT;
-    opts->pingInterval   = NATS_OPTS_DEFAULT_PING_INTERVAL;
-    opts->maxPingsOut    = NATS_OPTS_DEFAULT_MAX_PING_OUT;
-    opts->maxPendingMsgs = NATS_OPTS_DEFAULT_MAX_PENDING_MSGS;
-    opts->timeout        = NATS_OPTS_DEFAULT_TIMEOUT;
+    opts->allowReconnect      = true;
+    opts->secure              = false;
+    opts->maxReconnect        = NATS_OPTS_DEFAULT_MAX_RECONNECT;
+    opts->reconnectWait       = NATS_OPTS_DEFAULT_RECONNECT_WAIT;
+    opts->pingInterval        = NATS_OPTS_DEFAULT_PING_INTERVAL;
+    opts->maxPingsOut         = NATS_OPTS_DEFAULT_MAX_PING_OUT;
+    opts->maxPendingMsgs      = NATS_OPTS_DEFAULT_MAX_PENDING_MSGS;
+    opts->maxPendingBytes     = NATS_OPTS_DEFAULT_MAX_PENDING_BYTES;
+    opts->timeout             = NATS_OPTS_DEFAULT_TIMEOUT;
+    opts->flushPolicy         = NATS_FLUSH_LINGER;
+    opts->flushMaxLinger      = NATS_OPTS_DEFAULT_FLUSH_MAX_LINGER;
+    opts->msgPoolSize         = NATS_OPTS_DEFAULT_MSG_POOL_SIZE;
+    opts->connectAttemptDelay = NATS_OPTS_DEFAULT_CONNECT_DELAY;
+    opts->connectMaxServers   = 1;
+    opts->codecMinSize        = NATS_OPTS_DEFAULT_CODEC_MIN_SIZE;
+    opts->readBufSize         = NATS_OPTS_DEFAULT_READ_BUF_SIZE;
+    opts->writeBufSize        = NATS_OPTS_DEFAULT_WRITE_BUF_SIZE;
 
     *newOpts = opts;
 
@@ -801,7 +1193,7 @@ natsOptions_clone(natsOptions *opts)
 
     if ((s = natsOptions_Create(&cloned)) != NATS_OK)
     {
-        NATS_UPDATE_ERR_STACK(s);
+        (void) NATS_UPDATE_ERR_STACK(s);
         return NULL;
     }
 
@@ -816,10 +1208,11 @@ natsOptions_clone(natsOptions *opts)
     // Then remove all pointers, so that if we fail while
     // strduping them, and free the cloned, we don't free the strings
     // from the original.
-    cloned->name    = NULL;
-    cloned->servers = NULL;
-    cloned->url     = NULL;
-    cloned->sslCtx  = NULL;
+    cloned->name        = NULL;
+    cloned->servers     = NULL;
+    cloned->url         = NULL;
+    cloned->sslCtx      = NULL;
+    cloned->captureFile = NULL;
 
     // Also, set the number of servers count to 0, until we update
     // it (if necessary) when calling SetServers.
@@ -839,11 +1232,14 @@ natsOptions_clone(natsOptions *opts)
     if ((s == NATS_OK) && (opts->sslCtx != NULL))
         cloned->sslCtx = natsSSLCtx_retain(opts->sslCtx);
 
+    if ((s == NATS_OK) && (opts->captureFile != NULL))
+        s = natsOptions_SetCaptureFile(cloned, opts->captureFile);
+
     if (s != NATS_OK)
     {
         _freeOptions(cloned);
         cloned = NULL;
-        NATS_UPDATE_ERR_STACK(s);
+        (void) NATS_UPDATE_ERR_STACK(s);
     }
 
     natsMutex_Unlock(opts->mu);
@@ -11,6 +11,26 @@
 #define NATS_OPTS_DEFAULT_PING_INTERVAL       (2 * 60 * 1000)     // 2 minutes
 #define NATS_OPTS_DEFAULT_MAX_PING_OUT        (2)
 #define NATS_OPTS_DEFAULT_MAX_PENDING_MSGS    (65536)
+#define NATS_OPTS_DEFAULT_MAX_PENDING_BYTES   (64 * 1024 * 1024)  // 64MB
+#define NATS_OPTS_DEFAULT_FLUSH_MAX_LINGER    (1000)              // 1 millisecond (in microseconds)
+#define NATS_OPTS_DEFAULT_MSG_POOL_SIZE       (128)
+#define NATS_OPTS_DEFAULT_CONNECT_DELAY       (250)               // 250 milliseconds
+#define NATS_OPTS_DEFAULT_CODEC_MIN_SIZE      (512)
+#define NATS_OPTS_DEFAULT_READ_BUF_SIZE       (32 * 1024)         // 32KB
+#define NATS_OPTS_DEFAULT_WRITE_BUF_SIZE      (32 * 1024)         // 32KB
+
+// Settings of NATS_MEMORY_PROFILE_SMALL.
+#define NATS_OPTS_SMALL_READ_BUF_SIZE         (2 * 1024)          // 2KB
+#define NATS_OPTS_SMALL_WRITE_BUF_SIZE        (1024)              // 1KB
+#define NATS_OPTS_SMALL_MAX_PENDING_MSGS      (1024)
+#define NATS_OPTS_SMALL_MAX_PENDING_BYTES     (1024 * 1024)       // 1MB
+#define NATS_OPTS_SMALL_MSG_POOL_SIZE         (8)
+#define NATS_OPTS_SMALL_RECONNECT_BUF_SIZE    (64 * 1024)         // 64KB
+
+// Settings of NATS_MEMORY_PROFILE_THROUGHPUT.
+#define NATS_OPTS_THROUGHPUT_READ_BUF_SIZE    (256 * 1024)        // 256KB
+#define NATS_OPTS_THROUGHPUT_WRITE_BUF_SIZE   (256 * 1024)        // 256KB
+#define NATS_OPTS_THROUGHPUT_MSG_POOL_SIZE    (1024)
 
 natsOptions*
 natsOptions_clone(natsOptions *opts);
@@ -7,6 +7,7 @@
 #include "conn.h"
 #include "util.h"
 #include "mem.h"
+#include "probes.h"
 
 // cloneMsgArg is used when the split buffer scenario has the pubArg in the existing read buffer, but
 // we need to hold onto it into the next read.
@@ -65,55 +66,143 @@ _cloneMsgArg(natsConnection *nc)
     return s;
 }
 
+// Returns true if the message whose arguments have just been parsed is for a
+// subscription created with natsConnection_SubscribeStream(), in which case
+// the stream has begun.
+static bool
+_beginStream(natsConnection *nc)
+{
+    if (NATS_ATOMIC_GET(&(nc->streamSubs)) == 0)
+        return false;
+
+    return natsConn_beginStream(nc);
+}
+
 struct slice
 {
     char    *start;
     int     len;
 };
 
-static natsStatus
-_processMsgArgs(natsConnection *nc, char *buf, int bufLen)
+// When the compiler targets SSE2 (always the case for x86-64), the argument
+// scanner checks 16 bytes at a time for whitespace and jumps over the
+// subject, reply and digits in one step.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NATS_PARSER_SSE2
+#include <emmintrin.h>
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+// Returns the index of the first byte in the 16 bytes at 'buf' that is lower
+// or equal to ' ', or 16 if there is none. This catches all the protocol
+// whitespace characters (and other control characters, which are later
+// checked individually).
+static inline int
+_firstSpaceCandidate(const char *buf)
 {
-    natsStatus      s       = NATS_OK;
-    bool            started = false;
-    char            *start  = buf;
-    int             len     = 0;
-    int             index   = 0;
-    int             i;
-    char            b;
-    struct slice    slices[4];
+    const __m128i   spc  = _mm_set1_epi8(' ');
+    __m128i         v    = _mm_loadu_si128((const __m128i*) buf);
+    int             mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, spc), v));
+
+    if (mask == 0)
+        return 16;
 
-    for (i = 0; i < bufLen; i++)
+#if defined(_WIN32)
     {
-        b = buf[i];
+        unsigned long idx;
+
+        _BitScanForward(&idx, (unsigned long) mask);
+        return (int) idx;
+    }
+#else
+    return __builtin_ctz((unsigned int) mask);
+#endif
+}
+#endif
+
+// Splits 'buf' on ' ', '\t' and '\r', stopping at the first '\n', in a single
+// pass. Up to 'max' arguments are stored in 'slices', but all arguments are
+// counted, so a returned value greater than 'max' means that there were too
+// many. 'end' is set to the index of the '\n', or -1 if it was not found.
+static int
+_splitArgs(char *buf, int bufLen, struct slice *slices, int max, int *end)
+{
+    bool    started = false;
+    int     start   = 0;
+    int     index   = 0;
+    int     i       = 0;
+    char    b;
+
+    *end = -1;
 
-        if (((b == ' ') || (b == '\t') || (b == '\r') || (b == '\n'))
-            && started)
+    while (i < bufLen)
+    {
+#if defined(NATS_PARSER_SSE2)
+        if (i + 16 <= bufLen)
         {
-            slices[index].start = start;
-            slices[index].len   = len;
-            index++;
+            int skip = _firstSpaceCandidate(buf + i);
 
-            started = false;
-            len = 0;
+            if (skip > 0)
+            {
+                if (!started)
+                {
+                    start   = i;
+                    started = true;
+                }
+                i += skip;
+                continue;
+            }
         }
-        else
+#endif
+        b = buf[i];
+
+        if ((b == ' ') || (b == '\t') || (b == '\r') || (b == '\n'))
         {
-            if (!started)
+            if (started)
+            {
+                if (index < max)
+                {
+                    slices[index].start = buf + start;
+                    slices[index].len   = i - start;
+                }
+                index++;
+
+                started = false;
+            }
+            if (b == '\n')
             {
-                start   = buf + i;
-                started = true;
+                *end = i;
+                return index;
             }
-            len++;
         }
+        else if (!started)
+        {
+            start   = i;
+            started = true;
+        }
+        i++;
     }
     if (started)
     {
-        slices[index].start = start;
-        slices[index].len   = len;
+        if (index < max)
+        {
+            slices[index].start = buf + start;
+            slices[index].len   = i - start;
+        }
         index++;
     }
 
+    return index;
+}
+
+// Sets the message arguments from the 'index' slices found in 'buf'.
+static natsStatus
+_setMsgArgs(natsConnection *nc, struct slice *slices, int index,
+            char *buf, int bufLen)
+{
+    natsStatus  s = NATS_OK;
+
     if ((index == 3) || (index == 4))
     {
         int maSizeIndex = 2;
@@ -171,6 +260,18 @@ _processMsgArgs(natsConnection *nc, char *buf, int bufLen)
     return s;
 }
 
+static natsStatus
+_processMsgArgs(natsConnection *nc, char *buf, int bufLen)
+{
+    struct slice    slices[4];
+    int             index;
+    int             end;
+
+    index = _splitArgs(buf, bufLen, slices, 4, &end);
+
+    return _setMsgArgs(nc, slices, index, buf, bufLen);
+}
+
 // parse is the fast protocol parser engine.
 natsStatus
 natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
@@ -179,6 +280,8 @@ natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
     int         i;
     char        b;
 
+    NATS_PROBE1(parse, bufLen);
+
     for (i = 0; (s == NATS_OK) && (i < bufLen); i++)
     {
         b = buf[i];
@@ -255,9 +358,48 @@ natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
                     case '\t':
                         continue;
                     default:
-                        nc->ps->state      = MSG_ARG;
+                    {
+                        struct slice    slices[4];
+                        int             index;
+                        int             end;
+                        int             len;
+
                         nc->ps->afterSpace = i;
+
+                        // Locate the end of the control line and the
+                        // arguments in one pass.
+                        index = _splitArgs(buf + i, bufLen - i, slices, 4, &end);
+                        if (end < 0)
+                        {
+                            // Split buffer: the arguments are copied
+                            // after the loop.
+                            nc->ps->state = MSG_ARG;
+                            nc->ps->drop  = (buf[bufLen - 1] == '\r' ? 1 : 0);
+                            i = bufLen - 1;
+                            break;
+                        }
+
+                        len = end;
+                        if ((len > 0) && (buf[i + len - 1] == '\r'))
+                            len--;
+
+                        s = _setMsgArgs(nc, slices, index, buf + i, len);
+                        if (s == NATS_OK)
+                        {
+                            nc->ps->afterSpace  = i + end + 1;
+                            nc->ps->state       = MSG_PAYLOAD;
+
+                            // Skip directly over the payload. If this
+                            // overruns what is left we fall out and
+                            // process split buffer. A streamed payload
+                            // is handed over from the next byte.
+                            if (_beginStream(nc))
+                                i = nc->ps->afterSpace - 1;
+                            else
+                                i = nc->ps->afterSpace + nc->ps->ma.size - 1;
+                        }
                         break;
+                    }
                 }
                 break;
             }
@@ -294,7 +436,10 @@ natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
                             // jump ahead with the index. If this overruns
                             // what is left we fall out and process split
                             // buffer.
-                            i = nc->ps->afterSpace + nc->ps->ma.size - 1;
+                            if (_beginStream(nc))
+                                i = nc->ps->afterSpace - 1;
+                            else
+                                i = nc->ps->afterSpace + nc->ps->ma.size - 1;
                         }
                         break;
                     }
@@ -311,7 +456,28 @@ natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
             {
                 bool done = false;
 
-                if (nc->ps->msgBuf != NULL)
+                if (nc->ps->streaming)
+                {
+                    // Hand over what we have of the payload.
+                    int toCopy = nc->ps->streamLeft;
+                    int avail  = bufLen - i;
+
+                    if (avail < toCopy)
+                        toCopy = avail;
+
+                    if (toCopy > 0)
+                    {
+                        natsConn_streamChunk(nc, buf + i, toCopy);
+                        nc->ps->streamLeft -= toCopy;
+                        i += toCopy - 1;
+                    }
+                    if (nc->ps->streamLeft == 0)
+                    {
+                        natsConn_endStream(nc, NATS_OK);
+                        done = true;
+                    }
+                }
+                else if (nc->ps->msgBuf != NULL)
                 {
                     if (natsBuf_Len(nc->ps->msgBuf) >= nc->ps->ma.size)
                     {
@@ -651,7 +817,8 @@ natsParser_Parse(natsConnection *nc, char* buf, int bufLen)
     }
     // Check for split msg
     if ((s == NATS_OK)
-        && (nc->ps->state == MSG_PAYLOAD) && (nc->ps->msgBuf == NULL))
+        && (nc->ps->state == MSG_PAYLOAD) && (nc->ps->msgBuf == NULL)
+        && !(nc->ps->streaming))
     {
         // We need to clone the msgArg if it is still referencing the
         // read buffer and we are not able to process the msg.
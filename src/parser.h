@@ -63,6 +63,14 @@ typedef struct __natsParser
     natsBuffer  *msgBuf;
     char        scratch[MAX_CONTROL_LINE_SIZE];
 
+    // Set while the payload of a message is handed over to a subscription
+    // created with natsConnection_SubscribeStream(), with the number of
+    // bytes still to come. If 'streamSkip' is set, the rest of the payload
+    // is dropped.
+    bool        streaming;
+    bool        streamSkip;
+    int         streamLeft;
+
 } natsParser;
 
 // This is defined in natsp.h, natsp.h includes us. Alternatively, we can move
@@ -0,0 +1,33 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef PROBES_H_
+#define PROBES_H_
+
+// Static tracepoints of the 'nats' provider, compiled in with the
+// NATS_BUILD_WITH_USDT CMake option. They use the SystemTap SDT macros,
+// which are also provided for DTrace, and are a single 'nop' until a
+// tracer attaches to them. Durations are measured by the tracer, from
+// the timestamps of the '__start' and '__done' pairs, so that no clock is
+// read by the library. Otherwise, these macros expand to nothing.
+//
+// A double underscore in a name is shown as a dash by the tracers, for
+// instance 'nats:publish-start' for NATS_PROBE2(publish__start, ...).
+#if defined(NATS_HAS_USDT)
+
+#include <sys/sdt.h>
+
+#define NATS_PROBE0(n)                  DTRACE_PROBE(nats, n)
+#define NATS_PROBE1(n, a)               DTRACE_PROBE1(nats, n, a)
+#define NATS_PROBE2(n, a, b)            DTRACE_PROBE2(nats, n, a, b)
+#define NATS_PROBE3(n, a, b, c)         DTRACE_PROBE3(nats, n, a, b, c)
+
+#else
+
+#define NATS_PROBE0(n)
+#define NATS_PROBE1(n, a)
+#define NATS_PROBE2(n, a, b)
+#define NATS_PROBE3(n, a, b, c)
+
+#endif
+
+#endif /* PROBES_H_ */
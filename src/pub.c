@@ -7,45 +7,196 @@
 #include "conn.h"
 #include "sub.h"
 #include "msg.h"
+#include "mem.h"
+#include "util.h"
+#include "probes.h"
 
 static const char *digits = "0123456789";
 
-#define _publish(n, s, r, d, l) _publishEx((n), (s), (r), (d), (l), false)
+#define _publish(n, s, r, d, l) _publishEx((n), NULL, (s), (r), (d), (l), false)
 
-// _publish is the internal function to publish messages to a nats server.
-// Sends a protocol data message by queueing into the bufio writer
-// and kicking the flusher thread. These writes should be protected.
+// Writes the decimal representation of 'n' at the end of 'b', which is
+// 'bSize' bytes long, and returns the index of the first digit.
+static int
+_encodeSize(char *b, int bSize, int n)
+{
+    int i = bSize;
+
+    if (n > 0)
+    {
+        int l;
+
+        for (l = n; l > 0; l /= 10)
+        {
+            i -= 1;
+            b[i] = digits[l%10];
+        }
+    }
+    else
+    {
+        i -= 1;
+        b[i] = digits[0];
+    }
+
+    return i;
+}
+
+// Encodes the PUB protocol header in the connection's scratch buffer and
+// writes the message to the connection's write buffer (or socket).
+// The connection's write lock is held on entry.
 static natsStatus
-_publishEx(natsConnection *nc, const char *subj,
-         const char *reply, const void *data, int dataLen,
-         bool directFlush)
+_writeMsgV(natsConnection *nc, const char *subj, int subjLen,
+           const char *reply, int replyLen, const natsIOVec *iov, int iovcnt,
+           int dataLen)
 {
     natsStatus  s = NATS_OK;
     int         msgHdSize = 0;
     char        b[12];
     int         bSize = sizeof(b);
-    int         i = bSize;
+    int         i = _encodeSize(b, bSize, dataLen);
+    int         sizeSize = 0;
+
+    sizeSize = (bSize - i);
+
+    msgHdSize = _PUB_P_LEN_
+                + subjLen + 1
+                + (replyLen > 0 ? replyLen + 1 : 0)
+                + sizeSize + _CRLF_LEN_;
+
+    natsBuf_RewindTo(nc->scratch, _PUB_P_LEN_);
+
+    if (natsBuf_Capacity(nc->scratch) < msgHdSize)
+    {
+        // Although natsBuf_Append() would make sure that the buffer
+        // grows, it is better to make sure that the buffer is big
+        // enough for the pre-calculated size. We make it even a bit bigger.
+        s = natsBuf_Expand(nc->scratch, (int) ((float)msgHdSize * 1.1));
+    }
+
+    if (s == NATS_OK)
+        s = natsBuf_Append(nc->scratch, subj, subjLen);
+    if (s == NATS_OK)
+        s = natsBuf_Append(nc->scratch, _SPC_, _SPC_LEN_);
+    if ((s == NATS_OK) && (replyLen > 0))
+    {
+        s = natsBuf_Append(nc->scratch, reply, replyLen);
+        if (s == NATS_OK)
+            s = natsBuf_Append(nc->scratch, _SPC_, _SPC_LEN_);
+    }
+    if (s == NATS_OK)
+        s = natsBuf_Append(nc->scratch, (b+i), sizeSize);
+    if (s == NATS_OK)
+        s = natsBuf_Append(nc->scratch, _CRLF_, _CRLF_LEN_);
+
+    if (s == NATS_OK)
+        s = natsConn_bufferWriteMsgV(nc, natsBuf_Data(nc->scratch), msgHdSize,
+                                     iov, iovcnt, dataLen);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static natsStatus
+_writeMsg(natsConnection *nc, const char *subj, int subjLen,
+          const char *reply, int replyLen, const void *data, int dataLen)
+{
+    natsStatus  s;
+    natsIOVec   iov;
+
+    iov.data = data;
+    iov.len  = dataLen;
+
+    s = _writeMsgV(nc, subj, subjLen, reply, replyLen, &iov, 1, dataLen);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Completes the header pre-encoded in the publisher with the size and
+// writes the message. The connection's write lock is held on entry, which
+// also protects the publisher's header.
+static natsStatus
+_writePreparedMsg(natsConnection *nc, natsPublisher *pub,
+                  const void *data, int dataLen)
+{
+    natsStatus  s;
+    char        b[12];
+    int         bSize = sizeof(b);
+    int         i = _encodeSize(b, bSize, dataLen);
+    int         hdrLen = pub->prefixLen;
+
+    memcpy(pub->hdr + hdrLen, b + i, bSize - i);
+    hdrLen += (bSize - i);
+    memcpy(pub->hdr + hdrLen, _CRLF_, _CRLF_LEN_);
+    hdrLen += _CRLF_LEN_;
+
+    s = natsConn_bufferWriteMsg(nc, pub->hdr, hdrLen,
+                                (const char*) data, dataLen);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Encodes the payload with the connection's codec, see natsCodec_Encode().
+// Must be invoked with the write lock held.
+static natsStatus
+_encodePayload(natsConnection *nc, const natsIOVec *iov, int iovcnt,
+               int dataLen, const char **enc, int *encLen)
+{
+    natsStatus s;
+
+    s = natsCodec_Encode(nc->codec, iov, iovcnt, dataLen, enc, encLen);
+
+    // An escaped payload is larger than the original.
+    if ((s == NATS_OK) && (*enc != NULL) && ((int64_t) *encLen > nc->info.maxPayload))
+    {
+        s = nats_setError(NATS_MAX_PAYLOAD,
+                          "Encoded payload %d greater than maximum allowed: %" PRId64,
+                          *encLen, nc->info.maxPayload);
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// _publish is the internal function to publish messages to a nats server.
+// Sends a protocol data message by queueing into the bufio writer
+// and kicking the flusher thread. These writes should be protected.
+// If 'pub' is not NULL, the subject and reply are those of the publisher
+// and 'subj' and 'reply' are ignored (and 'iovcnt' is 1). The payload is
+// made of the 'iovcnt' fragments of 'iov', 'dataLen' bytes in total.
+static natsStatus
+_publishV(natsConnection *nc, natsPublisher *pub, const char *subj,
+          const char *reply, const natsIOVec *iov, int iovcnt, int dataLen,
+          bool directFlush)
+{
+    natsStatus  s = NATS_OK;
     int         subjLen = 0;
     int         replyLen = 0;
-    int         sizeSize = 0;
+    const char  *enc = NULL;
+    int         encLen = 0;
+    natsIOVec   encIov;
+    bool        local = false;
+    bool        notify = false;
+    bool        high = false;
 
     if (nc == NULL)
         return nats_setDefaultError(NATS_INVALID_ARG);
 
-    if ((subj == NULL)
-        || ((subjLen = (int) strlen(subj)) == 0))
+    if ((pub == NULL)
+        && ((subj == NULL)
+            || ((subjLen = (int) strlen(subj)) == 0)))
     {
         return nats_setDefaultError(NATS_INVALID_SUBJECT);
     }
 
-    replyLen = ((reply != NULL) ? (int) strlen(reply) : 0);
+    if (pub == NULL)
+        replyLen = ((reply != NULL) ? (int) strlen(reply) : 0);
 
-    natsConn_Lock(nc);
+    // Publishers only need the write lock, which is also held when the
+    // connection's status and server info are updated.
+    natsConn_writeLock(nc);
 
     // Pro-actively reject dataLen over the threshold set by server.
     if ((int64_t) dataLen > nc->info.maxPayload)
     {
-        natsConn_Unlock(nc);
+        natsConn_writeUnlock(nc);
 
         return nats_setError(NATS_MAX_PAYLOAD,
                              "Payload %d greater than maximum allowed: %" PRId64,
@@ -53,86 +204,101 @@ _publishEx(natsConnection *nc, const char *subj,
 
     }
 
+    // Over the high watermark, this may fail, or wait for the buffered data
+    // to be sent.
+    if (nc->wmHigh)
+        s = natsConn_waitWatermark(nc);
+
     if ((s == NATS_OK) && natsConn_isClosed(nc))
     {
         s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
     }
 
-    if (s == NATS_OK)
+    // The payload is encoded in the codec's buffer, which the write lock
+    // protects. Statistics still count the bytes of the original payload.
+    if ((s == NATS_OK) && (nc->codec != NULL))
     {
-        if (dataLen > 0)
+        s = _encodePayload(nc, iov, iovcnt, dataLen, &enc, &encLen);
+        if ((s == NATS_OK) && (enc != NULL))
         {
-            int l;
-
-            for (l = dataLen; l > 0; l /= 10)
-            {
-                i -= 1;
-                b[i] = digits[l%10];
-            }
-        }
-        else
-        {
-            i -= 1;
-            b[i] = digits[0];
+            encIov.data = enc;
+            encIov.len  = encLen;
         }
+    }
 
-        sizeSize = (bSize - i);
-
-        msgHdSize = _PUB_P_LEN_
-                    + subjLen + 1
-                    + (replyLen > 0 ? replyLen + 1 : 0)
-                    + sizeSize + _CRLF_LEN_;
-
-        natsBuf_RewindTo(nc->scratch, _PUB_P_LEN_);
-
-        if (natsBuf_Capacity(nc->scratch) < msgHdSize)
-        {
-            // Although natsBuf_Append() would make sure that the buffer
-            // grows, it is better to make sure that the buffer is big
-            // enough for the pre-calculated size. We make it even a bit bigger.
-            s = natsBuf_Expand(nc->scratch, (int) ((float)msgHdSize * 1.1));
-        }
+    if ((s == NATS_OK) && (enc != NULL))
+    {
+        if (pub != NULL)
+            s = _writePreparedMsg(nc, pub, enc, encLen);
+        else
+            s = _writeMsgV(nc, subj, subjLen, reply, replyLen, &encIov, 1, encLen);
     }
+    else if ((s == NATS_OK) && (pub != NULL))
+        s = _writePreparedMsg(nc, pub, iov[0].data, dataLen);
+    else if (s == NATS_OK)
+        s = _writeMsgV(nc, subj, subjLen, reply, replyLen, iov, iovcnt, dataLen);
 
     if (s == NATS_OK)
-        s = natsBuf_Append(nc->scratch, subj, subjLen);
-    if (s == NATS_OK)
-        s = natsBuf_Append(nc->scratch, _SPC_, _SPC_LEN_);
-    if ((s == NATS_OK) && (reply != NULL))
     {
-        s = natsBuf_Append(nc->scratch, reply, replyLen);
-        if (s == NATS_OK)
-            s = natsBuf_Append(nc->scratch, _SPC_, _SPC_LEN_);
+        if (directFlush)
+            s = natsConn_bufferFlush(nc);
+        else
+            natsConn_kickFlusher(nc);
     }
-    if (s == NATS_OK)
-        s = natsBuf_Append(nc->scratch, (b+i), sizeSize);
-    if (s == NATS_OK)
-        s = natsBuf_Append(nc->scratch, _CRLF_, _CRLF_LEN_);
 
     if (s == NATS_OK)
-        s = natsConn_bufferWrite(nc, natsBuf_Data(nc->scratch), msgHdSize);
+    {
+        local  = nc->localDlv;
+        notify = natsConn_updateWatermark(nc, &high);
+    }
 
-    if (s == NATS_OK)
-        s = natsConn_bufferWrite(nc, data, dataLen);
+    natsConn_writeUnlock(nc);
 
-    if (s == NATS_OK)
-        s = natsConn_bufferWrite(nc, _CRLF_, _CRLF_LEN_);
+    if (notify)
+        natsAsyncCb_PostWatermarkHandler(nc, high);
 
+    // The counters are atomic, no need to hold the lock for them.
     if (s == NATS_OK)
     {
-        if (directFlush)
-            s = natsConn_bufferFlush(nc);
-        else
-            natsConn_kickFlusher(nc);
+        NATS_ATOMIC64_ADD(&(nc->stats.outMsgs), 1);
+        NATS_ATOMIC64_ADD(&(nc->stats.outBytes), (uint64_t) dataLen);
     }
 
-    if (s == NATS_OK)
+    // The server does not send the message back, so the subscriptions of
+    // this connection get it from here.
+    if (local)
     {
-        nc->stats.outMsgs  += 1;
-        nc->stats.outBytes += dataLen;
+        if (pub != NULL)
+        {
+            subj     = pub->hdr + _PUB_P_LEN_;
+            subjLen  = pub->subjLen;
+            reply    = subj + subjLen + 1;
+            replyLen = pub->replyLen;
+        }
+
+        s = natsConn_deliverLocal(nc, subj, subjLen, reply, replyLen,
+                                  iov, iovcnt, dataLen);
     }
 
-    natsConn_Unlock(nc);
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static natsStatus
+_publishEx(natsConnection *nc, natsPublisher *pub, const char *subj,
+           const char *reply, const void *data, int dataLen,
+           bool directFlush)
+{
+    natsStatus  s;
+    natsIOVec   iov;
+
+    iov.data = data;
+    iov.len  = dataLen;
+
+    NATS_PROBE2(publish__start, subj, dataLen);
+
+    s = _publishV(nc, pub, subj, reply, &iov, 1, dataLen, directFlush);
+
+    NATS_PROBE2(publish__done, subj, (int) s);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
@@ -222,38 +388,483 @@ natsConnection_PublishRequestString(natsConnection *nc, const char *subj,
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+// Returns true if the subject is not empty and contains no character that
+// would break the protocol line.
+static bool
+_isValidPubSubject(const char *subj)
+{
+    if ((subj == NULL) || (subj[0] == '\0'))
+        return false;
+
+    return (strpbrk(subj, " \t\r\n") == NULL);
+}
+
+natsStatus
+natsConnection_PreparePublish(natsPublisher **newPub, natsConnection *nc,
+                              const char *subj, const char *reply)
+{
+    natsPublisher   *pub    = NULL;
+    int             subjLen = 0;
+    int             replyLen = 0;
+    char            *ptr    = NULL;
+
+    if ((newPub == NULL) || (nc == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    if (!_isValidPubSubject(subj)
+        || ((reply != NULL) && !_isValidPubSubject(reply)))
+    {
+        return nats_setDefaultError(NATS_INVALID_SUBJECT);
+    }
+
+    subjLen  = (int) strlen(subj);
+    replyLen = ((reply != NULL) ? (int) strlen(reply) : 0);
+
+    pub = (natsPublisher*) NATS_CALLOC(1, sizeof(natsPublisher));
+    if (pub == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    pub->subjLen   = subjLen;
+    pub->replyLen  = replyLen;
+    pub->prefixLen = _PUB_P_LEN_
+                     + subjLen + 1
+                     + (replyLen > 0 ? replyLen + 1 : 0);
+
+    // Room for the size (at most 10 digits) and the CRLF.
+    pub->hdr = (char*) NATS_MALLOC(pub->prefixLen + 10 + _CRLF_LEN_);
+    if (pub->hdr == NULL)
+    {
+        NATS_FREE(pub);
+        return nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    ptr = pub->hdr;
+    memcpy(ptr, _PUB_P_, _PUB_P_LEN_);
+    ptr += _PUB_P_LEN_;
+    memcpy(ptr, subj, subjLen);
+    ptr += subjLen;
+    *(ptr++) = ' ';
+    if (replyLen > 0)
+    {
+        memcpy(ptr, reply, replyLen);
+        ptr += replyLen;
+        *(ptr++) = ' ';
+    }
+
+    natsConn_retain(nc);
+    pub->nc = nc;
+
+    *newPub = pub;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsPublisher_Publish(natsPublisher *pub, const void *data, int dataLen)
+{
+    natsStatus s;
+
+    if ((pub == NULL) || (dataLen < 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _publishEx(pub->nc, pub, NULL, NULL, data, dataLen, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+void
+natsPublisher_Destroy(natsPublisher *pub)
+{
+    if (pub == NULL)
+        return;
+
+    natsConn_release(pub->nc);
+    NATS_FREE(pub->hdr);
+    NATS_FREE(pub);
+}
+
+// Receives the replies of all requests made with the connection's response
+// subscription, and hands each one to the request waiting for it.
+static void
+_respHandler(natsConnection *nc, natsSubscription *sub, natsMsg *msg,
+             void *closure)
+{
+    natsRespInfo    *resp = NULL;
+    const char      *id   = NULL;
+
+    natsConn_Lock(nc);
+
+    id = msg->subject + nc->respPrefixLen;
+    if ((nc->respMap != NULL)
+        && ((int) strlen(msg->subject) > nc->respPrefixLen))
+    {
+        resp = (natsRespInfo*) natsHash_Remove(nc->respMap,
+                                               nats_ParseInt64(id, (int) strlen(id)));
+    }
+    if ((resp != NULL) && (resp->cb == NULL))
+    {
+        resp->msg = msg;
+        msg = NULL;
+
+        natsCondition_Signal(resp->cond);
+        resp = NULL;
+    }
+
+    natsConn_Unlock(nc);
+
+    // We own this asynchronous request, complete it.
+    if (resp != NULL)
+    {
+        if (nc->latency != NULL)
+            natsHistogram_RecordSince(&(nc->latency[NATS_LATENCY_REQUEST]),
+                                      resp->start);
+
+        (*(resp->cb))(nc, msg, NATS_OK, resp->closure);
+        msg = NULL;
+
+        if (resp->timer != NULL)
+            natsTimer_Stop(resp->timer);
+        else
+            NATS_FREE(resp);
+    }
+
+    // Reply to a request that has timed out (or duplicate reply).
+    natsMsg_Destroy(msg);
+}
+
+// Creates the connection's response subscription on "_INBOX.<unique>.*".
+// The connection's lock is held on entry.
+static natsStatus
+_initRespMux(natsConnection *nc)
+{
+    natsStatus  s       = NATS_OK;
+    char        *subj   = NULL;
+    char        inbox[NATS_INBOX_ARRAY_SIZE];
+
+    s = natsInbox_Init(inbox, (int) sizeof(inbox));
+    if (s == NATS_OK)
+        s = natsHash_Create(&(nc->respMap), 8);
+    if ((s == NATS_OK)
+        && ((nats_asprintf(&(nc->respPrefix), "%s.", inbox) < 0)
+            || (nats_asprintf(&subj, "%s*", nc->respPrefix) < 0)))
+    {
+        s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if (s == NATS_OK)
+    {
+        nc->respPrefixLen = (int) strlen(nc->respPrefix);
+
+        // The lock is reentrant, so we can subscribe while holding it, which
+        // prevents concurrent requests from both creating the subscription.
+        s = natsConn_subscribe(&(nc->respMux), nc, subj, NULL,
+                               _respHandler, NULL, true);
+    }
+    if (s != NATS_OK)
+    {
+        natsHash_Destroy(nc->respMap);
+        nc->respMap = NULL;
+        NATS_FREE(nc->respPrefix);
+        nc->respPrefix = NULL;
+    }
+
+    NATS_FREE(subj);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+static void
+_destroyRespInfo(natsRespInfo *resp)
+{
+    if (resp == NULL)
+        return;
+
+    natsMsg_Destroy(resp->msg);
+    natsCondition_Destroy(resp->cond);
+    NATS_FREE(resp);
+}
+
 /*
  * Creates an inbox and performs a natsPublishRequest() call with the reply
  * set to that inbox. Returns the first reply received.
  * This is optimized for the case of multiple responses.
  */
-natsStatus
-natsConnection_Request(natsMsg **replyMsg, natsConnection *nc, const char *subj,
-                       const void *data, int dataLen, int64_t timeout)
+static natsStatus
+_oldRequest(natsMsg **replyMsg, natsConnection *nc, const char *subj,
+            const void *data, int dataLen, int64_t timeout)
 {
     natsStatus          s       = NATS_OK;
     natsSubscription    *sub    = NULL;
-    natsInbox           *inbox  = NULL;
-
-    if (replyMsg == NULL)
-        return nats_setDefaultError(NATS_INVALID_ARG);
+    char                inbox[NATS_INBOX_ARRAY_SIZE];
 
-    s = natsInbox_Create(&inbox);
+    s = natsInbox_Init(inbox, (int) sizeof(inbox));
     if (s == NATS_OK)
         s = natsConn_subscribe(&sub, nc, inbox, NULL, NULL, NULL, true);
     if (s == NATS_OK)
         s = natsSubscription_AutoUnsubscribe(sub, 1);
     if (s == NATS_OK)
-        s = _publishEx(nc, subj, inbox, data, dataLen, true);
+        s = _publishEx(nc, NULL, subj, inbox, data, dataLen, true);
     if (s == NATS_OK)
         s = natsSubscription_NextMsg(replyMsg, sub, timeout);
 
-    natsInbox_Destroy(inbox);
     natsSubscription_Destroy(sub);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+/*
+ * Publishes the request with a reply subject unique to this request, and
+ * received by the connection's response subscription (created on the first
+ * request). Returns the first reply received.
+ */
+natsStatus
+natsConnection_Request(natsMsg **replyMsg, natsConnection *nc, const char *subj,
+                       const void *data, int dataLen, int64_t timeout)
+{
+    natsStatus      s       = NATS_OK;
+    natsRespInfo    *resp   = NULL;
+    int64_t         id      = 0;
+    int64_t         target  = 0;
+    int64_t         start   = 0;
+    char            reply[128];
+
+    if ((replyMsg == NULL) || (nc == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    // The histograms are set when the connection is created.
+    if (nc->latency != NULL)
+        start = nats_NowInNanoSeconds();
+
+    natsConn_Lock(nc);
+
+    if (nc->opts->useOldRequestStyle)
+    {
+        natsConn_Unlock(nc);
+
+        s = _oldRequest(replyMsg, nc, subj, data, dataLen, timeout);
+        if ((s == NATS_OK) && (nc->latency != NULL))
+            natsHistogram_RecordSince(&(nc->latency[NATS_LATENCY_REQUEST]), start);
+
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    if (natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+
+    if ((s == NATS_OK) && (nc->respMux == NULL))
+        s = _initRespMux(nc);
+
+    if (s == NATS_OK)
+    {
+        resp = (natsRespInfo*) NATS_CALLOC(1, sizeof(natsRespInfo));
+        if (resp == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+        else
+            s = natsCondition_Create(&(resp->cond));
+    }
+    if (s == NATS_OK)
+    {
+        id = ++(nc->respId);
+        snprintf(reply, sizeof(reply), "%s%" PRId64, nc->respPrefix, id);
+
+        s = natsHash_Set(nc->respMap, id, (void*) resp, NULL);
+    }
+
+    natsConn_Unlock(nc);
+
+    if (s == NATS_OK)
+        s = _publishEx(nc, NULL, subj, reply, data, dataLen, true);
+
+    natsConn_Lock(nc);
+
+    if (s == NATS_OK)
+    {
+        target = nats_Now() + timeout;
+
+        while ((s != NATS_TIMEOUT) && (resp->msg == NULL) && !(resp->closed))
+        {
+            if (nc->opts->callerDrivenIO)
+                s = natsConn_waitAndProcessIO(nc, target);
+            else
+                s = natsCondition_AbsoluteTimedWait(resp->cond, nc->mu, target);
+        }
+
+        if (resp->msg != NULL)
+            s = NATS_OK;
+        else if (resp->closed)
+            s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+        else
+            s = nats_setDefaultError(NATS_TIMEOUT);
+    }
+
+    // The handler removes the entry when it delivers the reply, but not
+    // if we gave up waiting.
+    if ((id > 0) && (nc->respMap != NULL))
+        (void) natsHash_Remove(nc->respMap, id);
+
+    natsConn_Unlock(nc);
+
+    if (s == NATS_OK)
+    {
+        *replyMsg = resp->msg;
+        resp->msg = NULL;
+
+        if (nc->latency != NULL)
+            natsHistogram_RecordSince(&(nc->latency[NATS_LATENCY_REQUEST]), start);
+    }
+
+    _destroyRespInfo(resp);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Fires when an asynchronous request times out, or right away when the
+// connection is closed.
+static void
+_respTimeout(natsTimer *timer, void *closure)
+{
+    natsRespInfo    *resp   = (natsRespInfo*) closure;
+    natsConnection  *nc     = resp->nc;
+    natsStatus      s       = NATS_TIMEOUT;
+    bool            owned   = false;
+
+    natsConn_Lock(nc);
+
+    // Otherwise, the reply is being delivered and the response handler
+    // stops the timer.
+    if ((nc->respMap != NULL)
+        && (natsHash_Get(nc->respMap, resp->id) == (void*) resp))
+    {
+        (void) natsHash_Remove(nc->respMap, resp->id);
+        owned = true;
+    }
+    if (resp->closed)
+        s = NATS_CONNECTION_CLOSED;
+
+    natsConn_Unlock(nc);
+
+    if (owned)
+    {
+        (*(resp->cb))(nc, NULL, s, resp->closure);
+
+        natsTimer_Stop(timer);
+    }
+}
+
+static void
+_respTimerStopped(natsTimer *timer, void *closure)
+{
+    natsRespInfo    *resp   = (natsRespInfo*) closure;
+    natsConnection  *nc     = resp->nc;
+
+    // The library is shutting down and stops all timers.
+    natsConn_Lock(nc);
+    if ((nc->respMap != NULL)
+        && (natsHash_Get(nc->respMap, resp->id) == (void*) resp))
+    {
+        (void) natsHash_Remove(nc->respMap, resp->id);
+    }
+    natsConn_Unlock(nc);
+
+    natsTimer_Release(timer);
+    NATS_FREE(resp);
+
+    natsConn_release(nc);
+}
+
+natsStatus
+natsConnection_RequestAsync(natsConnection *nc, const char *subj,
+                            const void *data, int dataLen, int64_t timeout,
+                            natsReplyHandler cb, void *closure)
+{
+    natsStatus      s       = NATS_OK;
+    natsRespInfo    *resp   = NULL;
+    bool            owned   = true;
+    char            reply[128];
+
+    if ((nc == NULL) || (cb == NULL) || (timeout <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsConn_Lock(nc);
+
+    if (natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+
+    if ((s == NATS_OK) && (nc->respMux == NULL))
+        s = _initRespMux(nc);
+
+    if (s == NATS_OK)
+    {
+        resp = (natsRespInfo*) NATS_CALLOC(1, sizeof(natsRespInfo));
+        if (resp == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+    }
+    if (s == NATS_OK)
+    {
+        resp->cb      = cb;
+        resp->closure = closure;
+        resp->nc      = nc;
+        resp->id      = ++(nc->respId);
+
+        if (nc->latency != NULL)
+            resp->start = nats_NowInNanoSeconds();
+
+        snprintf(reply, sizeof(reply), "%s%" PRId64, nc->respPrefix, resp->id);
+
+        // With caller driven I/O, natsConnection_ProcessTimers() expires
+        // the request, so that the callback runs in the application's thread.
+        if (nc->opts->callerDrivenIO)
+            resp->deadline = nats_Now() + timeout;
+        else
+            s = natsTimer_Create(&(resp->timer), _respTimeout, _respTimerStopped,
+                                 timeout, (void*) resp);
+        if (s != NATS_OK)
+        {
+            NATS_FREE(resp);
+            resp = NULL;
+        }
+    }
+    if (s == NATS_OK)
+    {
+        // Released by the timer's stop callback.
+        if (resp->timer != NULL)
+            natsConn_retain(nc);
+
+        s = natsHash_Set(nc->respMap, resp->id, (void*) resp, NULL);
+    }
+
+    natsConn_Unlock(nc);
+
+    if ((s == NATS_OK) && (resp != NULL))
+    {
+        s = _publishEx(nc, NULL, subj, reply, data, dataLen, true);
+        if (s != NATS_OK)
+        {
+            // The request may have completed already (it timed out, or the
+            // connection was closed), in which case the callback has been
+            // invoked, so this call must not report the error.
+            natsConn_Lock(nc);
+            owned = ((nc->respMap != NULL)
+                     && (natsHash_Remove(nc->respMap, resp->id) == (void*) resp));
+            natsConn_Unlock(nc);
+
+            if (!owned)
+            {
+                nats_clearLastError();
+                s = NATS_OK;
+            }
+        }
+    }
+    if ((s != NATS_OK) && (resp != NULL) && owned)
+    {
+        if (resp->timer != NULL)
+            natsTimer_Stop(resp->timer);
+        else
+            NATS_FREE(resp);
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 /*
  * Convenient function to send a request as a string. This call is
  * equivalent to:
@@ -276,3 +887,164 @@ natsConnection_RequestString(natsMsg **replyMsg, natsConnection *nc,
 
     return NATS_UPDATE_ERR_STACK(s);
 }
+
+/*
+ * Publishes a message whose payload is made of the 'iovcnt' fragments of
+ * 'iov', without gathering them in a single buffer first.
+ */
+natsStatus
+natsConnection_PublishV(natsConnection *nc, const char *subj,
+                        const char *reply, const natsIOVec *iov, int iovcnt)
+{
+    natsStatus  s       = NATS_OK;
+    int64_t     dataLen = 0;
+
+    if ((iovcnt < 0) || ((iov == NULL) && (iovcnt > 0)))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    for (int i=0; i<iovcnt; i++)
+    {
+        if ((iov[i].len < 0) || ((iov[i].data == NULL) && (iov[i].len > 0)))
+            return nats_setDefaultError(NATS_INVALID_ARG);
+
+        dataLen += (int64_t) iov[i].len;
+    }
+    if (dataLen > INT32_MAX)
+        return nats_setError(NATS_MAX_PAYLOAD,
+                             "Payload %" PRId64 " greater than maximum allowed",
+                             dataLen);
+
+    NATS_PROBE2(publish__start, subj, (int) dataLen);
+
+    s = _publishV(nc, NULL, subj, reply, iov, iovcnt, (int) dataLen, false);
+
+    NATS_PROBE2(publish__done, subj, (int) s);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+/*
+ * Publishes all messages of the array under a single acquisition of the
+ * connection's write lock, and signals the flusher only once for the whole
+ * batch.
+ */
+natsStatus
+natsConnection_PublishBatch(natsConnection *nc, natsMsg **msgs, int count)
+{
+    natsStatus  s = NATS_OK;
+    int         written = 0;
+    uint64_t    bytes   = 0;
+    bool        local   = false;
+    bool        notify  = false;
+    bool        high    = false;
+    int         i;
+
+    if ((nc == NULL) || (msgs == NULL) || (count <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    // Validate the whole batch before writing anything.
+    for (i=0; i<count; i++)
+    {
+        if (msgs[i] == NULL)
+            return nats_setDefaultError(NATS_INVALID_ARG);
+
+        if ((msgs[i]->subject == NULL) || (msgs[i]->subject[0] == '\0'))
+            return nats_setDefaultError(NATS_INVALID_SUBJECT);
+    }
+
+    natsConn_writeLock(nc);
+
+    if (nc->wmHigh)
+        s = natsConn_waitWatermark(nc);
+
+    if ((s == NATS_OK) && natsConn_isClosed(nc))
+        s = nats_setDefaultError(NATS_CONNECTION_CLOSED);
+
+    // Pro-actively reject the batch if one of the payloads is over the
+    // threshold set by server.
+    for (i=0; (s == NATS_OK) && (i<count); i++)
+    {
+        if ((int64_t) msgs[i]->dataLen > nc->info.maxPayload)
+        {
+            s = nats_setError(NATS_MAX_PAYLOAD,
+                              "Payload %d of message %d greater than maximum allowed: %" PRId64,
+                              msgs[i]->dataLen, i, nc->info.maxPayload);
+        }
+    }
+
+    for (i=0; (s == NATS_OK) && (i<count); i++)
+    {
+        natsMsg     *msg    = msgs[i];
+        const char  *data   = msg->data;
+        int         dataLen = msg->dataLen;
+
+        // The codec's buffer is reused by the next message, so each one is
+        // written as soon as it is encoded.
+        if (nc->codec != NULL)
+        {
+            const char  *enc    = NULL;
+            int         encLen  = 0;
+            natsIOVec   iov;
+
+            iov.data = msg->data;
+            iov.len  = msg->dataLen;
+
+            s = _encodePayload(nc, &iov, 1, msg->dataLen, &enc, &encLen);
+            if ((s == NATS_OK) && (enc != NULL))
+            {
+                data    = enc;
+                dataLen = encLen;
+            }
+        }
+        if (s == NATS_OK)
+            s = _writeMsg(nc, msg->subject, (int) strlen(msg->subject),
+                          msg->reply,
+                          (msg->reply != NULL ? (int) strlen(msg->reply) : 0),
+                          data, dataLen);
+        if (s == NATS_OK)
+        {
+            bytes += (uint64_t) msg->dataLen;
+            written++;
+        }
+    }
+
+    // Even if we failed in the middle of the batch, kick the flusher for the
+    // messages that have been buffered.
+    if (written > 0)
+    {
+        natsConn_kickFlusher(nc);
+        local  = nc->localDlv;
+        notify = natsConn_updateWatermark(nc, &high);
+    }
+
+    natsConn_writeUnlock(nc);
+
+    if (notify)
+        natsAsyncCb_PostWatermarkHandler(nc, high);
+
+    if (written > 0)
+    {
+        NATS_ATOMIC64_ADD(&(nc->stats.outMsgs), (uint64_t) written);
+        NATS_ATOMIC64_ADD(&(nc->stats.outBytes), bytes);
+    }
+
+    // As in _publishV(), the server does not send the messages back.
+    for (i=0; local && (i<written); i++)
+    {
+        natsStatus  ls;
+        natsMsg     *msg = msgs[i];
+        natsIOVec   iov;
+
+        iov.data = msg->data;
+        iov.len  = msg->dataLen;
+
+        ls = natsConn_deliverLocal(nc, msg->subject, (int) strlen(msg->subject),
+                                   msg->reply,
+                                   (msg->reply != NULL ? (int) strlen(msg->reply) : 0),
+                                   &iov, 1, msg->dataLen);
+        if (s == NATS_OK)
+            s = ls;
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
@@ -58,12 +58,64 @@ natsSrvPool_GetCurrentServer(natsSrvPool *pool, const natsUrl *url, int *index)
     return NULL;
 }
 
+// Returns true if server 'a' should be preferred over server 'b': it has
+// failed fewer reconnect attempts or, if equal, has a lower round-trip time.
+// Servers with a known round-trip time are preferred.
+static bool
+_isBetterServer(natsSrv *a, natsSrv *b)
+{
+    if (a->reconnects != b->reconnects)
+        return (a->reconnects < b->reconnects);
+
+    if ((a->rtt == 0) || (b->rtt == 0))
+        return ((a->rtt != 0) && (b->rtt == 0));
+
+    return (a->rtt < b->rtt);
+}
+
+// Moves the best of the first 'count' servers to the head of the list.
+static void
+_moveBestToHead(natsSrvPool *pool, int count)
+{
+    natsSrv *best = pool->srvrs[0];
+    int     b     = 0;
+    int     i;
+
+    for (i = 1; i < count; i++)
+    {
+        if (_isBetterServer(pool->srvrs[i], best))
+        {
+            best = pool->srvrs[i];
+            b    = i;
+        }
+    }
+
+    for (i = b; i > 0; i--)
+        pool->srvrs[i] = pool->srvrs[i-1];
+
+    pool->srvrs[0] = best;
+}
+
+void
+natsSrvPool_UpdateRTT(natsSrv *srv, int64_t rtt)
+{
+    if (rtt <= 0)
+        rtt = 1;
+
+    // Same smoothing factor as TCP (RFC 6298).
+    if (srv->rtt == 0)
+        srv->rtt = rtt;
+    else
+        srv->rtt = srv->rtt - (srv->rtt / 8) + (rtt / 8);
+}
+
 // Pop the current server and put onto the end of the list. Select head of list as long
 // as number of reconnect attempts under MaxReconnect.
 natsSrv*
 natsSrvPool_GetNextServer(natsSrvPool *pool, natsOptions *opts, const natsUrl *ncUrl)
 {
-    natsSrv *s = NULL;
+    natsSrv *s    = NULL;
+    bool    kept  = false;
     int     i, j;
 
     s = natsSrvPool_GetCurrentServer(pool, ncUrl, &i);
@@ -79,6 +131,7 @@ natsSrvPool_GetNextServer(natsSrvPool *pool, natsOptions *opts, const natsUrl *n
     {
         // Move the current server to the back of the list
         pool->srvrs[pool->size - 1] = s;
+        kept = true;
     }
     else
     {
@@ -90,6 +143,17 @@ natsSrvPool_GetNextServer(natsSrvPool *pool, natsOptions *opts, const natsUrl *n
     if (pool->size <= 0)
         return NULL;
 
+    if (opts->serverSelection == NATS_SERVER_SELECTION_LOWEST_RTT)
+    {
+        int count = pool->size;
+
+        // Don't pick the server we just left, unless it is the only one.
+        if (kept && (count > 1))
+            count--;
+
+        _moveBestToHead(pool, count);
+    }
+
     return pool->srvrs[0];
 }
 
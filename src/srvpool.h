@@ -13,6 +13,10 @@ typedef struct __natsSrv
     int         reconnects;
     int64_t     lastAttempt;
 
+    // Smoothed round-trip time, in nanoseconds, measured with the PINGs
+    // sent to this server. Zero if unknown.
+    int64_t     rtt;
+
 } natsSrv;
 
 typedef struct __natsSrvPool
@@ -46,10 +50,17 @@ natsSrv*
 natsSrvPool_GetCurrentServer(natsSrvPool *pool, const natsUrl *url, int *index);
 
 // Pop the current server and put onto the end of the list. Select head of list as long
-// as number of reconnect attempts under MaxReconnect.
+// as number of reconnect attempts under MaxReconnect. With the
+// NATS_SERVER_SELECTION_LOWEST_RTT policy, the best server is moved to the
+// head of the list first.
 natsSrv*
 natsSrvPool_GetNextServer(natsSrvPool *pool, struct __natsOptions *opts, const natsUrl *ncUrl);
 
+// Updates the smoothed round-trip time of the server with a new sample,
+// expressed in nanoseconds.
+void
+natsSrvPool_UpdateRTT(natsSrv *srv, int64_t rtt);
+
 // Destroy the pool, freeing up all memory used.
 void
 natsSrvPool_Destroy(natsSrvPool *pool);
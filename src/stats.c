@@ -44,11 +44,207 @@ natsStatistics_GetCounts(natsStatistics *stats,
     return NATS_OK;
 }
 
+void
+natsHistogram_RecordSince(natsHistogram *h, int64_t start)
+{
+    int64_t     elapsed = (nats_NowInNanoSeconds() - start) / 1000;
+    uint64_t    v       = 0;
+    uint64_t    max;
+    int         shift   = 0;
+
+    if (elapsed > 0)
+        v = (uint64_t) elapsed;
+    if (v >= ((uint64_t) 1 << NATS_HIST_MAX_BITS))
+        v = ((uint64_t) 1 << NATS_HIST_MAX_BITS) - 1;
+
+    // Values below 2*NATS_HIST_SUB_BUCKETS have their own bucket. Above,
+    // the bucket is given by the power of two range and the top bits.
+    while ((v >> shift) >= (2 * NATS_HIST_SUB_BUCKETS))
+        shift++;
+
+    NATS_ATOMIC64_ADD(&(h->buckets[shift * NATS_HIST_SUB_BUCKETS + (int) (v >> shift)]), 1);
+    NATS_ATOMIC64_ADD(&(h->count), 1);
+    NATS_ATOMIC64_ADD(&(h->sum), v);
+
+    while ((v > (max = NATS_ATOMIC64_GET(&(h->max))))
+           && !NATS_ATOMIC64_CAS(&(h->max), max, v))
+    {
+    }
+}
+
+// Returns the highest value that is recorded in the given bucket.
+static uint64_t
+_bucketHighestValue(int idx)
+{
+    int shift = 0;
+
+    if (idx >= 2 * NATS_HIST_SUB_BUCKETS)
+        shift = (idx / NATS_HIST_SUB_BUCKETS) - 1;
+
+    return (((uint64_t) (idx - shift * NATS_HIST_SUB_BUCKETS + 1)) << shift) - 1;
+}
+
+natsStatus
+natsStatistics_setLatency(natsStatistics *stats, natsHistogram *latency)
+{
+    if (stats->latency == NULL)
+    {
+        stats->latency = (natsHistogram*) NATS_CALLOC(NATS_LATENCY_TYPES,
+                                                      sizeof(natsHistogram));
+        if (stats->latency == NULL)
+            return nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    for (int t = 0; t < NATS_LATENCY_TYPES; t++)
+    {
+        natsHistogram *src = &(latency[t]);
+        natsHistogram *dst = &(stats->latency[t]);
+
+        dst->count = NATS_ATOMIC64_GET(&(src->count));
+        dst->sum   = NATS_ATOMIC64_GET(&(src->sum));
+        dst->max   = NATS_ATOMIC64_GET(&(src->max));
+
+        for (int i = 0; i < NATS_HIST_BUCKETS; i++)
+            dst->buckets[i] = NATS_ATOMIC64_GET(&(src->buckets[i]));
+    }
+
+    return NATS_OK;
+}
+
+natsStatus
+natsStatistics_add(natsStatistics *dst, natsStatistics *src)
+{
+    dst->inMsgs        += src->inMsgs;
+    dst->outMsgs       += src->outMsgs;
+    dst->inBytes       += src->inBytes;
+    dst->outBytes      += src->outBytes;
+    dst->reconnects    += src->reconnects;
+    dst->msgPoolHits   += src->msgPoolHits;
+    dst->msgPoolMisses += src->msgPoolMisses;
+
+    if (src->latency == NULL)
+        return NATS_OK;
+
+    if (dst->latency == NULL)
+    {
+        dst->latency = (natsHistogram*) NATS_CALLOC(NATS_LATENCY_TYPES,
+                                                    sizeof(natsHistogram));
+        if (dst->latency == NULL)
+            return nats_setDefaultError(NATS_NO_MEMORY);
+    }
+
+    for (int t = 0; t < NATS_LATENCY_TYPES; t++)
+    {
+        natsHistogram *from = &(src->latency[t]);
+        natsHistogram *to   = &(dst->latency[t]);
+
+        to->count += from->count;
+        to->sum   += from->sum;
+        if (from->max > to->max)
+            to->max = from->max;
+
+        for (int i = 0; i < NATS_HIST_BUCKETS; i++)
+            to->buckets[i] += from->buckets[i];
+    }
+
+    return NATS_OK;
+}
+
+static natsStatus
+_getHistogram(natsHistogram **h, natsStatistics *stats, natsLatencyType type)
+{
+    if ((stats == NULL) || (type < 0) || (type >= NATS_LATENCY_TYPES))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    *h = (stats->latency == NULL ? NULL : &(stats->latency[type]));
+
+    return NATS_OK;
+}
+
+natsStatus
+natsStatistics_GetLatency(natsStatistics *stats, natsLatencyType type,
+                          uint64_t *count, int64_t *mean, int64_t *max)
+{
+    natsHistogram   *h = NULL;
+    natsStatus      s  = _getHistogram(&h, stats, type);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (count != NULL)
+        *count = (h == NULL ? 0 : h->count);
+    if (mean != NULL)
+        *mean = (((h == NULL) || (h->count == 0)) ? 0 : (int64_t) (h->sum / h->count));
+    if (max != NULL)
+        *max = (h == NULL ? 0 : (int64_t) h->max);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsStatistics_GetLatencyPercentile(natsStatistics *stats, natsLatencyType type,
+                                    double percentile, int64_t *value)
+{
+    natsHistogram   *h      = NULL;
+    natsStatus      s       = NATS_OK;
+    uint64_t        target  = 0;
+    uint64_t        total   = 0;
+    uint64_t        v       = 0;
+    int             i;
+
+    if ((value == NULL) || (percentile < 0.0) || (percentile > 100.0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _getHistogram(&h, stats, type);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    *value = 0;
+
+    if ((h == NULL) || (h->count == 0))
+        return NATS_OK;
+
+    target = (uint64_t) ((percentile / 100.0) * (double) h->count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    for (i = 0; i < NATS_HIST_BUCKETS; i++)
+    {
+        total += h->buckets[i];
+        if (total >= target)
+            break;
+    }
+
+    v = (i < NATS_HIST_BUCKETS ? _bucketHighestValue(i) : h->max);
+    if (v > h->max)
+        v = h->max;
+
+    *value = (int64_t) v;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsStatistics_GetMsgPoolCounts(natsStatistics *stats,
+                                uint64_t *hits, uint64_t *misses)
+{
+    if (stats == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    if (hits != NULL)
+        *hits = stats->msgPoolHits;
+    if (misses != NULL)
+        *misses = stats->msgPoolMisses;
+
+    return NATS_OK;
+}
+
 void
 natsStatistics_Destroy(natsStatistics *stats)
 {
     if (stats == NULL)
         return;
 
+    NATS_FREE(stats->latency);
     NATS_FREE(stats);
 }
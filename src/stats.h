@@ -8,6 +8,48 @@
 
 #include "status.h"
 
+// Latency histograms record durations in microseconds. Like HDR histograms,
+// each power of two range is split in NATS_HIST_SUB_BUCKETS buckets, so the
+// relative error of a recorded value is at most 1/NATS_HIST_SUB_BUCKETS,
+// with a fixed amount of memory. Values up to 2^NATS_HIST_MAX_BITS
+// microseconds (about 12 days) are recorded, larger ones are clamped.
+#define NATS_HIST_SUB_BITS      (4)
+#define NATS_HIST_SUB_BUCKETS   (1 << NATS_HIST_SUB_BITS)
+#define NATS_HIST_MAX_BITS      (40)
+#define NATS_HIST_BUCKETS       ((NATS_HIST_MAX_BITS - NATS_HIST_SUB_BITS + 1) * NATS_HIST_SUB_BUCKETS)
+
+#define NATS_LATENCY_TYPES      (NATS_LATENCY_DWELL + 1)
+
+// The counters are updated atomically, since values are recorded from the
+// threads calling the API as well as from the delivery threads.
+typedef struct __natsHistogram
+{
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    max;
+    uint64_t    buckets[NATS_HIST_BUCKETS];
+
+} natsHistogram;
+
+#define NATS_CACHE_LINE_SIZE    (64)
+
+// Counters of a connection, updated atomically. The inbound ones, bumped
+// by the thread reading from the socket, and the outbound ones, bumped by
+// the publishing threads, are a cache line apart so that they don't bounce
+// between the cores running those threads.
+typedef struct __natsConnStats
+{
+    uint64_t    inMsgs;
+    uint64_t    inBytes;
+    uint64_t    reconnects;
+    char        inPad[NATS_CACHE_LINE_SIZE];
+
+    uint64_t    outMsgs;
+    uint64_t    outBytes;
+    char        outPad[NATS_CACHE_LINE_SIZE];
+
+} natsConnStats;
+
 struct __natsStatistics
 {
     uint64_t    inMsgs;
@@ -15,7 +57,27 @@ struct __natsStatistics
     uint64_t    inBytes;
     uint64_t    outBytes;
     uint64_t    reconnects;
+    uint64_t    msgPoolHits;
+    uint64_t    msgPoolMisses;
+
+    // Copy of the connection's latency histograms, allocated the first time
+    // the stats of a connection with latency statistics are collected.
+    natsHistogram   *latency;
 
 };
 
+// Records the time elapsed since 'start' (in nanoseconds, as returned by
+// nats_NowInNanoSeconds()).
+void
+natsHistogram_RecordSince(natsHistogram *h, int64_t start);
+
+// Copies the NATS_LATENCY_TYPES histograms of a connection into the stats
+// object.
+natsStatus
+natsStatistics_setLatency(natsStatistics *stats, natsHistogram *latency);
+
+// Adds the counters and latency histograms of 'src' to 'dst'.
+natsStatus
+natsStatistics_add(natsStatistics *dst, natsStatistics *src);
+
 #endif /* STATS_H_ */
@@ -10,6 +10,8 @@
 #include "sub.h"
 #include "msg.h"
 #include "util.h"
+#include "submux.h"
+#include "probes.h"
 
 #ifdef DEV_MODE
 
@@ -26,24 +28,37 @@ void natsSub_Unlock(natsSubscription *sub)   { natsMutex_Unlock(sub->mu); }
 
 #endif // DEV_MODE
 
+static void
+_stopWorkers(natsSubscription *sub, bool drain);
+
 static void
 _freeSubscription(natsSubscription *sub)
 {
-    natsMsg *m;
-
     if (sub == NULL)
         return;
 
-    while ((m = sub->msgList.head) != NULL)
+    if (sub->workers != NULL)
     {
-        sub->msgList.head = m->next;
-        natsMsg_Destroy(m);
+        _stopWorkers(sub, false);
+
+        for (int i = 0; i < sub->workersCount; i++)
+        {
+            natsCondition_Destroy(sub->workers[i].cond);
+            natsMutex_Destroy(sub->workers[i].mu);
+        }
+        NATS_FREE(sub->workers);
     }
 
+    natsMsgQueue_Clear(&(sub->msgList));
+    natsMsg_free(sub->borrowedMsg);
+
     NATS_FREE(sub->subject);
+    natsSubject_Release(sub->literalSubj);
     NATS_FREE(sub->queue);
+    NATS_FREE(sub->batchMsgs);
 
-    natsTimer_Destroy(sub->signalTimer);
+    natsDlvPool_Release(sub->dlvPool);
+    natsSubMux_free(sub->mux);
 
     if (sub->deliverMsgsThread != NULL)
     {
@@ -86,6 +101,54 @@ natsSub_release(natsSubscription *sub)
         _freeSubscription(sub);
 }
 
+// Pops the next pending message, recording how long it has been waiting
+// if the connection records latencies. Lock held on entry.
+static natsMsg*
+_popMsg(natsSubscription *sub)
+{
+    natsMsg *msg = natsMsgQueue_Pop(&(sub->msgList));
+
+    if ((msg != NULL) && (sub->conn->latency != NULL))
+        natsHistogram_RecordSince(&(sub->conn->latency[NATS_LATENCY_DWELL]),
+                                  msg->queuedAt);
+
+    return msg;
+}
+
+static int
+_popMsgs(natsSubscription *sub, natsMsg **msgs, int max)
+{
+    int count = natsMsgQueue_PopMany(&(sub->msgList), msgs, max);
+
+    if (sub->conn->latency != NULL)
+    {
+        for (int i = 0; i < count; i++)
+            natsHistogram_RecordSince(&(sub->conn->latency[NATS_LATENCY_DWELL]),
+                                      msgs[i]->queuedAt);
+    }
+
+    return count;
+}
+
+// The time spent in the callbacks is measured only if the connection records
+// latencies, since it requires reading the clock twice per callback.
+static int64_t
+_callbackStart(natsSubscription *sub)
+{
+    NATS_PROBE1(deliver__start, sub->sid);
+
+    return (sub->conn->latency != NULL ? nats_NowInNanoSeconds() : 0);
+}
+
+static void
+_callbackDone(natsSubscription *sub, int64_t start)
+{
+    NATS_PROBE1(deliver__done, sub->sid);
+
+    if (start != 0)
+        NATS_ATOMIC64_ADD(&(sub->cbTime), nats_NowInNanoSeconds() - start);
+}
+
 // _deliverMsgs is used to deliver messages to asynchronous subscribers.
 void
 natsSub_deliverMsgs(void *arg)
@@ -94,6 +157,8 @@ natsSub_deliverMsgs(void *arg)
     natsConnection      *nc         = sub->conn;
     natsMsgHandler      mcb         = sub->msgCb;
     void                *mcbClosure = sub->msgCbClosure;
+    natsStatus          s           = NATS_OK;
+    int64_t             target      = 0;
     uint64_t            delivered;
     uint64_t            max;
     natsMsg             *msg;
@@ -102,16 +167,39 @@ natsSub_deliverMsgs(void *arg)
     natsConn_Lock(nc);
     natsConn_Unlock(nc);
 
+    nats_threadStarted(NATS_THREAD_SUB_DELIVERY, nc->opts);
+
     while (true)
     {
         natsSub_Lock(sub);
 
-        sub->inWait++;
+        // Announce that we may wait before checking the count, so that
+        // the connection either sees us waiting or we see its message.
+        (void) NATS_ATOMIC_INC(&(sub->inWait));
 
-        while ((sub->msgList.count == 0) && !(sub->closed))
-            natsCondition_Wait(sub->cond, sub->mu);
+        if ((natsMsgQueue_Count(&(sub->msgList)) == 0) && !(sub->closed))
+        {
+            while ((natsMsgQueue_Count(&(sub->msgList)) == 0) && !(sub->closed))
+                natsCondition_Wait(sub->cond, sub->mu);
+
+            // We have been woken up by the first message. Unless the
+            // subscription favors latency, give others a chance to arrive
+            // so that they are delivered in one go.
+            if (sub->signalDelay > 0)
+            {
+                target = nats_Now() + sub->signalDelay;
+                s      = NATS_OK;
+
+                while ((natsMsgQueue_Count(&(sub->msgList)) < sub->signalLimit)
+                       && (s != NATS_TIMEOUT)
+                       && !(sub->closed))
+                {
+                    s = natsCondition_AbsoluteTimedWait(sub->cond, sub->mu, target);
+                }
+            }
+        }
 
-        sub->inWait--;
+        (void) NATS_ATOMIC_DEC(&(sub->inWait));
 
         if (sub->closed)
         {
@@ -119,7 +207,7 @@ natsSub_deliverMsgs(void *arg)
             break;
         }
 
-        msg = sub->msgList.head;
+        msg = _popMsg(sub);
 
         // Should not happen, but reported by code analysis otherwise.
         if (msg == NULL)
@@ -130,15 +218,6 @@ natsSub_deliverMsgs(void *arg)
 
         delivered = ++(sub->delivered);
 
-        sub->msgList.head = msg->next;
-
-        if (sub->msgList.tail == msg)
-            sub->msgList.tail = NULL;
-
-        sub->msgList.count--;
-
-        msg->next = NULL;
-
         // Capture this under lock.
         max = sub->max;
 
@@ -146,7 +225,11 @@ natsSub_deliverMsgs(void *arg)
 
         if ((max == 0) || (delivered <= max))
         {
-           (*mcb)(nc, sub, msg, mcbClosure);
+            int64_t start = _callbackStart(sub);
+
+            (*mcb)(nc, sub, msg, mcbClosure);
+
+            _callbackDone(sub, start);
         }
 
         // Don't do 'else' because we need to remove when we have hit
@@ -162,56 +245,565 @@ natsSub_deliverMsgs(void *arg)
     natsSub_release(sub);
 }
 
+// Moves up to 'max' messages from the list to 'msgs' and returns how many
+// of them can be delivered given the auto-unsubscribe max. The others are
+// destroyed. Lock held on entry.
+static int
+_popBatch(natsSubscription *sub, natsMsg **msgs, int max, bool *maxReached)
+{
+    int         count  = _popMsgs(sub, msgs, max);
+    int         keep;
+
+    keep = count;
+    if ((sub->max > 0) && (sub->delivered + (uint64_t) count >= sub->max))
+    {
+        keep = (sub->delivered >= sub->max ? 0 : (int) (sub->max - sub->delivered));
+        *maxReached = true;
+
+        for (int i = keep; i < count; i++)
+            natsMsg_Destroy(msgs[i]);
+    }
+
+    sub->delivered += (uint64_t) keep;
+
+    return keep;
+}
+
+// _deliverMsgBatches is used to deliver messages to asynchronous
+// subscribers created with a batch callback.
 static void
-_signalMsgAvailable(natsTimer *timer, void *closure)
+_deliverMsgBatches(void *arg)
 {
-    natsSubscription *sub = (natsSubscription*) closure;
+    natsSubscription    *sub        = (natsSubscription*) arg;
+    natsConnection      *nc         = sub->conn;
+    natsMsgBatchHandler bcb         = sub->batchCb;
+    void                *bcbClosure = sub->msgCbClosure;
+    natsStatus          s           = NATS_OK;
+    int64_t             target      = 0;
+    bool                maxReached  = false;
+    int                 count;
+
+    // This just servers as a barrier for the creation of this thread.
+    natsConn_Lock(nc);
+    natsConn_Unlock(nc);
+
+    nats_threadStarted(NATS_THREAD_SUB_DELIVERY, nc->opts);
 
-    // See if we can get the lock
-    if (!natsMutex_TryLock(sub->mu))
+    while (!maxReached)
     {
-        // This variable is not protected by any lock, but used only
-        // here, so we are fine. This is check that if we failed too
-        // many times, then we will wait for the lock so that we
-        // reduce the risk of the list getting full too quickly.
-        if (++(sub->signalFailCount) == 10)
+        natsSub_Lock(sub);
+
+        (void) NATS_ATOMIC_INC(&(sub->inWait));
+
+        while ((natsMsgQueue_Count(&(sub->msgList)) == 0) && !(sub->closed))
+            natsCondition_Wait(sub->cond, sub->mu);
+
+        // Once there is a message, wait for a full batch, but no more
+        // than 'maxWait' milliseconds.
+        if (sub->maxWait > 0)
         {
-            // Reset our counter.
-            sub->signalFailCount = 0;
+            target = nats_Now() + sub->maxWait;
+            s      = NATS_OK;
+
+            while ((natsMsgQueue_Count(&(sub->msgList)) < sub->maxBatch)
+                   && (s != NATS_TIMEOUT)
+                   && !(sub->closed))
+            {
+                s = natsCondition_AbsoluteTimedWait(sub->cond, sub->mu, target);
+            }
+        }
+
+        (void) NATS_ATOMIC_DEC(&(sub->inWait));
 
-            // Now wait to grab the lock.
-            natsSub_Lock(sub);
+        if (sub->closed)
+        {
+            natsSub_Unlock(sub);
+            break;
         }
-        else
+
+        count = _popBatch(sub, sub->batchMsgs, sub->maxBatch, &maxReached);
+
+        natsSub_Unlock(sub);
+
+        if (count > 0)
+        {
+            int64_t start = _callbackStart(sub);
+
+            (*bcb)(nc, sub, sub->batchMsgs, count, bcbClosure);
+
+            _callbackDone(sub, start);
+        }
+    }
+
+    // If we have hit the max for delivered msgs, remove sub.
+    if (maxReached)
+        natsConn_removeSubscription(nc, sub, true);
+
+    natsSub_release(sub);
+}
+
+// Takes the oldest message of the worker that has the most messages while
+// busy in the callback, for the idle worker 'thief' of a balanced
+// subscription. The lists' consumers are serialized by the workers' lock,
+// so the message is popped with the victim's lock held. Returns NULL if
+// there is nothing to take.
+static natsMsg*
+_stealMsg(natsSubWorker *thief)
+{
+    natsSubscription    *sub    = thief->sub;
+    natsSubWorker       *victim = NULL;
+    natsSubWorker       *w;
+    natsMsg             *msg    = NULL;
+    int                 most    = 0;
+    int                 count;
+    bool                closed;
+
+    natsMutex_Lock(thief->mu);
+    closed = thief->closed;
+    natsMutex_Unlock(thief->mu);
+
+    if (closed)
+        return NULL;
+
+    for (int i = 0; i < sub->workersCount; i++)
+    {
+        w = &(sub->workers[i]);
+        if ((w == thief) || (NATS_ATOMIC_GET(&(w->inWait)) > 0))
+            continue;
+
+        count = natsMsgQueue_Count(&(w->msgList));
+        if (count > most)
+        {
+            most   = count;
+            victim = w;
+        }
+    }
+    if (victim == NULL)
+        return NULL;
+
+    natsMutex_Lock(victim->mu);
+
+    if (!(victim->closed))
+        msg = natsMsgQueue_Pop(&(victim->msgList));
+
+    if ((msg != NULL) && victim->full)
+        natsCondition_Broadcast(victim->cond);
+
+    natsMutex_Unlock(victim->mu);
+
+    return msg;
+}
+
+// Invokes the message callback of a keyed subscription for the messages
+// pushed to this worker by the delivery thread.
+static void
+_deliverWorkerMsgs(void *arg)
+{
+    natsSubWorker       *w          = (natsSubWorker*) arg;
+    natsSubscription    *sub        = w->sub;
+    natsConnection      *nc         = sub->conn;
+    natsMsgHandler      mcb         = sub->msgCb;
+    void                *mcbClosure = sub->msgCbClosure;
+    bool                balanced;
+    int64_t             start;
+    natsMsg             *msg;
+
+    // This just servers as a barrier for the creation of this thread.
+    natsConn_Lock(nc);
+    balanced = sub->balanced;
+    natsConn_Unlock(nc);
+
+    nats_threadStarted(NATS_THREAD_SUB_DELIVERY, nc->opts);
+
+    while (true)
+    {
+        // Rather than waiting, help the workers stuck in a slow callback.
+        if (balanced && (natsMsgQueue_Count(&(w->msgList)) == 0))
+        {
+            msg = _stealMsg(w);
+            if (msg != NULL)
+            {
+                start = _callbackStart(sub);
+
+                (*mcb)(nc, sub, msg, mcbClosure);
+
+                _callbackDone(sub, start);
+                continue;
+            }
+        }
+
+        natsMutex_Lock(w->mu);
+
+        (void) NATS_ATOMIC_INC(&(w->inWait));
+
+        while ((natsMsgQueue_Count(&(w->msgList)) == 0)
+               && !(w->closed)
+               && !(w->draining))
         {
-            // We did not get the lock, will try later.
-            return;
+            natsCondition_Wait(w->cond, w->mu);
         }
+
+        (void) NATS_ATOMIC_DEC(&(w->inWait));
+
+        msg = NULL;
+        if (!(w->closed))
+            msg = natsMsgQueue_Pop(&(w->msgList));
+
+        // Let the delivery thread know that there is room again.
+        if ((msg != NULL) && w->full)
+            natsCondition_Broadcast(w->cond);
+
+        natsMutex_Unlock(w->mu);
+
+        if (msg == NULL)
+            break;
+
+        start = _callbackStart(sub);
+
+        (*mcb)(nc, sub, msg, mcbClosure);
+
+        _callbackDone(sub, start);
     }
+}
 
-    // We have the lock.
+// Hands the message over to the worker, waiting for room if the worker
+// has too many messages, unless it is closed.
+static void
+_pushToWorker(natsSubWorker *w, natsMsg *msg)
+{
+    int count;
 
-    if (sub->msgList.count == 0)
+    if (natsMsgQueue_Count(&(w->msgList)) >= NATS_SUB_WORKER_MAX_MSGS)
     {
-        // There was no message, reset our interval to a higher value.
-        sub->signalTimerInterval = 10000;
-        natsTimer_Reset(sub->signalTimer, sub->signalTimerInterval);
+        natsMutex_Lock(w->mu);
+
+        w->full = true;
+        while ((natsMsgQueue_Count(&(w->msgList)) >= NATS_SUB_WORKER_MAX_MSGS)
+               && !(w->closed))
+        {
+            natsCondition_Wait(w->cond, w->mu);
+        }
+        w->full = false;
+
+        natsMutex_Unlock(w->mu);
     }
-    else if (sub->inWait > 0)
+
+    // If the worker is closed, the message is destroyed when the delivery
+    // thread clears the worker's list on exit.
+    count = natsMsgQueue_Push(&(w->msgList), msg);
+
+    // Same as the connection waking up the delivery thread.
+    if ((count == 1) && (NATS_ATOMIC_GET(&(w->inWait)) > 0))
     {
-        // Signal the waiters
-        natsCondition_Broadcast(sub->cond);
+        natsMutex_Lock(w->mu);
+        natsCondition_Broadcast(w->cond);
+        natsMutex_Unlock(w->mu);
     }
+}
 
-    natsSub_Unlock(sub);
+// Stops the workers, once they have delivered their messages if 'drain' is
+// true, and waits for their threads to exit.
+static void
+_stopWorkers(natsSubscription *sub, bool drain)
+{
+    natsSubWorker *w;
+
+    for (int i = 0; i < sub->workersCount; i++)
+    {
+        w = &(sub->workers[i]);
+
+        natsMutex_Lock(w->mu);
+        if (drain)
+            w->draining = true;
+        else
+            w->closed = true;
+        natsCondition_Broadcast(w->cond);
+        natsMutex_Unlock(w->mu);
+    }
+    for (int i = 0; i < sub->workersCount; i++)
+    {
+        w = &(sub->workers[i]);
+
+        if (w->thread != NULL)
+        {
+            natsThread_Join(w->thread);
+            natsThread_Destroy(w->thread);
+            w->thread = NULL;
+        }
+        natsMsgQueue_Clear(&(w->msgList));
+    }
 }
 
+// Returns the worker of a balanced subscription with the fewest messages,
+// counting the one in the callback, starting the search after the worker
+// picked last so that idle workers take turns.
+static natsSubWorker*
+_pickWorker(natsSubscription *sub, int *next)
+{
+    natsSubWorker   *best     = NULL;
+    int             bestLoad  = 0;
+    natsSubWorker   *w;
+    int             load;
+
+    for (int i = 0; i < sub->workersCount; i++)
+    {
+        w    = &(sub->workers[(*next + i) % sub->workersCount]);
+        load = natsMsgQueue_Count(&(w->msgList))
+               + (NATS_ATOMIC_GET(&(w->inWait)) > 0 ? 0 : 1);
+
+        if ((best == NULL) || (load < bestLoad))
+        {
+            best     = w;
+            bestLoad = load;
+            if (load == 0)
+                break;
+        }
+    }
+    *next = (int) ((best - sub->workers) + 1) % sub->workersCount;
+
+    return best;
+}
+
+// The delivery thread of keyed subscriptions: moves the messages to the
+// worker their key maps to, or to the least busy one if the subscription
+// is balanced.
 static void
-_signalTimerStopped(natsTimer *timer, void *closure)
+_dispatchKeyedMsgs(void *arg)
+{
+    natsSubscription    *sub        = (natsSubscription*) arg;
+    natsConnection      *nc         = sub->conn;
+    natsMsgKeyHandler   kcb         = sub->keyCb;
+    void                *kcbClosure = sub->msgCbClosure;
+    natsStatus          s           = NATS_OK;
+    int64_t             target      = 0;
+    bool                maxReached  = false;
+    bool                balanced;
+    int                 next        = 0;
+    uint32_t            key;
+    natsMsg             *msgs[NATS_SUB_DISPATCH_BATCH];
+    int                 count;
+
+    // This just servers as a barrier for the creation of this thread.
+    natsConn_Lock(nc);
+    balanced = sub->balanced;
+    natsConn_Unlock(nc);
+
+    nats_threadStarted(NATS_THREAD_SUB_DELIVERY, nc->opts);
+
+    while (!maxReached)
+    {
+        natsSub_Lock(sub);
+
+        (void) NATS_ATOMIC_INC(&(sub->inWait));
+
+        if ((natsMsgQueue_Count(&(sub->msgList)) == 0) && !(sub->closed))
+        {
+            while ((natsMsgQueue_Count(&(sub->msgList)) == 0) && !(sub->closed))
+                natsCondition_Wait(sub->cond, sub->mu);
+
+            if (sub->signalDelay > 0)
+            {
+                target = nats_Now() + sub->signalDelay;
+                s      = NATS_OK;
+
+                while ((natsMsgQueue_Count(&(sub->msgList)) < sub->signalLimit)
+                       && (s != NATS_TIMEOUT)
+                       && !(sub->closed))
+                {
+                    s = natsCondition_AbsoluteTimedWait(sub->cond, sub->mu, target);
+                }
+            }
+        }
+
+        (void) NATS_ATOMIC_DEC(&(sub->inWait));
+
+        if (sub->closed)
+        {
+            natsSub_Unlock(sub);
+            break;
+        }
+
+        count = _popBatch(sub, msgs, NATS_SUB_DISPATCH_BATCH, &maxReached);
+
+        natsSub_Unlock(sub);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (balanced)
+            {
+                _pushToWorker(_pickWorker(sub, &next), msgs[i]);
+                continue;
+            }
+
+            if (kcb != NULL)
+                key = (*kcb)(msgs[i], kcbClosure);
+            else
+                key = natsStrHash_Hash(msgs[i]->subject,
+                                       (int) strlen(msgs[i]->subject));
+
+            _pushToWorker(&(sub->workers[key % (uint32_t) sub->workersCount]),
+                          msgs[i]);
+        }
+    }
+
+    // If we have hit the max for delivered msgs, remove sub once the
+    // workers are done with the messages.
+    _stopWorkers(sub, maxReached);
+
+    if (maxReached)
+        natsConn_removeSubscription(nc, sub, true);
+
+    natsSub_release(sub);
+}
+
+static natsStatus
+_createWorkers(natsSubscription *sub, int count)
+{
+    natsStatus      s = NATS_OK;
+    natsSubWorker   *w;
+
+    sub->workers = (natsSubWorker*) NATS_CALLOC(count, sizeof(natsSubWorker));
+    if (sub->workers == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    for (int i = 0; (s == NATS_OK) && (i < count); i++)
+    {
+        w = &(sub->workers[i]);
+        w->sub = sub;
+
+        s = natsMutex_CreateEx(&(w->mu), NATS_LOCK_SUB);
+        if (s == NATS_OK)
+        {
+            s = natsCondition_Create(&(w->cond));
+            if (s != NATS_OK)
+            {
+                natsMutex_Destroy(w->mu);
+                break;
+            }
+        }
+        if (s == NATS_OK)
+        {
+            // The workers created so far are stopped and destroyed with
+            // the subscription.
+            sub->workersCount++;
+
+            s = natsThread_Create(&(w->thread), _deliverWorkerMsgs, (void*) w);
+        }
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+bool
+natsSub_deliverMsgsFromPool(natsSubscription *sub)
 {
-    natsSubscription *sub = (natsSubscription*) closure;
+    natsConnection      *nc         = sub->conn;
+    natsMsgHandler      mcb         = sub->msgCb;
+    void                *mcbClosure = sub->msgCbClosure;
+    uint64_t            delivered;
+    uint64_t            max;
+    natsMsg             *msg;
+    bool                closed      = false;
+    int                 i;
+
+    for (i = 0; !closed && (i < NATS_DLVPOOL_MAX_BATCH); i++)
+    {
+        natsSub_Lock(sub);
+
+        if (sub->batchCb != NULL)
+        {
+            int     count = 0;
+            int64_t start;
+
+            if (!(sub->closed))
+                count = _popBatch(sub, sub->batchMsgs, sub->maxBatch,
+                                  &closed);
+
+            natsSub_Unlock(sub);
+
+            if (count == 0)
+                break;
+
+            start = _callbackStart(sub);
+
+            (*(sub->batchCb))(nc, sub, sub->batchMsgs, count, mcbClosure);
+
+            _callbackDone(sub, start);
+
+            // Count the batch against the worker's budget.
+            i += count - 1;
+
+            if (closed)
+                natsConn_removeSubscription(nc, sub, true);
+
+            continue;
+        }
+
+        msg = NULL;
+        if (!(sub->closed))
+            msg = _popMsg(sub);
+
+        if (msg == NULL)
+        {
+            natsSub_Unlock(sub);
+            break;
+        }
+
+        delivered = ++(sub->delivered);
+        max       = sub->max;
+
+        natsSub_Unlock(sub);
+
+        if ((max == 0) || (delivered <= max))
+        {
+            int64_t start = _callbackStart(sub);
+
+            (*mcb)(nc, sub, msg, mcbClosure);
+
+            _callbackDone(sub, start);
+        }
+
+        if ((max > 0) && (delivered >= max))
+        {
+            natsConn_removeSubscription(nc, sub, true);
+            closed = true;
+        }
+    }
+
+    // Let the connection schedule us again, then check if it may have
+    // pushed a message before that and skipped scheduling.
+    NATS_ATOMIC_SET(&(sub->dlvScheduled), 0);
+
+    natsSub_Lock(sub);
+    closed = sub->closed;
+    natsSub_Unlock(sub);
+
+    if (!closed
+        && (natsMsgQueue_Count(&(sub->msgList)) > 0)
+        && NATS_ATOMIC_CAS(&(sub->dlvScheduled), 0, 1))
+    {
+        return true;
+    }
 
     natsSub_release(sub);
+
+    return false;
+}
+
+void
+natsSub_scheduleDelivery(natsSubscription *sub)
+{
+    if (!NATS_ATOMIC_CAS(&(sub->dlvScheduled), 0, 1))
+        return;
+
+    // The pool holds a reference while the subscription is scheduled.
+    natsSub_retain(sub);
+
+    if (!natsDlvPool_Schedule(sub->dlvPool, sub->dlvWorker, sub))
+    {
+        NATS_ATOMIC_SET(&(sub->dlvScheduled), 0);
+        natsSub_release(sub);
+    }
 }
 
 void
@@ -219,20 +811,50 @@ natsSub_close(natsSubscription *sub, bool connectionClosed)
 {
     natsSub_Lock(sub);
 
-    if (sub->signalTimer != NULL)
-        natsTimer_Stop(sub->signalTimer);
-
     sub->closed = true;
     sub->connClosed = connectionClosed;
     natsCondition_Broadcast(sub->cond);
 
+    // Workers stop at once, even if the delivery thread is waiting for
+    // room in one of them.
+    for (int i = 0; i < sub->workersCount; i++)
+    {
+        natsSubWorker *w = &(sub->workers[i]);
+
+        natsMutex_Lock(w->mu);
+        w->closed = true;
+        natsCondition_Broadcast(w->cond);
+        natsMutex_Unlock(w->mu);
+    }
+
     natsSub_Unlock(sub);
 }
 
+// Returns 'true' if one of the tokens of the subject is a wildcard.
+static bool
+_hasWildcards(const char *subj)
+{
+    const char *p = subj;
+
+    for (; *p != '\0'; p++)
+    {
+        if (((*p == '*') || (*p == '>'))
+            && ((p == subj) || (*(p - 1) == '.'))
+            && ((*(p + 1) == '\0') || (*(p + 1) == '.')))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 natsStatus
 natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
-               const char *queueGroup, natsMsgHandler cb, void *cbClosure,
-               bool noDelay)
+               const char *queueGroup, natsMsgHandler cb,
+               natsMsgBatchHandler batchCb, int maxBatch, int64_t maxWait,
+               void *cbClosure, bool noDelay, int workers,
+               natsMsgKeyHandler keyCb)
 {
     natsStatus          s = NATS_OK;
     natsSubscription    *sub = NULL;
@@ -241,7 +863,7 @@ natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
     if (sub == NULL)
         return nats_setDefaultError(NATS_NO_MEMORY);
 
-    s = natsMutex_Create(&(sub->mu));
+    s = natsMutex_CreateEx(&(sub->mu), NATS_LOCK_SUB);
     if (s != NATS_OK)
     {
         NATS_FREE(sub);
@@ -250,17 +872,39 @@ natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
 
     natsConn_retain(nc);
 
-    sub->refs           = 1;
-    sub->conn           = nc;
-    sub->msgCb          = cb;
-    sub->msgCbClosure   = cbClosure;
-    sub->noDelay        = noDelay;
-    sub->pendingMax     = nc->opts->maxPendingMsgs;
-    sub->signalLimit    = (int)(sub->pendingMax * 0.75);
+    sub->refs            = 1;
+    sub->conn            = nc;
+    sub->msgCb           = cb;
+    sub->batchCb         = batchCb;
+    sub->maxBatch        = maxBatch;
+    sub->maxWait         = maxWait;
+    sub->msgCbClosure    = cbClosure;
+    sub->noDelay         = noDelay;
+    sub->keyCb           = keyCb;
+    sub->pendingMax      = nc->opts->maxPendingMsgs;
+    sub->pendingBytesMax = nc->opts->maxPendingBytes;
+
+    if (noDelay)
+    {
+        sub->signalLimit = 1;
+        sub->signalDelay = 0;
+    }
+    else if (batchCb != NULL)
+    {
+        sub->signalLimit = maxBatch;
+        sub->signalDelay = 0;
+    }
+    else
+    {
+        sub->signalLimit = (int)(sub->pendingMax * 0.75);
+        sub->signalDelay = NATS_SUB_DEFAULT_SIGNAL_DELAY;
+    }
 
     sub->subject = NATS_STRDUP(subj);
     if (sub->subject == NULL)
         s = nats_setDefaultError(NATS_NO_MEMORY);
+    if ((s == NATS_OK) && !_hasWildcards(subj))
+        s = natsSubject_Create(&(sub->literalSubj), subj, (int) strlen(subj));
 
     if ((s == NATS_OK) && (queueGroup != NULL) && (strlen(queueGroup) > 0))
     {
@@ -270,24 +914,50 @@ natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
     }
     if (s == NATS_OK)
         s = natsCondition_Create(&(sub->cond));
-    if ((s == NATS_OK) && !(sub->noDelay))
+    if ((s == NATS_OK) && (batchCb != NULL))
     {
-        // Set the interval to any value, really, it will get reset to
-        // a smaller value when the delivery thread should be signaled.
-        sub->signalTimerInterval = 10000;
+        sub->batchMsgs = (natsMsg**) NATS_CALLOC(maxBatch, sizeof(natsMsg*));
+        if (sub->batchMsgs == NULL)
+            s = nats_setDefaultError(NATS_NO_MEMORY);
 
-        // Let's not rely on the created timer acquiring the lock that
-        // would make it safe to retain only on success.
-        _retain(sub);
+        // The callback is invoked with the messages it is given, there is
+        // no need for the message callback.
+        cb = NULL;
+    }
+    if ((s == NATS_OK) && (workers > 0))
+    {
+        if (nc->opts->callerDrivenIO)
+            s = nats_setError(NATS_ILLEGAL_STATE, "%s",
+                              "Keyed subscriptions need the connection's threads");
+        else
+            s = _createWorkers(sub, workers);
+    }
+    if ((s == NATS_OK) && ((cb != NULL) || (batchCb != NULL))
+        && nc->opts->useSharedDlvPool && (workers == 0))
+    {
+        s = nats_getDlvPool(&(sub->dlvPool));
+        if (s == NATS_OK)
+        {
+            sub->dlvWorker = natsDlvPool_AssignWorker(sub->dlvPool);
 
-        s = natsTimer_Create(&(sub->signalTimer),
-                             _signalMsgAvailable,
-                             _signalTimerStopped,
-                             sub->signalTimerInterval, (void*) sub);
-        if (s != NATS_OK)
-            _release(sub);
+            // Messages are scheduled for delivery as soon as they arrive.
+            sub->noDelay     = true;
+            sub->signalLimit = 1;
+            sub->signalDelay = 0;
+        }
+    }
+    if ((s == NATS_OK) && ((cb != NULL) || (batchCb != NULL))
+        && nc->opts->callerDrivenIO && (workers == 0))
+    {
+        // Messages are delivered from natsConnection_ProcessIO(), as soon
+        // as they have been read.
+        sub->inlineDlv   = true;
+        sub->noDelay     = true;
+        sub->signalLimit = 1;
+        sub->signalDelay = 0;
     }
-    if ((s == NATS_OK) && (cb != NULL))
+    if ((s == NATS_OK) && ((cb != NULL) || (batchCb != NULL))
+        && (sub->dlvPool == NULL) && !(sub->inlineDlv))
     {
         // Let's not rely on the created thread acquiring the lock that
         // would make it safe to retain only on success.
@@ -295,31 +965,141 @@ natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
 
         // If we have an async callback, start up a sub specific
         // thread to deliver the messages.
-        s = natsThread_Create(&(sub->deliverMsgsThread), natsSub_deliverMsgs,
-                              (void*) sub);
+        if (workers > 0)
+            s = natsThread_Create(&(sub->deliverMsgsThread),
+                                  _dispatchKeyedMsgs, (void*) sub);
+        else
+            s = natsThread_Create(&(sub->deliverMsgsThread),
+                                  (batchCb != NULL ? _deliverMsgBatches : natsSub_deliverMsgs),
+                                  (void*) sub);
         if (s != NATS_OK)
             _release(sub);
     }
 
-    if (s == NATS_OK)
-        *newSub = sub;
-    else
-        natsSub_release(sub);
+    if (s == NATS_OK)
+        *newSub = sub;
+    else
+        natsSub_release(sub);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+/*
+ * Expresses interest in the given subject. The subject can have wildcards
+ * (partial:*, full:>). Messages will be delivered to the associated
+ * natsMsgHandler. If no natsMsgHandler is given, the subscription is a
+ * synchronous subscription and can be polled via natsSubscription_NextMsg().
+ */
+natsStatus
+natsConnection_Subscribe(natsSubscription **sub, natsConnection *nc, const char *subject,
+                         natsMsgHandler cb, void *cbClosure)
+{
+    return natsConn_subscribe(sub, nc, subject, NULL, cb, cbClosure, false);
+}
+
+/*
+ * Similar to natsConnection_Subscribe, but messages are delivered to the
+ * callback in batches of up to 'maxBatch' messages. When 'maxWait' is
+ * positive, the library waits up to that many milliseconds for a full batch
+ * before invoking the callback with the messages available.
+ */
+natsStatus
+natsConnection_SubscribeBatch(natsSubscription **sub, natsConnection *nc,
+                              const char *subject, natsMsgBatchHandler cb,
+                              void *cbClosure, int maxBatch, int64_t maxWait)
+{
+    natsStatus s;
+
+    if ((cb == NULL) || (maxBatch <= 0) || (maxWait < 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConn_subscribeBatch(sub, nc, subject, cb, maxBatch, maxWait,
+                                cbClosure);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+/*
+ * Similar to natsConnection_Subscribe, but the callback is invoked by
+ * 'workers' threads. Messages with the same key are delivered in order by
+ * the same thread.
+ */
+natsStatus
+natsConnection_SubscribeKeyed(natsSubscription **sub, natsConnection *nc,
+                              const char *subject, natsMsgHandler cb,
+                              void *cbClosure, int workers,
+                              natsMsgKeyHandler keyCb)
+{
+    natsStatus s;
+
+    if ((cb == NULL) || (workers <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConn_subscribeKeyed(sub, nc, subject, cb, cbClosure, workers,
+                                keyCb);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+/*
+ * Creates a subscription whose messages' payload is handed over to the
+ * callbacks as it is read, instead of being assembled into a natsMsg.
+ */
+natsStatus
+natsConnection_SubscribeStream(natsSubscription **sub, natsConnection *nc,
+                               const char *subject,
+                               natsStreamBeginHandler beginCb,
+                               natsStreamChunkHandler chunkCb,
+                               natsStreamEndHandler endCb,
+                               void *cbClosure)
+{
+    natsStatus s;
+
+    if ((beginCb == NULL) || (chunkCb == NULL) || (endCb == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConn_subscribeStream(sub, nc, subject, beginCb, chunkCb, endCb,
+                                 cbClosure);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
 
 /*
- * Expresses interest in the given subject. The subject can have wildcards
- * (partial:*, full:>). Messages will be delivered to the associated
- * natsMsgHandler. If no natsMsgHandler is given, the subscription is a
- * synchronous subscription and can be polled via natsSubscription_NextMsg().
+ * Creates a subscription on each of the 'count' subjects. The protocols are
+ * sent to the server in a single write and, if 'timeout' is positive,
+ * confirmed with a single PING/PONG.
  */
 natsStatus
-natsConnection_Subscribe(natsSubscription **sub, natsConnection *nc, const char *subject,
-                         natsMsgHandler cb, void *cbClosure)
+natsConnection_SubscribeMany(natsSubscription **subs, natsConnection *nc,
+                             const char **subjects, int count,
+                             natsMsgHandler cb, void *cbClosure,
+                             int64_t timeout)
 {
-    return natsConn_subscribe(sub, nc, subject, NULL, cb, cbClosure, false);
+    natsStatus s;
+
+    if (timeout < 0)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = natsConn_subscribeMany(subs, nc, subjects, count, cb, cbClosure);
+    if ((s == NATS_OK) && (timeout > 0))
+    {
+        s = natsConnection_FlushTimeout(nc, timeout);
+        if (s != NATS_OK)
+        {
+            nats_doNotUpdateErrStack(true);
+
+            (void) natsConn_unsubscribeMany(nc, subs, count);
+            for (int i = 0; i < count; i++)
+            {
+                natsSubscription_Destroy(subs[i]);
+                subs[i] = NULL;
+            }
+
+            nats_doNotUpdateErrStack(false);
+        }
+    }
+
+    return NATS_UPDATE_ERR_STACK(s);
 }
 
 /*
@@ -357,6 +1137,31 @@ natsConnection_QueueSubscribe(natsSubscription **sub, natsConnection *nc,
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+/*
+ * Similar to natsConnection_QueueSubscribe, but the callback is invoked by
+ * 'workers' threads, each message by the least busy one. This is a single
+ * member of the queue group for the server.
+ */
+natsStatus
+natsConnection_QueueSubscribeWorkers(natsSubscription **sub,
+                                     natsConnection *nc, const char *subject,
+                                     const char *queueGroup, natsMsgHandler cb,
+                                     void *cbClosure, int workers)
+{
+    natsStatus s;
+
+    if ((queueGroup == NULL) || (strlen(queueGroup) == 0) || (cb == NULL)
+        || (workers <= 0))
+    {
+        return nats_setDefaultError(NATS_INVALID_ARG);
+    }
+
+    s = natsConn_subscribeWorkers(sub, nc, subject, queueGroup, cb, cbClosure,
+                                  workers);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 /*
  * Similar to natsQueueSubscribe except that the subscription is synchronous.
  */
@@ -392,9 +1197,12 @@ natsSubscription_NoDeliveryDelay(natsSubscription *sub)
 
     if (!(sub->noDelay))
     {
-        sub->noDelay = true;
+        sub->noDelay     = true;
+        sub->signalLimit = 1;
+        sub->signalDelay = 0;
 
-        natsTimer_Stop(sub->signalTimer);
+        // Don't let the delivery thread wait for more messages.
+        natsCondition_Broadcast(sub->cond);
     }
 
     natsSub_Unlock(sub);
@@ -402,29 +1210,88 @@ natsSubscription_NoDeliveryDelay(natsSubscription *sub)
     return NATS_OK;
 }
 
-
 /*
- * Return the next message available to a synchronous subscriber or block until
- * one is available. A timeout can be used to return when no message has been
- * delivered.
+ * Sets how long the delivery thread waits for more messages after the
+ * first one arrives, and how many pending messages end that wait.
  */
 natsStatus
-natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub, int64_t timeout)
+natsSubscription_SetDeliveryDelay(natsSubscription *sub, int minPending,
+                                  int64_t maxDelay)
+{
+    natsStatus s = NATS_OK;
+
+    if ((sub == NULL) || (minPending <= 0) || (maxDelay < 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsSub_Lock(sub);
+
+    if (sub->closed)
+        s = nats_setDefaultError(NATS_INVALID_SUBSCRIPTION);
+    else if ((sub->msgCb == NULL) || (sub->dlvPool != NULL) || sub->inlineDlv)
+        s = nats_setError(NATS_ILLEGAL_STATE, "%s",
+                          "Delivery delay applies only to asynchronous subscriptions with a delivery thread");
+
+    if (s == NATS_OK)
+    {
+        sub->noDelay     = ((minPending == 1) || (maxDelay == 0));
+        sub->signalLimit = minPending;
+        sub->signalDelay = maxDelay;
+
+        natsCondition_Broadcast(sub->cond);
+    }
+
+    natsSub_Unlock(sub);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+// Spins until the subscription has a message, for up to 'spinMicros'
+// microseconds but no more than 'timeout' milliseconds.
+static void
+_spinForMsgs(natsSubscription *sub, int64_t spinMicros, int64_t timeout)
+{
+    int64_t spin     = spinMicros * 1000;
+    int64_t deadline = 0;
+
+    if (spin > timeout * 1000000)
+        spin = timeout * 1000000;
+
+    deadline = nats_NowInNanoSeconds() + spin;
+
+    while ((natsMsgQueue_Count(&(sub->msgList)) == 0)
+           && (nats_NowInNanoSeconds() < deadline))
+    {
+        // Spinning...
+    }
+}
+
+// Pops up to 'max' messages of a synchronous subscription, waiting up
+// to 'timeout' for the first one. If 'borrow' is true ('max' is then 1),
+// the message stays owned by the subscription and the one previously
+// lent is released.
+static natsStatus
+_nextMsgs(natsMsg **msgs, int max, int *count, natsSubscription *sub,
+          int64_t timeout, bool borrow)
 {
     natsStatus      s    = NATS_OK;
     natsConnection  *nc  = NULL;
-    natsMsg         *msg = NULL;
+    natsMsg         *prev = NULL;
     bool            removeSub = false;
     int64_t         target    = 0;
-
-    if ((sub == NULL) || (nextMsg == NULL))
-        return nats_setDefaultError(NATS_INVALID_ARG);
+    int             n         = max;
 
     natsSub_Lock(sub);
 
+    if (borrow)
+    {
+        prev = sub->borrowedMsg;
+        sub->borrowedMsg = NULL;
+    }
+
     if (sub->connClosed)
     {
         natsSub_Unlock(sub);
+        natsMsg_free(prev);
 
         return nats_setDefaultError(NATS_CONNECTION_CLOSED);
     }
@@ -436,30 +1303,45 @@ natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub, int64_t timeo
             s = NATS_INVALID_SUBSCRIPTION;
 
         natsSub_Unlock(sub);
+        natsMsg_free(prev);
 
         return nats_setDefaultError(s);
     }
-    if (sub->msgCb != NULL)
+    if ((sub->msgCb != NULL) || (sub->batchCb != NULL) || sub->streaming)
     {
         natsSub_Unlock(sub);
+        natsMsg_free(prev);
 
         return nats_setDefaultError(NATS_ILLEGAL_STATE);
     }
-    if (sub->slowConsumer)
+    if (NATS_ATOMIC_CAS(&(sub->slowConsumer), 1, 0))
     {
-        sub->slowConsumer = false;
         natsSub_Unlock(sub);
+        natsMsg_free(prev);
 
         return nats_setDefaultError(NATS_SLOW_CONSUMER);
     }
 
     nc = sub->conn;
 
+    if ((timeout > 0)
+        && (nc->opts->busyPoll > 0)
+        && (natsMsgQueue_Count(&(sub->msgList)) == 0))
+    {
+        // The reader does not need our lock to queue messages, nor signals
+        // us since we are not counted as waiting.
+        target = nats_Now() + timeout;
+
+        natsSub_Unlock(sub);
+        _spinForMsgs(sub, nc->opts->busyPoll, timeout);
+        natsSub_Lock(sub);
+    }
+
     if (timeout > 0)
     {
-        sub->inWait++;
+        (void) NATS_ATOMIC_INC(&(sub->inWait));
 
-        while ((sub->msgList.count == 0)
+        while ((natsMsgQueue_Count(&(sub->msgList)) == 0)
                && (s != NATS_TIMEOUT)
                && !(sub->closed))
         {
@@ -471,53 +1353,118 @@ natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub, int64_t timeo
                 s = nats_setDefaultError(s);
         }
 
-        sub->inWait--;
+        (void) NATS_ATOMIC_DEC(&(sub->inWait));
 
         if (sub->closed)
             s = nats_setDefaultError(NATS_INVALID_SUBSCRIPTION);
     }
     else
     {
-        s = (sub->msgList.count == 0 ? NATS_TIMEOUT : NATS_OK);
+        s = (natsMsgQueue_Count(&(sub->msgList)) == 0 ? NATS_TIMEOUT : NATS_OK);
         if (s != NATS_OK)
             s = nats_setDefaultError(s);
     }
 
-    if (s == NATS_OK)
+    // Do not hand out more messages than the auto-unsubscribe max allows.
+    if ((s == NATS_OK) && (sub->max > 0))
     {
-        sub->delivered++;
-        if (sub->max > 0)
-        {
-            if (sub->delivered > sub->max)
-                s = nats_setDefaultError(NATS_MAX_DELIVERED_MSGS);
-            else if (sub->delivered == sub->max)
-                removeSub = true;
-        }
+        if (sub->delivered >= sub->max)
+            s = nats_setDefaultError(NATS_MAX_DELIVERED_MSGS);
+        else if ((uint64_t) n > (sub->max - sub->delivered))
+            n = (int) (sub->max - sub->delivered);
     }
     if (s == NATS_OK)
     {
-        msg = sub->msgList.head;
+        n = _popMsgs(sub, msgs, n);
 
-        sub->msgList.head = msg->next;
+        sub->delivered += (uint64_t) n;
+        if ((sub->max > 0) && (sub->delivered == sub->max))
+            removeSub = true;
 
-        if (sub->msgList.tail == msg)
-            sub->msgList.tail = NULL;
+        if (borrow)
+            sub->borrowedMsg = msgs[0];
 
-        sub->msgList.count--;
-
-        msg->next = NULL;
-
-        *nextMsg = msg;
+        *count = n;
     }
 
     natsSub_Unlock(sub);
 
+    // Lent messages are released directly (to the pool or slab they come
+    // from) instead of going through the garbage collector.
+    natsMsg_free(prev);
+
     if (removeSub)
         natsConn_removeSubscription(nc, sub, true);
 
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+/*
+ * Return the next message available to a synchronous subscriber or block until
+ * one is available. A timeout can be used to return when no message has been
+ * delivered.
+ */
+natsStatus
+natsSubscription_NextMsg(natsMsg **nextMsg, natsSubscription *sub, int64_t timeout)
+{
+    natsStatus  s;
+    int         count = 0;
+
+    if ((sub == NULL) || (nextMsg == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _nextMsgs(nextMsg, 1, &count, sub, timeout, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsSubscription_NextMsgBorrowed(natsMsg **nextMsg, natsSubscription *sub,
+                                 int64_t timeout)
+{
+    natsStatus  s;
+    int         count = 0;
+
+    if ((sub == NULL) || (nextMsg == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _nextMsgs(nextMsg, 1, &count, sub, timeout, true);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsSubscription_NextMsgs(natsSubscription *sub, natsMsg **msgs, int max,
+                          int64_t timeout, int *count)
+{
+    natsStatus s;
+
+    if ((sub == NULL) || (msgs == NULL) || (max <= 0) || (count == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    *count = 0;
+
+    s = _nextMsgs(msgs, max, count, sub, timeout, false);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+void
+natsSubscription_ReleaseMsg(natsSubscription *sub)
+{
+    natsMsg *msg = NULL;
+
+    if (sub == NULL)
+        return;
+
+    natsSub_Lock(sub);
+    msg = sub->borrowedMsg;
+    sub->borrowedMsg = NULL;
+    natsSub_Unlock(sub);
+
+    natsMsg_free(msg);
+}
+
 static natsStatus
 _unsubscribe(natsSubscription *sub, int max)
 {
@@ -564,6 +1511,49 @@ natsSubscription_Unsubscribe(natsSubscription *sub)
     return NATS_UPDATE_ERR_STACK(s);
 }
 
+/*
+ * Unsubscribes all 'count' subscriptions, which must belong to the same
+ * connection, with a single write of the protocols.
+ */
+natsStatus
+natsSubscription_UnsubscribeMany(natsSubscription **subs, int count,
+                                 int64_t timeout)
+{
+    natsStatus      s   = NATS_OK;
+    natsConnection  *nc = NULL;
+
+    if ((subs == NULL) || (count <= 0) || (timeout < 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    for (int i = 0; (s == NATS_OK) && (i < count); i++)
+    {
+        if (subs[i] == NULL)
+            return nats_setDefaultError(NATS_INVALID_ARG);
+
+        natsSub_Lock(subs[i]);
+
+        if (subs[i]->connClosed)
+            s = NATS_CONNECTION_CLOSED;
+        else if (subs[i]->closed)
+            s = NATS_INVALID_SUBSCRIPTION;
+        else if (nc == NULL)
+            nc = subs[i]->conn;
+        else if (subs[i]->conn != nc)
+            s = NATS_INVALID_ARG;
+
+        natsSub_Unlock(subs[i]);
+    }
+    if (s != NATS_OK)
+        return nats_setDefaultError(s);
+
+    // The subscriptions retain the connection until they are destroyed.
+    s = natsConn_unsubscribeMany(nc, subs, count);
+    if ((s == NATS_OK) && (timeout > 0))
+        s = natsConnection_FlushTimeout(nc, timeout);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
 /*
  * This call issues an automatic natsSubscription_Unsubscribe that is
  * processed by the server when 'max' messages have been received.
@@ -595,7 +1585,158 @@ natsSubscription_QueuedMsgs(natsSubscription *sub, uint64_t *queuedMsgs)
         return nats_setDefaultError(NATS_INVALID_SUBSCRIPTION);
     }
 
-    *queuedMsgs = (uint64_t) sub->msgList.count;
+    *queuedMsgs = (uint64_t) natsMsgQueue_Count(&(sub->msgList));
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+// The pending counters and limits are read by the connection without the
+// subscription's lock, the lock only guards against a closed subscription.
+static natsStatus
+_lockIfValid(natsSubscription *sub)
+{
+    if (sub == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    natsSub_Lock(sub);
+
+    if (sub->closed)
+    {
+        natsSub_Unlock(sub);
+
+        return nats_setDefaultError(NATS_INVALID_SUBSCRIPTION);
+    }
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_SetPendingLimits(natsSubscription *sub, int msgLimit,
+                                  int64_t bytesLimit)
+{
+    natsStatus s;
+
+    if ((msgLimit <= 0) || (bytesLimit <= 0))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _lockIfValid(sub);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    sub->pendingMax      = msgLimit;
+    sub->pendingBytesMax = bytesLimit;
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_GetPendingLimits(natsSubscription *sub, int *msgLimit,
+                                  int64_t *bytesLimit)
+{
+    natsStatus s = _lockIfValid(sub);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (msgLimit != NULL)
+        *msgLimit = sub->pendingMax;
+
+    if (bytesLimit != NULL)
+        *bytesLimit = sub->pendingBytesMax;
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_GetPending(natsSubscription *sub, int *msgs, int64_t *bytes)
+{
+    natsStatus s = _lockIfValid(sub);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (msgs != NULL)
+        *msgs = natsMsgQueue_Count(&(sub->msgList));
+
+    if (bytes != NULL)
+        *bytes = natsMsgQueue_Bytes(&(sub->msgList));
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_GetMaxPending(natsSubscription *sub, int *msgs,
+                               int64_t *bytes)
+{
+    natsStatus s = _lockIfValid(sub);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (msgs != NULL)
+        *msgs = (int) NATS_ATOMIC_GET(&(sub->pendingMsgsHWM));
+
+    if (bytes != NULL)
+        *bytes = (int64_t) NATS_ATOMIC64_GET(&(sub->pendingBytesHWM));
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_GetStats(natsSubscription *sub,
+                          int     *pendingMsgs,
+                          int64_t *pendingBytes,
+                          int     *maxPendingMsgs,
+                          int64_t *maxPendingBytes,
+                          int64_t *deliveredMsgs,
+                          int64_t *droppedMsgs,
+                          int64_t *callbackTime)
+{
+    natsStatus s = _lockIfValid(sub);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    if (pendingMsgs != NULL)
+        *pendingMsgs = natsMsgQueue_Count(&(sub->msgList));
+    if (pendingBytes != NULL)
+        *pendingBytes = natsMsgQueue_Bytes(&(sub->msgList));
+    if (maxPendingMsgs != NULL)
+        *maxPendingMsgs = (int) NATS_ATOMIC_GET(&(sub->pendingMsgsHWM));
+    if (maxPendingBytes != NULL)
+        *maxPendingBytes = (int64_t) NATS_ATOMIC64_GET(&(sub->pendingBytesHWM));
+    if (deliveredMsgs != NULL)
+        *deliveredMsgs = (int64_t) sub->delivered;
+    if (droppedMsgs != NULL)
+        *droppedMsgs = (int64_t) NATS_ATOMIC64_GET(&(sub->dropped));
+    if (callbackTime != NULL)
+        *callbackTime = (int64_t) NATS_ATOMIC64_GET(&(sub->cbTime)) / 1000;
+
+    natsSub_Unlock(sub);
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscription_ClearMaxPending(natsSubscription *sub)
+{
+    natsStatus s = _lockIfValid(sub);
+
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    NATS_ATOMIC_SET(&(sub->pendingMsgsHWM), 0);
+    NATS_ATOMIC64_SET(&(sub->pendingBytesHWM), 0);
 
     natsSub_Unlock(sub);
 
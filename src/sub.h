@@ -5,6 +5,16 @@
 
 #include "natsp.h"
 
+// Default time (in milliseconds) the delivery thread waits for more
+// messages after the first one arrives (see natsSubscription_SetDeliveryDelay).
+#define NATS_SUB_DEFAULT_SIGNAL_DELAY   (1)
+
+// Max number of messages held by a worker of a keyed subscription, and
+// max number of messages the delivery thread moves from the subscription
+// to the workers at a time.
+#define NATS_SUB_WORKER_MAX_MSGS        (1024)
+#define NATS_SUB_DISPATCH_BATCH         (64)
+
 #ifdef DEV_MODE
 // For type safety...
 
@@ -26,10 +36,24 @@ natsSub_release(natsSubscription *sub);
 
 natsStatus
 natsSub_create(natsSubscription **newSub, natsConnection *nc, const char *subj,
-               const char *queueGroup, natsMsgHandler cb, void *cbClosure,
-               bool noDelay);
+               const char *queueGroup, natsMsgHandler cb,
+               natsMsgBatchHandler batchCb, int maxBatch, int64_t maxWait,
+               void *cbClosure, bool noDelay, int workers,
+               natsMsgKeyHandler keyCb);
 
 void
 natsSub_close(natsSubscription *sub, bool connectionClosed);
 
+// Schedules the subscription on its shared delivery pool worker, unless it
+// is already scheduled. Invoked by the connection after queuing a message.
+void
+natsSub_scheduleDelivery(natsSubscription *sub);
+
+// Invoked by a worker of the shared delivery pool to deliver up to
+// NATS_DLVPOOL_MAX_BATCH messages. Returns 'true' if the subscription has
+// more messages and needs to be scheduled again, in which case the worker
+// keeps the reference it holds. Otherwise, the reference is released.
+bool
+natsSub_deliverMsgsFromPool(natsSubscription *sub);
+
 #endif /* SUB_H_ */
@@ -0,0 +1,603 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include <string.h>
+
+#include "mem.h"
+#include "hash.h"
+#include "msg.h"
+#include "sub.h"
+#include "submux.h"
+
+// Max number of handlers a message is routed to without allocating memory.
+#define _LOCAL_CALLS    (8)
+
+static bool
+_isWildcard(const char *tok, char wc)
+{
+    return ((tok[0] == wc) && (tok[1] == '\0'));
+}
+
+// Splits a copy of the subject into its tokens. On success, '*dup' needs
+// to be freed, and '*toks' too if it is not 'local'.
+static natsStatus
+_splitSubject(const char *subject, char **dup, char ***toks, int *count,
+              char **local, int localCap, bool *wildcards)
+{
+    char    **t     = local;
+    int     cap     = localCap;
+    int     n       = 0;
+    bool    valid   = true;
+    char    *p;
+
+    if ((subject == NULL) || (subject[0] == '\0'))
+        return nats_setDefaultError(NATS_INVALID_SUBJECT);
+
+    *dup = NATS_STRDUP(subject);
+    if (*dup == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    *wildcards = false;
+
+    for (p = *dup; p != NULL; n++)
+    {
+        if (n == cap)
+        {
+            char **nt = (char**) NATS_MALLOC(2 * cap * sizeof(char*));
+
+            if (nt == NULL)
+            {
+                valid = false;
+                break;
+            }
+
+            memcpy(nt, t, n * sizeof(char*));
+            if (t != local)
+                NATS_FREE(t);
+            t    = nt;
+            cap *= 2;
+        }
+
+        t[n] = p;
+        p    = strchr(p, '.');
+        if (p != NULL)
+            *(p++) = '\0';
+
+        // No empty token, and the full wildcard must be the last one.
+        if ((t[n][0] == '\0') || (_isWildcard(t[n], '>') && (p != NULL)))
+        {
+            valid = false;
+            break;
+        }
+
+        if (_isWildcard(t[n], '*') || _isWildcard(t[n], '>'))
+            *wildcards = true;
+    }
+
+    if (!valid)
+    {
+        bool noMem = (n == cap);
+
+        if (t != local)
+            NATS_FREE(t);
+        NATS_FREE(*dup);
+        *dup = NULL;
+
+        if (noMem)
+            return nats_setDefaultError(NATS_NO_MEMORY);
+
+        return nats_setDefaultError(NATS_INVALID_SUBJECT);
+    }
+
+    *toks  = t;
+    *count = n;
+
+    return NATS_OK;
+}
+
+static void
+_freeNode(natsSubMuxNode *node, bool embedded)
+{
+    natsStrHashIter iter;
+    void            *child = NULL;
+
+    if (node == NULL)
+        return;
+
+    if (node->next != NULL)
+    {
+        natsStrHashIter_Init(&iter, node->next);
+        while (natsStrHashIter_Next(&iter, NULL, &child))
+            _freeNode((natsSubMuxNode*) child, false);
+        natsStrHashIter_Done(&iter);
+
+        natsStrHash_Destroy(node->next);
+    }
+    _freeNode(node->pwc, false);
+    _freeNode(node->fwc, false);
+    NATS_FREE(node->handler);
+
+    if (embedded)
+        memset(node, 0, sizeof(natsSubMuxNode));
+    else
+        NATS_FREE(node);
+}
+
+static bool
+_isEmpty(natsSubMuxNode *node)
+{
+    return ((node->handler == NULL)
+            && (node->pwc == NULL)
+            && (node->fwc == NULL)
+            && ((node->next == NULL) || (natsStrHash_Count(node->next) == 0)));
+}
+
+static void
+_clearCache(natsSubscriptionMux *mux)
+{
+    natsStrHashIter iter;
+    void            *matches = NULL;
+
+    if (mux->cache == NULL)
+        return;
+
+    natsStrHashIter_Init(&iter, mux->cache);
+    while (natsStrHashIter_Next(&iter, NULL, &matches))
+        NATS_FREE(matches);
+    natsStrHashIter_Done(&iter);
+
+    natsStrHash_Destroy(mux->cache);
+    mux->cache = NULL;
+}
+
+// Returns the child of 'node' for the token, creating it if 'create' is
+// true (in which case NULL means no memory). Lock held on entry.
+static natsSubMuxNode*
+_getChild(natsSubMuxNode *node, char *tok, bool create)
+{
+    natsSubMuxNode  **wc    = NULL;
+    natsSubMuxNode  *child  = NULL;
+
+    if (_isWildcard(tok, '*'))
+        wc = &(node->pwc);
+    else if (_isWildcard(tok, '>'))
+        wc = &(node->fwc);
+
+    if (wc != NULL)
+        child = *wc;
+    else if (node->next != NULL)
+        child = (natsSubMuxNode*) natsStrHash_Get(node->next, tok);
+
+    if ((child != NULL) || !create)
+        return child;
+
+    child = (natsSubMuxNode*) NATS_CALLOC(1, sizeof(natsSubMuxNode));
+    if (child == NULL)
+        return NULL;
+
+    if (wc != NULL)
+    {
+        *wc = child;
+    }
+    else if (((node->next == NULL)
+              && (natsStrHash_Create(&(node->next), 4) != NATS_OK))
+             || (natsStrHash_Set(node->next, tok, true, (void*) child, NULL) != NATS_OK))
+    {
+        NATS_FREE(child);
+        child = NULL;
+    }
+
+    return child;
+}
+
+// Removes the handler of the subject made of the 'count' tokens under
+// 'node', and the nodes on its path left empty. Returns the handler, or
+// NULL if not found. Lock held on entry.
+static natsSubMuxHandler*
+_removeHandler(natsSubMuxNode *node, char **toks, int count)
+{
+    natsSubMuxNode      *child  = NULL;
+    natsSubMuxHandler   *h      = NULL;
+
+    if (count == 0)
+    {
+        h = node->handler;
+        node->handler = NULL;
+        return h;
+    }
+
+    child = _getChild(node, toks[0], false);
+    if (child == NULL)
+        return NULL;
+
+    h = _removeHandler(child, toks + 1, count - 1);
+    if (_isEmpty(child))
+    {
+        if (child == node->pwc)
+            node->pwc = NULL;
+        else if (child == node->fwc)
+            node->fwc = NULL;
+        else
+            (void) natsStrHash_Remove(node->next, toks[0]);
+
+        _freeNode(child, false);
+    }
+
+    return h;
+}
+
+static void
+_addMatch(natsSubMuxHandler *h, natsSubMuxMatches *m, int *count)
+{
+    if (m != NULL)
+        m->handlers[*count] = h;
+    (*count)++;
+}
+
+static void
+_collect(natsSubMuxNode *node, const char *tok, const char *end,
+         natsSubMuxMatches *m, int *count);
+
+static void
+_collectChild(natsSubMuxNode *child, const char *tokEnd, const char *end,
+              natsSubMuxMatches *m, int *count)
+{
+    if (tokEnd == end)
+    {
+        if (child->handler != NULL)
+            _addMatch(child->handler, m, count);
+    }
+    else
+    {
+        _collect(child, tokEnd + 1, end, m, count);
+    }
+}
+
+// Adds the handlers with wildcards matching the subject from 'tok' to
+// 'end' to 'm', or only counts them if 'm' is NULL.
+static void
+_collect(natsSubMuxNode *node, const char *tok, const char *end,
+         natsSubMuxMatches *m, int *count)
+{
+    const char      *tokEnd = tok;
+    natsSubMuxNode  *child  = NULL;
+
+    while ((tokEnd < end) && (*tokEnd != '.'))
+        tokEnd++;
+
+    // The full wildcard matches this token and the ones after it.
+    if ((node->fwc != NULL) && (node->fwc->handler != NULL))
+        _addMatch(node->fwc->handler, m, count);
+
+    if ((node->next != NULL)
+        && ((child = (natsSubMuxNode*) natsStrHash_GetEx(node->next, tok,
+                                                         (int) (tokEnd - tok))) != NULL))
+    {
+        _collectChild(child, tokEnd, end, m, count);
+    }
+
+    if (node->pwc != NULL)
+        _collectChild(node->pwc, tokEnd, end, m, count);
+}
+
+// Returns the handlers matching the subject, from the cache if possible.
+// If the result could not be cached, '*cached' is false and the result
+// needs to be freed. Lock held on entry.
+static natsSubMuxMatches*
+_getMatches(natsSubscriptionMux *mux, const char *subj, int subjLen,
+            bool *cached)
+{
+    natsSubMuxMatches   *m      = NULL;
+    natsSubMuxHandler   *h      = NULL;
+    int                 count   = 0;
+
+    *cached = false;
+
+    if (mux->cache != NULL)
+    {
+        m = (natsSubMuxMatches*) natsStrHash_GetEx(mux->cache, subj, subjLen);
+        if (m != NULL)
+        {
+            *cached = true;
+            return m;
+        }
+    }
+
+    h = (natsSubMuxHandler*) natsStrHash_GetEx(mux->literals, subj, subjLen);
+    if (h != NULL)
+        count++;
+    _collect(&(mux->root), subj, subj + subjLen, NULL, &count);
+
+    m = (natsSubMuxMatches*) NATS_MALLOC(sizeof(natsSubMuxMatches)
+                                         + count * sizeof(natsSubMuxHandler*));
+    if (m == NULL)
+        return NULL;
+
+    m->count = 0;
+    if (h != NULL)
+        _addMatch(h, m, &(m->count));
+    _collect(&(mux->root), subj, subj + subjLen, m, &(m->count));
+
+    if ((mux->cache != NULL)
+        && (natsStrHash_Count(mux->cache) >= NATS_SUBMUX_CACHE_SIZE))
+    {
+        _clearCache(mux);
+    }
+    if ((mux->cache == NULL)
+        && (natsStrHash_Create(&(mux->cache), 64) != NATS_OK))
+    {
+        return m;
+    }
+    if (natsStrHash_Set(mux->cache, (char*) subj, true, (void*) m, NULL) == NATS_OK)
+        *cached = true;
+
+    return m;
+}
+
+// The callback of the multiplexer's subscription.
+static void
+_routeMsg(natsConnection *nc, natsSubscription *sub, natsMsg *msg,
+          void *closure)
+{
+    natsSubscriptionMux *mux    = (natsSubscriptionMux*) closure;
+    const char          *subj   = natsMsg_GetSubject(msg);
+    int                 subjLen = (int) strlen(subj);
+    natsSubMuxHandler   local[_LOCAL_CALLS];
+    natsSubMuxHandler   *calls  = local;
+    natsSubMuxHandler   *h      = NULL;
+    natsSubMuxMatches   *m      = NULL;
+    bool                cached  = false;
+    int                 count   = 0;
+
+    // The handlers are copied so that they are invoked without the lock,
+    // which lets them add or remove handlers.
+    natsMutex_Lock(mux->mu);
+
+    if (mux->wildcards == 0)
+    {
+        h = (natsSubMuxHandler*) natsStrHash_GetEx(mux->literals, subj, subjLen);
+        if (h != NULL)
+            local[count++] = *h;
+    }
+    else if ((m = _getMatches(mux, subj, subjLen, &cached)) != NULL)
+    {
+        if (m->count > _LOCAL_CALLS)
+            calls = (natsSubMuxHandler*) NATS_MALLOC(m->count * sizeof(natsSubMuxHandler));
+
+        if (calls != NULL)
+        {
+            for (; count < m->count; count++)
+                calls[count] = *(m->handlers[count]);
+        }
+        if (!cached)
+            NATS_FREE(m);
+    }
+
+    natsMutex_Unlock(mux->mu);
+
+    // All handlers but the last get a copy of the message.
+    for (int i = 0; i < count; i++)
+    {
+        natsMsg *hmsg = msg;
+
+        if ((i < count - 1)
+            && (natsMsg_create(&hmsg, NULL, NULL, subj, subjLen,
+                               msg->reply, (int) strlen(msg->reply),
+                               msg->data, msg->dataLen) != NATS_OK))
+        {
+            continue;
+        }
+
+        (*(calls[i].cb))(nc, sub, hmsg, calls[i].closure);
+    }
+
+    if (count == 0)
+        natsMsg_Destroy(msg);
+
+    if ((calls != local) && (calls != NULL))
+        NATS_FREE(calls);
+}
+
+void
+natsSubMux_free(natsSubscriptionMux *mux)
+{
+    natsStrHashIter iter;
+    void            *h = NULL;
+
+    if (mux == NULL)
+        return;
+
+    if (mux->literals != NULL)
+    {
+        natsStrHashIter_Init(&iter, mux->literals);
+        while (natsStrHashIter_Next(&iter, NULL, &h))
+            NATS_FREE(h);
+        natsStrHashIter_Done(&iter);
+
+        natsStrHash_Destroy(mux->literals);
+    }
+
+    _freeNode(&(mux->root), true);
+    _clearCache(mux);
+
+    natsMutex_Destroy(mux->mu);
+
+    NATS_FREE(mux);
+}
+
+natsStatus
+natsSubscriptionMux_Create(natsSubscriptionMux **newMux, natsConnection *nc,
+                           const char *subject)
+{
+    natsStatus          s    = NATS_OK;
+    natsSubscriptionMux *mux = NULL;
+
+    if (newMux == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    mux = (natsSubscriptionMux*) NATS_CALLOC(1, sizeof(natsSubscriptionMux));
+    if (mux == NULL)
+        return nats_setDefaultError(NATS_NO_MEMORY);
+
+    s = natsMutex_Create(&(mux->mu));
+    if (s == NATS_OK)
+        s = natsStrHash_Create(&(mux->literals), 64);
+    if (s == NATS_OK)
+        s = natsConnection_Subscribe(&(mux->sub), nc, subject, _routeMsg,
+                                     (void*) mux);
+    if (s != NATS_OK)
+    {
+        natsSubMux_free(mux);
+        return NATS_UPDATE_ERR_STACK(s);
+    }
+
+    // From now on, the multiplexer is freed with the subscription.
+    natsSub_Lock(mux->sub);
+    mux->sub->mux = mux;
+    natsSub_Unlock(mux->sub);
+
+    *newMux = mux;
+
+    return NATS_OK;
+}
+
+natsStatus
+natsSubscriptionMux_Add(natsSubscriptionMux *mux, const char *subject,
+                        natsMsgHandler cb, void *cbClosure)
+{
+    natsStatus          s           = NATS_OK;
+    natsSubMuxHandler   *h          = NULL;
+    natsSubMuxHandler   *old        = NULL;
+    natsSubMuxNode      *node       = NULL;
+    char                *dup        = NULL;
+    char                *local[16];
+    char                **toks      = NULL;
+    int                 count       = 0;
+    bool                wildcards   = false;
+
+    if ((mux == NULL) || (cb == NULL))
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _splitSubject(subject, &dup, &toks, &count, local,
+                      (int) (sizeof(local) / sizeof(local[0])), &wildcards);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    h = (natsSubMuxHandler*) NATS_MALLOC(sizeof(natsSubMuxHandler));
+    if (h == NULL)
+        s = nats_setDefaultError(NATS_NO_MEMORY);
+    else
+    {
+        h->cb      = cb;
+        h->closure = cbClosure;
+    }
+
+    natsMutex_Lock(mux->mu);
+
+    if ((s == NATS_OK) && !wildcards)
+    {
+        s = natsStrHash_Set(mux->literals, (char*) subject, true, (void*) h,
+                            (void**) &old);
+    }
+    else if (s == NATS_OK)
+    {
+        node = &(mux->root);
+        for (int i = 0; (node != NULL) && (i < count); i++)
+            node = _getChild(node, toks[i], true);
+
+        if (node == NULL)
+        {
+            // Don't leave the nodes created so far in the tree.
+            (void) _removeHandler(&(mux->root), toks, count);
+            s = nats_setDefaultError(NATS_NO_MEMORY);
+        }
+        else
+        {
+            old = node->handler;
+            node->handler = h;
+            if (old == NULL)
+                mux->wildcards++;
+        }
+    }
+    if (s == NATS_OK)
+        _clearCache(mux);
+
+    natsMutex_Unlock(mux->mu);
+
+    if (s != NATS_OK)
+        NATS_FREE(h);
+    NATS_FREE(old);
+
+    if (toks != local)
+        NATS_FREE(toks);
+    NATS_FREE(dup);
+
+    return NATS_UPDATE_ERR_STACK(s);
+}
+
+natsStatus
+natsSubscriptionMux_Remove(natsSubscriptionMux *mux, const char *subject)
+{
+    natsStatus          s           = NATS_OK;
+    natsSubMuxHandler   *h          = NULL;
+    char                *dup        = NULL;
+    char                *local[16];
+    char                **toks      = NULL;
+    int                 count       = 0;
+    bool                wildcards   = false;
+
+    if (mux == NULL)
+        return nats_setDefaultError(NATS_INVALID_ARG);
+
+    s = _splitSubject(subject, &dup, &toks, &count, local,
+                      (int) (sizeof(local) / sizeof(local[0])), &wildcards);
+    if (s != NATS_OK)
+        return NATS_UPDATE_ERR_STACK(s);
+
+    natsMutex_Lock(mux->mu);
+
+    if (!wildcards)
+    {
+        h = (natsSubMuxHandler*) natsStrHash_Remove(mux->literals, (char*) subject);
+    }
+    else
+    {
+        h = _removeHandler(&(mux->root), toks, count);
+        if (h != NULL)
+            mux->wildcards--;
+    }
+    if (h != NULL)
+        _clearCache(mux);
+
+    natsMutex_Unlock(mux->mu);
+
+    if (h == NULL)
+        s = nats_setError(NATS_NOT_FOUND, "No handler for subject '%s'", subject);
+
+    NATS_FREE(h);
+
+    if (toks != local)
+        NATS_FREE(toks);
+    NATS_FREE(dup);
+
+    return s;
+}
+
+natsSubscription*
+natsSubscriptionMux_GetSubscription(natsSubscriptionMux *mux)
+{
+    if (mux == NULL)
+        return NULL;
+
+    return mux->sub;
+}
+
+void
+natsSubscriptionMux_Destroy(natsSubscriptionMux *mux)
+{
+    if (mux == NULL)
+        return;
+
+    natsSubscription_Destroy(mux->sub);
+}
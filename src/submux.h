@@ -0,0 +1,64 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#ifndef SUBMUX_H_
+#define SUBMUX_H_
+
+#include "natsp.h"
+
+// Max number of subjects whose matching handlers are cached. The cache is
+// emptied when full, and whenever a handler is added or removed.
+#define NATS_SUBMUX_CACHE_SIZE  (1024)
+
+typedef struct __natsSubMuxHandler
+{
+    natsMsgHandler      cb;
+    void                *closure;
+
+} natsSubMuxHandler;
+
+// A node of the tree of the handlers with wildcards. Each level matches a
+// token of the subject: 'next' holds the children for literal tokens, 'pwc'
+// and 'fwc' those for the '*' and '>' wildcards.
+typedef struct __natsSubMuxNode
+{
+    natsStrHash                 *next;
+    struct __natsSubMuxNode     *pwc;
+    struct __natsSubMuxNode     *fwc;
+
+    // The handler of the subject ending at this node, if any.
+    natsSubMuxHandler           *handler;
+
+} natsSubMuxNode;
+
+// The handlers matching a subject, as cached.
+typedef struct __natsSubMuxMatches
+{
+    int                 count;
+    natsSubMuxHandler   *handlers[1];
+
+} natsSubMuxMatches;
+
+struct __natsSubscriptionMux
+{
+    natsMutex           *mu;
+    natsSubscription    *sub;
+
+    // Handlers of subjects without wildcards, by subject.
+    natsStrHash         *literals;
+
+    // Handlers of subjects with wildcards, and how many there are. The
+    // tree and the cache are only looked up if there is at least one.
+    natsSubMuxNode      root;
+    int                 wildcards;
+
+    // The natsSubMuxMatches of recently received subjects, created lazily.
+    natsStrHash         *cache;
+
+};
+
+// Frees the multiplexer. Invoked when its subscription is freed, so that
+// the delivery thread never routes a message with a freed multiplexer.
+void
+natsSubMux_free(natsSubscriptionMux *mux);
+
+#endif /* SUBMUX_H_ */
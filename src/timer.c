@@ -12,6 +12,8 @@ _freeTimer(natsTimer *t)
 
     natsMutex_Destroy(t->mu);
     NATS_FREE(t);
+
+    nats_unreserveTimer();
 }
 
 void
@@ -43,8 +45,16 @@ natsTimer_Create(natsTimer **timer, natsTimerCb timerCb, natsTimerStopCb stopCb,
     t->cb      = timerCb;
     t->stopCb  = stopCb;
     t->closure = closure;
+    t->heapIdx = -1;
+
+    s = nats_reserveTimer();
+    if (s != NATS_OK)
+    {
+        NATS_FREE(t);
+        return NATS_UPDATE_ERR_STACK(s);
+    }
 
-    s = natsMutex_Create(&(t->mu));
+    s = natsMutex_CreateEx(&(t->mu), NATS_LOCK_TIMER);
     if (s == NATS_OK)
     {
         // Doing so, so that nats_resetTimer() does not try to remove the timer
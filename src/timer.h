@@ -19,8 +19,12 @@ typedef void (*natsTimerStopCb)(struct __natsTimer *timer, void* closure);
 
 typedef struct __natsTimer
 {
-    struct __natsTimer  *prev;
-    struct __natsTimer  *next;
+    // Position in the library's timers heap, -1 if not in the heap.
+    int                 heapIdx;
+
+    // Insertion sequence, so that timers with the same absolute time fire
+    // in the order they were (re)started.
+    uint64_t            seq;
 
     natsMutex           *mu;
     int                 refs;
@@ -30,7 +30,7 @@ natsCondition_Create(natsCondition **cond)
 void
 natsCondition_Wait(natsCondition *cond, natsMutex *mutex)
 {
-    if (pthread_cond_wait(cond, mutex) != 0)
+    if (pthread_cond_wait(cond, &(mutex->mu)) != 0)
         abort();
 }
 
@@ -55,7 +55,7 @@ _timedWait(natsCondition *cond, natsMutex *mutex, bool isAbsolute, int64_t timeo
         ts.tv_nsec -= 1000000000L;
     }
 
-    r = pthread_cond_timedwait(cond, mutex, &ts);
+    r = pthread_cond_timedwait(cond, &(mutex->mu), &ts);
 
     if (r == 0)
         return NATS_OK;
@@ -78,6 +78,29 @@ natsCondition_AbsoluteTimedWait(natsCondition *cond, natsMutex *mutex, int64_t a
     return _timedWait(cond, mutex, true, absoluteTime);
 }
 
+natsStatus
+natsCondition_AbsoluteTimedWaitNano(natsCondition *cond, natsMutex *mutex, int64_t absoluteTime)
+{
+    int     r;
+    struct  timespec ts;
+
+    if (absoluteTime <= nats_NowInNanoSeconds())
+        return NATS_TIMEOUT;
+
+    ts.tv_sec  = absoluteTime / 1000000000L;
+    ts.tv_nsec = absoluteTime % 1000000000L;
+
+    r = pthread_cond_timedwait(cond, &(mutex->mu), &ts);
+
+    if (r == 0)
+        return NATS_OK;
+
+    if (r == ETIMEDOUT)
+        return NATS_TIMEOUT;
+
+    return nats_setError(NATS_SYS_ERROR, "pthread_cond_timedwait error: %d", errno);
+}
+
 void
 natsCondition_Signal(natsCondition *cond)
 {
@@ -4,7 +4,7 @@
 #include "../mem.h"
 
 natsStatus
-natsMutex_Create(natsMutex **newMutex)
+natsMutex_CreateEx(natsMutex **newMutex, natsLockRole role)
 {
     natsStatus          s = NATS_OK;
     pthread_mutexattr_t attr;
@@ -30,7 +30,7 @@ natsMutex_Create(natsMutex **newMutex)
     }
 
     if ((s == NATS_OK)
-        && (pthread_mutex_init(m, &attr) != 0))
+        && (pthread_mutex_init(&(m->mu), &attr) != 0))
     {
         s = nats_setError(NATS_SYS_ERROR, "pthread_mutex_init error: %d",
                           errno);
@@ -40,18 +40,32 @@ natsMutex_Create(natsMutex **newMutex)
         pthread_mutexattr_destroy(&attr);
 
     if (s == NATS_OK)
+    {
+        m->role   = (int) role;
         *newMutex = m;
+    }
     else
+    {
         NATS_FREE(m);
+    }
 
     return s;
 }
 
+#if defined(NATS_LOCK_STATS)
+#define _recordAcquired(m)  NATS_ATOMIC64_ADD(&(gLockStats[(m)->role].acquisitions), 1)
+#else
+#define _recordAcquired(m)
+#endif
+
 bool
 natsMutex_TryLock(natsMutex *m)
 {
-    if (pthread_mutex_trylock(m) == 0)
+    if (pthread_mutex_trylock(&(m->mu)) == 0)
+    {
+        _recordAcquired(m);
         return true;
+    }
 
     return false;
 }
@@ -59,37 +73,65 @@ natsMutex_TryLock(natsMutex *m)
 void
 natsMutex_Lock(natsMutex *m)
 {
-    if (gLockSpinCount > 0)
+    int32_t estimate;
+    int32_t maxSpins;
+    int32_t spins    = 0;
+    bool    acquired = false;
+#if defined(NATS_LOCK_STATS)
+    natsLockStats   *stats = &(gLockStats[m->role]);
+    int64_t         start;
+#endif
+
+    if (pthread_mutex_trylock(&(m->mu)) == 0)
     {
-        int64_t attempts = 0;
+        _recordAcquired(m);
+        return;
+    }
+
+#if defined(NATS_LOCK_STATS)
+    start = nats_NowInNanoSeconds();
+#endif
+
+    // As glibc's adaptive mutexes, spin up to twice the number of spins
+    // that were needed recently (plus some), so that locks that are
+    // held for long do not burn CPU. 'gLockSpinCount' is the upper limit.
+    estimate = NATS_ATOMIC_GET(&(m->spins));
+    maxSpins = (int32_t) (gLockSpinCount < (2 * (int64_t) estimate + 10) ?
+                          gLockSpinCount : (2 * estimate + 10));
 
-        while (pthread_mutex_trylock(m) != 0)
+    while (spins < maxSpins)
+    {
+        spins++;
+
+        __asm__ __volatile__ ("rep; nop");
+
+        if (pthread_mutex_trylock(&(m->mu)) == 0)
         {
-            if (++attempts <= gLockSpinCount)
-            {
-                __asm__ __volatile__ ("rep; nop");
-            }
-            else
-            {
-                if (pthread_mutex_lock(m))
-                    abort();
-
-                break;
-            }
+            acquired = true;
+            break;
         }
     }
-    else
-    {
-        if (pthread_mutex_lock(m))
-            abort();
-    }
-}
 
+    if (!acquired && (pthread_mutex_lock(&(m->mu)) != 0))
+        abort();
+
+    // We own the lock, so no other thread is updating the estimate.
+    NATS_ATOMIC_SET(&(m->spins), estimate + ((spins - estimate) / 8));
+
+#if defined(NATS_LOCK_STATS)
+    NATS_ATOMIC64_ADD(&(stats->acquisitions), 1);
+    NATS_ATOMIC64_ADD(&(stats->contended), 1);
+    if (acquired)
+        NATS_ATOMIC64_ADD(&(stats->spinSuccesses), 1);
+    NATS_ATOMIC64_ADD(&(stats->waitTime),
+                      (uint64_t) (nats_NowInNanoSeconds() - start));
+#endif
+}
 
 void
 natsMutex_Unlock(natsMutex *m)
 {
-    if (pthread_mutex_unlock(m))
+    if (pthread_mutex_unlock(&(m->mu)))
         abort();
 }
 
@@ -99,6 +141,6 @@ natsMutex_Destroy(natsMutex *m)
     if (m == NULL)
         return;
 
-    pthread_mutex_destroy(m);
+    pthread_mutex_destroy(&(m->mu));
     NATS_FREE(m);
 }
@@ -29,6 +29,30 @@ natsSock_SetBlocking(natsSock fd, bool blocking)
     return NATS_OK;
 }
 
+natsStatus
+natsSock_SetBusyPoll(natsSock fd, int64_t spinMicros)
+{
+#if defined(SO_BUSY_POLL)
+    int usecs = (spinMicros > INT32_MAX ? INT32_MAX : (int) spinMicros);
+
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == -1)
+        return nats_setError(NATS_SYS_ERROR, "setsockopt SO_BUSY_POLL error: %d",
+                             NATS_SOCK_GET_ERROR);
+
+    return NATS_OK;
+#else
+    return nats_setError(NATS_ILLEGAL_STATE, "%s",
+                         "SO_BUSY_POLL not supported on this platform");
+#endif
+}
+
+int
+natsSock_Poll(natsSockPollFd *fds, int count, int64_t timeout)
+{
+    return poll(fds, (nfds_t) count,
+                (timeout > INT32_MAX ? INT32_MAX : (int) timeout));
+}
+
 bool
 natsSock_IsConnected(natsSock fd)
 {
@@ -43,6 +67,12 @@ natsSock_IsConnected(natsSock fd)
     return true;
 }
 
+int
+natsSock_SendV(natsSock fd, natsSockIOVec *iov, int count)
+{
+    return (int) writev(fd, iov, count);
+}
+
 natsStatus
 natsSock_Flush(natsSock fd)
 {
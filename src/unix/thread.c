@@ -113,6 +113,20 @@ natsThread_Destroy(natsThread *t)
     NATS_FREE(t);
 }
 
+void
+natsThread_SetName(const char *name)
+{
+    // Names are limited to 16 characters (including the terminating NULL)
+    // on Linux, longer names would be rejected.
+#if defined(DARWIN)
+    pthread_setname_np(name);
+#elif defined(__linux__)
+    pthread_setname_np(pthread_self(), name);
+#else
+    (void) name;
+#endif
+}
+
 natsStatus
 natsThreadLocal_CreateKey(natsThreadLocal *tl, void (*destructor)(void*))
 {
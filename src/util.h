@@ -17,6 +17,11 @@ nats_CreateStringFromBuffer(char **newStr, natsBuffer *buf);
 void
 nats_Randomize(int *array, int arraySize);
 
+// Returns the next number of the splitmix64 generator whose state is
+// 'state'. The state is not protected by any lock.
+uint64_t
+nats_NextRandom(uint64_t *state);
+
 const char*
 nats_GetBoolStr(bool value);
 
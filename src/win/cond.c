@@ -64,6 +64,30 @@ natsCondition_AbsoluteTimedWait(natsCondition *cond, natsMutex *mutex, int64_t a
     return NATS_OK;
 }
 
+natsStatus
+natsCondition_AbsoluteTimedWaitNano(natsCondition *cond, natsMutex *mutex, int64_t absoluteTime)
+{
+    int64_t sleepTime = absoluteTime - nats_NowInNanoSeconds();
+
+    if (sleepTime <= 0)
+        return NATS_TIMEOUT;
+
+    // Round up to the next millisecond, which is the best we can do here.
+    sleepTime = (sleepTime + 999999) / 1000000;
+
+    if (SleepConditionVariableCS(cond, mutex, (DWORD) sleepTime) == 0)
+    {
+        if (GetLastError() == ERROR_TIMEOUT)
+            return NATS_TIMEOUT;
+
+        return nats_setError(NATS_SYS_ERROR,
+                             "SleepConditionVariableCS error: %d",
+                             GetLastError());
+    }
+
+    return NATS_OK;
+}
+
 void
 natsCondition_Signal(natsCondition *cond)
 {
@@ -4,8 +4,11 @@
 #include "../mem.h"
 
 natsStatus
-natsMutex_Create(natsMutex **newMutex)
+natsMutex_CreateEx(natsMutex **newMutex, natsLockRole role)
 {
+    // Critical sections do their own spinning (up to 'gLockSpinCount'), and
+    // lock statistics are not supported on this platform, so the role is
+    // not needed.
     natsMutex *m = NATS_CALLOC(1, sizeof(natsMutex));
 
     if (m == NULL)
@@ -40,6 +40,62 @@ natsSock_SetBlocking(natsSock fd, bool blocking)
     return NATS_OK;
 }
 
+natsStatus
+natsSock_SetBusyPoll(natsSock fd, int64_t spinMicros)
+{
+    return nats_setError(NATS_ILLEGAL_STATE, "%s",
+                         "SO_BUSY_POLL not supported on this platform");
+}
+
+int
+natsSock_Poll(natsSockPollFd *fds, int count, int64_t timeout)
+{
+    fd_set          readSet;
+    fd_set          writeSet;
+    fd_set          exceptSet;
+    struct timeval  tv;
+    int             res, i;
+
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    FD_ZERO(&exceptSet);
+
+    for (i = 0; i < count; i++)
+    {
+        if (fds[i].events & NATS_POLL_IN)
+            FD_SET(fds[i].fd, &readSet);
+        if (fds[i].events & NATS_POLL_OUT)
+            FD_SET(fds[i].fd, &writeSet);
+
+        // Failed connects are reported in the exception set.
+        FD_SET(fds[i].fd, &exceptSet);
+    }
+
+    tv.tv_sec  = (long) (timeout / 1000);
+    tv.tv_usec = (long) ((timeout % 1000) * 1000);
+
+    res = select(0, &readSet, &writeSet, &exceptSet,
+                 (timeout < 0 ? NULL : &tv));
+    if (res <= 0)
+        return res;
+
+    for (i = 0, res = 0; i < count; i++)
+    {
+        fds[i].revents = 0;
+        if (FD_ISSET(fds[i].fd, &readSet))
+            fds[i].revents |= NATS_POLL_IN;
+        if (FD_ISSET(fds[i].fd, &writeSet))
+            fds[i].revents |= NATS_POLL_OUT;
+        if (FD_ISSET(fds[i].fd, &exceptSet))
+            fds[i].revents |= NATS_POLL_ERR;
+
+        if (fds[i].revents != 0)
+            res++;
+    }
+
+    return res;
+}
+
 bool
 natsSock_IsConnected(natsSock fd)
 {
@@ -54,6 +110,17 @@ natsSock_IsConnected(natsSock fd)
     return true;
 }
 
+int
+natsSock_SendV(natsSock fd, natsSockIOVec *iov, int count)
+{
+    DWORD sent = 0;
+
+    if (WSASend(fd, iov, (DWORD) count, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+        return NATS_SOCK_ERROR;
+
+    return (int) sent;
+}
+
 natsStatus
 natsSock_Flush(natsSock fd)
 {
@@ -126,6 +126,14 @@ natsThread_Destroy(natsThread *t)
     NATS_FREE(t);
 }
 
+void
+natsThread_SetName(const char *name)
+{
+    // SetThreadDescription() is not available on all supported versions
+    // of Windows, so threads are not named on this platform.
+    (void) name;
+}
+
 natsStatus
 natsThreadLocal_CreateKey(natsThreadLocal *tl, void (*destructor)(void*))
 {
@@ -0,0 +1,642 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+#include "natsp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mem.h"
+#include "buf.h"
+#include "timer.h"
+#include "hash.h"
+#include "conn.h"
+#include "sub.h"
+#include "msg.h"
+
+// Each benchmark is run with an increasing number of operations until it
+// runs for at least that long (in nanoseconds).
+#define BENCH_MIN_TIME      (200 * 1000 * 1000)
+#define BENCH_MAX_OPS       (100 * 1000 * 1000)
+
+typedef void (*benchFunc)(int64_t n, void *arg);
+
+typedef struct __benchTimer
+{
+    int64_t     start;
+    int64_t     elapsed;
+    int64_t     allocs;
+
+    // Set by benchmarks that do not run exactly the requested operations.
+    int64_t     ops;
+
+} benchTimer;
+
+static benchTimer   bt;
+static const char   *filter = NULL;
+
+// Benchmarks call this once their setup is done...
+static void
+_startTimer(void)
+{
+    bt.allocs = natsMem_Allocs;
+    bt.start  = nats_NowInNanoSeconds();
+}
+
+// ... and this before their teardown.
+static void
+_stopTimer(void)
+{
+    bt.elapsed += nats_NowInNanoSeconds() - bt.start;
+    bt.allocs   = natsMem_Allocs - bt.allocs;
+}
+
+static void
+_run(const char *name, benchFunc f, void *arg)
+{
+    int64_t n   = 1;
+    int64_t ops = 0;
+
+    if ((filter != NULL) && (strstr(name, filter) == NULL))
+        return;
+
+    while (true)
+    {
+        memset(&bt, 0, sizeof(bt));
+
+        (*f)(n, arg);
+
+        if ((bt.elapsed >= BENCH_MIN_TIME) || (n >= BENCH_MAX_OPS))
+            break;
+
+        // Aim a bit above the minimum time, based on this run.
+        if (bt.elapsed <= 0)
+            n *= 100;
+        else
+            n = (int64_t) ((double) n * 1.2 * BENCH_MIN_TIME / bt.elapsed) + 1;
+
+        if (n > BENCH_MAX_OPS)
+            n = BENCH_MAX_OPS;
+    }
+
+    ops = (bt.ops > 0 ? bt.ops : n);
+
+    printf("%-40s %12" PRId64 " %12.1f ns/op %10.2f allocs/op\n",
+           name, ops, (double) bt.elapsed / ops, (double) bt.allocs / ops);
+    fflush(stdout);
+}
+
+//
+// Parser
+//
+
+typedef struct __parserArgs
+{
+    int         payload;
+    int         subjLen;
+    int         numSids;
+
+    // Percentage of messages that go to the first sid, the others are
+    // spread evenly. Zero means an even distribution.
+    int         hotPct;
+
+    // Size of the reads the stream is split into, 0 for a single read.
+    int         readSize;
+
+} parserArgs;
+
+#define PARSER_STREAM_MSGS  (1000)
+
+static char*
+_createStream(parserArgs *a, int *len)
+{
+    natsBuffer  *buf = NULL;
+    char        *subj;
+    char        *data;
+    char        *stream = NULL;
+    char        line[256];
+    int64_t     sid;
+    int         i;
+
+    subj = (char*) malloc(a->subjLen + 1);
+    data = (char*) malloc(a->payload + 1);
+    if ((subj == NULL) || (data == NULL)
+        || (natsBuf_Create(&buf, 64 * 1024) != NATS_OK))
+    {
+        free(subj);
+        free(data);
+        return NULL;
+    }
+
+    for (i = 0; i < a->subjLen; i++)
+        subj[i] = ((i % 8) == 7 ? '.' : 'a' + (i % 26));
+    subj[a->subjLen] = '\0';
+
+    memset(data, 'x', a->payload);
+
+    for (i = 0; i < PARSER_STREAM_MSGS; i++)
+    {
+        if ((a->hotPct > 0) && ((i % 100) < a->hotPct))
+            sid = 1;
+        else
+            sid = (i % a->numSids) + 1;
+
+        snprintf(line, sizeof(line), "MSG %s %" PRId64 " %d\r\n",
+                 subj, sid, a->payload);
+
+        natsBuf_Append(buf, line, (int) strlen(line));
+        natsBuf_Append(buf, data, a->payload);
+        natsBuf_Append(buf, "\r\n", 2);
+    }
+
+    *len   = natsBuf_Len(buf);
+    stream = (char*) malloc(*len);
+    if (stream != NULL)
+        memcpy(stream, natsBuf_Data(buf), *len);
+
+    natsBuf_Destroy(buf);
+    free(subj);
+    free(data);
+
+    return stream;
+}
+
+static void
+bench_Parser(int64_t n, void *arg)
+{
+    parserArgs          *a      = (parserArgs*) arg;
+    natsConnection      *nc     = NULL;
+    natsOptions         *opts   = NULL;
+    natsSubscription    **subs  = NULL;
+    char                *stream = NULL;
+    int                 len     = 0;
+    int64_t             done    = 0;
+    natsStatus          s;
+    int                 i;
+
+    stream = _createStream(a, &len);
+    subs   = (natsSubscription**) calloc(a->numSids, sizeof(natsSubscription*));
+
+    s = ((stream == NULL) || (subs == NULL) ? NATS_NO_MEMORY : NATS_OK);
+    if (s == NATS_OK)
+        s = natsOptions_Create(&opts);
+    if (s == NATS_OK)
+        s = natsConn_create(&nc, opts);
+    if (s == NATS_OK)
+        s = natsParser_Create(&(nc->ps));
+    for (i = 0; (s == NATS_OK) && (i < a->numSids); i++)
+    {
+        s = natsSub_create(&(subs[i]), nc, "foo", NULL, NULL, NULL, 0, 0,
+                           NULL, false, 0, NULL);
+        if (s == NATS_OK)
+        {
+            subs[i]->sid             = i + 1;
+            subs[i]->pendingMax      = INT32_MAX;
+            subs[i]->pendingBytesMax = INT64_MAX;
+
+            s = natsConn_addSubcription(nc, subs[i]);
+        }
+    }
+    if (s != NATS_OK)
+    {
+        printf("@@ Unable to setup the parser benchmark: %d\n", s);
+        n = 0;
+    }
+
+    _startTimer();
+
+    while (done < n)
+    {
+        if (a->readSize == 0)
+        {
+            s = natsParser_Parse(nc, stream, len);
+        }
+        else
+        {
+            for (i = 0; (s == NATS_OK) && (i < len); i += a->readSize)
+                s = natsParser_Parse(nc, stream + i,
+                                     (len - i < a->readSize ? len - i : a->readSize));
+        }
+        if (s != NATS_OK)
+            break;
+
+        // Consumers would release the messages.
+        for (i = 0; i < a->numSids; i++)
+            natsMsgQueue_Clear(&(subs[i]->msgList));
+
+        done += PARSER_STREAM_MSGS;
+    }
+
+    _stopTimer();
+
+    // The whole stream is parsed each time.
+    bt.ops = done;
+
+    for (i = 0; (subs != NULL) && (i < a->numSids); i++)
+    {
+        if (subs[i] == NULL)
+            continue;
+
+        natsConn_removeSubscription(nc, subs[i], false);
+        natsSub_release(subs[i]);
+    }
+    free(subs);
+    free(stream);
+
+    natsConnection_Destroy(nc);
+}
+
+//
+// Hash
+//
+
+typedef struct __hashArgs
+{
+    int         keys;
+
+    // Distance between two keys: 1 for sequential sids.
+    int64_t     spread;
+
+} hashArgs;
+
+static void
+bench_HashGet(int64_t n, void *arg)
+{
+    hashArgs    *a    = (hashArgs*) arg;
+    natsHash    *hash = NULL;
+    void        *res  = NULL;
+    int64_t     i;
+
+    if (natsHash_Create(&hash, 8) != NATS_OK)
+        return;
+
+    for (i = 0; i < a->keys; i++)
+        natsHash_Set(hash, (i + 1) * a->spread, (void*) hash, NULL);
+
+    _startTimer();
+
+    for (i = 0; i < n; i++)
+        res = natsHash_Get(hash, ((i % a->keys) + 1) * a->spread);
+
+    _stopTimer();
+
+    if (res != (void*) hash)
+        printf("@@ Unexpected result from the hash benchmark\n");
+
+    natsHash_Destroy(hash);
+}
+
+static void
+bench_StrHashHash(int64_t n, void *arg)
+{
+    int         len  = *(int*) arg;
+    char        *str = NULL;
+    uint32_t    hk   = 0;
+    int64_t     i;
+
+    str = (char*) malloc(len);
+    if (str == NULL)
+        return;
+
+    for (i = 0; i < len; i++)
+        str[i] = 'a' + (char) (i % 26);
+
+    _startTimer();
+
+    for (i = 0; i < n; i++)
+    {
+        // Feed the result back so that the calls can't be optimized away.
+        str[0] = (char) ('a' + (hk & 0xF));
+        hk     = natsStrHash_Hash(str, len);
+    }
+
+    _stopTimer();
+
+    free(str);
+}
+
+//
+// Buffer
+//
+
+typedef struct __bufArgs
+{
+    int         initial;
+    int         chunk;
+
+    // Number of appends before the buffer is reset.
+    int         appends;
+
+} bufArgs;
+
+static void
+bench_BufAppend(int64_t n, void *arg)
+{
+    bufArgs     *a    = (bufArgs*) arg;
+    natsBuffer  *buf  = NULL;
+    char        *data = NULL;
+    int64_t     i;
+
+    data = (char*) calloc(1, a->chunk);
+    if (data == NULL)
+        return;
+
+    _startTimer();
+
+    for (i = 0; i < n; i++)
+    {
+        if ((i % a->appends) == 0)
+        {
+            natsBuf_Destroy(buf);
+            buf = NULL;
+            if (natsBuf_Create(&buf, a->initial) != NATS_OK)
+                break;
+        }
+        natsBuf_Append(buf, data, a->chunk);
+    }
+
+    _stopTimer();
+
+    natsBuf_Destroy(buf);
+    free(data);
+}
+
+static void
+bench_BufExpand(int64_t n, void *arg)
+{
+    int         max  = *(int*) arg;
+    natsBuffer  *buf = NULL;
+    int64_t     i;
+    int         size = 0;
+
+    _startTimer();
+
+    for (i = 0; i < n; i++)
+    {
+        if ((buf == NULL) || (size >= max))
+        {
+            natsBuf_Destroy(buf);
+            buf  = NULL;
+            size = 64;
+            if (natsBuf_Create(&buf, size) != NATS_OK)
+                break;
+        }
+        size *= 2;
+        natsBuf_Expand(buf, size);
+    }
+
+    _stopTimer();
+
+    natsBuf_Destroy(buf);
+}
+
+//
+// Messages
+//
+
+typedef struct __msgArgs
+{
+    int         payload;
+    bool        pooled;
+
+} msgArgs;
+
+static void
+bench_MsgCreate(int64_t n, void *arg)
+{
+    msgArgs     *a    = (msgArgs*) arg;
+    natsMsgPool *pool = NULL;
+    natsMsg     *msg  = NULL;
+    char        *data = NULL;
+    int64_t     i;
+
+    data = (char*) calloc(1, a->payload + 1);
+    if (data == NULL)
+        return;
+
+    if (a->pooled && (natsMsgPool_Create(&pool, 64) != NATS_OK))
+    {
+        free(data);
+        return;
+    }
+
+    _startTimer();
+
+    for (i = 0; i < n; i++)
+    {
+        if (natsMsg_create(&msg, pool, NULL, "foo.bar", 7, "reply", 5,
+                           data, a->payload) != NATS_OK)
+        {
+            break;
+        }
+        // Bypass the garbage collector, which would free the message in
+        // a different thread.
+        natsMsg_free((void*) msg);
+    }
+
+    _stopTimer();
+
+    natsMsgPool_Release(pool);
+    free(data);
+}
+
+//
+// Publish
+//
+
+static void
+bench_Publish(int64_t n, void *arg)
+{
+    int             payload = *(int*) arg;
+    natsConnection  *nc     = NULL;
+    natsOptions     *opts   = NULL;
+    char            *data   = NULL;
+    int64_t         i;
+    natsStatus      s;
+
+    data = (char*) calloc(1, payload + 1);
+
+    s = (data == NULL ? NATS_NO_MEMORY : NATS_OK);
+    if (s == NATS_OK)
+        s = natsOptions_Create(&opts);
+    if (s == NATS_OK)
+        s = natsConn_create(&nc, opts);
+    if (s == NATS_OK)
+        s = natsBuf_Create(&(nc->bw), 64 * 1024);
+    if (s != NATS_OK)
+    {
+        printf("@@ Unable to setup the publish benchmark: %d\n", s);
+        free(data);
+        natsConnection_Destroy(nc);
+        return;
+    }
+    nc->info.maxPayload = 1024 * 1024;
+
+    _startTimer();
+
+    // There is no socket, so the write buffer is emptied before it fills.
+    for (i = 0; (s == NATS_OK) && (i < n); i++)
+    {
+        if (natsBuf_Available(nc->bw) < payload + 64)
+            natsBuf_Reset(nc->bw);
+
+        s = natsConnection_Publish(nc, "foo.bar", data, payload);
+    }
+
+    _stopTimer();
+
+    if (s != NATS_OK)
+        printf("@@ Publish failed: %d\n", s);
+
+    free(data);
+    natsConnection_Destroy(nc);
+}
+
+//
+// Timers
+//
+
+static void
+_timerCb(natsTimer *timer, void *closure)
+{
+}
+
+static void
+bench_TimerReset(int64_t n, void *arg)
+{
+    int         count   = *(int*) arg;
+    natsTimer   **timers = NULL;
+    int64_t     i;
+    int         created = 0;
+
+    timers = (natsTimer**) calloc(count, sizeof(natsTimer*));
+    if (timers == NULL)
+        return;
+
+    // The timers never fire during the benchmark.
+    for (i = 0; i < count; i++)
+    {
+        if (natsTimer_Create(&(timers[i]), _timerCb, NULL,
+                             3600 * 1000 + i, NULL) != NATS_OK)
+        {
+            break;
+        }
+        created++;
+    }
+
+    _startTimer();
+
+    // Each reset moves a timer from the front of the sorted list to its end.
+    for (i = 0; (created > 0) && (i < n); i++)
+        natsTimer_Reset(timers[i % created], 3600 * 1000 + count + i);
+
+    _stopTimer();
+
+    for (i = 0; i < created; i++)
+    {
+        natsTimer_Stop(timers[i]);
+        natsTimer_Destroy(timers[i]);
+    }
+    free(timers);
+}
+
+int main(int argc, char **argv)
+{
+    char    name[128];
+    int     payloads[]  = { 0, 16, 128, 1024, 8192 };
+    int     subjLens[]  = { 8, 32, 128 };
+    int     readSizes[] = { 0, 512, 7 };
+    int     strLens[]   = { 8, 32, 128, 1024 };
+    int     timers[]    = { 10, 1000 };
+    int     i;
+
+    if (argc > 2)
+    {
+        printf("Usage: %s [filter]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2)
+        filter = argv[1];
+
+    if (nats_Open(-1) != NATS_OK)
+    {
+        printf("@@ Unable to initialize the library!\n");
+        return 1;
+    }
+
+    for (i = 0; i < (int) (sizeof(payloads) / sizeof(int)); i++)
+    {
+        parserArgs a = { payloads[i], 16, 1, 0, 0 };
+
+        snprintf(name, sizeof(name), "Parser/payload=%d", payloads[i]);
+        _run(name, bench_Parser, &a);
+    }
+    for (i = 0; i < (int) (sizeof(readSizes) / sizeof(int)); i++)
+    {
+        parserArgs a = { 128, 16, 1, 0, readSizes[i] };
+
+        snprintf(name, sizeof(name), "Parser/read=%d", readSizes[i]);
+        _run(name, bench_Parser, &a);
+    }
+    for (i = 0; i < (int) (sizeof(subjLens) / sizeof(int)); i++)
+    {
+        parserArgs a = { 128, subjLens[i], 1, 0, 0 };
+
+        snprintf(name, sizeof(name), "Parser/subject=%d", subjLens[i]);
+        _run(name, bench_Parser, &a);
+    }
+    {
+        parserArgs uniform = { 128, 16, 100, 0, 0 };
+        parserArgs skewed  = { 128, 16, 100, 90, 0 };
+
+        _run("Parser/sids=100,uniform", bench_Parser, &uniform);
+        _run("Parser/sids=100,skewed", bench_Parser, &skewed);
+    }
+    {
+        hashArgs small  = { 16, 1 };
+        hashArgs large  = { 100000, 1 };
+        hashArgs sparse = { 10000, 7919 };
+
+        _run("HashGet/keys=16", bench_HashGet, &small);
+        _run("HashGet/keys=100000", bench_HashGet, &large);
+        _run("HashGet/keys=10000,sparse", bench_HashGet, &sparse);
+    }
+    for (i = 0; i < (int) (sizeof(strLens) / sizeof(int)); i++)
+    {
+        snprintf(name, sizeof(name), "StrHashHash/len=%d", strLens[i]);
+        _run(name, bench_StrHashHash, &(strLens[i]));
+    }
+    {
+        bufArgs noGrow = { 64 * 1024, 16, 1000 };
+        bufArgs grow   = { 16, 64, 1000 };
+        int     max    = 1024 * 1024;
+
+        _run("BufAppend/chunk=16", bench_BufAppend, &noGrow);
+        _run("BufAppend/chunk=64,grow", bench_BufAppend, &grow);
+        _run("BufExpand/to=1MB", bench_BufExpand, &max);
+    }
+    for (i = 0; i < (int) (sizeof(payloads) / sizeof(int)); i++)
+    {
+        msgArgs heap   = { payloads[i], false };
+        msgArgs pooled = { payloads[i], true };
+
+        snprintf(name, sizeof(name), "MsgCreate/payload=%d", payloads[i]);
+        _run(name, bench_MsgCreate, &heap);
+
+        snprintf(name, sizeof(name), "MsgCreate/payload=%d,pooled", payloads[i]);
+        _run(name, bench_MsgCreate, &pooled);
+    }
+    for (i = 0; i < (int) (sizeof(payloads) / sizeof(int)); i++)
+    {
+        snprintf(name, sizeof(name), "Publish/payload=%d", payloads[i]);
+        _run(name, bench_Publish, &(payloads[i]));
+    }
+    for (i = 0; i < (int) (sizeof(timers) / sizeof(int)); i++)
+    {
+        snprintf(name, sizeof(name), "TimerReset/timers=%d", timers[i]);
+        _run(name, bench_TimerReset, &(timers[i]));
+    }
+
+    nats_Close();
+
+    return 0;
+}
@@ -0,0 +1,417 @@
+// Copyright 2015 Apcera Inc. All rights reserved.
+
+// Replays a capture recorded with natsOptions_SetCaptureFile() through the
+// parser and the dispatch of the messages to asynchronous subscriptions,
+// without a server, and reports the throughput. The reads are replayed with
+// their original boundaries, either as fast as possible or with their
+// original pacing.
+
+#include "natsp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "mem.h"
+#include "buf.h"
+#include "hash.h"
+#include "conn.h"
+#include "sub.h"
+#include "msg.h"
+#include "util.h"
+#include "capture.h"
+
+// How long to wait for the callbacks to be done with the messages, in
+// milliseconds.
+#define REPLAY_DRAIN_TIMEOUT    (30000)
+
+typedef struct __replayStats
+{
+    int64_t     reads;
+    int64_t     bytes;
+    int64_t     msgs;
+
+    // Offset, in the concatenation of the reads, where the replay stops,
+    // that is the first '-ERR', which closes the connection.
+    int64_t     stopAt;
+
+    // Updated by the callbacks.
+    int64_t     delivered;
+
+} replayStats;
+
+static void
+_onMsg(natsConnection *nc, natsSubscription *sub, natsMsg *msg, void *closure)
+{
+    replayStats *stats = (replayStats*) closure;
+
+    natsMsg_Destroy(msg);
+
+    NATS_ATOMIC64_ADD(&(stats->delivered), 1);
+}
+
+// Returns the 'idx'th argument of the 'MSG' line, of 'lineLen' bytes.
+static bool
+_getArg(const char *line, int lineLen, int idx, const char **arg, int *argLen)
+{
+    int i = 0;
+    int n = -1;
+
+    while (i < lineLen)
+    {
+        while ((i < lineLen) && isspace((unsigned char) line[i]))
+            i++;
+        if (i == lineLen)
+            break;
+
+        *arg = line + i;
+        while ((i < lineLen) && !isspace((unsigned char) line[i]))
+            i++;
+        *argLen = (int) (line + i - *arg);
+
+        if (++n == idx)
+            return true;
+    }
+
+    return false;
+}
+
+static int
+_countArgs(const char *line, int lineLen)
+{
+    const char  *arg;
+    int         argLen;
+    int         n = 0;
+
+    while (_getArg(line, lineLen, n, &arg, &argLen))
+        n++;
+
+    return n;
+}
+
+// Goes through the protocols of the capture to find the sids of the
+// messages, so that a subscription can be created for each of them.
+static natsStatus
+_scan(natsCaptureReader *reader, replayStats *stats, natsHash *sids)
+{
+    natsStatus  s       = NATS_OK;
+    natsBuffer  *all    = NULL;
+    const char  *data   = NULL;
+    const char  *b;
+    const char  *eol;
+    const char  *arg;
+    int64_t     ts;
+    int64_t     len;
+    int64_t     p       = 0;
+    int         argLen;
+    int         args;
+    int         n;
+
+    s = natsBuf_Create(&all, 64 * 1024);
+    while ((s == NATS_OK)
+           && ((s = natsCaptureReader_Next(reader, &ts, &data, &n)) == NATS_OK))
+    {
+        stats->reads++;
+        stats->bytes += n;
+        s = natsBuf_Append(all, data, n);
+    }
+    if (s == NATS_NOT_FOUND)
+        s = NATS_OK;
+
+    natsCaptureReader_Rewind(reader);
+
+    stats->stopAt = stats->bytes;
+
+    b   = (all != NULL ? natsBuf_Data(all) : NULL);
+    len = (all != NULL ? natsBuf_Len(all) : 0);
+
+    while ((s == NATS_OK) && (p < len))
+    {
+        int lineLen;
+
+        eol = (const char*) memchr(b + p, '\n', (size_t) (len - p));
+        if (eol == NULL)
+            break;
+
+        lineLen = (int) (eol - (b + p)) + 1;
+
+        if ((lineLen > 4)
+            && (strncasecmp(b + p, "MSG", 3) == 0)
+            && isspace((unsigned char) b[p + 3]))
+        {
+            // MSG <subject> <sid> [reply] <size>
+            args = _countArgs(b + p, lineLen);
+            if ((args != 4) && (args != 5))
+            {
+                s = nats_setError(NATS_PROTOCOL_ERROR,
+                                  "invalid MSG line at offset %" PRId64, p);
+                break;
+            }
+
+            (void) _getArg(b + p, lineLen, 2, &arg, &argLen);
+            if (natsHash_Get(sids, nats_ParseInt64(arg, argLen)) == NULL)
+                s = natsHash_Set(sids, nats_ParseInt64(arg, argLen), (void*) sids, NULL);
+
+            (void) _getArg(b + p, lineLen, args - 1, &arg, &argLen);
+            p += lineLen + nats_ParseInt64(arg, argLen) + 2;
+
+            stats->msgs++;
+        }
+        else if ((lineLen >= 4) && (strncasecmp(b + p, "-ERR", 4) == 0))
+        {
+            stats->stopAt = p;
+            break;
+        }
+        else
+        {
+            p += lineLen;
+        }
+    }
+
+    natsBuf_Destroy(all);
+
+    return s;
+}
+
+// Waits until 'target', in nanoseconds, sleeping for the bulk of the wait
+// and spinning for the last millisecond.
+static void
+_waitUntil(int64_t target)
+{
+    int64_t left;
+
+    while ((left = target - nats_NowInNanoSeconds()) > 0)
+    {
+        if (left > 2000000)
+            nats_Sleep((left / 1000000) - 1);
+    }
+}
+
+static natsStatus
+_replay(natsConnection *nc, natsCaptureReader *reader, replayStats *stats,
+        bool pace)
+{
+    natsStatus  s       = NATS_OK;
+    const char  *data   = NULL;
+    int64_t     first   = 0;
+    int64_t     start   = 0;
+    int64_t     offset  = 0;
+    int64_t     ts;
+    int         n;
+
+    start = nats_NowInNanoSeconds();
+
+    while ((offset < stats->stopAt)
+           && ((s = natsCaptureReader_Next(reader, &ts, &data, &n)) == NATS_OK))
+    {
+        if (first == 0)
+            first = ts;
+
+        if (pace)
+            _waitUntil(start + (ts - first));
+
+        if (offset + n > stats->stopAt)
+            n = (int) (stats->stopAt - offset);
+        offset += n;
+
+        s = natsParser_Parse(nc, (char*) data, n);
+        if (s != NATS_OK)
+            break;
+
+        // There is no socket: the PONGs sent back to the server are dropped.
+        natsBuf_Reset(nc->bw);
+    }
+    if (s == NATS_NOT_FOUND)
+        s = NATS_OK;
+
+    natsCaptureReader_Rewind(reader);
+
+    return s;
+}
+
+static void
+_printRate(const char *what, int64_t msgs, int64_t bytes, int64_t elapsed)
+{
+    double secs = (double) elapsed / 1e9;
+
+    if (secs <= 0)
+        secs = 1e-9;
+
+    printf("%-24s %10.3f ms %14.0f msgs/sec %10.2f MB/sec %10.1f ns/msg\n",
+           what, secs * 1000, (double) msgs / secs,
+           (double) bytes / secs / (1024 * 1024),
+           (msgs > 0 ? (double) elapsed / msgs : 0.0));
+}
+
+int main(int argc, char **argv)
+{
+    natsStatus          s       = NATS_OK;
+    natsCaptureReader   *reader = NULL;
+    natsOptions         *opts   = NULL;
+    natsConnection      *nc     = NULL;
+    natsHash            *sids   = NULL;
+    natsSubscription    **subs  = NULL;
+    const char          *path   = NULL;
+    bool                pace    = false;
+    bool                shared  = false;
+    int                 count   = 1;
+    int                 numSubs = 0;
+    int64_t             start   = 0;
+    int64_t             parsed  = 0;
+    int64_t             done    = 0;
+    int64_t             dropped = 0;
+    int64_t             target  = 0;
+    int64_t             sid;
+    natsHashIter        iter;
+    replayStats         stats;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-pace") == 0)
+            pace = true;
+        else if (strcmp(argv[i], "-shared") == 0)
+            shared = true;
+        else if ((strcmp(argv[i], "-count") == 0) && (i + 1 < argc))
+            count = atoi(argv[++i]);
+        else if ((argv[i][0] != '-') && (path == NULL))
+            path = argv[i];
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+    if ((path == NULL) || (count <= 0))
+    {
+        printf("Usage: %s [-pace] [-shared] [-count <n>] <capture file>\n\n"
+               "  -pace    replay the reads with their original pacing, instead\n"
+               "           of as fast as possible\n"
+               "  -shared  deliver the messages with the shared delivery pool\n"
+               "  -count   number of times the capture is replayed (default 1)\n",
+               argv[0]);
+        return 1;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+
+    s = nats_Open(-1);
+    if (s == NATS_OK)
+        s = natsCaptureReader_Create(&reader, path);
+    if (s == NATS_OK)
+        s = natsHash_Create(&sids, 64);
+    if (s == NATS_OK)
+        s = _scan(reader, &stats, sids);
+    if (s == NATS_OK)
+        s = natsOptions_Create(&opts);
+    if (s == NATS_OK)
+        s = natsOptions_UseSharedDeliveryPool(opts, shared);
+    if (s == NATS_OK)
+        s = natsConn_create(&nc, opts);
+    if (s == NATS_OK)
+        s = natsParser_Create(&(nc->ps));
+    if (s == NATS_OK)
+        s = natsBuf_Create(&(nc->bw), 64 * 1024);
+    if (s == NATS_OK)
+    {
+        subs = (natsSubscription**) calloc(natsHash_Count(sids) + 1,
+                                           sizeof(natsSubscription*));
+        if (subs == NULL)
+            s = NATS_NO_MEMORY;
+    }
+    if (s == NATS_OK)
+    {
+        natsHashIter_Init(&iter, sids);
+        while ((s == NATS_OK) && natsHashIter_Next(&iter, &sid, NULL))
+        {
+            natsSubscription *sub = NULL;
+
+            s = natsSub_create(&sub, nc, "replay", NULL, _onMsg, NULL, 0, 0,
+                               (void*) &stats, false, 0, NULL);
+            if (s == NATS_OK)
+            {
+                subs[numSubs++] = sub;
+
+                // The replay measures the client, not how it copes with
+                // a slow application.
+                sub->sid             = sid;
+                sub->pendingMax      = INT32_MAX;
+                sub->pendingBytesMax = INT64_MAX;
+
+                s = natsConn_addSubcription(nc, sub);
+            }
+        }
+        natsHashIter_Done(&iter);
+    }
+    if (s != NATS_OK)
+    {
+        printf("@@ Unable to setup the replay: %d - %s\n", s, natsStatus_GetText(s));
+        nats_PrintLastErrorStack(stdout);
+    }
+    else
+    {
+        printf("Capture: %" PRId64 " reads, %" PRId64 " bytes, %" PRId64
+               " messages on %d subscriptions\n",
+               stats.reads, stats.bytes, stats.msgs, numSubs);
+        if (stats.stopAt < stats.bytes)
+            printf("Replay stops at the -ERR at offset %" PRId64 "\n", stats.stopAt);
+
+        start = nats_NowInNanoSeconds();
+
+        for (int i = 0; (s == NATS_OK) && (i < count); i++)
+            s = _replay(nc, reader, &stats, pace);
+
+        parsed = nats_NowInNanoSeconds();
+
+        if (s != NATS_OK)
+        {
+            printf("@@ Replay failed: %d - %s\n", s, natsStatus_GetText(s));
+            nats_PrintLastErrorStack(stdout);
+        }
+    }
+
+    if (s == NATS_OK)
+    {
+        int64_t received = (int64_t) NATS_ATOMIC64_GET(&(nc->stats.inMsgs));
+
+        // Wait for the callbacks to be done with all the messages.
+        target = nats_Now() + REPLAY_DRAIN_TIMEOUT;
+        while (nats_Now() < target)
+        {
+            dropped = 0;
+            for (int i = 0; i < numSubs; i++)
+                dropped += NATS_ATOMIC64_GET(&(subs[i]->dropped));
+
+            if (NATS_ATOMIC64_GET(&(stats.delivered)) + dropped >= received)
+                break;
+
+            nats_Sleep(1);
+        }
+        done = nats_NowInNanoSeconds();
+
+        printf("Replayed %d time(s)%s: %" PRId64 " messages, %" PRId64
+               " delivered, %" PRId64 " dropped\n",
+               count, (pace ? " with the original pacing" : ""), received,
+               NATS_ATOMIC64_GET(&(stats.delivered)), dropped);
+
+        // The delivery threads consume the messages while the replay is
+        // parsing, so the first rate includes queueing them.
+        _printRate("Parse and enqueue", received, stats.bytes * count, parsed - start);
+        _printRate("Parse and dispatch", received, stats.bytes * count, done - start);
+    }
+
+    for (int i = 0; i < numSubs; i++)
+    {
+        natsConn_removeSubscription(nc, subs[i], false);
+        natsSub_release(subs[i]);
+    }
+    free(subs);
+
+    natsConnection_Destroy(nc);
+    natsHash_Destroy(sids);
+    natsCaptureReader_Destroy(reader);
+
+    nats_Close();
+
+    return (s == NATS_OK ? 0 : 1);
+}